@@ -21,6 +21,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <string.h>
+
 #include "pk-backend-alpm.h"
 #include "pk-backend-error.h"
 #include "pk-backend-groups.h"
@@ -67,28 +69,29 @@ pkalpm_backend_pkg (PkBackendJob *job, alpm_pkg_t *pkg, PkInfoEnum info)
 alpm_pkg_t *
 pkalpm_backend_find_pkg (PkBackendJob *job, const gchar *package_id, GError **error)
 {
-	gchar **package;
-	const gchar *repo_id;
+	gchar *name;
 	alpm_db_t *db = NULL;
-	alpm_pkg_t *pkg;
+	alpm_pkg_t *pkg = NULL;
+	PkPackageIdView view;
 
 	g_return_val_if_fail (job != NULL, NULL);
 	g_return_val_if_fail (package_id != NULL, NULL);
 	g_return_val_if_fail (alpm != NULL, NULL);
 	g_return_val_if_fail (localdb != NULL, NULL);
 
-	package = pk_package_id_split (package_id);
-	repo_id = package[PK_PACKAGE_ID_DATA];
+	if (!pk_package_id_view_init (&view, package_id))
+		goto out;
 
 	/* find the database to search in */
-	if (g_strcmp0 (repo_id, "installed") == 0) {
+	if (view.data_len == 9 && strncmp (view.data, "installed", 9) == 0) {
 		db = localdb;
 	} else {
 		const alpm_list_t *i = alpm_get_syncdbs (alpm);
 		for (; i != NULL; i = i->next) {
 			const gchar *repo = alpm_db_get_name (i->data);
 
-			if (g_strcmp0 (repo, repo_id) == 0) {
+			if (strlen (repo) == view.data_len &&
+			    strncmp (repo, view.data, view.data_len) == 0) {
 				db = i->data;
 				break;
 			}
@@ -96,24 +99,24 @@ pkalpm_backend_find_pkg (PkBackendJob *job, const gchar *package_id, GError **er
 	}
 
 	if (db != NULL) {
-		pkg = alpm_db_get_pkg (db, package[PK_PACKAGE_ID_NAME]);
-	} else {
-		pkg = NULL;
+		name = g_strndup (view.name, view.name_len);
+		pkg = alpm_db_get_pkg (db, name);
+		g_free (name);
 	}
 
 	if (pkg != NULL) {
 		const gchar *version = alpm_pkg_get_version (pkg);
-		if (g_strcmp0 (version, package[PK_PACKAGE_ID_VERSION]) != 0) {
+		if (strlen (version) != view.version_len ||
+		    strncmp (version, view.version, view.version_len) != 0) {
 			pkg = NULL;
 		}
 	}
-
+out:
 	if (pkg == NULL) {
 		int code = ALPM_ERR_PKG_NOT_FOUND;
 		g_set_error (error, ALPM_ERROR, code, "%s: %s", package_id,
 			     alpm_strerror (code));
 	}
-	g_strfreev (package);
 	return pkg;
 }
 
@@ -19,6 +19,8 @@
  */
 #include "AptCacheFile.h"
 
+#include "AptSharedCache.h"
+#include "AptVersionFlags.h"
 #include "apt-utils.h"
 #include "apt-messages.h"
 #include "OpPackageKitProgress.h"
@@ -29,7 +31,9 @@
 
 AptCacheFile::AptCacheFile(PkBackendJob *job) :
     m_packageRecords(0),
-    m_job(job)
+    m_versionFlags(0),
+    m_job(job),
+    m_shared(0)
 {
 }
 
@@ -44,11 +48,58 @@ bool AptCacheFile::Open(bool withLock)
     return pkgCacheFile::Open(&progress, withLock);
 }
 
+void AptCacheFile::Attach(AptSharedCache *shared)
+{
+    AptCacheFile *cache = shared->cacheFile();
+
+    Close();
+    m_shared = shared;
+    Map = cache->Map;
+    Cache = cache->Cache;
+    Policy = cache->Policy;
+    DCache = cache->DCache;
+}
+
+AptSearchIndex* AptCacheFile::searchIndex()
+{
+    if (m_shared == 0) {
+        return 0;
+    }
+    return m_shared->searchIndex(*this);
+}
+
+AptVersionFlags* AptCacheFile::versionFlags(bool applications)
+{
+    if (m_shared) {
+        return m_shared->versionFlags(*this, applications);
+    }
+
+    if (m_versionFlags == 0) {
+        m_versionFlags = new AptVersionFlags(*this);
+    }
+    if (applications) {
+        m_versionFlags->findApplications(*this);
+    }
+    return m_versionFlags;
+}
+
 void AptCacheFile::Close()
 {
     delete m_packageRecords;
+    delete m_versionFlags;
 
     m_packageRecords = 0;
+    m_versionFlags = 0;
+
+    // the maps belong to the shared cache, so don't let them be freed
+    if (m_shared) {
+        Map = 0;
+        Cache = 0;
+        Policy = 0;
+        DCache = 0;
+        m_shared->unref();
+        m_shared = 0;
+    }
 
     pkgCacheFile::Close();
 
@@ -426,7 +477,13 @@ std::string AptCacheFile::getShortDescription(const pkgCache::VerIterator &ver)
 
 std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver)
 {
-    if (ver.end() || ver.FileList().end() || GetPkgRecords() == 0) {
+    return getLongDescription(ver, GetPkgRecords());
+}
+
+std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver,
+                                             pkgRecords *records)
+{
+    if (ver.end() || ver.FileList().end() || records == 0) {
         return string();
     }
 
@@ -439,7 +496,7 @@ std::string AptCacheFile::getLongDescription(const pkgCache::VerIterator &ver)
     if (df.end()) {
         return string();
     } else {
-        return m_packageRecords->Lookup(df).LongDesc();
+        return records->Lookup(df).LongDesc();
     }
 }
 
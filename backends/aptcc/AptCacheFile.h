@@ -24,6 +24,9 @@
 #include <pk-backend.h>
 
 class pkgProblemResolver;
+class AptSharedCache;
+class AptSearchIndex;
+class AptVersionFlags;
 class AptCacheFile : public pkgCacheFile
 {
 public:
@@ -35,6 +38,26 @@ public:
       */
     bool Open(bool withLock = false);
 
+    /**
+      * Uses the already open maps of a shared read-only cache instead of
+      * opening our own, the reference is dropped when this is closed
+      * @note Nothing may be marked in the dependency cache afterwards
+      */
+    void Attach(AptSharedCache *shared);
+
+    /**
+      * Gets the search index of the shared cache
+      * @returns 0 if this cache is not shared
+      */
+    AptSearchIndex* searchIndex();
+
+    /**
+      * Gets the filter flags of the versions, which are shared with the
+      * other jobs if this cache is, and are dropped when it is closed.
+      * The application bit is only there if @applications is set
+      */
+    AptVersionFlags* versionFlags(bool applications);
+
     /**
       * Closes the package cache
       */
@@ -121,6 +144,12 @@ public:
      */
     std::string getLongDescription(const pkgCache::VerIterator &ver);
 
+    /** \return the long description of the given version, looked up
+     *  with @records instead of the records of this cache.
+     */
+    static std::string getLongDescription(const pkgCache::VerIterator &ver,
+                                          pkgRecords *records);
+
     /** \return a short description string corresponding to the given
      *  version.
      */
@@ -138,7 +167,9 @@ private:
     static std::string debParser(std::string descr);
 
     pkgRecords *m_packageRecords;
+    AptVersionFlags *m_versionFlags;
     PkBackendJob *m_job;
+    AptSharedCache *m_shared;
 };
 
 #endif // APTCACHEFILE_H
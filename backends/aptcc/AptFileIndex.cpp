@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "AptFileIndex.h"
+
+#include "apt-utils.h"
+
+#include <glib/gstdio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <dirent.h>
+#include <regex.h>
+
+#define APT_FILE_INDEX_MAGIC    0x49464b50 /* "PKFI" */
+#define APT_FILE_INDEX_VERSION  1
+
+#define APT_FILE_INDEX_FLAG_DESKTOP (1 << 0)
+
+using std::string;
+using std::vector;
+
+static GMutex s_mutex;
+static AptFileIndex *s_current = 0;
+
+/**
+  * Orders path indexes by the full path, or by the file name
+  */
+class PathCompare
+{
+public:
+    PathCompare(const char *strings, const vector<guint32> &offsets) :
+        m_strings(strings),
+        m_offsets(offsets)
+    {
+    }
+
+    bool operator()(guint32 a, guint32 b) const
+    {
+        return strcmp(m_strings + m_offsets[a], m_strings + m_offsets[b]) < 0;
+    }
+
+private:
+    const char *m_strings;
+    const vector<guint32> &m_offsets;
+};
+
+AptFileIndex::AptFileIndex() :
+    m_mapped(0),
+    m_refcount(1),
+    m_header(0),
+    m_packages(0),
+    m_paths(0),
+    m_byPath(0),
+    m_byName(0),
+    m_strings(0)
+{
+}
+
+AptFileIndex::~AptFileIndex()
+{
+    if (m_mapped) {
+        g_mapped_file_unref(m_mapped);
+    }
+}
+
+bool AptFileIndex::attach(const char *data, gsize size)
+{
+    const Header *header = reinterpret_cast<const Header*>(data);
+    if (size < sizeof(Header) ||
+            header->magic != APT_FILE_INDEX_MAGIC ||
+            header->version != APT_FILE_INDEX_VERSION) {
+        return false;
+    }
+
+    gsize expected = sizeof(Header) +
+            header->nPackages * sizeof(Package) +
+            header->nPaths * (sizeof(Path) + 2 * sizeof(guint32)) +
+            header->stringsSize;
+    if (size != expected || header->stringsSize == 0) {
+        return false;
+    }
+
+    m_header = header;
+    m_packages = reinterpret_cast<const Package*>(data + sizeof(Header));
+    m_paths = reinterpret_cast<const Path*>(m_packages + header->nPackages);
+    m_byPath = reinterpret_cast<const guint32*>(m_paths + header->nPaths);
+    m_byName = m_byPath + header->nPaths;
+    m_strings = reinterpret_cast<const char*>(m_byName + header->nPaths);
+
+    // make sure a damaged file can't send us outside of the map
+    if (m_strings[header->stringsSize - 1] != '\0') {
+        return false;
+    }
+    for (guint32 i = 0; i < header->nPackages; ++i) {
+        const Package &pkg = m_packages[i];
+        if (pkg.name >= header->stringsSize ||
+                pkg.firstPath > header->nPaths ||
+                pkg.nPaths > header->nPaths - pkg.firstPath) {
+            return false;
+        }
+    }
+    for (guint32 i = 0; i < header->nPaths; ++i) {
+        const Path &path = m_paths[i];
+        if (path.name >= header->stringsSize ||
+                path.base >= header->stringsSize ||
+                path.package >= header->nPackages ||
+                m_byPath[i] >= header->nPaths ||
+                m_byName[i] >= header->nPaths) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AptFileIndex::isCurrent(const struct stat &info) const
+{
+    return m_header->infoMtime == info.st_mtim.tv_sec &&
+            m_header->infoMtimeNsec == info.st_mtim.tv_nsec;
+}
+
+AptFileIndex* AptFileIndex::load()
+{
+    GMappedFile *mapped = g_mapped_file_new(APT_FILE_INDEX_FILE, FALSE, NULL);
+    if (mapped == NULL) {
+        return 0;
+    }
+
+    AptFileIndex *index = new AptFileIndex;
+    index->m_mapped = mapped;
+    if (!index->attach(g_mapped_file_get_contents(mapped),
+                       g_mapped_file_get_length(mapped))) {
+        g_debug("ignoring invalid file index %s", APT_FILE_INDEX_FILE);
+        delete index;
+        return 0;
+    }
+    return index;
+}
+
+AptFileIndex* AptFileIndex::build(const AptFileIndex *old, const struct stat &info)
+{
+    DIR *dp;
+    struct dirent *dirp;
+    vector<string> names;
+
+    if (!(dp = opendir(DPKG_INFO_DIR))) {
+        g_debug("Error opening %s", DPKG_INFO_DIR);
+        return 0;
+    }
+    while ((dirp = readdir(dp)) != NULL) {
+        string name(dirp->d_name);
+        if (ends_with(name, ".list")) {
+            names.push_back(name.erase(name.size() - 5));
+        }
+    }
+    closedir(dp);
+    std::sort(names.begin(), names.end());
+
+    string strings;
+    vector<Package> packages;
+    vector<Path> paths;
+    vector<guint32> pathNames;
+    vector<guint32> pathBases;
+    guint reused = 0;
+    string line;
+
+    packages.reserve(names.size());
+    for (vector<string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+        string fileName = DPKG_INFO_DIR + *it + ".list";
+        struct stat buf;
+        if (stat(fileName.c_str(), &buf) != 0) {
+            continue;
+        }
+
+        Package pkg;
+        memset(&pkg, 0, sizeof(Package));
+        pkg.name = strings.size();
+        strings.append(it->c_str(), it->size() + 1);
+        pkg.firstPath = paths.size();
+        pkg.mtime = buf.st_mtim.tv_sec;
+        pkg.mtimeNsec = buf.st_mtim.tv_nsec;
+        pkg.size = buf.st_size;
+
+        // dpkg replaces the .list files whenever it changes them, so
+        // the files of an unchanged one can be taken from the old index
+        const Package *oldPkg = old ? old->findPackage(it->c_str()) : 0;
+        vector<string> lines;
+        if (oldPkg &&
+                oldPkg->mtime == pkg.mtime &&
+                oldPkg->mtimeNsec == pkg.mtimeNsec &&
+                oldPkg->size == pkg.size) {
+            for (guint32 i = 0; i < oldPkg->nPaths; ++i) {
+                lines.push_back(old->str(old->m_paths[oldPkg->firstPath + i].name));
+            }
+            reused++;
+        } else {
+            std::ifstream in(fileName.c_str());
+            while (in && getline(in, line)) {
+                if (!line.empty()) {
+                    lines.push_back(line);
+                }
+            }
+        }
+
+        for (vector<string>::const_iterator l = lines.begin(); l != lines.end(); ++l) {
+            Path path;
+            path.name = strings.size();
+            path.base = path.name + l->rfind('/') + 1;
+            path.package = packages.size();
+            strings.append(l->c_str(), l->size() + 1);
+            paths.push_back(path);
+            pathNames.push_back(path.name);
+            pathBases.push_back(path.base);
+            if (ends_with(*l, ".desktop")) {
+                pkg.flags |= APT_FILE_INDEX_FLAG_DESKTOP;
+            }
+        }
+        pkg.nPaths = paths.size() - pkg.firstPath;
+        packages.push_back(pkg);
+    }
+    g_debug("indexed %u files of %u packages, reused %u packages",
+            (guint) paths.size(), (guint) packages.size(), reused);
+
+    // an empty pool would not be valid
+    if (strings.empty()) {
+        strings.push_back('\0');
+    }
+
+    // sort by the full path and by the file name for the lookups
+    vector<guint32> byPath(paths.size());
+    vector<guint32> byName(paths.size());
+    for (guint32 i = 0; i < paths.size(); ++i) {
+        byPath[i] = i;
+        byName[i] = i;
+    }
+    std::sort(byPath.begin(), byPath.end(), PathCompare(strings.c_str(), pathNames));
+    std::sort(byName.begin(), byName.end(), PathCompare(strings.c_str(), pathBases));
+
+    Header header;
+    memset(&header, 0, sizeof(Header));
+    header.magic = APT_FILE_INDEX_MAGIC;
+    header.version = APT_FILE_INDEX_VERSION;
+    header.infoMtime = info.st_mtim.tv_sec;
+    header.infoMtimeNsec = info.st_mtim.tv_nsec;
+    header.nPackages = packages.size();
+    header.nPaths = paths.size();
+    header.stringsSize = strings.size();
+
+    AptFileIndex *index = new AptFileIndex;
+    vector<char> &data = index->m_buffer;
+    data.reserve(sizeof(Header) +
+                 packages.size() * sizeof(Package) +
+                 paths.size() * (sizeof(Path) + 2 * sizeof(guint32)) +
+                 strings.size());
+    const char *ptr = reinterpret_cast<const char*>(&header);
+    data.insert(data.end(), ptr, ptr + sizeof(Header));
+    if (!packages.empty()) {
+        ptr = reinterpret_cast<const char*>(&packages[0]);
+        data.insert(data.end(), ptr, ptr + packages.size() * sizeof(Package));
+    }
+    if (!paths.empty()) {
+        ptr = reinterpret_cast<const char*>(&paths[0]);
+        data.insert(data.end(), ptr, ptr + paths.size() * sizeof(Path));
+        ptr = reinterpret_cast<const char*>(&byPath[0]);
+        data.insert(data.end(), ptr, ptr + byPath.size() * sizeof(guint32));
+        ptr = reinterpret_cast<const char*>(&byName[0]);
+        data.insert(data.end(), ptr, ptr + byName.size() * sizeof(guint32));
+    }
+    data.insert(data.end(), strings.begin(), strings.end());
+    index->attach(&data[0], data.size());
+
+    // save it for the next daemon, it's not fatal if we can't
+    GError *error = NULL;
+    gchar *dirName = g_path_get_dirname(APT_FILE_INDEX_FILE);
+    g_mkdir_with_parents(dirName, 0755);
+    g_free(dirName);
+    if (!g_file_set_contents(APT_FILE_INDEX_FILE, &data[0], data.size(), &error)) {
+        g_debug("failed to save the file index: %s", error->message);
+        g_error_free(error);
+    }
+
+    return index;
+}
+
+AptFileIndex* AptFileIndex::ref()
+{
+    struct stat info;
+    AptFileIndex *ret = 0;
+
+    g_mutex_lock(&s_mutex);
+
+    if (stat(DPKG_INFO_DIR, &info) != 0) {
+        g_debug("Error opening %s", DPKG_INFO_DIR);
+        g_mutex_unlock(&s_mutex);
+        return 0;
+    }
+
+    if (s_current == 0) {
+        s_current = load();
+    }
+
+    if (s_current == 0 || !s_current->isCurrent(info)) {
+        AptFileIndex *index = build(s_current, info);
+        if (index) {
+            if (s_current) {
+                s_current->unref();
+            }
+            s_current = index;
+        }
+    }
+
+    ret = s_current;
+    if (ret) {
+        g_atomic_int_inc(&ret->m_refcount);
+    }
+
+    g_mutex_unlock(&s_mutex);
+    return ret;
+}
+
+void AptFileIndex::invalidate()
+{
+    g_mutex_lock(&s_mutex);
+    if (s_current) {
+        s_current->unref();
+        s_current = 0;
+    }
+    g_mutex_unlock(&s_mutex);
+}
+
+void AptFileIndex::unref()
+{
+    if (g_atomic_int_dec_and_test(&m_refcount)) {
+        delete this;
+    }
+}
+
+const AptFileIndex::Package* AptFileIndex::findPackage(const char *name) const
+{
+    guint32 low = 0;
+    guint32 high = m_header->nPackages;
+
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        int cmp = strcmp(str(m_packages[mid].name), name);
+        if (cmp == 0) {
+            return &m_packages[mid];
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+const AptFileIndex::Package* AptFileIndex::findPackage(const char *name, const char *arch) const
+{
+    if (arch) {
+        gchar *fullName = g_strdup_printf("%s:%s", name, arch);
+        const Package *pkg = findPackage(fullName);
+        g_free(fullName);
+        if (pkg) {
+            return pkg;
+        }
+    }
+
+    // if the file was not found try without the arch field
+    return findPackage(name);
+}
+
+void AptFileIndex::addMatches(const char *value, bool basename, vector<bool> &found) const
+{
+    const guint32 *order = basename ? m_byName : m_byPath;
+    guint32 low = 0;
+    guint32 high = m_header->nPaths;
+
+    // find the first path that is not before the value
+    while (low < high) {
+        guint32 mid = low + (high - low) / 2;
+        const Path &path = m_paths[order[mid]];
+        if (strcmp(str(basename ? path.base : path.name), value) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    for (; low < m_header->nPaths; ++low) {
+        const Path &path = m_paths[order[low]];
+        if (strcmp(str(basename ? path.base : path.name), value) != 0) {
+            break;
+        }
+        found[path.package] = true;
+    }
+}
+
+void AptFileIndex::search(gchar **values,
+                          vector<string> &packages,
+                          const volatile gint *cancel) const
+{
+    vector<bool> found(m_header->nPackages, false);
+
+    for (guint i = 0; values[i] != NULL; ++i) {
+        const gchar *value = values[i];
+
+        // the values are basic regular expressions, where "+?{}|()" are
+        // literal, and a '.' is nearly always meant literally in a file name
+        bool basename = value[0] != '/';
+        if (strpbrk(value, "[]*^$\\") == NULL) {
+            addMatches(value, basename, found);
+            continue;
+        }
+
+        // fall back to checking every path, but only in the index, a
+        // value without a '/' is matched against the file names as above
+        regex_t re;
+        gchar *search = g_strdup_printf("^%s$", value);
+        if (regcomp(&re, search, REG_NOSUB) != 0) {
+            g_debug("Regex compilation error");
+            g_free(search);
+            continue;
+        }
+        g_free(search);
+
+        for (guint32 j = 0; j < m_header->nPaths && !g_atomic_int_get(cancel); ++j) {
+            const Path &path = m_paths[j];
+            if (!found[path.package] &&
+                    regexec(&re, str(basename ? path.base : path.name), (size_t)0, NULL, 0) == 0) {
+                found[path.package] = true;
+            }
+        }
+        regfree(&re);
+    }
+
+    for (guint32 i = 0; i < m_header->nPackages; ++i) {
+        if (found[i]) {
+            packages.push_back(str(m_packages[i].name));
+        }
+    }
+}
+
+bool AptFileIndex::files(const char *name, const char *arch, GPtrArray *files) const
+{
+    const Package *pkg = findPackage(name, arch);
+    if (pkg == 0) {
+        return false;
+    }
+
+    for (guint32 i = 0; i < pkg->nPaths; ++i) {
+        g_ptr_array_add(files, g_strdup(str(m_paths[pkg->firstPath + i].name)));
+    }
+    return true;
+}
+
+bool AptFileIndex::hasDesktopFile(const char *name, const char *arch) const
+{
+    const Package *pkg = findPackage(name, arch);
+    return pkg && (pkg->flags & APT_FILE_INDEX_FLAG_DESKTOP);
+}
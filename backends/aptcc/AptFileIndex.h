@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef APTFILEINDEX_H
+#define APTFILEINDEX_H
+
+#include <glib.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+#define DPKG_INFO_DIR        "/var/lib/dpkg/info/"
+#define APT_FILE_INDEX_FILE  LOCALSTATEDIR "/cache/PackageKit/aptcc-files.idx"
+
+/**
+ * An index of the files owned by the installed packages, built from the
+ * dpkg .list files and saved so the next daemon can just map it.
+ *
+ * When the dpkg info directory changes only the .list files that are
+ * new or changed are read again, the rest is copied from the old index.
+ * Packages are named like their .list files, e.g. "libc6:amd64".
+ */
+class AptFileIndex
+{
+public:
+    /**
+      * Gets a reference to an up to date index, building it if needed
+      * @returns 0 if the dpkg info directory could not be read
+      */
+    static AptFileIndex* ref();
+
+    /**
+      * Drops the current index, it is freed once nobody uses it
+      */
+    static void invalidate();
+
+    void unref();
+
+    /**
+      * Finds the packages owning any of the files in @values. A value
+      * starting with '/' is an exact path, one without is a file name.
+      * A value using basic regex characters has to match the whole path,
+      * or the whole file name if it has no leading '/'
+      */
+    void search(gchar **values,
+                std::vector<std::string> &packages,
+                const volatile gint *cancel) const;
+
+    /**
+      * Adds a copy of each file owned by the package to @files, trying
+      * "name:arch" first if @arch is set
+      * @returns false if the package is not known
+      */
+    bool files(const char *name, const char *arch, GPtrArray *files) const;
+
+    /**
+      * @returns true if the package ships a .desktop file, trying
+      * "name:arch" first if @arch is set
+      */
+    bool hasDesktopFile(const char *name, const char *arch) const;
+
+private:
+    AptFileIndex();
+    ~AptFileIndex();
+
+    struct Header {
+        guint32 magic;
+        guint32 version;
+        gint64  infoMtime;
+        gint64  infoMtimeNsec;
+        guint32 nPackages;
+        guint32 nPaths;
+        guint32 stringsSize;
+        guint32 padding;
+    };
+
+    struct Package {
+        guint32 name;
+        guint32 firstPath;
+        guint32 nPaths;
+        guint32 flags;
+        gint64  mtime;
+        gint64  mtimeNsec;
+        gint64  size;
+    };
+
+    struct Path {
+        guint32 name;
+        guint32 base;
+        guint32 package;
+    };
+
+    static AptFileIndex* load();
+    static AptFileIndex* build(const AptFileIndex *old, const struct stat &info);
+    bool attach(const char *data, gsize size);
+    bool isCurrent(const struct stat &info) const;
+
+    const Package* findPackage(const char *name) const;
+    const Package* findPackage(const char *name, const char *arch) const;
+    void addMatches(const char *value, bool basename, std::vector<bool> &found) const;
+    inline const char* str(guint32 offset) const { return m_strings + offset; }
+
+    GMappedFile *m_mapped;
+    std::vector<char> m_buffer;
+    gint m_refcount;
+
+    const Header *m_header;
+    const Package *m_packages;
+    const Path *m_paths;
+    const guint32 *m_byPath;
+    const guint32 *m_byName;
+    const char *m_strings;
+};
+
+#endif // APTFILEINDEX_H
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "AptParallelScan.h"
+
+#include "AptCacheFile.h"
+#include "AptVersionFlags.h"
+
+#include <apt-pkg/pkgrecords.h>
+
+#include <unistd.h>
+
+using std::vector;
+
+AptParallelScan::AptParallelScan(AptCacheFile &cache) :
+    m_cache(cache),
+    m_records(0),
+    m_flags(0),
+    m_mask(0),
+    m_value(0)
+{
+}
+
+AptParallelScan::~AptParallelScan()
+{
+    delete m_records;
+}
+
+pkgRecords* AptParallelScan::records()
+{
+    if (m_records == 0) {
+        m_records = new pkgRecords(m_cache);
+    }
+    return m_records;
+}
+
+void AptParallelScan::setFilters(PkBitfield filters, bool multiArch)
+{
+    if (filters == 0) {
+        return;
+    }
+
+    // the flags are worked out here, so the threads only read them
+    AptVersionFlags::filterMask(filters, multiArch, m_mask, m_value);
+    m_flags = m_cache.versionFlags(m_mask & APT_VERSION_APPLICATION);
+}
+
+PkgList AptParallelScan::run(const volatile gint *cancel)
+{
+    PkgList output;
+    pkgCache *cacheMap = m_cache.GetPkgCache();
+
+    // the policy and the dependency cache are built lazily, make sure
+    // that happens before the threads start looking up versions
+    m_cache.GetDepCache();
+
+    // the package array has holes, so take the packages from the
+    // hash table once and hand out ranges of that
+    vector<guint32> packages;
+    packages.reserve(cacheMap->HeaderP->PackageCount);
+    for (pkgCache::PkgIterator pkg = cacheMap->PkgBegin(); !pkg.end(); ++pkg) {
+        // Ignore packages that exist only due to dependencies.
+        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
+            continue;
+        }
+        packages.push_back(pkg.Index());
+    }
+
+    guint chunks = (packages.size() + APT_PARALLEL_SCAN_CHUNK - 1) / APT_PARALLEL_SCAN_CHUNK;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    guint nThreads = CLAMP(cpus, 1, APT_PARALLEL_SCAN_MAX_THREADS);
+    nThreads = MAX(MIN(nThreads, chunks), 1);
+
+    volatile gint next = 0;
+    vector<Worker> workers(nThreads);
+    vector<GThread*> threads;
+    for (guint i = 0; i < nThreads; ++i) {
+        workers[i].scan = i == 0 ? this : clone();
+        workers[i].cacheMap = cacheMap;
+        workers[i].packages = &packages;
+        workers[i].next = &next;
+        workers[i].cancel = cancel;
+        workers[i].flags = m_flags;
+        workers[i].mask = m_mask;
+        workers[i].value = m_value;
+    }
+
+    // the first worker runs in this thread, if a thread can't be
+    // created the others just get more chunks
+    for (guint i = 1; i < nThreads; ++i) {
+        GError *error = NULL;
+        GThread *thread = g_thread_try_new("aptcc-scan", workerThread, &workers[i], &error);
+        if (thread == NULL) {
+            g_warning("failed to start scan thread: %s", error->message);
+            g_error_free(error);
+            continue;
+        }
+        threads.push_back(thread);
+    }
+    scanChunks(&workers[0]);
+    for (vector<GThread*>::const_iterator it = threads.begin(); it != threads.end(); ++it) {
+        g_thread_join(*it);
+    }
+
+    for (guint i = 0; i < nThreads; ++i) {
+        output.insert(output.end(), workers[i].output.begin(), workers[i].output.end());
+        if (i > 0) {
+            delete workers[i].scan;
+        }
+    }
+
+    // the order of the chunks depends on the threads
+    output.sort();
+    output.removeDuplicates();
+    return output;
+}
+
+gpointer AptParallelScan::workerThread(gpointer data)
+{
+    scanChunks(static_cast<Worker*>(data));
+    return NULL;
+}
+
+void AptParallelScan::scanChunks(Worker *worker)
+{
+    pkgCache *cacheMap = worker->cacheMap;
+    const vector<guint32> &packages = *worker->packages;
+
+    while (!g_atomic_int_get(worker->cancel)) {
+        gsize start = (gsize) g_atomic_int_add(worker->next, 1) * APT_PARALLEL_SCAN_CHUNK;
+        if (start >= packages.size()) {
+            break;
+        }
+
+        gsize end = MIN(start + APT_PARALLEL_SCAN_CHUNK, packages.size());
+        for (gsize i = start; i < end; ++i) {
+            pkgCache::PkgIterator pkg(*cacheMap, cacheMap->PkgP + packages[i]);
+            gsize found = worker->output.size();
+            worker->scan->scan(pkg, worker->output);
+            if (worker->flags == 0) {
+                continue;
+            }
+
+            // drop what was just found if it doesn't match the filters
+            for (gsize j = found; j < worker->output.size();) {
+                if (worker->flags->matches(worker->output[j], worker->mask, worker->value)) {
+                    ++j;
+                } else {
+                    worker->output.erase(worker->output.begin() + j);
+                }
+            }
+        }
+    }
+}
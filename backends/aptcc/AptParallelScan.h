@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef APTPARALLELSCAN_H
+#define APTPARALLELSCAN_H
+
+#include <glib.h>
+#include <apt-pkg/pkgcache.h>
+#include <pk-backend.h>
+
+#include <vector>
+
+#include "PkgList.h"
+
+#define APT_PARALLEL_SCAN_CHUNK        512
+#define APT_PARALLEL_SCAN_MAX_THREADS  16
+
+class AptCacheFile;
+class AptVersionFlags;
+class pkgRecords;
+
+/**
+ * A walk over the packages of a cache, skipping the ones that exist only
+ * due to dependencies, split in chunks that a few threads take in turns.
+ *
+ * Each thread scans with its own copy made by clone(), so matchers and
+ * record parsers are never shared; the cache itself is only read. The
+ * lists found by the threads are merged sorted and without duplicates.
+ * The versions a scan finds are filtered by the threads too, if it has
+ * filters set.
+ */
+class AptParallelScan
+{
+public:
+    AptParallelScan(AptCacheFile &cache);
+    virtual ~AptParallelScan();
+
+    /**
+      * Only keeps the found versions that match @filters, this must be
+      * called before run()
+      */
+    void setFilters(PkBitfield filters, bool multiArch);
+
+    /**
+      * Scans the packages, stopping early once @cancel is set
+      */
+    PkgList run(const volatile gint *cancel);
+
+protected:
+    /**
+      * @returns a new scan looking for the same packages
+      */
+    virtual AptParallelScan* clone() const = 0;
+
+    /**
+      * Adds the versions of @pkg that match to @output
+      */
+    virtual void scan(const pkgCache::PkgIterator &pkg, PkgList &output) = 0;
+
+    /**
+      * The record parser of this copy, as pkgRecords is not thread safe
+      */
+    pkgRecords* records();
+
+    AptCacheFile &m_cache;
+
+private:
+    struct Worker {
+        AptParallelScan *scan;
+        pkgCache *cacheMap;
+        const std::vector<guint32> *packages;
+        volatile gint *next;
+        const volatile gint *cancel;
+        const AptVersionFlags *flags;
+        guint8 mask;
+        guint8 value;
+        PkgList output;
+    };
+
+    static gpointer workerThread(gpointer data);
+    static void scanChunks(Worker *worker);
+
+    pkgRecords *m_records;
+    const AptVersionFlags *m_flags;
+    guint8 m_mask;
+    guint8 m_value;
+};
+
+#endif // APTPARALLELSCAN_H
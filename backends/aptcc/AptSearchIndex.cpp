@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "AptSearchIndex.h"
+
+#include "AptCacheFile.h"
+#include "matcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define APT_SEARCH_INDEX_NO_VERSION G_MAXUINT32
+
+using std::string;
+using std::vector;
+
+/**
+  * Finds @needle in @haystack, comparing the first and the last byte of
+  * the needle at 16 positions at once before comparing the rest
+  */
+static bool findLiteral(const char *haystack, size_t n, const char *needle, size_t k)
+{
+    if (k > n) {
+        return false;
+    }
+    if (k == 1) {
+        return memchr(haystack, needle[0], n) != NULL;
+    }
+
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[k - 1]);
+    for (; i + k - 1 + 16 <= n; i += 16) {
+        const __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        const __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + k - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst),
+                                                        _mm_cmpeq_epi8(last, blockLast)));
+        while (mask != 0) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, k - 2) == 0) {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    // whatever is left is too short for a whole block
+    return memmem(haystack + i, n - i, needle, k) != NULL;
+}
+
+/**
+  * Only ASCII words without any regex characters can be looked up,
+  * everything else still goes through the Matcher
+  */
+static bool isLiteral(const string &term)
+{
+    for (string::const_iterator it = term.begin(); it != term.end(); ++it) {
+        if ((guchar) *it >= 0x80 || strchr(".[]()*+?{}|^$\\", *it) != NULL) {
+            return false;
+        }
+    }
+    return !term.empty();
+}
+
+static void appendLower(string &text, const char *str, size_t len)
+{
+    size_t start = text.size();
+    text.append(str, len);
+    for (size_t i = start; i < text.size(); ++i) {
+        text[i] = g_ascii_tolower(text[i]);
+    }
+    text.push_back('\0');
+}
+
+AptSearchIndex::AptSearchIndex(AptCacheFile &cache) :
+    m_postingOffsets(APT_SEARCH_INDEX_BUCKETS + 1, 0)
+{
+    vector<vector<guint32> > lists(APT_SEARCH_INDEX_BUCKETS);
+    vector<guint32> buckets;
+    pkgCache *cacheMap = cache.GetPkgCache();
+
+    for (pkgCache::PkgIterator pkg = cacheMap->PkgBegin(); !pkg.end(); ++pkg) {
+        // Ignore packages that exist only due to dependencies.
+        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
+            continue;
+        }
+
+        Entry entry;
+        const pkgCache::VerIterator &ver = cache.findVer(pkg);
+        entry.pkg = pkg.Index();
+        entry.ver = ver.end() ? APT_SEARCH_INDEX_NO_VERSION : ver.Index();
+
+        entry.name = m_text.size();
+        entry.nameLen = strlen(pkg.Name());
+        appendLower(m_text, pkg.Name(), entry.nameLen);
+
+        // virtual packages only ever match by name
+        entry.desc = m_text.size();
+        if (ver.end() == false) {
+            const string &desc = cache.getLongDescription(ver);
+            entry.descLen = desc.size();
+            appendLower(m_text, desc.c_str(), desc.size());
+        } else {
+            entry.descLen = 0;
+            m_text.push_back('\0');
+        }
+
+        buckets.clear();
+        addPostings(m_text.c_str() + entry.name, entry.nameLen, buckets);
+        addPostings(m_text.c_str() + entry.desc, entry.descLen, buckets);
+        std::sort(buckets.begin(), buckets.end());
+        buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+        for (vector<guint32>::const_iterator it = buckets.begin(); it != buckets.end(); ++it) {
+            lists[*it].push_back(m_entries.size());
+        }
+        m_entries.push_back(entry);
+    }
+
+    // store each list as the varint encoded gaps between the entries
+    for (guint32 b = 0; b < APT_SEARCH_INDEX_BUCKETS; ++b) {
+        guint32 prev = 0;
+        m_postingOffsets[b] = m_postings.size();
+        for (vector<guint32>::const_iterator it = lists[b].begin(); it != lists[b].end(); ++it) {
+            guint32 gap = *it - prev;
+            prev = *it;
+            while (gap >= 0x80) {
+                m_postings.push_back((gap & 0x7f) | 0x80);
+                gap >>= 7;
+            }
+            m_postings.push_back(gap);
+        }
+        vector<guint32>().swap(lists[b]);
+    }
+    m_postingOffsets[APT_SEARCH_INDEX_BUCKETS] = m_postings.size();
+
+    g_debug("indexed %u packages, %u bytes of text, %u bytes of postings",
+            (guint) m_entries.size(), (guint) m_text.size(), (guint) m_postings.size());
+}
+
+guint32 AptSearchIndex::trigramBucket(const char *text)
+{
+    guint32 trigram = (guchar) text[0] |
+            (guchar) text[1] << 8 |
+            (guchar) text[2] << 16;
+    return (trigram * 2654435761u) >> 16;
+}
+
+void AptSearchIndex::addPostings(const char *text, guint32 len, vector<guint32> &buckets) const
+{
+    for (guint32 i = 0; i + 3 <= len; ++i) {
+        buckets.push_back(trigramBucket(text + i));
+    }
+}
+
+void AptSearchIndex::decodePostings(guint32 bucket, vector<guint32> &output) const
+{
+    guint32 prev = 0;
+
+    output.clear();
+    if (m_postingOffsets[bucket] == m_postingOffsets[bucket + 1]) {
+        return;
+    }
+
+    const guint8 *data = &m_postings[0] + m_postingOffsets[bucket];
+    const guint8 *end = &m_postings[0] + m_postingOffsets[bucket + 1];
+    while (data < end) {
+        guint32 gap = 0;
+        guint shift = 0;
+        while (*data & 0x80) {
+            gap |= (*data++ & 0x7f) << shift;
+            shift += 7;
+        }
+        gap |= *data++ << shift;
+        prev += gap;
+        output.push_back(prev);
+    }
+}
+
+void AptSearchIndex::candidates(const vector<string> &terms, vector<guint32> &output) const
+{
+    vector<guint32> buckets;
+    for (vector<string>::const_iterator it = terms.begin(); it != terms.end(); ++it) {
+        addPostings(it->c_str(), it->size(), buckets);
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+    // every term is too short to have a trigram
+    output.clear();
+    if (buckets.empty()) {
+        for (guint32 i = 0; i < m_entries.size(); ++i) {
+            output.push_back(i);
+        }
+        return;
+    }
+
+    // start with the shortest list so the rest have the least to do
+    vector<std::pair<guint32, guint32> > bySize;
+    for (vector<guint32>::const_iterator it = buckets.begin(); it != buckets.end(); ++it) {
+        bySize.push_back(std::make_pair(m_postingOffsets[*it + 1] - m_postingOffsets[*it], *it));
+    }
+    std::sort(bySize.begin(), bySize.end());
+
+    vector<guint32> list;
+    vector<guint32> merged;
+    decodePostings(bySize[0].second, output);
+    for (size_t i = 1; i < bySize.size() && !output.empty(); ++i) {
+        decodePostings(bySize[i].second, list);
+        merged.clear();
+        std::set_intersection(output.begin(), output.end(),
+                              list.begin(), list.end(),
+                              std::back_inserter(merged));
+        output.swap(merged);
+    }
+}
+
+bool AptSearchIndex::matchesLiteral(const Entry &entry,
+                                    const vector<string> &terms,
+                                    bool details) const
+{
+    const char *name = m_text.c_str() + entry.name;
+    vector<string>::const_iterator it;
+    for (it = terms.begin(); it != terms.end(); ++it) {
+        if (!findLiteral(name, entry.nameLen, it->c_str(), it->size())) {
+            break;
+        }
+    }
+    if (it == terms.end()) {
+        return true;
+    }
+
+    if (!details || entry.ver == APT_SEARCH_INDEX_NO_VERSION) {
+        return false;
+    }
+    const char *desc = m_text.c_str() + entry.desc;
+    for (it = terms.begin(); it != terms.end(); ++it) {
+        if (!findLiteral(desc, entry.descLen, it->c_str(), it->size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AptSearchIndex::addEntry(const Entry &entry, AptCacheFile &cache, PkgList &output) const
+{
+    pkgCache *cacheMap = cache.GetPkgCache();
+    if (entry.ver != APT_SEARCH_INDEX_NO_VERSION) {
+        output.push_back(pkgCache::VerIterator(*cacheMap, cacheMap->VerP + entry.ver));
+        return;
+    }
+
+    // Don't insert virtual packages instead add what it provides
+    pkgCache::PkgIterator pkg(*cacheMap, cacheMap->PkgP + entry.pkg);
+    for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
+        const pkgCache::VerIterator &ownerVer = cache.findVer(Prv.OwnerPkg());
+
+        // check to see if the provided package isn't virtual too
+        if (ownerVer.end() == false) {
+            // we add the package now because we will need to
+            // remove duplicates later anyway
+            output.push_back(ownerVer);
+        }
+    }
+}
+
+void AptSearchIndex::search(Matcher &matcher,
+                            bool details,
+                            AptCacheFile &cache,
+                            PkgList &output,
+                            const volatile gint *cancel) const
+{
+    const vector<string> &terms = matcher.terms();
+    vector<string> lower;
+    bool literal = !terms.empty();
+
+    for (vector<string>::const_iterator it = terms.begin(); it != terms.end(); ++it) {
+        if (!isLiteral(*it)) {
+            literal = false;
+            break;
+        }
+        lower.push_back(string());
+        appendLower(lower.back(), it->c_str(), it->size());
+        lower.back().resize(it->size());
+    }
+
+    if (literal) {
+        vector<guint32> ids;
+        candidates(lower, ids);
+        for (vector<guint32>::const_iterator it = ids.begin(); it != ids.end() && !g_atomic_int_get(cancel); ++it) {
+            if (matchesLiteral(m_entries[*it], lower, details)) {
+                addEntry(m_entries[*it], cache, output);
+            }
+        }
+        return;
+    }
+
+    // the regex is case insensitive, so the lowercased text is fine
+    for (vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end() && !g_atomic_int_get(cancel); ++it) {
+        if (matcher.matches(m_text.c_str() + it->name) ||
+                (details &&
+                 it->ver != APT_SEARCH_INDEX_NO_VERSION &&
+                 matcher.matches(m_text.c_str() + it->desc))) {
+            addEntry(*it, cache, output);
+        }
+    }
+}
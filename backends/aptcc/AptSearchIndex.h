@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef APTSEARCHINDEX_H
+#define APTSEARCHINDEX_H
+
+#include <glib.h>
+
+#include <string>
+#include <vector>
+
+#include "PkgList.h"
+
+#define APT_SEARCH_INDEX_BUCKETS 65536
+
+class AptCacheFile;
+class Matcher;
+
+/**
+ * The lowercased names and long descriptions of every package in one
+ * cache, so searches don't have to look up the package records.
+ *
+ * Every trigram of the text points to the packages containing it, which
+ * narrows a search for plain words down to a few candidates that are
+ * then checked with a fast substring search.
+ */
+class AptSearchIndex
+{
+public:
+    /**
+      * Builds the index, reading the descriptions with the records of @cache
+      */
+    AptSearchIndex(AptCacheFile &cache);
+
+    /**
+      * Adds the packages matching all of the terms in their name, or if
+      * @details is set all of them in their name or in their description
+      */
+    void search(Matcher &matcher,
+                bool details,
+                AptCacheFile &cache,
+                PkgList &output,
+                const volatile gint *cancel) const;
+
+private:
+    struct Entry {
+        guint32 pkg;
+        guint32 ver;
+        guint32 name;
+        guint32 nameLen;
+        guint32 desc;
+        guint32 descLen;
+    };
+
+    static guint32 trigramBucket(const char *text);
+    void addPostings(const char *text, guint32 len, std::vector<guint32> &buckets) const;
+    void candidates(const std::vector<std::string> &terms, std::vector<guint32> &output) const;
+    void decodePostings(guint32 bucket, std::vector<guint32> &output) const;
+    bool matchesLiteral(const Entry &entry,
+                        const std::vector<std::string> &terms,
+                        bool details) const;
+    void addEntry(const Entry &entry, AptCacheFile &cache, PkgList &output) const;
+
+    std::vector<Entry> m_entries;
+    std::string m_text;
+    std::vector<guint32> m_postingOffsets;
+    std::vector<guint8> m_postings;
+};
+
+#endif // APTSEARCHINDEX_H
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "AptSharedCache.h"
+
+#include "AptCacheFile.h"
+#include "AptSearchIndex.h"
+#include "AptVersionFlags.h"
+#include "apt-messages.h"
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/error.h>
+
+#include <cstring>
+
+static GMutex s_mutex;
+static AptSharedCache *s_current = 0;
+
+AptSharedCache::AptSharedCache(AptCacheFile *cache) :
+    m_cache(cache),
+    m_searchIndex(0),
+    m_versionFlags(0),
+    m_refcount(1)
+{
+    memset(m_stamps, 0, sizeof(m_stamps));
+    g_mutex_init(&m_searchIndexMutex);
+    g_mutex_init(&m_versionFlagsMutex);
+}
+
+AptSharedCache::~AptSharedCache()
+{
+    delete m_searchIndex;
+    delete m_versionFlags;
+    delete m_cache;
+    g_mutex_clear(&m_searchIndexMutex);
+    g_mutex_clear(&m_versionFlagsMutex);
+}
+
+AptSearchIndex* AptSharedCache::searchIndex(AptCacheFile &cache)
+{
+    // searches that start while it is being built just wait for it
+    g_mutex_lock(&m_searchIndexMutex);
+    if (m_searchIndex == 0) {
+        m_searchIndex = new AptSearchIndex(cache);
+    }
+    g_mutex_unlock(&m_searchIndexMutex);
+    return m_searchIndex;
+}
+
+AptVersionFlags* AptSharedCache::versionFlags(AptCacheFile &cache, bool applications)
+{
+    g_mutex_lock(&m_versionFlagsMutex);
+    if (m_versionFlags == 0) {
+        m_versionFlags = new AptVersionFlags(cache);
+    }
+    if (applications) {
+        m_versionFlags->findApplications(cache);
+    }
+    g_mutex_unlock(&m_versionFlagsMutex);
+    return m_versionFlags;
+}
+
+void AptSharedCache::getStamps(Stamp *stamps)
+{
+    // everything the cache, the policy and the dependency cache are built from
+    const std::string files[APT_SHARED_CACHE_STAMP_FILES] = {
+        _config->FindFile("Dir::State::status"),
+        _config->FindFile("Dir::State::extended_states"),
+        _config->FindDir("Dir::State::lists"),
+        _config->FindFile("Dir::Cache::pkgcache"),
+        _config->FindFile("Dir::Cache::srcpkgcache")
+    };
+
+    struct stat buf;
+    memset(stamps, 0, sizeof(Stamp) * APT_SHARED_CACHE_STAMP_FILES);
+    for (uint i = 0; i < APT_SHARED_CACHE_STAMP_FILES; ++i) {
+        if (files[i].empty() || stat(files[i].c_str(), &buf) != 0) {
+            continue;
+        }
+        stamps[i].mtime = buf.st_mtim.tv_sec;
+        stamps[i].mtimeNsec = buf.st_mtim.tv_nsec;
+        stamps[i].size = buf.st_size;
+        stamps[i].inode = buf.st_ino;
+    }
+}
+
+bool AptSharedCache::stampsEqual(const Stamp *a, const Stamp *b)
+{
+    for (uint i = 0; i < APT_SHARED_CACHE_STAMP_FILES; ++i) {
+        if (a[i].mtime != b[i].mtime ||
+                a[i].mtimeNsec != b[i].mtimeNsec ||
+                a[i].size != b[i].size ||
+                a[i].inode != b[i].inode) {
+            return false;
+        }
+    }
+    return true;
+}
+
+AptSharedCache* AptSharedCache::build(PkBackendJob *job)
+{
+    AptCacheFile *cache = new AptCacheFile(job);
+    if (cache->Open(false) == false) {
+        show_errors(job, PK_ERROR_ENUM_CANNOT_GET_LOCK);
+        delete cache;
+        return 0;
+    }
+
+    // Check if there are half-installed packages and if we can fix them
+    if (cache->CheckDeps(false) == false) {
+        delete cache;
+        return 0;
+    }
+
+    // apt may have just written the binary caches, so only look at
+    // the files once it is done with them
+    AptSharedCache *shared = new AptSharedCache(cache);
+    getStamps(shared->m_stamps);
+    return shared;
+}
+
+AptSharedCache* AptSharedCache::ref(PkBackendJob *job)
+{
+    Stamp stamps[APT_SHARED_CACHE_STAMP_FILES];
+
+    // jobs that start while the cache is being built just wait for it
+    g_mutex_lock(&s_mutex);
+
+    getStamps(stamps);
+    if (s_current && !stampsEqual(s_current->m_stamps, stamps)) {
+        g_debug("package cache changed, building it again");
+        s_current->unref();
+        s_current = 0;
+    }
+
+    if (s_current == 0) {
+        s_current = build(job);
+    }
+
+    AptSharedCache *ret = s_current;
+    if (ret) {
+        g_atomic_int_inc(&ret->m_refcount);
+    }
+
+    g_mutex_unlock(&s_mutex);
+    return ret;
+}
+
+void AptSharedCache::invalidate()
+{
+    g_mutex_lock(&s_mutex);
+    if (s_current) {
+        s_current->unref();
+        s_current = 0;
+    }
+    g_mutex_unlock(&s_mutex);
+}
+
+void AptSharedCache::unref()
+{
+    if (g_atomic_int_dec_and_test(&m_refcount)) {
+        delete this;
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef APTSHAREDCACHE_H
+#define APTSHAREDCACHE_H
+
+#include <glib.h>
+#include <sys/stat.h>
+
+#include <pk-backend.h>
+
+#define APT_SHARED_CACHE_STAMP_FILES 5
+
+class AptCacheFile;
+class AptSearchIndex;
+class AptVersionFlags;
+
+/**
+ * A read-only package cache that is kept open between jobs, so queries
+ * don't have to build the cache, policy and dependency cache each time.
+ * It is built again once any of the files it was built from changes.
+ *
+ * Jobs sharing it must never mark packages in the dependency cache.
+ */
+class AptSharedCache
+{
+public:
+    /**
+      * Gets a reference to the current shared cache, building it first
+      * if needed, using @job to report progress and errors
+      * @returns 0 if the cache could not be opened
+      */
+    static AptSharedCache* ref(PkBackendJob *job);
+
+    /**
+      * Drops the current shared cache, it is freed once the last job
+      * using it lets go
+      */
+    static void invalidate();
+
+    void unref();
+
+    inline AptCacheFile* cacheFile() const { return m_cache; }
+
+    /**
+      * Gets the search index of this cache, building it the first time
+      * using the package records of @cache
+      */
+    AptSearchIndex* searchIndex(AptCacheFile &cache);
+
+    /**
+      * Gets the filter flags of the versions of this cache, working them
+      * out the first time, and the applications the first time that
+      * @applications is set
+      */
+    AptVersionFlags* versionFlags(AptCacheFile &cache, bool applications);
+
+private:
+    AptSharedCache(AptCacheFile *cache);
+    ~AptSharedCache();
+
+    struct Stamp {
+        time_t mtime;
+        long mtimeNsec;
+        off_t size;
+        ino_t inode;
+    };
+
+    static AptSharedCache* build(PkBackendJob *job);
+    static void getStamps(Stamp *stamps);
+    static bool stampsEqual(const Stamp *a, const Stamp *b);
+
+    AptCacheFile *m_cache;
+    AptSearchIndex *m_searchIndex;
+    GMutex m_searchIndexMutex;
+    AptVersionFlags *m_versionFlags;
+    GMutex m_versionFlagsMutex;
+    gint m_refcount;
+    Stamp m_stamps[APT_SHARED_CACHE_STAMP_FILES];
+};
+
+#endif // APTSHAREDCACHE_H
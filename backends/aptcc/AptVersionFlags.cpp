@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#include "AptVersionFlags.h"
+
+#include "AptCacheFile.h"
+#include "AptFileIndex.h"
+
+#include <apt-pkg/aptconfiguration.h>
+#include <apt-pkg/configuration.h>
+
+#include <cstring>
+
+using std::string;
+
+AptVersionFlags::AptVersionFlags(AptCacheFile &cache) :
+    m_flags(cache.GetPkgCache()->HeaderP->VersionCount, 0),
+    m_applications(cache.GetPkgCache()->HeaderP->VersionCount, false),
+    m_hasApplications(false)
+{
+    pkgCache *cacheMap = cache.GetPkgCache();
+    const string nativeArch = _config->Find("APT::Architecture");
+
+    for (pkgCache::PkgIterator pkg = cacheMap->PkgBegin(); !pkg.end(); ++pkg) {
+        const char *name = pkg.Name();
+        for (pkgCache::VerIterator ver = pkg.VersionList(); !ver.end(); ++ver) {
+            guint8 flags = 0;
+
+            // Check if the package is installed
+            bool installed = pkg->CurrentState == pkgCache::State::Installed &&
+                    pkg.CurrentVer() == ver;
+            if (installed) {
+                flags |= APT_VERSION_INSTALLED;
+            }
+
+            if (strcmp(ver.Arch(), "all") == 0 || nativeArch.compare(ver.Arch()) == 0) {
+                flags |= APT_VERSION_NATIVE_ARCH;
+            }
+
+            // the section is "component/section", without a component
+            // the package is in main
+            const char *str = ver.Section() == NULL ? "" : ver.Section();
+            const char *slash = strrchr(str, '/');
+            const char *section = slash == NULL ? str : slash + 1;
+            string component = slash == NULL ? "main" : string(str, slash - str);
+
+            if (g_str_has_suffix(name, "-dev") ||
+                    g_str_has_suffix(name, "-dbg") ||
+                    strcmp(section, "devel") == 0 ||
+                    strcmp(section, "libdevel") == 0) {
+                flags |= APT_VERSION_DEVEL;
+            }
+
+            if (strcmp(section, "x11") == 0 ||
+                    strcmp(section, "gnome") == 0 ||
+                    strcmp(section, "kde") == 0 ||
+                    strcmp(section, "graphics") == 0) {
+                flags |= APT_VERSION_GUI;
+            }
+
+            // Must be in main and universe to be free
+            if (component.compare("main") == 0 ||
+                    component.compare("universe") == 0) {
+                flags |= APT_VERSION_FREE;
+            }
+
+            pkgCache::VerFileIterator vf = ver.FileList();
+            const char *origin = vf.end() || vf.File().Origin() == NULL ? "" : vf.File().Origin();
+            if (component.empty()) {
+                component = "main";
+            }
+            if ((strcmp(origin, "Debian") == 0 || strcmp(origin, "Ubuntu") == 0) &&
+                    (component.compare("main") == 0 ||
+                     component.compare("restricted") == 0 ||
+                     component.compare("unstable") == 0 ||
+                     component.compare("testing") == 0)) {
+                flags |= APT_VERSION_SUPPORTED;
+            }
+
+            m_flags[ver->ID] = flags;
+        }
+    }
+}
+
+void AptVersionFlags::findApplications(AptCacheFile &cache)
+{
+    if (m_hasApplications) {
+        return;
+    }
+
+    AptFileIndex *files = AptFileIndex::ref();
+    if (files) {
+        pkgCache *cacheMap = cache.GetPkgCache();
+        bool multiArch = APT::Configuration::getArchitectures(false).size() > 1;
+
+        // We do not support checking if it is an Application
+        // if NOT installed
+        for (pkgCache::PkgIterator pkg = cacheMap->PkgBegin(); !pkg.end(); ++pkg) {
+            if (pkg->CurrentState != pkgCache::State::Installed || pkg.CurrentVer().end()) {
+                continue;
+            }
+
+            pkgCache::VerIterator ver = pkg.CurrentVer();
+            if (files->hasDesktopFile(pkg.Name(), multiArch ? ver.Arch() : 0)) {
+                m_applications[ver->ID] = true;
+            }
+        }
+        files->unref();
+    }
+    m_hasApplications = true;
+}
+
+void AptVersionFlags::filterMask(PkBitfield filters, bool multiArch, guint8 &mask, guint8 &value)
+{
+    guint8 set = 0;
+    guint8 unset = 0;
+
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_INSTALLED)) {
+        set |= APT_VERSION_INSTALLED;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED)) {
+        unset |= APT_VERSION_INSTALLED;
+    }
+
+    // if we are on multiarch check also the arch filter
+    if (multiArch && pk_bitfield_contain(filters, PK_FILTER_ENUM_ARCH)) {
+        set |= APT_VERSION_NATIVE_ARCH;
+    }
+
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_DEVELOPMENT)) {
+        set |= APT_VERSION_DEVEL;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_DEVELOPMENT)) {
+        unset |= APT_VERSION_DEVEL;
+    }
+
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_GUI)) {
+        set |= APT_VERSION_GUI;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_GUI)) {
+        unset |= APT_VERSION_GUI;
+    }
+
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_FREE)) {
+        set |= APT_VERSION_FREE;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_FREE)) {
+        unset |= APT_VERSION_FREE;
+    }
+
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_SUPPORTED)) {
+        set |= APT_VERSION_SUPPORTED;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_SUPPORTED)) {
+        unset |= APT_VERSION_SUPPORTED;
+    }
+
+    // both only know about installed packages
+    if (pk_bitfield_contain(filters, PK_FILTER_ENUM_APPLICATION)) {
+        set |= APT_VERSION_INSTALLED | APT_VERSION_APPLICATION;
+    } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_APPLICATION)) {
+        set |= APT_VERSION_INSTALLED;
+        unset |= APT_VERSION_APPLICATION;
+    }
+
+    mask = set | unset;
+    value = set;
+    if (set & unset) {
+        // e.g. not installed applications
+        mask |= APT_VERSION_NONE;
+        value |= APT_VERSION_NONE;
+    }
+}
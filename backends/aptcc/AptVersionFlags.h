@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef APTVERSIONFLAGS_H
+#define APTVERSIONFLAGS_H
+
+#include <glib.h>
+#include <apt-pkg/pkgcache.h>
+#include <pk-backend.h>
+
+#include <vector>
+
+#define APT_VERSION_INSTALLED    (1 << 0)
+#define APT_VERSION_NATIVE_ARCH  (1 << 1)
+#define APT_VERSION_DEVEL        (1 << 2)
+#define APT_VERSION_GUI          (1 << 3)
+#define APT_VERSION_FREE         (1 << 4)
+#define APT_VERSION_SUPPORTED    (1 << 5)
+#define APT_VERSION_APPLICATION  (1 << 6)
+// never set, asked for by filters that can't match anything
+#define APT_VERSION_NONE         (1 << 7)
+
+class AptCacheFile;
+
+/**
+ * What the PackageKit filters look at for every version of a cache,
+ * worked out once so filtering a version is a single mask and compare.
+ *
+ * The installed and application bits are only right as long as the
+ * cache is, so the flags must be dropped with the cache. Finding the
+ * applications needs the file index, so it is only done once a filter
+ * asks for them.
+ */
+class AptVersionFlags
+{
+public:
+    AptVersionFlags(AptCacheFile &cache);
+
+    /**
+      * Turns @filters into the bits to look at, @mask, and the value
+      * they must have, @value. The arch filter only applies if
+      * @multiArch is set
+      */
+    static void filterMask(PkBitfield filters, bool multiArch, guint8 &mask, guint8 &value);
+
+    /**
+      * Works out the application bit, which a mask must only look at
+      * after this was called
+      */
+    void findApplications(AptCacheFile &cache);
+
+    inline bool hasApplications() const {
+        return m_hasApplications;
+    }
+
+    inline bool matches(const pkgCache::VerIterator &ver, guint8 mask, guint8 value) const {
+        guint8 flags = m_flags[ver->ID];
+        if ((mask & APT_VERSION_APPLICATION) && m_applications[ver->ID]) {
+            flags |= APT_VERSION_APPLICATION;
+        }
+        return (flags & mask) == value;
+    }
+
+private:
+    std::vector<guint8> m_flags;
+    std::vector<bool> m_applications;
+    bool m_hasApplications;
+};
+
+#endif // APTVERSIONFLAGS_H
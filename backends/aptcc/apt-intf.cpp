@@ -40,6 +40,11 @@
 #include <dirent.h>
 
 #include "AptCacheFile.h"
+#include "AptFileIndex.h"
+#include "AptParallelScan.h"
+#include "AptSearchIndex.h"
+#include "AptSharedCache.h"
+#include "AptVersionFlags.h"
 #include "apt-utils.h"
 #include "matcher.h"
 #include "gstMatcher.h"
@@ -52,13 +57,14 @@
 
 AptIntf::AptIntf(PkBackendJob *job) :
     m_job(job),
-    m_cancel(false),
+    m_cancel(FALSE),
     m_terminalTimeout(120),
     m_lastSubProgress(0),
-    m_cache(0)
+    m_cache(0),
+    m_fileIndex(0),
+    m_locale(0),
+    m_oldLocale(0)
 {
-    m_cancel = false;
-
     // Make sure initial m_time is 0
     m_restartStat.st_mtime = 0;
 }
@@ -71,9 +77,12 @@ bool AptIntf::init()
 
     m_isMultiArch = APT::Configuration::getArchitectures(false).size() > 1;
 
-    // set locale
+    // set locale, only for this thread as other jobs may be running
     if (locale = pk_backend_job_get_locale(m_job)) {
-        setlocale(LC_ALL, locale);
+        m_locale = newlocale(LC_ALL_MASK, locale, (locale_t) 0);
+        if (m_locale) {
+            m_oldLocale = uselocale(m_locale);
+        }
         // TODO why this cuts characthers on ui?
         // 		string _locale(locale);
         // 		size_t found;
@@ -83,16 +92,6 @@ bool AptIntf::init()
     }
     g_free(locale);
 
-    // set http proxy
-    http_proxy = pk_backend_job_get_proxy_http(m_job);
-    setenv("http_proxy", http_proxy, 1);
-    g_free(http_proxy);
-
-    // set ftp proxy
-    ftp_proxy = pk_backend_job_get_proxy_ftp(m_job);
-    setenv("ftp_proxy", ftp_proxy, 1);
-    g_free(ftp_proxy);
-
     // Prepare for the restart thing
     if (g_file_test(REBOOT_REQUIRED, G_FILE_TEST_EXISTS)) {
         g_stat(REBOOT_REQUIRED, &m_restartStat);
@@ -101,6 +100,7 @@ bool AptIntf::init()
     // Check if we should open the Cache with lock
     bool withLock;
     bool AllowBroken = false;
+    bool shared = false;
     PkRoleEnum role = pk_backend_job_get_role(m_job);
     switch (role) {
     case PK_ROLE_ENUM_INSTALL_PACKAGES:
@@ -112,10 +112,41 @@ bool AptIntf::init()
     case PK_ROLE_ENUM_REPAIR_SYSTEM:
         AllowBroken = true;
         break;
+    case PK_ROLE_ENUM_RESOLVE:
+    case PK_ROLE_ENUM_SEARCH_NAME:
+    case PK_ROLE_ENUM_SEARCH_DETAILS:
+    case PK_ROLE_ENUM_SEARCH_GROUP:
+    case PK_ROLE_ENUM_SEARCH_FILE:
+    case PK_ROLE_ENUM_GET_PACKAGES:
+    case PK_ROLE_ENUM_GET_DETAILS:
+    case PK_ROLE_ENUM_GET_FILES:
+    case PK_ROLE_ENUM_DEPENDS_ON:
+    case PK_ROLE_ENUM_REQUIRED_BY:
+    case PK_ROLE_ENUM_WHAT_PROVIDES:
+        // these only read the cache, unless the downloaded filter
+        // has to mark the packages to find their archives
+        withLock = false;
+        shared = !pk_bitfield_contain(jobFilters(), PK_FILTER_ENUM_DOWNLOADED);
+        break;
     default:
         withLock = false;
     }
 
+    // the environment is shared by all the jobs, so only change it
+    // from the roles that never run next to another job
+    PkBackend *backend = PK_BACKEND(pk_backend_job_get_backend(m_job));
+    if (pk_backend_get_lock_class(backend, role) != PK_BACKEND_LOCK_CLASS_READ_SHARED) {
+        // set http proxy
+        http_proxy = pk_backend_job_get_proxy_http(m_job);
+        setenv("http_proxy", http_proxy, 1);
+        g_free(http_proxy);
+
+        // set ftp proxy
+        ftp_proxy = pk_backend_job_get_proxy_ftp(m_job);
+        setenv("ftp_proxy", ftp_proxy, 1);
+        g_free(ftp_proxy);
+    }
+
     bool simulate = false;
     if (withLock) {
         // Get the simulate value to see if the lock is valid
@@ -129,6 +160,16 @@ bool AptIntf::init()
     // Create the AptCacheFile class to search for packages
     m_cache = new AptCacheFile(m_job);
 
+    // Reuse the cache the last query built if nothing changed since
+    if (shared) {
+        AptSharedCache *sharedCache = AptSharedCache::ref(m_job);
+        if (sharedCache == 0) {
+            return false;
+        }
+        m_cache->Attach(sharedCache);
+        return true;
+    }
+
     int timeout = 10;
     // TODO test this
     while (m_cache->Open(withLock) == false) {
@@ -150,6 +191,22 @@ bool AptIntf::init()
     return m_cache->CheckDeps(AllowBroken);
 }
 
+PkBitfield AptIntf::jobFilters() const
+{
+    PkBitfield filters = 0;
+
+    // the filters are always the first parameter when there are any
+    GVariant *params = pk_backend_job_get_parameters(m_job);
+    if (params && g_variant_n_children(params) > 0) {
+        GVariant *value = g_variant_get_child_value(params, 0);
+        if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64)) {
+            filters = g_variant_get_uint64(value);
+        }
+        g_variant_unref(value);
+    }
+    return filters;
+}
+
 AptIntf::~AptIntf()
 {
     // Check the restart thing
@@ -172,12 +229,15 @@ AptIntf::~AptIntf()
     }
 
     delete m_cache;
+
+    if (m_fileIndex) {
+        m_fileIndex->unref();
+    }
 }
 
 void AptIntf::cancel()
 {
-    if (!m_cancel) {
-        m_cancel = true;
+    if (g_atomic_int_compare_and_exchange(&m_cancel, FALSE, TRUE)) {
         pk_backend_job_set_status(m_job, PK_STATUS_ENUM_CANCEL);
     }
 
@@ -188,144 +248,31 @@ void AptIntf::cancel()
 
 bool AptIntf::cancelled() const
 {
-    return m_cancel;
+    return g_atomic_int_get(&m_cancel);
 }
 
 void AptIntf::emitFinished()
 {
+    // the thread goes back to the pool, so it must not keep our locale
+    if (m_locale) {
+        uselocale(m_oldLocale);
+        freelocale(m_locale);
+        m_locale = 0;
+    }
+
     pk_backend_job_finished(m_job);
 }
 
 bool AptIntf::matchPackage(const pkgCache::VerIterator &ver, PkBitfield filters)
 {
-    if (filters != 0) {
-        const pkgCache::PkgIterator &pkg = ver.ParentPkg();
-        bool installed = false;
-
-        // Check if the package is installed
-        if (pkg->CurrentState == pkgCache::State::Installed && pkg.CurrentVer() == ver) {
-            installed = true;
-        }
-
-        // if we are on multiarch check also the arch filter
-        if (m_isMultiArch && pk_bitfield_contain(filters, PK_FILTER_ENUM_ARCH)/* && !installed*/) {
-            // don't emit the package if it does not match
-            // the native architecture
-            if (strcmp(ver.Arch(), "all") != 0 &&
-                    strcmp(ver.Arch(), _config->Find("APT::Architecture").c_str()) != 0) {
-                return false;
-            }
-        }
-
-        std::string str = ver.Section() == NULL ? "" : ver.Section();
-        std::string section, component;
-
-        size_t found;
-        found = str.find_last_of("/");
-        section = str.substr(found + 1);
-        if(found == str.npos) {
-            component = "main";
-        } else {
-            component = str.substr(0, found);
-        }
-
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_INSTALLED) && installed) {
-            return false;
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_INSTALLED) && !installed) {
-            return false;
-        }
-
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_DEVELOPMENT)) {
-            // if ver.end() means unknow
-            // strcmp will be true when it's different than devel
-            std::string pkgName = pkg.Name();
-            if (!ends_with(pkgName, "-dev") &&
-                    !ends_with(pkgName, "-dbg") &&
-                    section.compare("devel") &&
-                    section.compare("libdevel")) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_DEVELOPMENT)) {
-            std::string pkgName = pkg.Name();
-            if (ends_with(pkgName, "-dev") ||
-                    ends_with(pkgName, "-dbg") ||
-                    !section.compare("devel") ||
-                    !section.compare("libdevel")) {
-                return false;
-            }
-        }
-
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_GUI)) {
-            // if ver.end() means unknow
-            // strcmp will be true when it's different than x11
-            if (section.compare("x11") && section.compare("gnome") &&
-                    section.compare("kde") && section.compare("graphics")) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_GUI)) {
-            if (!section.compare("x11") || !section.compare("gnome") ||
-                    !section.compare("kde") || !section.compare("graphics")) {
-                return false;
-            }
-        }
-
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_FREE)) {
-            if (component.compare("main") != 0 &&
-                    component.compare("universe") != 0) {
-                // Must be in main and universe to be free
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_FREE)) {
-            if (component.compare("main") == 0 ||
-                    component.compare("universe") == 0) {
-                // Must not be in main or universe to be free
-                return false;
-            }
-        }
-
-        // Check for supported packages
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_SUPPORTED)) {
-            if (!packageIsSupported(ver, component)) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_SUPPORTED)) {
-            if (packageIsSupported(ver, component)) {
-                return false;
-            }
-        }
-
-        // Check for applications, if they have files with .desktop
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_APPLICATION)) {
-            // We do not support checking if it is an Application
-            // if NOT installed
-            if (!installed || !isApplication(ver)) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_APPLICATION)) {
-            // We do not support checking if it is an Application
-            // if NOT installed
-            if (!installed || isApplication(ver)) {
-                return false;
-            }
-        }
-
-        // TODO test this one..
-#if 0
-        // I couldn'tfind any packages with the metapackages component, and I
-        // think the check is the wrong way around; PK_FILTER_ENUM_COLLECTIONS
-        // is for virtual group packages -- hughsie
-        if (pk_bitfield_contain(filters, PK_FILTER_ENUM_COLLECTIONS)) {
-            if (!component.compare("metapackages")) {
-                return false;
-            }
-        } else if (pk_bitfield_contain(filters, PK_FILTER_ENUM_NOT_COLLECTIONS)) {
-            if (component.compare("metapackages")) {
-                return false;
-            }
-        }
-#endif
+    if (filters == 0) {
+        return true;
     }
-    return true;
+
+    guint8 mask;
+    guint8 value;
+    AptVersionFlags::filterMask(filters, m_isMultiArch, mask, value);
+    return m_cache->versionFlags(mask & APT_VERSION_APPLICATION)->matches(ver, mask, value);
 }
 
 PkgList AptIntf::filterPackages(const PkgList &packages, PkBitfield filters)
@@ -334,8 +281,12 @@ PkgList AptIntf::filterPackages(const PkgList &packages, PkBitfield filters)
         PkgList ret;
         ret.reserve(packages.size());
 
+        guint8 mask;
+        guint8 value;
+        AptVersionFlags::filterMask(filters, m_isMultiArch, mask, value);
+        const AptVersionFlags *flags = m_cache->versionFlags(mask & APT_VERSION_APPLICATION);
         for (PkgList::const_iterator i = packages.begin(); i != packages.end(); ++i) {
-            if (matchPackage(*i, filters)) {
+            if (flags->matches(*i, mask, value)) {
                 ret.push_back(*i);
             }
         }
@@ -348,7 +299,7 @@ PkgList AptIntf::filterPackages(const PkgList &packages, PkBitfield filters)
             {
                 pkgDepCache::ActionGroup group(*m_cache);
                 for (PkgList::const_iterator it = ret.begin(); it != ret.end(); ++it) {
-                    if (m_cancel) {
+                    if (cancelled()) {
                         break;
                     }
 
@@ -438,7 +389,7 @@ void AptIntf::emitPackages(PkgList &output, PkBitfield filters, PkInfoEnum state
 
     output = filterPackages(output, filters);
     for (PkgList::const_iterator it = output.begin(); it != output.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -473,7 +424,7 @@ void AptIntf::emitUpdates(PkgList &output, PkBitfield filters)
 
     output = filterPackages(output, filters);
     for (PkgList::const_iterator i = output.begin(); i != output.end(); ++i) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -505,45 +456,58 @@ void AptIntf::emitUpdates(PkgList &output, PkBitfield filters)
 }
 
 // search packages which provide a codec (specified in "values")
-void AptIntf::providesCodec(PkgList &output, gchar **values)
+class CodecScan : public AptParallelScan
 {
-    GstMatcher *matcher = new GstMatcher(values);
-    if (!matcher->hasMatches()) {
-        return;
+public:
+    CodecScan(AptCacheFile &cache, gchar **values) :
+        AptParallelScan(cache),
+        m_values(values),
+        m_matcher(values)
+    {
     }
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            delete matcher;
-            break;
-        }
+    bool hasMatches() const { return m_matcher.hasMatches(); }
 
-        // Ignore packages that exist only due to dependencies.
-        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
-        }
+protected:
+    AptParallelScan* clone() const { return new CodecScan(m_cache, m_values); }
 
+    void scan(const pkgCache::PkgIterator &pkg, PkgList &output)
+    {
         // TODO search in updates packages
         // Ignore virtual packages
-        pkgCache::VerIterator ver = m_cache->findVer(pkg);
+        pkgCache::VerIterator ver = m_cache.findVer(pkg);
         if (ver.end() == true) {
-            ver = m_cache->findCandidateVer(pkg);
+            ver = m_cache.findCandidateVer(pkg);
             if (ver.end() == true) {
-                continue;
+                return;
             }
         }
 
         pkgCache::VerFileIterator vf = ver.FileList();
-        pkgRecords::Parser &rec = m_cache->GetPkgRecords()->Lookup(vf);
+        pkgRecords::Parser &rec = records()->Lookup(vf);
         const char *start, *stop;
         rec.GetRec(start, stop);
         string record(start, stop - start);
-        if (matcher->matches(record)) {
+        if (m_matcher.matches(record)) {
             output.push_back(ver);
         }
     }
 
-    delete matcher;
+private:
+    gchar **m_values;
+    GstMatcher m_matcher;
+};
+
+void AptIntf::providesCodec(PkgList &output, gchar **values, PkBitfield filters)
+{
+    CodecScan scan(*m_cache, values);
+    if (!scan.hasMatches()) {
+        return;
+    }
+    scan.setFilters(filters, m_isMultiArch);
+
+    const PkgList &found = scan.run(&m_cancel);
+    output.insert(output.end(), found.begin(), found.end());
 }
 
 // search packages which provide the libraries specified in "values"
@@ -755,7 +719,7 @@ void AptIntf::emitDetails(PkgList &pkgs)
     pkgs.removeDuplicates();
 
     for (PkgList::const_iterator i = pkgs.begin(); i != pkgs.end(); ++i) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -961,7 +925,7 @@ void AptIntf::emitUpdateDetail(const pkgCache::VerIterator &candver)
 void AptIntf::emitUpdateDetails(const PkgList &pkgs)
 {
     for (PkgList::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -975,7 +939,7 @@ void AptIntf::getDepends(PkgList &output,
 {
     pkgCache::DepIterator dep = ver.DependsList();
     while (!dep.end()) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -1003,7 +967,7 @@ void AptIntf::getRequires(PkgList &output,
                           bool recursive)
 {
     for (pkgCache::PkgIterator parentPkg = m_cache->GetPkgCache()->PkgBegin(); !parentPkg.end(); ++parentPkg) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -1034,72 +998,73 @@ void AptIntf::getRequires(PkgList &output,
     }
 }
 
-PkgList AptIntf::getPackages()
+// the packages that have a version, the virtual ones don't have all kinds of info
+class PackagesScan : public AptParallelScan
 {
-    pk_backend_job_set_status(m_job, PK_STATUS_ENUM_QUERY);
+public:
+    PackagesScan(AptCacheFile &cache) : AptParallelScan(cache) {}
 
-    PkgList output;
-    output.reserve(m_cache->GetPkgCache()->HeaderP->PackageCount);
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
+protected:
+    AptParallelScan* clone() const { return new PackagesScan(m_cache); }
 
-        // Ignore packages that exist only due to dependencies.
-        if(pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
-        }
-
-        // Don't insert virtual packages as they don't have all kinds of info
-        const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
+    void scan(const pkgCache::PkgIterator &pkg, PkgList &output)
+    {
+        const pkgCache::VerIterator &ver = m_cache.findVer(pkg);
         if (ver.end() == false) {
             output.push_back(ver);
         }
     }
-    return output;
-}
+};
 
-PkgList AptIntf::getPackagesFromRepo(SourcesList::SourceRecord *&rec)
+PkgList AptIntf::getPackages(PkBitfield filters)
 {
     pk_backend_job_set_status(m_job, PK_STATUS_ENUM_QUERY);
 
-    PkgList output;
-    output.reserve(m_cache->GetPkgCache()->HeaderP->PackageCount);
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
+    PackagesScan scan(*m_cache);
+    scan.setFilters(filters, m_isMultiArch);
+    return scan.run(&m_cancel);
+}
 
-        // Ignore packages that exist only due to dependencies.
-        if(pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
-        }
+// the installed packages that come from a repository
+class RepoScan : public AptParallelScan
+{
+public:
+    RepoScan(AptCacheFile &cache, SourcesList::SourceRecord *rec) :
+        AptParallelScan(cache),
+        m_rec(rec)
+    {
+    }
 
+protected:
+    AptParallelScan* clone() const { return new RepoScan(m_cache, m_rec); }
+
+    void scan(const pkgCache::PkgIterator &pkg, PkgList &output)
+    {
         // Don't insert virtual packages as they don't have all kinds of info
-        const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
+        const pkgCache::VerIterator &ver = m_cache.findVer(pkg);
         if (ver.end()) {
-            continue;
+            return;
         }
 
         // only installed packages matters
         if (!(pkg->CurrentState == pkgCache::State::Installed && pkg.CurrentVer() == ver)) {
-            continue;
+            return;
         }
 
         // Distro name
         pkgCache::VerFileIterator vf = ver.FileList();
-        if (vf.File().Archive() == NULL || rec->Dist.compare(vf.File().Archive()) != 0){
-            continue;
+        if (vf.File().Archive() == NULL || m_rec->Dist.compare(vf.File().Archive()) != 0){
+            return;
         }
 
         // Section part
-        if (vf.File().Component() == NULL || !rec->hasSection(vf.File().Component())) {
-            continue;
+        if (vf.File().Component() == NULL || !m_rec->hasSection(vf.File().Component())) {
+            return;
         }
 
         // Check if the site the package comes from is include in the Repo uri
-        if (vf.File().Site() == NULL || rec->URI.find(vf.File().Site()) == std::string::npos) {
-            continue;
+        if (vf.File().Site() == NULL || m_rec->URI.find(vf.File().Site()) == std::string::npos) {
+            return;
         }
 
 //         cout << endl;
@@ -1116,7 +1081,17 @@ PkgList AptIntf::getPackagesFromRepo(SourcesList::SourceRecord *&rec)
 
         output.push_back(ver);
     }
-    return output;
+
+private:
+    SourcesList::SourceRecord *m_rec;
+};
+
+PkgList AptIntf::getPackagesFromRepo(SourcesList::SourceRecord *&rec)
+{
+    pk_backend_job_set_status(m_job, PK_STATUS_ENUM_QUERY);
+
+    RepoScan scan(*m_cache, rec);
+    return scan.run(&m_cancel);
 }
 
 PkgList AptIntf::getPackagesFromGroup(gchar **values)
@@ -1142,7 +1117,7 @@ PkgList AptIntf::getPackagesFromGroup(gchar **values)
     pk_backend_job_set_allow_cancel(m_job, true);
 
     for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
         // Ignore packages that exist only due to dependencies.
@@ -1173,50 +1148,61 @@ PkgList AptIntf::getPackagesFromGroup(gchar **values)
     return output;
 }
 
-PkgList AptIntf::searchPackageName(gchar *search)
+// Don't insert virtual packages instead add what they provide
+static void addProviders(AptCacheFile &cache, const pkgCache::PkgIterator &pkg, PkgList &output)
 {
-    PkgList output;
+    // iterate over the provides list
+    for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
+        const pkgCache::VerIterator &ownerVer = cache.findVer(Prv.OwnerPkg());
 
-    Matcher *matcher = new Matcher(search);
-    if (matcher->hasError()) {
-        g_debug("Regex compilation error");
-        delete matcher;
-        return output;
+        // check to see if the provided package isn't virtual too
+        if (ownerVer.end() == false) {
+            // we add the package now because we will need to
+            // remove duplicates later anyway
+            output.push_back(ownerVer);
+        }
     }
+}
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
-        // Ignore packages that exist only due to dependencies.
-        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
-        }
+// the packages whose name, or if details is set whose long description,
+// matches; each copy compiles its own regexes as regexec() locks them
+class SearchScan : public AptParallelScan
+{
+public:
+    SearchScan(AptCacheFile &cache, const string &search, bool details) :
+        AptParallelScan(cache),
+        m_search(search),
+        m_details(details),
+        m_matcher(search)
+    {
+    }
 
-        if (matcher->matches(pkg.Name())) {
-            // Don't insert virtual packages instead add what it provides
-            const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
-            if (ver.end() == false) {
-                output.push_back(ver);
-            } else {
-                // iterate over the provides list
-                for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
-                    const pkgCache::VerIterator &ownerVer = m_cache->findVer(Prv.OwnerPkg());
+protected:
+    AptParallelScan* clone() const { return new SearchScan(m_cache, m_search, m_details); }
 
-                    // check to see if the provided package isn't virtual too
-                    if (ownerVer.end() == false) {
-                        // we add the package now because we will need to
-                        // remove duplicates later anyway
-                        output.push_back(ownerVer);
-                    }
-                }
+    void scan(const pkgCache::PkgIterator &pkg, PkgList &output)
+    {
+        const pkgCache::VerIterator &ver = m_cache.findVer(pkg);
+        if (ver.end() == false) {
+            if (m_matcher.matches(pkg.Name()) ||
+                    (m_details &&
+                     m_matcher.matches(AptCacheFile::getLongDescription(ver, records())))) {
+                // The package matched
+                output.push_back(ver);
             }
+        } else if (m_matcher.matches(pkg.Name())) {
+            // The package is virtual and MATCHED the name
+            addProviders(m_cache, pkg, output);
         }
     }
-    return output;
-}
 
-PkgList AptIntf::searchPackageDetails(gchar *search)
+private:
+    string m_search;
+    bool m_details;
+    Matcher m_matcher;
+};
+
+PkgList AptIntf::searchPackageName(gchar *search, PkBitfield filters)
 {
     PkgList output;
 
@@ -1227,98 +1213,62 @@ PkgList AptIntf::searchPackageDetails(gchar *search)
         return output;
     }
 
-    for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-        if (m_cancel) {
-            break;
-        }
-        // Ignore packages that exist only due to dependencies.
-        if (pkg.VersionList().end() && pkg.ProvidesList().end()) {
-            continue;
-        }
-
-        const pkgCache::VerIterator &ver = m_cache->findVer(pkg);
-        if (ver.end() == false) {
-            if (matcher->matches(pkg.Name()) ||
-                    matcher->matches((*m_cache).getLongDescription(ver))) {
-                // The package matched
-                output.push_back(ver);
-            }
-        } else if (matcher->matches(pkg.Name())) {
-            // The package is virtual and MATCHED the name
-            // Don't insert virtual packages instead add what it provides
-
-            // iterate over the provides list
-            for (pkgCache::PrvIterator Prv = pkg.ProvidesList(); Prv.end() == false; ++Prv) {
-                const pkgCache::VerIterator &ownerVer = m_cache->findVer(Prv.OwnerPkg());
-
-                // check to see if the provided package isn't virtual too
-                if (ownerVer.end() == false) {
-                    // we add the package now because we will need to
-                    // remove duplicates later anyway
-                    output.push_back(ownerVer);
-                }
-            }
-        }
+    // the shared cache has the names ready to search
+    AptSearchIndex *index = m_cache->searchIndex();
+    if (index) {
+        index->search(*matcher, false, *m_cache, output, &m_cancel);
+        delete matcher;
+        return output;
     }
-    return output;
+    delete matcher;
+
+    SearchScan scan(*m_cache, search, false);
+    scan.setFilters(filters, m_isMultiArch);
+    return scan.run(&m_cancel);
 }
 
-// used to return files it reads, using the info from the files in /var/lib/dpkg/info/
-PkgList AptIntf::searchPackageFiles(gchar **values)
+PkgList AptIntf::searchPackageDetails(gchar *search, PkBitfield filters)
 {
     PkgList output;
-    vector<string> packages;
-    regex_t re;
-    gchar *search;
-    gchar *values_str;
 
-    values_str = g_strjoinv("$|^", values);
-    search = g_strdup_printf("^%s$",
-                             values_str);
-    g_free(values_str);
-    if(regcomp(&re, search, REG_NOSUB) != 0) {
+    Matcher *matcher = new Matcher(search);
+    if (matcher->hasError()) {
         g_debug("Regex compilation error");
-        g_free(search);
+        delete matcher;
         return output;
     }
-    g_free(search);
 
-    DIR *dp;
-    struct dirent *dirp;
-    if (!(dp = opendir("/var/lib/dpkg/info/"))) {
-        g_debug ("Error opening /var/lib/dpkg/info/\n");
-        regfree(&re);
+    // the shared cache has the descriptions ready to search, so there
+    // is no need to look up the records of every package
+    AptSearchIndex *index = m_cache->searchIndex();
+    if (index) {
+        index->search(*matcher, true, *m_cache, output, &m_cancel);
+        delete matcher;
         return output;
     }
+    delete matcher;
 
-    string line;
-    while ((dirp = readdir(dp)) != NULL) {
-        if (m_cancel) {
-            break;
-        }
-        if (ends_with(dirp->d_name, ".list")) {
-            string f = "/var/lib/dpkg/info/" + string(dirp->d_name);
-            ifstream in(f.c_str());
-            if (!in != 0) {
-                continue;
-            }
-            while (!in.eof()) {
-                getline(in, line);
-                if (regexec(&re, line.c_str(), (size_t)0, NULL, 0) == 0) {
-                    string file(dirp->d_name);
-                    packages.push_back(file.erase(file.size() - 5, file.size()));
-                    break;
-                }
-            }
-        }
+    SearchScan scan(*m_cache, search, true);
+    scan.setFilters(filters, m_isMultiArch);
+    return scan.run(&m_cancel);
+}
+
+// used to return the packages owning the files, using the index of /var/lib/dpkg/info/
+PkgList AptIntf::searchPackageFiles(gchar **values)
+{
+    PkgList output;
+    vector<string> packages;
+
+    AptFileIndex *index = fileIndex();
+    if (index == 0) {
+        return output;
     }
-    closedir(dp);
-    regfree(&re);
+    index->search(values, packages, &m_cancel);
 
     // Resolve the package names now
     for (vector<string>::const_iterator it = packages.begin();
         it != packages.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
         const pkgCache::PkgIterator &pkg = (*m_cache)->FindPkg(*it);
@@ -1395,7 +1345,7 @@ void AptIntf::providesMimeType(PkgList &output, gchar **values)
     vector<string> packages;
     string line;
     while ((dirp = readdir(dp)) != NULL) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
         if (ends_with(dirp->d_name, ".desktop")) {
@@ -1429,7 +1379,7 @@ void AptIntf::providesMimeType(PkgList &output, gchar **values)
     // resolve the package names
     for (vector<string>::const_iterator it = packages.begin();
          it != packages.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
         const pkgCache::PkgIterator &pkg = (*m_cache)->FindPkg(*it);
@@ -1459,131 +1409,38 @@ void AptIntf::providesMimeType(PkgList &output, gchar **values)
     }
 }
 
-bool AptIntf::isApplication(const pkgCache::VerIterator &ver)
-{
-    bool ret = false;
-    gchar *fileName;
-    string line;
-
-    if (m_isMultiArch) {
-        fileName = g_strdup_printf("/var/lib/dpkg/info/%s:%s.list",
-                                   ver.ParentPkg().Name(),
-                                   ver.Arch());
-        if (!FileExists(fileName)) {
-            g_free(fileName);
-            // if the file was not found try without the arch field
-            fileName = g_strdup_printf("/var/lib/dpkg/info/%s.list",
-                                       ver.ParentPkg().Name());
-        }
-    } else {
-        fileName = g_strdup_printf("/var/lib/dpkg/info/%s.list",
-                                   ver.ParentPkg().Name());
-    }
-
-    if (FileExists(fileName)) {
-        ifstream in(fileName);
-        if (!in != 0) {
-            g_free(fileName);
-            return false;
-        }
-
-        while (in.eof() == false) {
-            getline(in, line);
-            if (ends_with(line, ".desktop")) {
-                ret = true;
-                break;
-            }
-        }
-    }
-
-    g_free(fileName);
-    return ret;
-}
-
-// used to emit files it reads the info directly from the files
+// used to emit files it reads the info from the index of the .list files
 void AptIntf::emitPackageFiles(const gchar *pi)
 {
     GPtrArray *files;
-    string line;
     gchar **parts;
 
-    parts = pk_package_id_split(pi);
-
-    string fName;
-    if (m_isMultiArch) {
-        fName = "/var/lib/dpkg/info/" +
-                string(parts[PK_PACKAGE_ID_NAME]) +
-                ":" +
-                string(parts[PK_PACKAGE_ID_ARCH]) +
-                ".list";
-        if (!FileExists(fName)) {
-            // if the file was not found try without the arch field
-            fName = "/var/lib/dpkg/info/" +
-                    string(parts[PK_PACKAGE_ID_NAME]) +
-                    ".list";
-        }
-    } else {
-        fName = "/var/lib/dpkg/info/" +
-                string(parts[PK_PACKAGE_ID_NAME]) +
-                ".list";
+    AptFileIndex *index = fileIndex();
+    if (index == 0) {
+        return;
     }
-    g_strfreev (parts);
 
-    if (FileExists(fName)) {
-        ifstream in(fName.c_str());
-        if (!in != 0) {
-            return;
-        }
-
-        files = g_ptr_array_new_with_free_func(g_free);
-        while (in.eof() == false) {
-            getline(in, line);
-            if (!line.empty()) {
-                g_ptr_array_add(files, g_strdup(line.c_str()));
-            }
-        }
+    parts = pk_package_id_split(pi);
+    files = g_ptr_array_new_with_free_func(g_free);
+    index->files(parts[PK_PACKAGE_ID_NAME],
+                 m_isMultiArch ? parts[PK_PACKAGE_ID_ARCH] : 0,
+                 files);
+    g_strfreev(parts);
 
-        if (files->len) {
-            g_ptr_array_add(files, NULL);
-            pk_backend_job_files(m_job, pi, (gchar **) files->pdata);
-        }
-        g_ptr_array_unref(files);
+    if (files->len) {
+        g_ptr_array_add(files, NULL);
+        pk_backend_job_files(m_job, pi, (gchar **) files->pdata);
     }
+    g_ptr_array_unref(files);
 }
 
-/**
-  * Check if package is officially supported by the current distribution
-  */
-bool AptIntf::packageIsSupported(const pkgCache::VerIterator &verIter, string component)
+AptFileIndex* AptIntf::fileIndex()
 {
-    string origin;
-    if (!verIter.end()) {
-        pkgCache::VerFileIterator vf = verIter.FileList();
-        origin = vf.File().Origin() == NULL ? "" : vf.File().Origin();
-    }
-
-    if (component.empty()) {
-        component = "main";
+    // keep the same index for the whole job
+    if (m_fileIndex == 0) {
+        m_fileIndex = AptFileIndex::ref();
     }
-
-    // Get a fetcher
-    AcqPackageKitStatus Stat(this, m_job);
-    pkgAcquire fetcher;
-    fetcher.Setup(&Stat);
-
-    PkBitfield flags = pk_backend_job_get_transaction_flags(m_job);
-    bool trusted = checkTrusted(fetcher, flags);
-
-    if ((origin.compare("Debian") == 0) || (origin.compare("Ubuntu") == 0))  {
-        if ((component.compare("main") == 0 ||
-             component.compare("restricted") == 0 ||
-             component.compare("unstable") == 0 ||
-             component.compare("testing") == 0) && trusted) {
-            return true;
-        }
-    }
-
-    return false;
+    return m_fileIndex;
 }
 
 bool AptIntf::checkTrusted(pkgAcquire &fetcher, PkBitfield flags)
@@ -1746,7 +1603,7 @@ void AptIntf::updateInterface(int fd, int writeFd)
         m_lastTermAction = time(NULL);
 
         if( buf[0] == '\n') {
-            if (m_cancel) {
+            if (cancelled()) {
                 kill(m_child_pid, SIGTERM);
             }
             //cout << "got line: " << line << endl;
@@ -2062,7 +1919,7 @@ PkgList AptIntf::resolvePackageIds(gchar **package_ids, PkBitfield filters)
     }
 
     for (uint i = 0; i < g_strv_length(package_ids); ++i) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -2077,7 +1934,7 @@ PkgList AptIntf::resolvePackageIds(gchar **package_ids, PkBitfield filters)
                 // search the whole package cache and match the package
                 // name manually
                 for (pkgCache::PkgIterator pkg = m_cache->GetPkgCache()->PkgBegin(); !pkg.end(); ++pkg) {
-                    if (m_cancel) {
+                    if (cancelled()) {
                         break;
                     }
 
@@ -2164,7 +2021,7 @@ void AptIntf::refreshCache()
 void AptIntf::markAutoInstalled(const PkgList &pkgs)
 {
     for (PkgList::const_iterator it = pkgs.begin(); it != pkgs.end(); ++it) {
-        if (m_cancel) {
+        if (cancelled()) {
             break;
         }
 
@@ -2391,7 +2248,7 @@ bool AptIntf::runTransaction(const PkgList &install, const PkgList &remove, bool
     {
         pkgDepCache::ActionGroup group(*m_cache);
         for (PkgList::const_iterator it = install.begin(); it != install.end(); ++it) {
-            if (m_cancel) {
+            if (cancelled()) {
                 break;
             }
 
@@ -2401,7 +2258,7 @@ bool AptIntf::runTransaction(const PkgList &install, const PkgList &remove, bool
         }
 
         for (PkgList::const_iterator it = remove.begin(); it != remove.end(); ++it) {
-            if (m_cancel) {
+            if (cancelled()) {
                 break;
             }
 
@@ -2560,7 +2417,7 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
 
     // Download and check if we can continue
     if (fetcher.Run() != pkgAcquire::Continue
-            && m_cancel == false) {
+            && !cancelled()) {
         // We failed and we did not cancel
         show_errors(m_job, PK_ERROR_ENUM_PACKAGE_DOWNLOAD_FAILED);
         return false;
@@ -2577,7 +2434,7 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
     }
 
     // Check if the user canceled
-    if (m_cancel) {
+    if (cancelled()) {
         return true;
     }
 
@@ -2619,6 +2476,7 @@ bool AptIntf::installPackages(PkBitfield flags, bool autoremove)
         close(readFromChildFD[0]);
 
         // Change the locale to not get libapt localization
+        uselocale(LC_GLOBAL_LOCALE);
         setlocale(LC_ALL, "C");
 
         // Debconf handlying
@@ -25,6 +25,7 @@
 
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <locale.h>
 
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/acquire.h>
@@ -41,6 +42,7 @@
 class pkgProblemResolver;
 class Matcher;
 class AptCacheFile;
+class AptFileIndex;
 class AptIntf
 {
 public:
@@ -51,6 +53,9 @@ public:
     void cancel();
     bool cancelled() const;
 
+    /**
+     * Finishes the job, this must be called from the thread running it
+     */
     void emitFinished();
 
     /**
@@ -113,9 +118,10 @@ public:
                      bool recursive);
 
     /**
-      * Returns a list of all packages in the cache
+      * Returns a list of all packages in the cache, the ones not
+      * matching @filters may already be left out
       */
-    PkgList getPackages();
+    PkgList getPackages(PkBitfield filters);
 
     /**
       * Returns a list of all packages in the cache
@@ -128,14 +134,16 @@ public:
     PkgList getPackagesFromGroup(gchar **values);
 
     /**
-      * Returns a list of all packages that matched their names with matcher
+      * Returns a list of all packages that matched their names with matcher,
+      * the ones not matching @filters may already be left out
       */
-    PkgList searchPackageName(gchar *search);
+    PkgList searchPackageName(gchar *search, PkBitfield filters);
 
     /**
-      * Returns a list of all packages that matched their description with matcher
+      * Returns a list of all packages that matched their description with matcher,
+      * the ones not matching @filters may already be left out
       */
-    PkgList searchPackageDetails(gchar *search);
+    PkgList searchPackageDetails(gchar *search, PkBitfield filters);
 
     /**
       * Returns a list of all packages that matched contains the given files
@@ -223,9 +231,10 @@ public:
     bool installFile(const gchar *path, bool simulate);
 
     /**
-     *  Check which package provides the codec
+     *  Check which package provides the codec, the ones not matching
+     *  @filters may already be left out
      */
-    void providesCodec(PkgList &output, gchar **values);
+    void providesCodec(PkgList &output, gchar **values, PkBitfield filters);
 
     /**
      *  Check which package provides a shared library
@@ -246,9 +255,9 @@ public:
     AptCacheFile* aptCacheFile() const;
 
 private:
+    PkBitfield jobFilters() const;
     bool checkTrusted(pkgAcquire &fetcher, PkBitfield flags);
-    bool packageIsSupported(const pkgCache::VerIterator &verIter, string component);
-    bool isApplication(const pkgCache::VerIterator &verIter);
+    AptFileIndex* fileIndex();
 
     /**
      *  interprets dpkg status fd
@@ -258,8 +267,9 @@ private:
     pkgCache::VerIterator findTransactionPackage(const std::string &name);
 
     AptCacheFile *m_cache;
+    AptFileIndex *m_fileIndex;
     PkBackendJob  *m_job;
-    bool       m_cancel;
+    volatile gint m_cancel;
     struct stat m_restartStat;
 
     bool m_isMultiArch;
@@ -274,6 +284,10 @@ private:
     // when the internal terminal timesout after no activity
     int m_terminalTimeout;
     pid_t m_child_pid;
+
+    // the locale of the job, only used by the thread running it
+    locale_t m_locale;
+    locale_t m_oldLocale;
 };
 
 #endif
@@ -55,11 +55,16 @@ bool string_matches(const char *s, regex_t &pattern_nogroup)
 }
 
 bool Matcher::matches(const string &s)
+{
+    return matches(s.c_str());
+}
+
+bool Matcher::matches(const char *s)
 {
     int matchesCount = 0;
     for (vector<regex_t>::iterator i=m_matches.begin();
          i != m_matches.end(); ++i) {
-        if (string_matches(s.c_str(), *i)) {
+        if (string_matches(s, *i)) {
             matchesCount++;
         }
     }
@@ -110,6 +115,7 @@ bool Matcher::parse_pattern(string::const_iterator &start,
         regex_t pattern_nogroup;
         if (do_compile(subString, pattern_nogroup, REG_ICASE|REG_EXTENDED|REG_NOSUB)) {
             m_matches.push_back(pattern_nogroup);
+            m_terms.push_back(subString);
         } else {
             regfree(&pattern_nogroup);
             m_error = string("Regex compilation error");
@@ -233,3 +239,8 @@ bool Matcher::hasError() const
 {
     return m_hasError;
 }
+
+const vector<string>& Matcher::terms() const
+{
+    return m_terms;
+}
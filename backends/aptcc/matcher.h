@@ -37,9 +37,15 @@ public:
     ~Matcher();
 
     bool matches(const string &s);
+    bool matches(const char *s);
     bool matchesFile(const string &s, map<int, bool> &matchers_used);
     bool hasError() const;
 
+    /**
+      * The terms that must all match, before they are compiled
+      */
+    const vector<string>& terms() const;
+
 private:
     bool m_hasError;
     string m_error;
@@ -50,6 +56,7 @@ private:
     string parse_literal_string_tail(string::const_iterator &start,
                                      const string::const_iterator end);
     vector<regex_t> m_matches;
+    vector<string> m_terms;
 };
 
 #endif
@@ -30,6 +30,8 @@
 
 #include "apt-intf.h"
 #include "AptCacheFile.h"
+#include "AptFileIndex.h"
+#include "AptSharedCache.h"
 #include "apt-messages.h"
 #include "acqpkitstatus.h"
 #include "apt-sourceslist.h"
@@ -59,8 +61,27 @@ const gchar* pk_backend_get_author(PkBackend *backend)
 gboolean
 pk_backend_supports_parallelization (PkBackend *backend)
 {
-	// we need to set this to TRUE as soon as the parallelization work is completed!
-	return FALSE;
+	// queries share one read-only cache, and the lock classes keep
+	// anything that writes away from them
+	return TRUE;
+}
+
+/**
+ * pk_backend_get_lock_class:
+ */
+PkBackendLockClass
+pk_backend_get_lock_class (PkBackend *backend, PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+		// the changelogs are downloaded using the proxy set in the
+		// environment, which is shared by all the jobs
+	case PK_ROLE_ENUM_GET_DISTRO_UPGRADES:
+		// there is only one spawn, which runs one helper at a time
+		return PK_BACKEND_LOCK_CLASS_DB_WRITE;
+	default:
+		return pk_backend_get_default_lock_class (role);
+	}
 }
 
 /**
@@ -100,6 +121,9 @@ void pk_backend_initialize(GKeyFile *conf, PkBackend *backend)
 void pk_backend_destroy(PkBackend *backend)
 {
     g_debug("APTcc being destroyed");
+
+    AptSharedCache::invalidate();
+    AptFileIndex::invalidate();
 }
 
 /**
@@ -474,7 +498,7 @@ static void backend_what_provides_thread(PkBackendJob *job, GVariant *params, gp
 
     PkgList output;
     apt->providesLibrary(output, values);
-    apt->providesCodec(output, values);
+    apt->providesCodec(output, values, filters);
     apt->providesMimeType(output, values);
 
     // It's faster to emit the packages here rather than in the matching part
@@ -797,9 +821,9 @@ static void backend_search_package_thread(PkBackendJob *job, GVariant *params, g
     PkgList output;
     role = pk_backend_job_get_role(job);
     if (role == PK_ROLE_ENUM_SEARCH_DETAILS) {
-        output = apt->searchPackageDetails(search);
+        output = apt->searchPackageDetails(search, filters);
     } else {
-        output = apt->searchPackageName(search);
+        output = apt->searchPackageName(search, filters);
     }
     g_free(search);
 
@@ -1199,7 +1223,7 @@ static void backend_get_packages_thread(PkBackendJob *job, GVariant *params, gpo
     }
 
     PkgList output;
-    output = apt->getPackages();
+    output = apt->getPackages(filters);
 
     // It's faster to emmit the packages rather here than in the matching part
     apt->emitPackages(output, filters);
@@ -907,19 +907,20 @@ zypp_get_package_by_id (const gchar *package_id)
 		return sat::Solvable::noSolvable;
 	}
 
-	gchar **id_parts = pk_package_id_split(package_id);
-	const gchar *arch = id_parts[PK_PACKAGE_ID_ARCH];
-	if (!arch)
-		arch = "noarch";
-	bool want_source = !g_strcmp0 (arch, "source");
+	// the view points into package_id, so nothing is allocated per lookup
+	PkPackageIdView id_view;
+	pk_package_id_view_init (&id_view, package_id);
+	bool want_source = pk_package_id_view_arch_equal (&id_view, "source");
+	bool want_installed = id_view.data_len >= 9 && !strncmp (id_view.data, "installed", 9);
+	const string name (id_view.name, id_view.name_len);
 	
 	sat::Solvable package;
 
 	ResPool pool = ResPool::instance();
 
 	// Iterate over the resolvables and mark the one we want to check its dependencies
-	for (ResPool::byName_iterator it = pool.byNameBegin (id_parts[PK_PACKAGE_ID_NAME]);
-	     it != pool.byNameEnd (id_parts[PK_PACKAGE_ID_NAME]); ++it) {
+	for (ResPool::byName_iterator it = pool.byNameBegin (name);
+	     it != pool.byNameEnd (name); ++it) {
 		
 		sat::Solvable pkg = it->satSolvable();
 		//MIL << "match " << package_id << " " << pkg << endl;
@@ -929,27 +930,27 @@ zypp_get_package_by_id (const gchar *package_id)
 			continue;
 		}
 
-		if (!want_source && (isKind<SrcPackage>(pkg) || g_strcmp0 (pkg.arch().c_str(), arch))) {
+		if (!want_source && (isKind<SrcPackage>(pkg) || !pk_package_id_view_arch_equal (&id_view, pkg.arch().c_str()))) {
 			//MIL << "not a matching arch\n";
 			continue;
 		}
 
 		const string &ver = pkg.edition ().asString();
-		if (g_strcmp0 (ver.c_str (), id_parts[PK_PACKAGE_ID_VERSION])) {
+		if (ver.compare (0, string::npos, id_view.version, id_view.version_len)) {
 			//MIL << "not a matching version\n";
 			continue;
 		}
 
 		if (!pkg.isSystem()) {
-			if (!strncmp(id_parts[PK_PACKAGE_ID_DATA], "installed", 9)) {
+			if (want_installed) {
 				//MIL << "pkg is not installed\n";
 				continue;
 			}
-			if (g_strcmp0(pkg.repository().alias().c_str(), id_parts[PK_PACKAGE_ID_DATA])) {
+			if (pkg.repository().alias().compare (0, string::npos, id_view.data, id_view.data_len)) {
 				//MIL << "repo does not match\n";
 				continue;
 			}
-		} else if (strncmp(id_parts[PK_PACKAGE_ID_DATA], "installed", 9)) {
+		} else if (!want_installed) {
 			//MIL << "pkg installed\n";
 			continue;
 		}
@@ -959,7 +960,6 @@ zypp_get_package_by_id (const gchar *package_id)
 		break;
 	}
 
-	g_strfreev (id_parts);
 	return package;
 }
 
@@ -1649,6 +1649,15 @@ pk_backend_supports_parallelization (PkBackend *backend)
         return FALSE;
 }
 
+/**
+ * libzypp keeps its pool and target state in the thread that created it
+ */
+PkBackendThreadAffinity
+pk_backend_get_thread_affinity (PkBackend *backend)
+{
+	return PK_BACKEND_THREAD_AFFINITY_SINGLE;
+}
+
 
 /**
  * pk_backend_get_description:
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Copyright (C) 2014 Richard Hughes <richard@hughsie.com>
+# Licensed under the GNU General Public License Version 2
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+# writes one frame, with a little endian length in front
+frame () {
+	len=$(printf "$1" | wc -c)
+	printf "\\$(printf %03o $((len & 255)))\\$(printf %03o $((len >> 8 & 255)))\\000\\000"
+	printf "$1"
+}
+
+# helpers start off in text, and then switch over
+printf "percentage\t0\n"
+printf "framed\n"
+frame 'package\000available\000polkit;0.0.1;i386;data\000PolicyKit daemon\000'
+frame 'finished\000'
@@ -0,0 +1,13 @@
+#!/bin/sh
+# Copyright (C) 2014 Richard Hughes <richard@hughsie.com>
+# Licensed under the GNU General Public License Version 2
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+
+# as many lines as a large search, written as fast as possible
+awk 'BEGIN {
+	for (i = 1; i <= 100000; i++)
+		printf "package\tavailable\tpolkit;0.0.%i;i386;data\tPolicyKit daemon\n", i
+}'
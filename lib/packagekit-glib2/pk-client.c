@@ -31,10 +31,18 @@
 
 #include "config.h"
 
+/* for the file sealing API */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib-object.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include <packagekit-glib2/pk-client.h>
 #include <packagekit-glib2/pk-client-helper.h>
@@ -65,7 +73,11 @@ struct _PkClientPrivate
 	gboolean		 background;
 	gboolean		 interactive;
 	gboolean		 idle;
+	gboolean		 accumulate;
 	guint			 cache_age;
+	PkClientPackageCallback	 package_callback;
+	gpointer		 package_user_data;
+	GDestroyNotify		 package_destroy_func;
 };
 
 enum {
@@ -75,6 +87,7 @@ enum {
 	PROP_INTERACTIVE,
 	PROP_IDLE,
 	PROP_CACHE_AGE,
+	PROP_ACCUMULATE,
 	PROP_LAST
 };
 
@@ -88,6 +101,7 @@ typedef struct {
 	PkBitfield			 transaction_flags;
 	gboolean			 recursive;
 	gboolean			 ret;
+	gboolean			 results_fd;
 	gchar				*directory;
 	gchar				*eula_id;
 	gchar				**files;
@@ -174,6 +188,9 @@ pk_client_get_property (GObject *object, guint prop_id, GValue *value, GParamSpe
 	case PROP_CACHE_AGE:
 		g_value_set_uint (value, priv->cache_age);
 		break;
+	case PROP_ACCUMULATE:
+		g_value_set_boolean (value, priv->accumulate);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -203,6 +220,9 @@ pk_client_set_property (GObject *object, guint prop_id, const GValue *value, GPa
 	case PROP_CACHE_AGE:
 		priv->cache_age = g_value_get_uint (value);
 		break;
+	case PROP_ACCUMULATE:
+		priv->accumulate = g_value_get_boolean (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -775,26 +795,20 @@ pk_client_signal_package (PkClientState *state,
 {
 	gboolean ret;
 	GError *error = NULL;
-	PkPackage *package;
+	PkClientPrivate *priv = state->client->priv;
+	PkPackage *package = NULL;
+
+	if (info_enum != PK_INFO_ENUM_FINISHED) {
+		/* let the caller process the row before it is stored, if at all */
+		if (priv->package_callback != NULL) {
+			priv->package_callback (info_enum, package_id, summary,
+						priv->package_user_data);
+		}
 
-	/* create virtual package */
-	package = pk_package_new ();
-	ret = pk_package_set_id (package, package_id, &error);
-	if (!ret) {
-		g_warning ("failed to set package id for %s", package_id);
-		g_error_free (error);
-		goto out;
+		/* add to results, the object is only created if it is needed */
+		if (state->results != NULL && priv->accumulate)
+			pk_results_add_package_data (state->results, info_enum, package_id, summary);
 	}
-	g_object_set (package,
-		      "info", info_enum,
-		      "summary", summary,
-		      "role", state->role,
-		      "transaction-id", state->transaction_id,
-		      NULL);
-
-	/* add to results */
-	if (state->results != NULL && info_enum != PK_INFO_ENUM_FINISHED)
-		pk_results_add_package (state->results, package);
 
 	/* only emit progress for verb packages */
 	switch (info_enum) {
@@ -809,6 +823,20 @@ pk_client_signal_package (PkClientState *state,
 	case PK_INFO_ENUM_PREPARING:
 	case PK_INFO_ENUM_DECOMPRESSING:
 	case PK_INFO_ENUM_FINISHED:
+		/* create virtual package */
+		package = pk_package_new ();
+		ret = pk_package_set_id (package, package_id, &error);
+		if (!ret) {
+			g_warning ("failed to set package id for %s", package_id);
+			g_error_free (error);
+			goto out;
+		}
+		g_object_set (package,
+			      "info", info_enum,
+			      "summary", summary,
+			      "role", state->role,
+			      "transaction-id", state->transaction_id,
+			      NULL);
 		ret = pk_progress_set_package_id (state->progress, package_id);
 		if (state->progress_callback != NULL && ret) {
 			state->progress_callback (state->progress,
@@ -826,7 +854,8 @@ pk_client_signal_package (PkClientState *state,
 		break;
 	}
 out:
-	g_object_unref (package);
+	if (package != NULL)
+		g_object_unref (package);
 }
 
 /**
@@ -1051,6 +1080,122 @@ out:
 		g_ptr_array_unref (array);
 }
 
+/**
+ * pk_client_get_results_fd_cb:
+ **/
+static void
+pk_client_get_results_fd_cb (GObject *source_object,
+			     GAsyncResult *res,
+			     gpointer user_data)
+{
+	gchar **files;
+	gchar *package_id;
+	gboolean sealed = FALSE;
+	gint fd = -1;
+	gint idx;
+#ifdef F_GET_SEALS
+	gint seals;
+#endif
+	GDBusProxy *proxy = G_DBUS_PROXY (source_object);
+	GError *error = NULL;
+	GMappedFile *mapped = NULL;
+	GUnixFDList *fd_list = NULL;
+	GVariantIter iter;
+	GVariant *files_array = NULL;
+	GVariant *packages = NULL;
+	GVariant *results = NULL;
+	GVariant *value;
+	PkClientState *state = (PkClientState *) user_data;
+	PkFiles *item;
+
+	/* get the result */
+	value = g_dbus_proxy_call_with_unix_fd_list_finish (proxy, &fd_list, res, &error);
+	if (value == NULL) {
+		/* the client cancelled the request */
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+			pk_client_state_finish (state, error);
+			goto out;
+		}
+
+		/* the daemon sent the results as signals instead */
+		g_debug ("no results file: %s", error->message);
+		goto finished;
+	}
+	g_variant_get (value, "(h)", &idx);
+	fd = g_unix_fd_list_get (fd_list, idx, &error);
+	if (fd < 0) {
+		g_warning ("failed to get results file: %s", error->message);
+		goto finished;
+	}
+
+	/* only use the data in place if it can never change under us */
+#ifdef F_GET_SEALS
+	seals = fcntl (fd, F_GET_SEALS);
+	if (seals >= 0)
+		sealed = (seals & (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW)) ==
+			 (F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW);
+#endif
+	if (!sealed) {
+		error = g_error_new (PK_CLIENT_ERROR,
+				     PK_CLIENT_ERROR_FAILED,
+				     "The results file is not sealed");
+		pk_client_state_finish (state, error);
+		goto out;
+	}
+	mapped = g_mapped_file_new_from_fd (fd, FALSE, &error);
+	if (mapped == NULL) {
+		g_warning ("failed to map results file: %s", error->message);
+		goto finished;
+	}
+	results = g_variant_new_from_data (G_VARIANT_TYPE ("(a(uss)a(sas))"),
+					   g_mapped_file_get_contents (mapped),
+					   g_mapped_file_get_length (mapped),
+					   FALSE,
+					   (GDestroyNotify) g_mapped_file_unref,
+					   mapped);
+	g_variant_ref_sink (results);
+
+	/* the packages are only created if they are actually used, and the
+	 * file is never asked for by callers using a package callback */
+	packages = g_variant_get_child_value (results, 0);
+	pk_results_add_package_variant (state->results, packages);
+
+	/* there are far fewer of these */
+	files_array = g_variant_get_child_value (results, 1);
+	g_variant_iter_init (&iter, files_array);
+	while (g_variant_iter_next (&iter, "(s^as)", &package_id, &files)) {
+		item = pk_files_new ();
+		g_object_set (item,
+			      "package-id", package_id,
+			      "files", files,
+			      "role", state->role,
+			      "transaction-id", state->transaction_id,
+			      NULL);
+		pk_results_add_files (state->results, item);
+		g_object_unref (item);
+		g_free (package_id);
+		g_strfreev (files);
+	}
+finished:
+	state->ret = TRUE;
+	pk_client_state_finish (state, NULL);
+out:
+	if (error != NULL)
+		g_error_free (error);
+	if (fd >= 0)
+		close (fd);
+	if (files_array != NULL)
+		g_variant_unref (files_array);
+	if (packages != NULL)
+		g_variant_unref (packages);
+	if (results != NULL)
+		g_variant_unref (results);
+	if (fd_list != NULL)
+		g_object_unref (fd_list);
+	if (value != NULL)
+		g_variant_unref (value);
+}
+
 /**
  * pk_client_signal_finished:
  */
@@ -1095,6 +1240,22 @@ pk_client_signal_finished (PkClientState *state,
 		goto out;
 	}
 
+	/* the bulk of the results are waiting for us in a file */
+	if (exit_enum == PK_EXIT_ENUM_SUCCESS &&
+	    state->results_fd &&
+	    (state->role == PK_ROLE_ENUM_GET_PACKAGES ||
+	     state->role == PK_ROLE_ENUM_GET_FILES ||
+	     state->role == PK_ROLE_ENUM_SEARCH_FILE)) {
+		g_dbus_proxy_call_with_unix_fd_list (state->proxy, "GetResultsFd",
+						     NULL,
+						     G_DBUS_CALL_FLAGS_NONE,
+						     PK_CLIENT_DBUS_METHOD_TIMEOUT,
+						     NULL,
+						     state->cancellable,
+						     pk_client_get_results_fd_cb, state);
+		goto out;
+	}
+
 	/* we're done */
 	state->ret = TRUE;
 	pk_client_state_finish (state, NULL);
@@ -1144,6 +1305,23 @@ pk_client_signal_cb (GDBusProxy *proxy,
 					  tmp_str[2]);
 		return;
 	}
+	if (g_strcmp0 (signal_name, "Packages") == 0) {
+		GVariantIter *iter;
+		g_variant_get (parameters,
+			       "(a(uss))",
+			       &iter);
+		while (g_variant_iter_loop (iter, "(u&s&s)",
+					    &tmp_uint,
+					    &tmp_str[1],
+					    &tmp_str[2])) {
+			pk_client_signal_package (state,
+						  tmp_uint,
+						  tmp_str[1],
+						  tmp_str[2]);
+		}
+		g_variant_iter_free (iter);
+		return;
+	}
 	if (g_strcmp0 (signal_name, "Details") == 0) {
 		gchar *key;
 		GVariantIter *dictionary;
@@ -2119,6 +2297,22 @@ pk_client_get_proxy_cb (GObject *object,
 				pk_client_bool_to_string (state->client->priv->interactive));
 	g_ptr_array_add (array, hint);
 
+	/* we can handle ::Packages */
+	hint = g_strdup ("supports-plural-signals=true");
+	g_ptr_array_add (array, hint);
+
+	/* we can get large results using GetResultsFd(), but only if
+	 * all the packages are wanted at the end rather than one by one,
+	 * and if we can check the file is sealed */
+#ifdef F_GET_SEALS
+	state->results_fd = state->client->priv->accumulate &&
+			    state->client->priv->package_callback == NULL;
+	if (state->results_fd) {
+		hint = g_strdup ("supports-results-fd=true");
+		g_ptr_array_add (array, hint);
+	}
+#endif
+
 	/* cache-age */
 	if (state->client->priv->cache_age > 0) {
 		hint = g_strdup_printf ("cache-age=%u",
@@ -4975,6 +5169,77 @@ pk_client_get_cache_age (PkClient *client)
 	return client->priv->cache_age;
 }
 
+/**
+ * pk_client_set_accumulate:
+ * @client: a valid #PkClient instance
+ * @accumulate: if package results should be stored
+ *
+ * Sets if package results are stored in the #PkResults returned when the
+ * transaction finishes. Clients that process each package using
+ * pk_client_set_package_callback() can turn this off so that very large
+ * result sets are never held in memory.
+ *
+ * File lists are always stored, as there is no callback for them.
+ *
+ * Since: 0.9.6
+ **/
+void
+pk_client_set_accumulate (PkClient *client, gboolean accumulate)
+{
+	g_return_if_fail (PK_IS_CLIENT (client));
+	client->priv->accumulate = accumulate;
+	g_object_notify (G_OBJECT (client), "accumulate");
+}
+
+/**
+ * pk_client_get_accumulate:
+ * @client: a valid #PkClient instance
+ *
+ * Gets if package results are stored in the #PkResults.
+ *
+ * Return value: %TRUE if the package results are stored
+ *
+ * Since: 0.9.6
+ **/
+gboolean
+pk_client_get_accumulate (PkClient *client)
+{
+	g_return_val_if_fail (PK_IS_CLIENT (client), FALSE);
+	return client->priv->accumulate;
+}
+
+/**
+ * pk_client_set_package_callback:
+ * @client: a valid #PkClient instance
+ * @callback: (scope notified): the function to run for each package, or %NULL
+ * @user_data: the data to pass to @callback
+ * @destroy_func: (allow-none): the function to free @user_data, or %NULL
+ *
+ * Sets a function that is called for every package result of every
+ * transaction started by this client, as soon as it is received. While
+ * a callback is set the daemon is asked to send every package as a
+ * signal, rather than in a results file at the end of the transaction.
+ *
+ * Since: 0.9.6
+ **/
+void
+pk_client_set_package_callback (PkClient *client,
+				PkClientPackageCallback callback,
+				gpointer user_data,
+				GDestroyNotify destroy_func)
+{
+	PkClientPrivate *priv;
+
+	g_return_if_fail (PK_IS_CLIENT (client));
+
+	priv = client->priv;
+	if (priv->package_destroy_func != NULL)
+		priv->package_destroy_func (priv->package_user_data);
+	priv->package_callback = callback;
+	priv->package_user_data = user_data;
+	priv->package_destroy_func = destroy_func;
+}
+
 /**
  * pk_client_class_init:
  **/
@@ -5038,6 +5303,16 @@ pk_client_class_init (PkClientClass *klass)
 				   0, G_MAXUINT, 0,
 				   G_PARAM_READWRITE);
 	g_object_class_install_property (object_class, PROP_CACHE_AGE, pspec);
+
+	/**
+	 * PkClient:accumulate:
+	 *
+	 * Since: 0.9.6
+	 */
+	pspec = g_param_spec_boolean ("accumulate", NULL, "if package results are stored in the results",
+				      TRUE,
+				      G_PARAM_READWRITE);
+	g_object_class_install_property (object_class, PROP_ACCUMULATE, pspec);
 }
 
 /**
@@ -5052,6 +5327,7 @@ pk_client_init (PkClient *client)
 	client->priv->interactive = TRUE;
 	client->priv->idle = TRUE;
 	client->priv->cache_age = G_MAXUINT;
+	client->priv->accumulate = TRUE;
 
 	/* use a control object */
 	client->priv->control = pk_control_new ();
@@ -5072,6 +5348,8 @@ pk_client_finalize (GObject *object)
 	/* ensure we cancel any in-flight DBus calls */
 	pk_client_cancel_all_dbus_methods (client);
 
+	if (priv->package_destroy_func != NULL)
+		priv->package_destroy_func (priv->package_user_data);
 	g_free (client->priv->locale);
 	g_object_unref (priv->control);
 	g_ptr_array_unref (priv->calls);
@@ -98,6 +98,23 @@ struct _PkClientClass
 	void (*_pk_reserved5) (void);
 };
 
+/**
+ * PkClientPackageCallback:
+ * @info: the #PkInfoEnum of the package
+ * @package_id: the package ID
+ * @summary: the package summary, or %NULL
+ * @user_data: the data passed to pk_client_set_package_callback()
+ *
+ * Called for each package result as it arrives from the daemon. The
+ * strings are only valid for the duration of the callback.
+ *
+ * Since: 0.9.6
+ */
+typedef void	(*PkClientPackageCallback)		(PkInfoEnum		 info,
+							 const gchar		*package_id,
+							 const gchar		*summary,
+							 gpointer		 user_data);
+
 GQuark		 pk_client_error_quark			(void);
 GType		 pk_client_get_type		  	(void);
 PkClient	*pk_client_new				(void);
@@ -410,6 +427,13 @@ gboolean	 pk_client_get_idle			(PkClient		*client);
 void		 pk_client_set_cache_age		(PkClient		*client,
 							 guint			 cache_age);
 guint		 pk_client_get_cache_age		(PkClient		*client);
+void		 pk_client_set_accumulate		(PkClient		*client,
+							 gboolean		 accumulate);
+gboolean	 pk_client_get_accumulate		(PkClient		*client);
+void		 pk_client_set_package_callback		(PkClient		*client,
+							 PkClientPackageCallback callback,
+							 gpointer		 user_data,
+							 GDestroyNotify		 destroy_func);
 
 G_END_DECLS
 
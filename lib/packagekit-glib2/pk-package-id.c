@@ -28,7 +28,218 @@
 
 #include <glib.h>
 
+#include <string.h>
+
 #include <packagekit-glib2/pk-package-id.h>
+#include <packagekit-glib2/pk-package-id-private.h>
+
+/* one allocation holds the refcount, the PackageID and a copy of the
+ * PackageID with the ';' delimiters replaced by '\0' */
+typedef struct {
+	gint		 refcount;
+	const gchar	*sections[4];
+	gchar		 package_id[1];
+} PkPackageIdEntry;
+
+static GMutex		 pk_package_id_intern_mutex;
+static GHashTable	*pk_package_id_intern_hash = NULL;
+
+/**
+ * pk_package_id_view_init:
+ * @view: a #PkPackageIdView to fill
+ * @package_id: the ; delimited PackageID, which must outlive @view
+ *
+ * Finds the sections of a PackageID without allocating any memory.
+ * The sections of @view point into @package_id and are not %NULL
+ * terminated, so always use the lengths.
+ *
+ * Return value: %TRUE if the PackageID was valid
+ *
+ * Since: 0.9.6
+ **/
+gboolean
+pk_package_id_view_init (PkPackageIdView *view, const gchar *package_id)
+{
+	const gchar *sections[4];
+	const gchar *tmp;
+	guint cnt = 0;
+
+	g_return_val_if_fail (view != NULL, FALSE);
+
+	if (package_id == NULL)
+		return FALSE;
+
+	/* find the delimiters */
+	sections[0] = package_id;
+	for (tmp = package_id; *tmp != '\0'; tmp++) {
+		if (*tmp != ';')
+			continue;
+		if (++cnt > 3)
+			return FALSE;
+		sections[cnt] = tmp + 1;
+	}
+	if (cnt != 3)
+		return FALSE;
+
+	view->name = sections[0];
+	view->name_len = sections[1] - sections[0] - 1;
+	view->version = sections[1];
+	view->version_len = sections[2] - sections[1] - 1;
+	view->arch = sections[2];
+	view->arch_len = sections[3] - sections[2] - 1;
+	view->data = sections[3];
+	view->data_len = tmp - sections[3];
+
+	/* name has to be valid */
+	return view->name_len > 0;
+}
+
+/**
+ * pk_package_id_view_section_equal:
+ **/
+static gboolean
+pk_package_id_view_section_equal (const gchar *section, guint len, const gchar *value)
+{
+	if (value == NULL)
+		return FALSE;
+	return strncmp (section, value, len) == 0 && value[len] == '\0';
+}
+
+/**
+ * pk_package_id_view_name_equal:
+ * @view: a #PkPackageIdView
+ * @name: a package name, e.g. "hal"
+ *
+ * Compares the name section of a PackageID without copying it.
+ *
+ * Return value: %TRUE if the package name is @name
+ *
+ * Since: 0.9.6
+ **/
+gboolean
+pk_package_id_view_name_equal (const PkPackageIdView *view, const gchar *name)
+{
+	g_return_val_if_fail (view != NULL, FALSE);
+	return pk_package_id_view_section_equal (view->name, view->name_len, name);
+}
+
+/**
+ * pk_package_id_view_arch_equal:
+ * @view: a #PkPackageIdView
+ * @arch: a package architecture, e.g. "i386"
+ *
+ * Compares the architecture section of a PackageID without copying it.
+ *
+ * Return value: %TRUE if the package architecture is @arch
+ *
+ * Since: 0.9.6
+ **/
+gboolean
+pk_package_id_view_arch_equal (const PkPackageIdView *view, const gchar *arch)
+{
+	g_return_val_if_fail (view != NULL, FALSE);
+	return pk_package_id_view_section_equal (view->arch, view->arch_len, arch);
+}
+
+/**
+ * pk_package_id_intern:
+ * @package_id: the ; delimited PackageID
+ *
+ * Gets the process-wide shared copy of a PackageID, creating it if it does
+ * not already exist. Each call takes a reference that has to be dropped
+ * using pk_package_id_unintern() when the caller no longer needs it.
+ *
+ * Interned PackageIDs can be compared by pointer, and the split sections of
+ * a PackageID are only computed once however many objects refer to it.
+ *
+ * Return value: the shared PackageID, or %NULL if @package_id was invalid
+ *
+ * Since: 0.9.6
+ **/
+const gchar *
+pk_package_id_intern (const gchar *package_id)
+{
+	gchar *tmp;
+	guint i;
+	guint cnt = 0;
+	gsize len;
+	PkPackageIdEntry *entry;
+	PkPackageIdView view;
+
+	if (!pk_package_id_view_init (&view, package_id))
+		return NULL;
+
+	g_mutex_lock (&pk_package_id_intern_mutex);
+	if (pk_package_id_intern_hash == NULL)
+		pk_package_id_intern_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	entry = g_hash_table_lookup (pk_package_id_intern_hash, package_id);
+	if (entry != NULL) {
+		entry->refcount++;
+		goto out;
+	}
+
+	/* copy the PackageID twice, the second copy being split in place */
+	len = strlen (package_id);
+	entry = g_malloc (sizeof (PkPackageIdEntry) + (len * 2) + 1);
+	entry->refcount = 1;
+	memcpy (entry->package_id, package_id, len + 1);
+	tmp = entry->package_id + len + 1;
+	memcpy (tmp, package_id, len + 1);
+	entry->sections[0] = tmp;
+	for (i = 0; tmp[i] != '\0'; i++) {
+		if (tmp[i] == ';') {
+			tmp[i] = '\0';
+			entry->sections[++cnt] = &tmp[i + 1];
+		}
+	}
+	g_hash_table_insert (pk_package_id_intern_hash, entry->package_id, entry);
+out:
+	g_mutex_unlock (&pk_package_id_intern_mutex);
+	return entry->package_id;
+}
+
+/**
+ * pk_package_id_unintern:
+ * @package_id: a PackageID returned from pk_package_id_intern()
+ *
+ * Drops a reference on an interned PackageID, freeing it when the last
+ * user has gone.
+ *
+ * Since: 0.9.6
+ **/
+void
+pk_package_id_unintern (const gchar *package_id)
+{
+	PkPackageIdEntry *entry;
+
+	if (package_id == NULL)
+		return;
+
+	entry = (PkPackageIdEntry *) (package_id - G_STRUCT_OFFSET (PkPackageIdEntry, package_id));
+	g_mutex_lock (&pk_package_id_intern_mutex);
+	if (--entry->refcount == 0) {
+		g_hash_table_remove (pk_package_id_intern_hash, entry->package_id);
+		g_free (entry);
+	}
+	g_mutex_unlock (&pk_package_id_intern_mutex);
+}
+
+/**
+ * pk_package_id_intern_get_sections:
+ * @package_id: a PackageID returned from pk_package_id_intern()
+ *
+ * Gets the %NULL terminated sections of an interned PackageID, which are
+ * valid for as long as the caller holds the reference.
+ *
+ * Return value: an array of 4 sections, indexed by %PK_PACKAGE_ID_NAME etc.
+ **/
+const gchar * const *
+pk_package_id_intern_get_sections (const gchar *package_id)
+{
+	PkPackageIdEntry *entry;
+	entry = (PkPackageIdEntry *) (package_id - G_STRUCT_OFFSET (PkPackageIdEntry, package_id));
+	return entry->sections;
+}
 
 /**
  * pk_package_id_split:
@@ -44,22 +255,18 @@
 gchar **
 pk_package_id_split (const gchar *package_id)
 {
-	gchar **sections = NULL;
-
-	if (package_id == NULL)
-		goto out;
+	gchar **sections;
+	PkPackageIdView view;
 
-	/* split by delimeter ';' */
-	sections = g_strsplit (package_id, ";", -1);
-	if (g_strv_length (sections) != 4)
-		goto out;
+	if (!pk_package_id_view_init (&view, package_id))
+		return NULL;
 
-	/* name has to be valid */
-	if (sections[0][0] != '\0')
-		return sections;
-out:
-	g_strfreev (sections);
-	return NULL;
+	sections = g_new0 (gchar *, 5);
+	sections[PK_PACKAGE_ID_NAME] = g_strndup (view.name, view.name_len);
+	sections[PK_PACKAGE_ID_VERSION] = g_strndup (view.version, view.version_len);
+	sections[PK_PACKAGE_ID_ARCH] = g_strndup (view.arch, view.arch_len);
+	sections[PK_PACKAGE_ID_DATA] = g_strndup (view.data, view.data_len);
+	return sections;
 }
 
 /**
@@ -73,26 +280,18 @@ out:
 gboolean
 pk_package_id_check (const gchar *package_id)
 {
-	gchar **sections;
-	gboolean ret;
+	PkPackageIdView view;
 
 	/* NULL check */
 	if (package_id == NULL)
 		return FALSE;
 
 	/* UTF8 */
-	ret = g_utf8_validate (package_id, -1, NULL);
-	if (!ret)
+	if (!g_utf8_validate (package_id, -1, NULL))
 		return FALSE;
 
 	/* correct number of sections */
-	sections = pk_package_id_split (package_id);
-	if (sections == NULL)
-		return FALSE;
-
-	/* all okay */
-	g_strfreev (sections);
-	return TRUE;
+	return pk_package_id_view_init (&view, package_id);
 }
 
 /**
@@ -123,25 +322,25 @@ pk_package_id_build (const gchar *name, const gchar *version,
  * pk_arch_base_ix86:
  **/
 static gboolean
-pk_arch_base_ix86 (const gchar *arch)
+pk_arch_base_ix86 (const gchar *arch, guint len)
 {
-	if (g_strcmp0 (arch, "i386") == 0 ||
-	    g_strcmp0 (arch, "i486") == 0 ||
-	    g_strcmp0 (arch, "i586") == 0 ||
-	    g_strcmp0 (arch, "i686") == 0)
-		return TRUE;
-	return FALSE;
+	return len == 4 && arch[0] == 'i' &&
+	       arch[1] >= '3' && arch[1] <= '6' &&
+	       arch[2] == '8' && arch[3] == '6';
 }
 
 /**
  * pk_package_id_equal_fuzzy_arch_section:
  **/
 static gboolean
-pk_package_id_equal_fuzzy_arch_section (const gchar *arch1, const gchar *arch2)
+pk_package_id_equal_fuzzy_arch_section (const PkPackageIdView *view1,
+					const PkPackageIdView *view2)
 {
-	if (g_strcmp0 (arch1, arch2) == 0)
+	if (view1->arch_len == view2->arch_len &&
+	    strncmp (view1->arch, view2->arch, view1->arch_len) == 0)
 		return TRUE;
-	if (pk_arch_base_ix86 (arch1) && pk_arch_base_ix86 (arch2))
+	if (pk_arch_base_ix86 (view1->arch, view1->arch_len) &&
+	    pk_arch_base_ix86 (view2->arch, view2->arch_len))
 		return TRUE;
 	return FALSE;
 }
@@ -161,20 +360,17 @@ pk_package_id_equal_fuzzy_arch_section (const gchar *arch1, const gchar *arch2)
 gboolean
 pk_package_id_equal_fuzzy_arch (const gchar *package_id1, const gchar *package_id2)
 {
-	gchar **sections1;
-	gchar **sections2;
-	gboolean ret = FALSE;
-
-	sections1 = pk_package_id_split (package_id1);
-	sections2 = pk_package_id_split (package_id2);
-	if (g_strcmp0 (sections1[0], sections2[0]) == 0 &&
-	    g_strcmp0 (sections1[1], sections2[1]) == 0 &&
-	    pk_package_id_equal_fuzzy_arch_section (sections1[2], sections2[2]))
-		ret = TRUE;
-
-	g_strfreev (sections1);
-	g_strfreev (sections2);
-	return ret;
+	PkPackageIdView view1;
+	PkPackageIdView view2;
+
+	if (!pk_package_id_view_init (&view1, package_id1) ||
+	    !pk_package_id_view_init (&view2, package_id2))
+		return FALSE;
+	return view1.name_len == view2.name_len &&
+	       strncmp (view1.name, view2.name, view1.name_len) == 0 &&
+	       view1.version_len == view2.version_len &&
+	       strncmp (view1.version, view2.version, view1.version_len) == 0 &&
+	       pk_package_id_equal_fuzzy_arch_section (&view1, &view2);
 }
 
 /**
@@ -190,32 +386,26 @@ pk_package_id_equal_fuzzy_arch (const gchar *package_id1, const gchar *package_i
 gchar *
 pk_package_id_to_printable (const gchar *package_id)
 {
-	gchar **parts = NULL;
-	gchar *value = NULL;
-	GString *string = NULL;
+	GString *string;
+	PkPackageIdView view;
 
 	/* invalid */
-	if (package_id == NULL)
-		goto out;
-
-	/* split */
-	parts = pk_package_id_split (package_id);
-	if (parts == NULL)
-		goto out;
+	if (!pk_package_id_view_init (&view, package_id))
+		return NULL;
 
 	/* name */
-	string = g_string_new (parts[PK_PACKAGE_ID_NAME]);
+	string = g_string_new_len (view.name, view.name_len);
 
 	/* version if present */
-	if (parts[PK_PACKAGE_ID_VERSION][0] != '\0')
-		g_string_append_printf (string, "-%s", parts[PK_PACKAGE_ID_VERSION]);
+	if (view.version_len > 0) {
+		g_string_append_c (string, '-');
+		g_string_append_len (string, view.version, view.version_len);
+	}
 
 	/* arch if present */
-	if (parts[PK_PACKAGE_ID_ARCH][0] != '\0')
-		g_string_append_printf (string, ".%s", parts[PK_PACKAGE_ID_ARCH]);
-out:
-	if (string != NULL)
-		value = g_string_free (string, FALSE);
-	g_strfreev (parts);
-	return value;
+	if (view.arch_len > 0) {
+		g_string_append_c (string, '.');
+		g_string_append_len (string, view.arch, view.arch_len);
+	}
+	return g_string_free (string, FALSE);
 }
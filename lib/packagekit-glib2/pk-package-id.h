@@ -58,6 +58,30 @@ G_BEGIN_DECLS
  */
 #define PK_PACKAGE_ID_DATA	3
 
+/**
+ * PkPackageIdView:
+ * @name: the start of the package name
+ * @name_len: the length of the package name
+ * @version: the start of the package version
+ * @version_len: the length of the package version
+ * @arch: the start of the package architecture
+ * @arch_len: the length of the package architecture
+ * @data: the start of the package data
+ * @data_len: the length of the package data
+ *
+ * The sections of a PackageID, pointing into the original string.
+ **/
+typedef struct {
+	const gchar	*name;
+	guint		 name_len;
+	const gchar	*version;
+	guint		 version_len;
+	const gchar	*arch;
+	guint		 arch_len;
+	const gchar	*data;
+	guint		 data_len;
+} PkPackageIdView;
+
 void		 pk_package_id_test			(gpointer		 user_data);
 gchar		*pk_package_id_build			(const gchar		*name,
 							 const gchar		*version,
@@ -68,6 +92,14 @@ gchar		**pk_package_id_split			(const gchar		*package_id);
 gchar		*pk_package_id_to_printable		(const gchar		*package_id);
 gboolean	 pk_package_id_equal_fuzzy_arch		(const gchar		*package_id1,
 							 const gchar		*package_id2);
+gboolean	 pk_package_id_view_init		(PkPackageIdView	*view,
+							 const gchar		*package_id);
+gboolean	 pk_package_id_view_name_equal		(const PkPackageIdView	*view,
+							 const gchar		*name);
+gboolean	 pk_package_id_view_arch_equal		(const PkPackageIdView	*view,
+							 const gchar		*arch);
+const gchar	*pk_package_id_intern			(const gchar		*package_id);
+void		 pk_package_id_unintern			(const gchar		*package_id);
 G_END_DECLS
 
 #endif /* __PK_PACKAGE_ID_H */
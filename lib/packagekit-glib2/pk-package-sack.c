@@ -30,6 +30,7 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <glib-object.h>
 #include <gio/gio.h>
 
@@ -44,6 +45,9 @@ static void     pk_package_sack_finalize	(GObject     *object);
 
 #define PK_PACKAGE_SACK_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_PACKAGE_SACK, PkPackageSackPrivate))
 
+/* the number of chunk transactions that are in flight at any one time */
+#define PK_PACKAGE_SACK_MAX_PARALLEL	4
+
 /**
  * PkPackageSackPrivate:
  *
@@ -52,10 +56,22 @@ static void     pk_package_sack_finalize	(GObject     *object);
 struct _PkPackageSackPrivate
 {
 	GHashTable		*table;
+	GHashTable		*name_table;		/* key:PkPackageSackKey value:GPtrArray */
+	GHashTable		*name_arch_table;	/* key:PkPackageSackKey value:GPtrArray */
 	GPtrArray		*array;
 	PkClient		*client;
+	guint			 chunk_size;
 };
 
+/* a name, or a name and arch, that can point into a package-id without
+ * copying so that lookups do not allocate */
+typedef struct {
+	const gchar		*name;
+	gsize			 name_len;
+	const gchar		*arch;
+	gsize			 arch_len;
+} PkPackageSackKey;
+
 enum {
 	SIGNAL_CHANGED,
 	SIGNAL_LAST
@@ -63,6 +79,165 @@ enum {
 
 G_DEFINE_TYPE (PkPackageSack, pk_package_sack, G_TYPE_OBJECT)
 
+/**
+ * pk_package_sack_key_new:
+ *
+ * Allocates a key that owns a copy of the strings in the same block.
+ **/
+static PkPackageSackKey *
+pk_package_sack_key_new (const PkPackageSackKey *tmp)
+{
+	gchar *dest;
+	PkPackageSackKey *key;
+
+	key = g_malloc (sizeof (PkPackageSackKey) + tmp->name_len + tmp->arch_len + 2);
+	dest = (gchar *) (key + 1);
+	memcpy (dest, tmp->name, tmp->name_len);
+	dest[tmp->name_len] = '\0';
+	key->name = dest;
+	key->name_len = tmp->name_len;
+	dest += tmp->name_len + 1;
+	if (tmp->arch_len > 0)
+		memcpy (dest, tmp->arch, tmp->arch_len);
+	dest[tmp->arch_len] = '\0';
+	key->arch = dest;
+	key->arch_len = tmp->arch_len;
+	return key;
+}
+
+/**
+ * pk_package_sack_key_hash:
+ **/
+static guint
+pk_package_sack_key_hash (gconstpointer data)
+{
+	const PkPackageSackKey *key = data;
+	guint hash = 5381;
+	gsize i;
+
+	for (i = 0; i < key->name_len; i++)
+		hash = (hash << 5) + hash + (guchar) key->name[i];
+	hash = (hash << 5) + hash + ';';
+	for (i = 0; i < key->arch_len; i++)
+		hash = (hash << 5) + hash + (guchar) key->arch[i];
+	return hash;
+}
+
+/**
+ * pk_package_sack_key_equal:
+ **/
+static gboolean
+pk_package_sack_key_equal (gconstpointer a, gconstpointer b)
+{
+	const PkPackageSackKey *key1 = a;
+	const PkPackageSackKey *key2 = b;
+
+	if (key1->name_len != key2->name_len ||
+	    key1->arch_len != key2->arch_len)
+		return FALSE;
+	if (memcmp (key1->name, key2->name, key1->name_len) != 0)
+		return FALSE;
+	return key1->arch_len == 0 ||
+	       memcmp (key1->arch, key2->arch, key1->arch_len) == 0;
+}
+
+/**
+ * pk_package_sack_index_insert:
+ **/
+static void
+pk_package_sack_index_insert (GHashTable *index,
+			      const PkPackageSackKey *tmp,
+			      PkPackage *package)
+{
+	GPtrArray *bucket;
+
+	bucket = g_hash_table_lookup (index, tmp);
+	if (bucket == NULL) {
+		bucket = g_ptr_array_new ();
+		g_hash_table_insert (index, pk_package_sack_key_new (tmp), bucket);
+	}
+	g_ptr_array_add (bucket, package);
+}
+
+/**
+ * pk_package_sack_index_remove:
+ **/
+static void
+pk_package_sack_index_remove (GHashTable *index,
+			      const PkPackageSackKey *tmp,
+			      PkPackage *package)
+{
+	GPtrArray *bucket;
+
+	bucket = g_hash_table_lookup (index, tmp);
+	if (bucket == NULL)
+		return;
+	g_ptr_array_remove (bucket, package);
+	if (bucket->len == 0)
+		g_hash_table_remove (index, tmp);
+}
+
+/**
+ * pk_package_sack_index_key:
+ *
+ * Fills in the name and arch keys for a package, returning %FALSE if the
+ * package has no package-id and so cannot be indexed.
+ **/
+static gboolean
+pk_package_sack_index_key (PkPackage *package,
+			   PkPackageSackKey *key_name,
+			   PkPackageSackKey *key_name_arch)
+{
+	const gchar *arch;
+	const gchar *name;
+
+	name = pk_package_get_name (package);
+	if (name == NULL)
+		return FALSE;
+	arch = pk_package_get_arch (package);
+	if (arch == NULL)
+		arch = "";
+	key_name->name = name;
+	key_name->name_len = strlen (name);
+	key_name->arch = NULL;
+	key_name->arch_len = 0;
+	key_name_arch->name = name;
+	key_name_arch->name_len = key_name->name_len;
+	key_name_arch->arch = arch;
+	key_name_arch->arch_len = strlen (arch);
+	return TRUE;
+}
+
+/**
+ * pk_package_sack_index_add:
+ **/
+static void
+pk_package_sack_index_add (PkPackageSack *sack, PkPackage *package)
+{
+	PkPackageSackKey key_name;
+	PkPackageSackKey key_name_arch;
+
+	if (!pk_package_sack_index_key (package, &key_name, &key_name_arch))
+		return;
+	pk_package_sack_index_insert (sack->priv->name_table, &key_name, package);
+	pk_package_sack_index_insert (sack->priv->name_arch_table, &key_name_arch, package);
+}
+
+/**
+ * pk_package_sack_index_del:
+ **/
+static void
+pk_package_sack_index_del (PkPackageSack *sack, PkPackage *package)
+{
+	PkPackageSackKey key_name;
+	PkPackageSackKey key_name_arch;
+
+	if (!pk_package_sack_index_key (package, &key_name, &key_name_arch))
+		return;
+	pk_package_sack_index_remove (sack->priv->name_table, &key_name, package);
+	pk_package_sack_index_remove (sack->priv->name_arch_table, &key_name_arch, package);
+}
+
 /**
  * pk_package_sack_clear:
  * @sack: a valid #PkPackageSack instance
@@ -76,6 +251,8 @@ pk_package_sack_clear (PkPackageSack *sack)
 {
 	g_return_if_fail (PK_IS_PACKAGE_SACK (sack));
 
+	g_hash_table_remove_all (sack->priv->name_table);
+	g_hash_table_remove_all (sack->priv->name_arch_table);
 	g_ptr_array_set_size (sack->priv->array, 0);
 	g_hash_table_remove_all (sack->priv->table);
 }
@@ -240,6 +417,7 @@ pk_package_sack_add_package (PkPackageSack *sack, PkPackage *package)
 	g_hash_table_insert (sack->priv->table,
 			     (gpointer) pk_package_get_id (package),
 			     (gpointer) package);
+	pk_package_sack_index_add (sack, package);
 
 	return TRUE;
 }
@@ -444,8 +622,9 @@ pk_package_sack_remove_package (PkPackageSack *sack, PkPackage *package)
 	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), FALSE);
 	g_return_val_if_fail (PK_IS_PACKAGE (package), FALSE);
 
-	/* remove from array */
+	/* remove from array, the indexes borrow strings from the package */
 	g_hash_table_remove (sack->priv->table, pk_package_get_id (package));
+	pk_package_sack_index_del (sack, package);
 	ret = g_ptr_array_remove (sack->priv->array, package);
 
 	return ret;
@@ -468,24 +647,14 @@ pk_package_sack_remove_package_by_id (PkPackageSack *sack,
 				      const gchar *package_id)
 {
 	PkPackage *package;
-	gboolean ret = FALSE;
-	guint i;
-	GPtrArray *array;
 
 	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), FALSE);
 	g_return_val_if_fail (package_id != NULL, FALSE);
 
-	array = sack->priv->array;
-	for (i = 0; i < array->len; i++) {
-		package = g_ptr_array_index (array, i);
-		if (g_strcmp0 (package_id, pk_package_get_id (package)) == 0) {
-			pk_package_sack_remove_package (sack, package);
-			ret = TRUE;
-			break;
-		}
-	}
-
-	return ret;
+	package = g_hash_table_lookup (sack->priv->table, package_id);
+	if (package == NULL)
+		return FALSE;
+	return pk_package_sack_remove_package (sack, package);
 }
 
 /**
@@ -560,8 +729,8 @@ pk_package_sack_find_by_id (PkPackageSack *sack, const gchar *package_id)
  * @sack: a valid #PkPackageSack instance
  * @package_id: a package_id descriptor
  *
- * Finds a package in a sack by package name and architecture. As soon as one
- * package is found the search is stopped.
+ * Finds a package in a sack by package name and architecture. If more than
+ * one package matches, the one added to the sack first is returned.
  *
  * Return value: (transfer full): the #PkPackage object, or %NULL if not found.
  *
@@ -570,31 +739,61 @@ pk_package_sack_find_by_id (PkPackageSack *sack, const gchar *package_id)
 PkPackage *
 pk_package_sack_find_by_id_name_arch (PkPackageSack *sack, const gchar *package_id)
 {
-	PkPackage *pkg = NULL;
-	PkPackage *pkg_tmp;
-	gchar **split;
-	guint i;
+	GPtrArray *bucket;
+	PkPackageIdView view;
+	PkPackageSackKey key;
 
 	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), NULL);
 	g_return_val_if_fail (package_id != NULL, NULL);
 
-	/* does the package name feature in the array */
-	split = pk_package_id_split (package_id);
-	if (split == NULL)
-		goto out;
-	for (i = 0; i < sack->priv->array->len; i++) {
-		pkg_tmp = g_ptr_array_index (sack->priv->array, i);
-		if (g_strcmp0 (pk_package_get_name (pkg_tmp),
-			       split[PK_PACKAGE_ID_NAME]) == 0 &&
-		    g_strcmp0 (pk_package_get_arch (pkg_tmp),
-			       split[PK_PACKAGE_ID_ARCH]) == 0) {
-			pkg = g_object_ref (pkg_tmp);
-			break;
-		}
-	}
-out:
-	g_strfreev (split);
-	return pkg;
+	/* the key points into the package-id, so nothing is allocated */
+	if (!pk_package_id_view_init (&view, package_id))
+		return NULL;
+	key.name = view.name;
+	key.name_len = view.name_len;
+	key.arch = view.arch;
+	key.arch_len = view.arch_len;
+	bucket = g_hash_table_lookup (sack->priv->name_arch_table, &key);
+	if (bucket == NULL)
+		return NULL;
+	return g_object_ref (g_ptr_array_index (bucket, 0));
+}
+
+/**
+ * pk_package_sack_find_by_name:
+ * @sack: a valid #PkPackageSack instance
+ * @name: a package name, e.g. "hal"
+ *
+ * Finds all the packages in a sack with a given name, in the order they
+ * were added to the sack.
+ *
+ * Return value: (element-type PkPackage) (transfer container): an array of
+ * #PkPackage objects, which may be empty. Free with g_ptr_array_unref()
+ *
+ * Since: 0.9.6
+ */
+GPtrArray *
+pk_package_sack_find_by_name (PkPackageSack *sack, const gchar *name)
+{
+	GPtrArray *array;
+	GPtrArray *bucket;
+	PkPackageSackKey key;
+	guint i;
+
+	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), NULL);
+	g_return_val_if_fail (name != NULL, NULL);
+
+	array = g_ptr_array_new_with_free_func (g_object_unref);
+	key.name = name;
+	key.name_len = strlen (name);
+	key.arch = NULL;
+	key.arch_len = 0;
+	bucket = g_hash_table_lookup (sack->priv->name_table, &key);
+	if (bucket == NULL)
+		return array;
+	for (i = 0; i < bucket->len; i++)
+		g_ptr_array_add (array, g_object_ref (g_ptr_array_index (bucket, i)));
+	return array;
 }
 
 /**
@@ -603,20 +802,7 @@ out:
 static gint
 pk_package_sack_sort_compare_name_func (PkPackage **a, PkPackage **b)
 {
-	const gchar *package_id1;
-	const gchar *package_id2;
-	gchar **split1;
-	gchar **split2;
-	gint retval;
-
-	package_id1 = pk_package_get_id (*a);
-	package_id2 = pk_package_get_id (*b);
-	split1 = pk_package_id_split (package_id1);
-	split2 = pk_package_id_split (package_id2);
-	retval = g_strcmp0 (split1[PK_PACKAGE_ID_NAME], split2[PK_PACKAGE_ID_NAME]);
-	g_strfreev (split1);
-	g_strfreev (split2);
-	return retval;
+	return g_strcmp0 (pk_package_get_name (*a), pk_package_get_name (*b));
 }
 
 /**
@@ -685,6 +871,46 @@ pk_package_sack_sort (PkPackageSack *sack, PkPackageSackSortType type)
 		g_ptr_array_sort (sack->priv->array, (GCompareFunc) pk_package_sack_sort_compare_info_func);
 }
 
+/**
+ * pk_package_sack_set_chunk_size:
+ * @sack: a valid #PkPackageSack instance
+ * @chunk_size: the number of packages in each transaction, or 0 for no limit
+ *
+ * Sets how many packages are sent in each transaction when merging data
+ * into the sack using pk_package_sack_resolve_async(),
+ * pk_package_sack_get_details_async() or
+ * pk_package_sack_get_update_detail_async().
+ *
+ * When the sack is split, several transactions are started at the same
+ * time and the results of each are merged as soon as they arrive. The
+ * daemon will run them in parallel if the backend supports it.
+ *
+ * Since: 0.9.6
+ **/
+void
+pk_package_sack_set_chunk_size (PkPackageSack *sack, guint chunk_size)
+{
+	g_return_if_fail (PK_IS_PACKAGE_SACK (sack));
+	sack->priv->chunk_size = chunk_size;
+}
+
+/**
+ * pk_package_sack_get_chunk_size:
+ * @sack: a valid #PkPackageSack instance
+ *
+ * Gets how many packages are sent in each transaction.
+ *
+ * Return value: the chunk size, or 0 for no limit
+ *
+ * Since: 0.9.6
+ **/
+guint
+pk_package_sack_get_chunk_size (PkPackageSack *sack)
+{
+	g_return_val_if_fail (PK_IS_PACKAGE_SACK (sack), 0);
+	return sack->priv->chunk_size;
+}
+
 /**
  * pk_package_sack_get_total_bytes:
  * @sack: a valid #PkPackageSack instance
@@ -747,6 +973,15 @@ typedef struct {
 	GCancellable		*cancellable;
 	gboolean		 ret;
 	GSimpleAsyncResult	*res;
+	PkRoleEnum		 role;
+	gchar			**package_ids;
+	guint			 package_ids_len;
+	guint			 next;
+	guint			 pending;
+	guint			 merged;
+	GError			*error;
+	PkProgressCallback	 progress_callback;
+	gpointer		 progress_user_data;
 } PkPackageSackState;
 
 /***************************************************************************************************/
@@ -770,11 +1005,153 @@ pk_package_sack_merge_bool_state_finish (PkPackageSackState *state, const GError
 	/* deallocate */
 	if (state->cancellable != NULL)
 		g_object_unref (state->cancellable);
+	if (state->error != NULL)
+		g_error_free (state->error);
+	g_strfreev (state->package_ids);
 	g_object_unref (state->res);
 	g_object_unref (state->sack);
 	g_slice_free (PkPackageSackState, state);
 }
 
+static void pk_package_sack_resolve_cb (GObject *source_object, GAsyncResult *res, PkPackageSackState *state);
+static void pk_package_sack_get_details_cb (GObject *source_object, GAsyncResult *res, PkPackageSackState *state);
+static void pk_package_sack_get_update_detail_cb (GObject *source_object, GAsyncResult *res, PkPackageSackState *state);
+
+/**
+ * pk_package_sack_chunks_start:
+ *
+ * Starts transactions for the next chunks of package IDs, until there are
+ * %PK_PACKAGE_SACK_MAX_PARALLEL in flight or every package has been sent.
+ **/
+static void
+pk_package_sack_chunks_start (PkPackageSackState *state)
+{
+	gchar **chunk;
+	guint chunk_size;
+	guint n;
+	PkClient *client = state->sack->priv->client;
+
+	chunk_size = state->sack->priv->chunk_size;
+	if (chunk_size == 0)
+		chunk_size = G_MAXUINT;
+	while (state->error == NULL &&
+	       state->pending < PK_PACKAGE_SACK_MAX_PARALLEL &&
+	       state->next < state->package_ids_len) {
+
+		/* the client copies the IDs, so the chunk can borrow them */
+		n = MIN (chunk_size, state->package_ids_len - state->next);
+		chunk = g_new0 (gchar *, n + 1);
+		memcpy (chunk, state->package_ids + state->next, n * sizeof (gchar *));
+		state->next += n;
+		state->pending++;
+
+		switch (state->role) {
+		case PK_ROLE_ENUM_RESOLVE:
+			pk_client_resolve_async (client, pk_bitfield_value (PK_FILTER_ENUM_INSTALLED), chunk,
+						 state->cancellable, state->progress_callback, state->progress_user_data,
+						 (GAsyncReadyCallback) pk_package_sack_resolve_cb, state);
+			break;
+		case PK_ROLE_ENUM_GET_DETAILS:
+			pk_client_get_details_async (client, chunk,
+						     state->cancellable, state->progress_callback, state->progress_user_data,
+						     (GAsyncReadyCallback) pk_package_sack_get_details_cb, state);
+			break;
+		case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+			pk_client_get_update_detail_async (client, chunk,
+							   state->cancellable, state->progress_callback, state->progress_user_data,
+							   (GAsyncReadyCallback) pk_package_sack_get_update_detail_cb, state);
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+		g_free (chunk);
+	}
+}
+
+/**
+ * pk_package_sack_chunk_done:
+ * @error: the error from this chunk, or %NULL
+ * @merged: the number of items merged into the sack from this chunk
+ *
+ * Called when each chunk transaction has completed and its results have
+ * been merged. The operation completes when the last chunk is done.
+ **/
+static void
+pk_package_sack_chunk_done (PkPackageSackState *state, const GError *error, guint merged)
+{
+	state->pending--;
+	state->merged += merged;
+
+	/* do not start any more chunks after the first failure */
+	if (error != NULL && state->error == NULL)
+		state->error = g_error_copy (error);
+	pk_package_sack_chunks_start (state);
+	if (state->pending > 0)
+		return;
+
+	/* nothing came back from any of the chunks */
+	if (state->error == NULL && state->merged == 0) {
+		switch (state->role) {
+		case PK_ROLE_ENUM_RESOLVE:
+			state->error = g_error_new (1, 0, "no packages found!");
+			break;
+		case PK_ROLE_ENUM_GET_DETAILS:
+			state->error = g_error_new (1, 0, "no details found!");
+			break;
+		default:
+			state->error = g_error_new (1, 0, "no update details found!");
+			break;
+		}
+	}
+
+	/* we're done */
+	state->ret = (state->error == NULL);
+	pk_package_sack_merge_bool_state_finish (state, state->error);
+}
+
+/**
+ * pk_package_sack_state_new:
+ **/
+static PkPackageSackState *
+pk_package_sack_state_new (PkPackageSack *sack,
+			   PkRoleEnum role,
+			   GCancellable *cancellable,
+			   PkProgressCallback progress_callback,
+			   gpointer progress_user_data,
+			   GSimpleAsyncResult *res)
+{
+	PkPackageSackState *state;
+
+	state = g_slice_new0 (PkPackageSackState);
+	state->res = g_object_ref (res);
+	state->sack = g_object_ref (sack);
+	if (cancellable != NULL) {
+		state->cancellable = g_object_ref (cancellable);
+	}
+	state->ret = FALSE;
+	state->role = role;
+	state->progress_callback = progress_callback;
+	state->progress_user_data = progress_user_data;
+	state->package_ids = pk_package_sack_get_package_ids (sack);
+	state->package_ids_len = g_strv_length (state->package_ids);
+	return state;
+}
+
+/**
+ * pk_package_sack_state_run:
+ **/
+static void
+pk_package_sack_state_run (PkPackageSackState *state)
+{
+	/* an empty sack never gets any results */
+	if (state->package_ids_len == 0) {
+		state->pending = 1;
+		pk_package_sack_chunk_done (state, NULL, 0);
+		return;
+	}
+	pk_package_sack_chunks_start (state);
+}
+
 /**
  * pk_package_sack_resolve_cb:
  **/
@@ -796,20 +1173,13 @@ pk_package_sack_resolve_cb (GObject *source_object, GAsyncResult *res, PkPackage
 	results = pk_client_generic_finish (client, res, &error);
 	if (results == NULL) {
 		g_warning ("failed to resolve: %s", error->message);
-		pk_package_sack_merge_bool_state_finish (state, error);
+		pk_package_sack_chunk_done (state, error, 0);
 		g_error_free (error);
 		goto out;
 	}
 
 	/* get the packages */
 	packages = pk_results_get_package_array (results);
-	if (packages->len == 0) {
-		g_warning ("%i", state->ret);
-		error = g_error_new (1, 0, "no packages found!");
-		pk_package_sack_merge_bool_state_finish (state, error);
-		g_error_free (error);
-		goto out;
-	}
 
 	/* set data on each item */
 	for (i = 0; i < packages->len; i++) {
@@ -838,11 +1208,8 @@ skip:
 		g_free (package_id);
 	}
 
-	/* all okay */
-	state->ret = TRUE;
-
-	/* we're done */
-	pk_package_sack_merge_bool_state_finish (state, error);
+	/* merged as soon as each chunk arrives */
+	pk_package_sack_chunk_done (state, NULL, packages->len);
 out:
 	if (results != NULL)
 		g_object_unref (results);
@@ -870,7 +1237,6 @@ pk_package_sack_resolve_async (PkPackageSack *sack, GCancellable *cancellable,
 {
 	GSimpleAsyncResult *res;
 	PkPackageSackState *state;
-	gchar **package_ids;
 
 	g_return_if_fail (PK_IS_PACKAGE_SACK (sack));
 	g_return_if_fail (callback != NULL);
@@ -878,20 +1244,11 @@ pk_package_sack_resolve_async (PkPackageSack *sack, GCancellable *cancellable,
 	res = g_simple_async_result_new (G_OBJECT (sack), callback, user_data, pk_package_sack_resolve_async);
 
 	/* save state */
-	state = g_slice_new0 (PkPackageSackState);
-	state->res = g_object_ref (res);
-	state->sack = g_object_ref (sack);
-	if (cancellable != NULL) {
-		state->cancellable = g_object_ref (cancellable);
-	}
-	state->ret = FALSE;
+	state = pk_package_sack_state_new (sack, PK_ROLE_ENUM_RESOLVE, cancellable,
+					   progress_callback, progress_user_data, res);
 
-	/* start resolve async */
-	package_ids = pk_package_sack_get_package_ids (sack);
-	pk_client_resolve_async (sack->priv->client, pk_bitfield_value (PK_FILTER_ENUM_INSTALLED), package_ids,
-				 cancellable, progress_callback, progress_user_data,
-				 (GAsyncReadyCallback) pk_package_sack_resolve_cb, state);
-	g_strfreev (package_ids);
+	/* start resolve async, in chunks if required */
+	pk_package_sack_state_run (state);
 	g_object_unref (res);
 }
 
@@ -950,19 +1307,13 @@ pk_package_sack_get_details_cb (GObject *source_object, GAsyncResult *res, PkPac
 	results = pk_client_generic_finish (client, res, &error);
 	if (results == NULL) {
 		g_warning ("failed to details: %s", error->message);
-		pk_package_sack_merge_bool_state_finish (state, error);
+		pk_package_sack_chunk_done (state, error, 0);
 		g_error_free (error);
 		goto out;
 	}
 
 	/* get the details */
 	details = pk_results_get_details_array (results);
-	if (details->len == 0) {
-		error = g_error_new (1, 0, "no details found!");
-		pk_package_sack_merge_bool_state_finish (state, error);
-		g_error_free (error);
-		goto out;
-	}
 
 	/* set data on each item */
 	for (i = 0; i < details->len; i++) {
@@ -1000,11 +1351,8 @@ skip:
 		g_free (description);
 	}
 
-	/* all okay */
-	state->ret = TRUE;
-
-	/* we're done */
-	pk_package_sack_merge_bool_state_finish (state, error);
+	/* merged as soon as each chunk arrives */
+	pk_package_sack_chunk_done (state, NULL, details->len);
 out:
 	if (results != NULL)
 		g_object_unref (results);
@@ -1030,7 +1378,6 @@ pk_package_sack_get_details_async (PkPackageSack *sack, GCancellable *cancellabl
 {
 	GSimpleAsyncResult *res;
 	PkPackageSackState *state;
-	gchar **package_ids;
 
 	g_return_if_fail (PK_IS_PACKAGE_SACK (sack));
 	g_return_if_fail (callback != NULL);
@@ -1038,21 +1385,11 @@ pk_package_sack_get_details_async (PkPackageSack *sack, GCancellable *cancellabl
 	res = g_simple_async_result_new (G_OBJECT (sack), callback, user_data, pk_package_sack_get_details_async);
 
 	/* save state */
-	state = g_slice_new0 (PkPackageSackState);
-	state->res = g_object_ref (res);
-	state->sack = g_object_ref (sack);
-	if (cancellable != NULL) {
-		state->cancellable = g_object_ref (cancellable);
-	}
-	state->ret = FALSE;
-
-	/* start details async */
-	package_ids = pk_package_sack_get_package_ids (sack);
-	pk_client_get_details_async (sack->priv->client, package_ids,
-				     cancellable, progress_callback, progress_user_data,
-				     (GAsyncReadyCallback) pk_package_sack_get_details_cb, state);
+	state = pk_package_sack_state_new (sack, PK_ROLE_ENUM_GET_DETAILS, cancellable,
+					   progress_callback, progress_user_data, res);
 
-	g_strfreev (package_ids);
+	/* start details async, in chunks if required */
+	pk_package_sack_state_run (state);
 	g_object_unref (res);
 }
 
@@ -1088,19 +1425,13 @@ pk_package_sack_get_update_detail_cb (GObject *source_object, GAsyncResult *res,
 	results = pk_client_generic_finish (client, res, &error);
 	if (results == NULL) {
 		g_warning ("failed to update_detail: %s", error->message);
-		pk_package_sack_merge_bool_state_finish (state, error);
+		pk_package_sack_chunk_done (state, error, 0);
 		g_error_free (error);
 		goto out;
 	}
 
 	/* get the update_details */
 	update_details = pk_results_get_update_detail_array (results);
-	if (update_details->len == 0) {
-		error = g_error_new (1, 0, "no update details found!");
-		pk_package_sack_merge_bool_state_finish (state, error);
-		g_error_free (error);
-		goto out;
-	}
 
 	/* set data on each item */
 	for (i = 0; i < update_details->len; i++) {
@@ -1155,11 +1486,8 @@ skip:
 		g_free (updated);
 	}
 
-	/* all okay */
-	state->ret = TRUE;
-
-	/* we're done */
-	pk_package_sack_merge_bool_state_finish (state, error);
+	/* merged as soon as each chunk arrives */
+	pk_package_sack_chunk_done (state, NULL, update_details->len);
 out:
 	if (results != NULL)
 		g_object_unref (results);
@@ -1187,7 +1515,6 @@ pk_package_sack_get_update_detail_async (PkPackageSack *sack, GCancellable *canc
 {
 	GSimpleAsyncResult *res;
 	PkPackageSackState *state;
-	gchar **package_ids;
 
 	g_return_if_fail (PK_IS_PACKAGE_SACK (sack));
 	g_return_if_fail (callback != NULL);
@@ -1195,21 +1522,11 @@ pk_package_sack_get_update_detail_async (PkPackageSack *sack, GCancellable *canc
 	res = g_simple_async_result_new (G_OBJECT (sack), callback, user_data, pk_package_sack_get_update_detail_async);
 
 	/* save state */
-	state = g_slice_new0 (PkPackageSackState);
-	state->res = g_object_ref (res);
-	state->sack = g_object_ref (sack);
-	if (cancellable != NULL) {
-		state->cancellable = g_object_ref (cancellable);
-	}
-	state->ret = FALSE;
-
-	/* start update_detail async */
-	package_ids = pk_package_sack_get_package_ids (sack);
-	pk_client_get_update_detail_async (sack->priv->client, package_ids,
-					   cancellable, progress_callback, progress_user_data,
-					   (GAsyncReadyCallback) pk_package_sack_get_update_detail_cb, state);
+	state = pk_package_sack_state_new (sack, PK_ROLE_ENUM_GET_UPDATE_DETAIL, cancellable,
+					   progress_callback, progress_user_data, res);
 
-	g_strfreev (package_ids);
+	/* start update_detail async, in chunks if required */
+	pk_package_sack_state_run (state);
 	g_object_unref (res);
 }
 
@@ -1253,6 +1570,14 @@ pk_package_sack_init (PkPackageSack *sack)
 	priv = sack->priv;
 
 	priv->table = g_hash_table_new (g_str_hash, g_str_equal);
+	priv->name_table = g_hash_table_new_full (pk_package_sack_key_hash,
+						  pk_package_sack_key_equal,
+						  g_free,
+						  (GDestroyNotify) g_ptr_array_unref);
+	priv->name_arch_table = g_hash_table_new_full (pk_package_sack_key_hash,
+						       pk_package_sack_key_equal,
+						       g_free,
+						       (GDestroyNotify) g_ptr_array_unref);
 	priv->array = g_ptr_array_new_with_free_func (g_object_unref);
 	priv->client = pk_client_new ();
 }
@@ -1266,6 +1591,8 @@ pk_package_sack_finalize (GObject *object)
 	PkPackageSack *sack = PK_PACKAGE_SACK (object);
 	PkPackageSackPrivate *priv = sack->priv;
 
+	g_hash_table_unref (priv->name_table);
+	g_hash_table_unref (priv->name_arch_table);
 	g_ptr_array_unref (priv->array);
 	g_hash_table_unref (priv->table);
 	g_object_unref (priv->client);
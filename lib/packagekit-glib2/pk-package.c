@@ -30,12 +30,14 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <glib-object.h>
 
 #include <packagekit-glib2/pk-package.h>
 #include <packagekit-glib2/pk-common.h>
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-package-id.h>
+#include <packagekit-glib2/pk-package-id-private.h>
 
 static void     pk_package_finalize	(GObject     *object);
 
@@ -49,9 +51,10 @@ static void     pk_package_finalize	(GObject     *object);
 struct _PkPackagePrivate
 {
 	PkInfoEnum		 info;
-	gchar			*package_id;
-	gchar			*package_id_data;
+	const gchar		*package_id;
 	const gchar		*package_id_split[4];
+	gchar			*package_id_invalid;
+	gchar			*package_id_data;
 	gchar			*summary;
 	gchar			*license;
 	PkGroupEnum		 group;
@@ -104,6 +107,22 @@ static guint signals [SIGNAL_LAST] = { 0 };
 
 G_DEFINE_TYPE (PkPackage, pk_package, PK_TYPE_SOURCE)
 
+/**
+ * pk_package_id_equal_internal:
+ *
+ * Valid package-ids are interned and can be compared by pointer, but
+ * invalid ones are only copies.
+ **/
+static gboolean
+pk_package_id_equal_internal (PkPackagePrivate *priv1, PkPackagePrivate *priv2)
+{
+	if (priv1->package_id == priv2->package_id)
+		return TRUE;
+	if (priv1->package_id_invalid == NULL && priv2->package_id_invalid == NULL)
+		return FALSE;
+	return g_strcmp0 (priv1->package_id, priv2->package_id) == 0;
+}
+
 /**
  * pk_package_equal:
  * @package1: a valid #PkPackage instance
@@ -121,7 +140,7 @@ pk_package_equal (PkPackage *package1, PkPackage *package2)
 	g_return_val_if_fail (PK_IS_PACKAGE (package1), FALSE);
 	g_return_val_if_fail (PK_IS_PACKAGE (package2), FALSE);
 	return (g_strcmp0 (package1->priv->summary, package2->priv->summary) == 0 &&
-	        g_strcmp0 (package1->priv->package_id, package2->priv->package_id) == 0 &&
+	        pk_package_id_equal_internal (package1->priv, package2->priv) &&
 	        package1->priv->info == package2->priv->info);
 }
 
@@ -141,7 +160,9 @@ pk_package_equal_id (PkPackage *package1, PkPackage *package2)
 {
 	g_return_val_if_fail (PK_IS_PACKAGE (package1), FALSE);
 	g_return_val_if_fail (PK_IS_PACKAGE (package2), FALSE);
-	return (g_strcmp0 (package1->priv->package_id, package2->priv->package_id) == 0);
+	if (package1->priv->package_id == NULL || package2->priv->package_id == NULL)
+		return FALSE;
+	return pk_package_id_equal_internal (package1->priv, package2->priv);
 }
 
 /**
@@ -160,44 +181,59 @@ gboolean
 pk_package_set_id (PkPackage *package, const gchar *package_id, GError **error)
 {
 	PkPackagePrivate *priv = package->priv;
-	gboolean ret;
+	const gchar * const *sections;
+	const gchar *package_id_new;
+	gchar *package_id_invalid = NULL;
 	guint cnt = 0;
 	guint i;
 
 	g_return_val_if_fail (PK_IS_PACKAGE (package), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+	/* the same package-id is shared by every package object, so the
+	 * common case of a valid id does not copy or split anything */
+	package_id_new = pk_package_id_intern (package_id);
+	if (package_id_new == NULL)
+		package_id_invalid = g_strdup (package_id);
+
 	/* free old data */
-	g_free (priv->package_id);
+	if (priv->package_id_invalid == NULL)
+		pk_package_id_unintern (priv->package_id);
+	g_free (priv->package_id_invalid);
 	g_free (priv->package_id_data);
-
-	/* copy the package-id into package_id_data, change the ';' into '\0'
-	 * and reference the pointers in the const gchar * array */
-	priv->package_id = g_strdup (package_id);
-	priv->package_id_data = g_strdup (package_id);
-	priv->package_id_split[0] = priv->package_id_data;
-	for (i = 0; priv->package_id_data[i] != '\0'; i++) {
-		if (package_id[i] == ';') {
-			if (++cnt > 3)
-				continue;
-			priv->package_id_split[cnt] = &priv->package_id_data[i+1];
-			priv->package_id_data[i] = '\0';
+	priv->package_id_invalid = NULL;
+	priv->package_id_data = NULL;
+	priv->package_id = package_id_new;
+	if (package_id_new != NULL) {
+		sections = pk_package_id_intern_get_sections (package_id_new);
+		memcpy (priv->package_id_split, sections, sizeof (priv->package_id_split));
+		return TRUE;
+	}
+	memset (priv->package_id_split, 0, sizeof (priv->package_id_split));
+
+	/* an invalid id is still set, split as far as it goes, so copy
+	 * it into package_id_data, change the ';' into '\0' and reference
+	 * the pointers in the const gchar * array */
+	if (package_id_invalid != NULL) {
+		priv->package_id_invalid = package_id_invalid;
+		priv->package_id_data = g_strdup (package_id_invalid);
+		priv->package_id = priv->package_id_invalid;
+		priv->package_id_split[0] = priv->package_id_data;
+		for (i = 0; priv->package_id_data[i] != '\0'; i++) {
+			if (package_id_invalid[i] == ';') {
+				if (++cnt > 3)
+					continue;
+				priv->package_id_split[cnt] = &priv->package_id_data[i+1];
+				priv->package_id_data[i] = '\0';
+			}
 		}
 	}
 	if (cnt != 3) {
-		ret = FALSE;
 		g_set_error (error, 1, 0, "invalid number of sections %i", cnt);
-		goto out;
-	}
-
-	/* name has to be valid */
-	ret = (priv->package_id_split[0][0] != '\0');
-	if (!ret) {
-		g_set_error_literal (error, 1, 0, "name invalid");
-		goto out;
+		return FALSE;
 	}
-out:
-	return ret;
+	g_set_error_literal (error, 1, 0, "name invalid");
+	return FALSE;
 }
 
 /**
@@ -833,7 +869,10 @@ pk_package_finalize (GObject *object)
 	PkPackage *package = PK_PACKAGE (object);
 	PkPackagePrivate *priv = package->priv;
 
-	g_free (priv->package_id);
+	if (priv->package_id_invalid == NULL)
+		pk_package_id_unintern (priv->package_id);
+	g_free (priv->package_id_invalid);
+	g_free (priv->package_id_data);
 	g_free (priv->summary);
 	g_free (priv->license);
 	g_free (priv->description);
@@ -847,7 +886,6 @@ pk_package_finalize (GObject *object)
 	g_free (priv->update_changelog);
 	g_free (priv->update_issued);
 	g_free (priv->update_updated);
-	g_free (priv->package_id_data);
 
 	G_OBJECT_CLASS (pk_package_parent_class)->finalize (object);
 }
@@ -35,6 +35,7 @@
 
 #include <packagekit-glib2/pk-results.h>
 #include <packagekit-glib2/pk-enum.h>
+#include <packagekit-glib2/pk-package-id.h>
 
 static void     pk_results_finalize	(GObject     *object);
 
@@ -65,8 +66,18 @@ struct _PkResultsPrivate
 	GPtrArray		*media_change_required_array;
 	GPtrArray		*repo_detail_array;
 	PkPackageSack		*package_sack;
+	GArray			*package_info;
+	GPtrArray		*package_ids;
+	GArray			*package_summary;
+	GString			*summary_arena;
 };
 
+typedef struct {
+	PkResults		*results;
+	GPtrArray		*array;
+	guint			 index;
+} PkResultsPackageIterReal;
+
 enum {
 	PROP_0,
 	PROP_ROLE,
@@ -158,6 +169,51 @@ pk_results_set_exit_code (PkResults *results, PkExitEnum exit_enum)
 	return TRUE;
 }
 
+/**
+ * pk_results_ensure_packages:
+ *
+ * Creates the #PkPackage objects for any packages held in the compact
+ * storage. This is only done when the objects are actually needed, as many
+ * callers only care about the exit code or can use a #PkResultsPackageIter.
+ **/
+static void
+pk_results_ensure_packages (PkResults *results)
+{
+	const gchar *package_id;
+	gchar *transaction_id = NULL;
+	guint i;
+	PkPackage *package;
+	PkResultsPrivate *priv = results->priv;
+
+	if (priv->package_ids->len == 0)
+		return;
+
+	if (priv->progress != NULL) {
+		g_object_get (priv->progress,
+			      "transaction-id", &transaction_id,
+			      NULL);
+	}
+	for (i = 0; i < priv->package_ids->len; i++) {
+		package_id = g_ptr_array_index (priv->package_ids, i);
+		package = pk_package_new ();
+		pk_package_set_id (package, package_id, NULL);
+		g_object_set (package,
+			      "info", (guint) g_array_index (priv->package_info, guint8, i),
+			      "summary", priv->summary_arena->str +
+					 g_array_index (priv->package_summary, guint, i),
+			      "role", priv->role,
+			      "transaction-id", transaction_id,
+			      NULL);
+		pk_package_sack_add_package (priv->package_sack, package);
+		g_object_unref (package);
+	}
+	g_array_set_size (priv->package_info, 0);
+	g_ptr_array_set_size (priv->package_ids, 0);
+	g_array_set_size (priv->package_summary, 0);
+	g_string_truncate (priv->summary_arena, 0);
+	g_free (transaction_id);
+}
+
 /**
  * pk_results_add_package:
  * @results: a valid #PkResults instance
@@ -180,10 +236,217 @@ pk_results_add_package (PkResults *results, PkPackage *item)
 		g_warning ("Finished packages cannot be added to PkResults");
 		return FALSE;
 	}
+	pk_results_ensure_packages (results);
 	pk_package_sack_add_package (results->priv->package_sack, item);
 	return TRUE;
 }
 
+/**
+ * pk_results_add_package_data:
+ * @results: a valid #PkResults instance
+ * @info: the #PkInfoEnum of the package
+ * @package_id: the package-id
+ * @summary: the package summary, or %NULL
+ *
+ * Adds a package to the results set without creating a #PkPackage.
+ * The info, the interned package-id and the offset of the summary in a
+ * shared string buffer are stored in arrays, and the #PkPackage objects
+ * are only created if pk_results_get_package_array() is used.
+ *
+ * Return value: %TRUE if the value was set
+ *
+ * Since: 0.9.6
+ **/
+gboolean
+pk_results_add_package_data (PkResults *results,
+			     PkInfoEnum info,
+			     const gchar *package_id,
+			     const gchar *summary)
+{
+	const gchar *package_id_interned;
+	guint8 info_tmp = info;
+	guint offset;
+	PkResultsPrivate *priv;
+
+	g_return_val_if_fail (PK_IS_RESULTS (results), FALSE);
+	g_return_val_if_fail (package_id != NULL, FALSE);
+
+	priv = results->priv;
+
+	/* the info is stored in a single byte */
+	G_STATIC_ASSERT (PK_INFO_ENUM_LAST <= G_MAXUINT8);
+
+	/* do not allow finished types */
+	if (info == PK_INFO_ENUM_FINISHED) {
+		g_warning ("Finished packages cannot be added to PkResults");
+		return FALSE;
+	}
+	package_id_interned = pk_package_id_intern (package_id);
+	if (package_id_interned == NULL) {
+		g_warning ("failed to set package id for %s", package_id);
+		return FALSE;
+	}
+
+	/* the summary is stored with the trailing NUL */
+	offset = priv->summary_arena->len;
+	if (summary != NULL)
+		g_string_append (priv->summary_arena, summary);
+	g_string_append_c (priv->summary_arena, '\0');
+
+	g_array_append_val (priv->package_info, info_tmp);
+	g_ptr_array_add (priv->package_ids, (gpointer) package_id_interned);
+	g_array_append_val (priv->package_summary, offset);
+	return TRUE;
+}
+
+/**
+ * pk_results_add_package_variant:
+ * @results: a valid #PkResults instance
+ * @packages: a #GVariant of type a(uss)
+ *
+ * Adds packages to the results set without creating any objects.
+ * The #PkPackage objects are only created when the packages are requested,
+ * and the data is copied, so @packages can be freed afterwards.
+ *
+ * Return value: %TRUE if the value was set
+ *
+ * Since: 0.9.6
+ **/
+gboolean
+pk_results_add_package_variant (PkResults *results, GVariant *packages)
+{
+	const gchar *package_id;
+	const gchar *summary;
+	guint info_enum;
+	GVariantIter iter;
+
+	g_return_val_if_fail (PK_IS_RESULTS (results), FALSE);
+	g_return_val_if_fail (packages != NULL, FALSE);
+
+	if (!g_variant_is_of_type (packages, G_VARIANT_TYPE ("a(uss)"))) {
+		g_warning ("Package variants must be of type a(uss), not %s",
+			   g_variant_get_type_string (packages));
+		return FALSE;
+	}
+	g_variant_ref_sink (packages);
+	g_variant_iter_init (&iter, packages);
+	while (g_variant_iter_next (&iter, "(u&s&s)",
+				    &info_enum,
+				    &package_id,
+				    &summary)) {
+		if (info_enum == PK_INFO_ENUM_FINISHED)
+			continue;
+		pk_results_add_package_data (results, info_enum, package_id, summary);
+	}
+	g_variant_unref (packages);
+	return TRUE;
+}
+
+/**
+ * pk_results_package_iter_init:
+ * @iter: a #PkResultsPackageIter
+ * @results: a valid #PkResults instance
+ *
+ * Initializes an iterator over all the packages in the results, in the
+ * order they were added. The iterator keeps a reference on @results until
+ * pk_results_package_iter_clear() is called.
+ *
+ * Since: 0.9.6
+ **/
+void
+pk_results_package_iter_init (PkResultsPackageIter *iter, PkResults *results)
+{
+	PkResultsPackageIterReal *real = (PkResultsPackageIterReal *) iter;
+
+	g_return_if_fail (iter != NULL);
+	g_return_if_fail (PK_IS_RESULTS (results));
+
+	real->results = g_object_ref (results);
+	real->array = pk_package_sack_get_array (results->priv->package_sack);
+	real->index = 0;
+}
+
+/**
+ * pk_results_package_iter_clear:
+ * @iter: a #PkResultsPackageIter
+ *
+ * Releases the references held by an iterator initialized with
+ * pk_results_package_iter_init(). It is safe to call this more than once.
+ *
+ * Since: 0.9.6
+ **/
+void
+pk_results_package_iter_clear (PkResultsPackageIter *iter)
+{
+	PkResultsPackageIterReal *real = (PkResultsPackageIterReal *) iter;
+
+	g_return_if_fail (iter != NULL);
+
+	if (real->array != NULL) {
+		g_ptr_array_unref (real->array);
+		real->array = NULL;
+	}
+	if (real->results != NULL) {
+		g_object_unref (real->results);
+		real->results = NULL;
+	}
+}
+
+/**
+ * pk_results_package_iter_next:
+ * @iter: a #PkResultsPackageIter
+ * @info: (out) (allow-none): the #PkInfoEnum of the package
+ * @package_id: (out) (allow-none): the package-id
+ * @summary: (out) (allow-none): the package summary
+ *
+ * Gets the next package without creating a #PkPackage object.
+ * The returned strings are only valid until the results are next changed.
+ *
+ * Return value: %FALSE when there are no more packages
+ *
+ * Since: 0.9.6
+ **/
+gboolean
+pk_results_package_iter_next (PkResultsPackageIter *iter,
+			      PkInfoEnum *info,
+			      const gchar **package_id,
+			      const gchar **summary)
+{
+	guint idx;
+	PkPackage *package;
+	PkResultsPackageIterReal *real = (PkResultsPackageIterReal *) iter;
+	PkResultsPrivate *priv;
+
+	g_return_val_if_fail (iter != NULL, FALSE);
+	g_return_val_if_fail (real->results != NULL, FALSE);
+
+	priv = real->results->priv;
+
+	/* objects first, as compact rows are only ever appended to the sack */
+	if (real->index < real->array->len) {
+		package = g_ptr_array_index (real->array, real->index++);
+		if (info != NULL)
+			*info = pk_package_get_info (package);
+		if (package_id != NULL)
+			*package_id = pk_package_get_id (package);
+		if (summary != NULL)
+			*summary = pk_package_get_summary (package);
+		return TRUE;
+	}
+
+	idx = real->index - real->array->len;
+	if (idx >= priv->package_ids->len)
+		return FALSE;
+	real->index++;
+	if (info != NULL)
+		*info = g_array_index (priv->package_info, guint8, idx);
+	if (package_id != NULL)
+		*package_id = g_ptr_array_index (priv->package_ids, idx);
+	if (summary != NULL)
+		*summary = priv->summary_arena->str + g_array_index (priv->package_summary, guint, idx);
+	return TRUE;
+}
+
 /**
  * pk_results_add_details:
  * @results: a valid #PkResults instance
@@ -556,6 +819,7 @@ GPtrArray *
 pk_results_get_package_array (PkResults *results)
 {
 	g_return_val_if_fail (PK_IS_RESULTS (results), NULL);
+	pk_results_ensure_packages (results);
 	return pk_package_sack_get_array (results->priv->package_sack);
 }
 
@@ -573,6 +837,7 @@ PkPackageSack *
 pk_results_get_package_sack (PkResults *results)
 {
 	g_return_val_if_fail (PK_IS_RESULTS (results), NULL);
+	pk_results_ensure_packages (results);
 	return g_object_ref (results->priv->package_sack);
 }
 
@@ -872,6 +1137,10 @@ pk_results_init (PkResults *results)
 	results->priv->progress = NULL;
 	results->priv->error_code = NULL;
 	results->priv->package_sack = pk_package_sack_new ();
+	results->priv->package_info = g_array_new (FALSE, FALSE, sizeof (guint8));
+	results->priv->package_ids = g_ptr_array_new_with_free_func ((GDestroyNotify) pk_package_id_unintern);
+	results->priv->package_summary = g_array_new (FALSE, FALSE, sizeof (guint));
+	results->priv->summary_arena = g_string_new (NULL);
 	results->priv->details_array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	results->priv->update_detail_array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	results->priv->category_array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -906,6 +1175,10 @@ pk_results_finalize (GObject *object)
 	g_ptr_array_unref (priv->media_change_required_array);
 	g_ptr_array_unref (priv->repo_detail_array);
 	g_object_unref (priv->package_sack);
+	g_array_unref (priv->package_info);
+	g_ptr_array_unref (priv->package_ids);
+	g_array_unref (priv->package_summary);
+	g_string_free (priv->summary_arena, TRUE);
 	if (results->priv->progress != NULL)
 		g_object_unref (results->priv->progress);
 	if (results->priv->error_code != NULL)
@@ -74,6 +74,20 @@ struct _PkResultsClass
 	void (*_pk_reserved5) (void);
 };
 
+/**
+ * PkResultsPackageIter:
+ *
+ * An iterator over the packages in a #PkResults, which does not create any
+ * #PkPackage objects. Free it with pk_results_package_iter_clear(). All the
+ * fields are private.
+ **/
+typedef struct {
+	/*< private >*/
+	gpointer	 dummy1;
+	gpointer	 dummy2;
+	guint		 dummy3;
+} PkResultsPackageIter;
+
 GType		 pk_results_get_type		  	(void);
 PkResults	*pk_results_new				(void);
 void		 pk_results_test			(gpointer		 user_data);
@@ -87,6 +101,12 @@ gboolean	 pk_results_set_error_code 		(PkResults		*results,
 /* add */
 gboolean	 pk_results_add_package			(PkResults		*results,
 							 PkPackage		*item);
+gboolean	 pk_results_add_package_variant		(PkResults		*results,
+							 GVariant		*packages);
+gboolean	 pk_results_add_package_data		(PkResults		*results,
+							 PkInfoEnum		 info,
+							 const gchar		*package_id,
+							 const gchar		*summary);
 gboolean	 pk_results_add_details			(PkResults		*results,
 							 PkDetails		*item);
 gboolean	 pk_results_add_update_detail		(PkResults		*results,
@@ -131,6 +151,15 @@ GPtrArray	*pk_results_get_repo_signature_required_array (PkResults	*results);
 GPtrArray	*pk_results_get_eula_required_array	(PkResults		*results);
 GPtrArray	*pk_results_get_media_change_required_array (PkResults		*results);
 GPtrArray	*pk_results_get_repo_detail_array	(PkResults		*results);
+
+/* iterate packages without creating objects */
+void		 pk_results_package_iter_init		(PkResultsPackageIter	*iter,
+							 PkResults		*results);
+void		 pk_results_package_iter_clear		(PkResultsPackageIter	*iter);
+gboolean	 pk_results_package_iter_next		(PkResultsPackageIter	*iter,
+							 PkInfoEnum		*info,
+							 const gchar		**package_id,
+							 const gchar		**summary);
 G_DEPRECATED
 GPtrArray	*pk_results_get_message_array		(PkResults		*results);
 
@@ -387,6 +387,40 @@ pk_test_client_resolve_cb (GObject *object, GAsyncResult *res, gpointer user_dat
 	_g_test_loop_quit ();
 }
 
+static void
+pk_test_client_resolve_streamed_cb (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+	PkClient *client = PK_CLIENT (object);
+	GError *error = NULL;
+	PkResults *results = NULL;
+	GPtrArray *packages;
+
+	/* get the results */
+	results = pk_client_generic_finish (client, res, &error);
+	g_assert_no_error (error);
+	g_assert (results != NULL);
+	g_assert_cmpint (pk_results_get_exit_code (results), ==, PK_EXIT_ENUM_SUCCESS);
+
+	/* nothing was stored */
+	packages = pk_results_get_package_array (results);
+	g_assert_cmpint (packages->len, ==, 0);
+	g_ptr_array_unref (packages);
+
+	g_object_unref (results);
+	_g_test_loop_quit ();
+}
+
+static void
+pk_test_client_package_cb (PkInfoEnum info,
+			   const gchar *package_id,
+			   const gchar *summary,
+			   gpointer user_data)
+{
+	guint *cnt = (guint *) user_data;
+	g_assert (pk_package_id_check (package_id));
+	(*cnt)++;
+}
+
 static void
 pk_test_client_get_details_cb (GObject *object, GAsyncResult *res, gpointer user_data)
 {
@@ -619,9 +653,11 @@ pk_test_client_func (void)
 	GError *error = NULL;
 	PkProgress *progress;
 	gchar *tid;
+	guint package_cnt = 0;
+	GPtrArray *array;
 	PkRoleEnum role;
 	PkStatusEnum status;
-//	PkResults *results;
+	PkResults *results;
 
 #if 0
 	/* test user temp */
@@ -691,6 +727,63 @@ pk_test_client_func (void)
 	g_free (tid);
 	g_free (_tid);
 
+	/* resolve again, processing each package without storing it */
+	pk_client_set_package_callback (client, pk_test_client_package_cb, &package_cnt, NULL);
+	pk_client_set_accumulate (client, FALSE);
+	package_ids = pk_package_ids_from_string ("glib2;2.14.0;i386;fedora&powertop");
+	pk_client_resolve_async (client, pk_bitfield_value (PK_FILTER_ENUM_INSTALLED), package_ids, NULL,
+		 NULL, NULL,
+		 (GAsyncReadyCallback) pk_test_client_resolve_streamed_cb, NULL);
+	g_strfreev (package_ids);
+	_g_test_loop_run_with_timeout (15000);
+	g_assert_cmpint (package_cnt, ==, 2);
+	pk_client_set_package_callback (client, NULL, NULL, NULL);
+	pk_client_set_accumulate (client, TRUE);
+
+	/* get packages, which the daemon sends in a results file if it can */
+	results = pk_client_get_packages (client, pk_bitfield_value (PK_FILTER_ENUM_NONE),
+					  NULL, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (results != NULL);
+	g_assert_cmpint (pk_results_get_exit_code (results), ==, PK_EXIT_ENUM_SUCCESS);
+	array = pk_results_get_package_array (results);
+	g_assert_cmpint (array->len, ==, 1);
+	g_assert_cmpstr (pk_package_get_id (g_ptr_array_index (array, 0)), ==,
+			 "update1;2.19.1-4.fc8;i386;fedora");
+	g_ptr_array_unref (array);
+	g_object_unref (results);
+
+	/* with a package callback the daemon sends ::Packages instead */
+	package_cnt = 0;
+	pk_client_set_package_callback (client, pk_test_client_package_cb, &package_cnt, NULL);
+	results = pk_client_get_packages (client, pk_bitfield_value (PK_FILTER_ENUM_NONE),
+					  NULL, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (results != NULL);
+	g_assert_cmpint (package_cnt, ==, 1);
+	array = pk_results_get_package_array (results);
+	g_assert_cmpint (array->len, ==, 1);
+	g_ptr_array_unref (array);
+	g_object_unref (results);
+
+	/* the file lists are still stored when not accumulating */
+	pk_client_set_accumulate (client, FALSE);
+	package_ids = pk_package_ids_from_id ("powertop;1.8-1.fc8;i386;fedora");
+	results = pk_client_get_files (client, package_ids, NULL, NULL, NULL, &error);
+	g_strfreev (package_ids);
+	g_assert_no_error (error);
+	g_assert (results != NULL);
+	g_assert_cmpint (pk_results_get_exit_code (results), ==, PK_EXIT_ENUM_SUCCESS);
+	array = pk_results_get_files_array (results);
+	g_assert_cmpint (array->len, ==, 1);
+	g_assert_cmpstr (pk_files_get_package_id (g_ptr_array_index (array, 0)), ==,
+			 "powertop;1.8-1.fc8;i386;fedora");
+	g_assert_cmpint (g_strv_length (pk_files_get_files (g_ptr_array_index (array, 0))), ==, 2);
+	g_ptr_array_unref (array);
+	g_object_unref (results);
+	pk_client_set_package_callback (client, NULL, NULL, NULL);
+	pk_client_set_accumulate (client, TRUE);
+
 	/* got updates */
 	g_assert_cmpint (_progress_cb, >, 0);
 	g_assert_cmpint (_status_cb, >, 0);
@@ -1237,9 +1330,11 @@ pk_test_enum_func (void)
 static void
 pk_test_package_id_func (void)
 {
+	const gchar *interned;
 	gboolean ret;
 	gchar *text;
 	gchar **sections;
+	PkPackageIdView view;
 
 	/* check not valid - NULL */
 	ret = pk_package_id_check (NULL);
@@ -1311,6 +1406,33 @@ pk_test_package_id_func (void)
 	/* test fail missing first */
 	sections = pk_package_id_split (";0.1.2;i386;data");
 	g_assert (sections == NULL);
+
+	/* test view */
+	ret = pk_package_id_view_init (&view, "moo;0.0.1;i386;fedora");
+	g_assert (ret);
+	g_assert_cmpint (view.name_len, ==, 3);
+	g_assert_cmpint (view.version_len, ==, 5);
+	g_assert_cmpint (view.data_len, ==, 6);
+	g_assert (pk_package_id_view_name_equal (&view, "moo"));
+	g_assert (!pk_package_id_view_name_equal (&view, "mo"));
+	g_assert (!pk_package_id_view_name_equal (&view, "moos"));
+	g_assert (pk_package_id_view_arch_equal (&view, "i386"));
+
+	/* test view fail */
+	ret = pk_package_id_view_init (&view, "foo;moo;dave;clive;dan");
+	g_assert (!ret);
+	ret = pk_package_id_view_init (&view, ";0.1.2;i386;data");
+	g_assert (!ret);
+
+	/* test interning */
+	text = g_strdup ("moo;0.0.1;i386;fedora");
+	interned = pk_package_id_intern ("moo;0.0.1;i386;fedora");
+	g_assert_cmpstr (interned, ==, "moo;0.0.1;i386;fedora");
+	g_assert (pk_package_id_intern (text) == interned);
+	pk_package_id_unintern (interned);
+	pk_package_id_unintern (interned);
+	g_free (text);
+	g_assert (pk_package_id_intern ("foo;moo") == NULL);
 }
 
 static void
@@ -1405,6 +1527,7 @@ pk_test_package_sack_func (void)
 	guint size;
 	PkInfoEnum info = PK_INFO_ENUM_UNKNOWN;
 	guint64 bytes;
+	GPtrArray *array;
 
 	sack = pk_package_sack_new ();
 	g_assert (sack != NULL);
@@ -1506,12 +1629,215 @@ pk_test_package_sack_func (void)
 	/* remove by filter */
 	pk_package_sack_add_package_by_id (sack, "powertop;1.8-1.fc8;i386;fedora", NULL);
 	pk_package_sack_add_package_by_id (sack, "powertop-debuginfo;1.8-1.fc8;i386;fedora", NULL);
+	pk_package_sack_add_package_by_id (sack, "powertop;1.9-1.fc8;x86_64;fedora", NULL);
+
+	/* find by name uses the index */
+	array = pk_package_sack_find_by_name (sack, "powertop");
+	g_assert_cmpint (array->len, ==, 2);
+	g_assert_cmpstr (pk_package_get_arch (g_ptr_array_index (array, 1)), ==, "x86_64");
+	g_ptr_array_unref (array);
+	array = pk_package_sack_find_by_name (sack, "power");
+	g_assert_cmpint (array->len, ==, 0);
+	g_ptr_array_unref (array);
+
+	/* find by name and arch */
+	package = pk_package_sack_find_by_id_name_arch (sack, "powertop;1.0;x86_64;");
+	g_assert (package != NULL);
+	g_assert_cmpstr (pk_package_get_version (package), ==, "1.9-1.fc8");
+	g_object_unref (package);
+	package = pk_package_sack_find_by_id_name_arch (sack, "powertop;1.0;noarch;");
+	g_assert (package == NULL);
+
 	ret = pk_package_sack_remove_by_filter (sack, pk_test_package_sack_filter_cb, NULL);
 	g_assert (ret);
 
-	/* check all removed */
+	/* check all removed, including from the indexes */
 	size = pk_package_sack_get_size (sack);
 	g_assert_cmpint (size, ==, 0);
+	package = pk_package_sack_find_by_id_name_arch (sack, "powertop;1.8-1.fc8;i386;fedora");
+	g_assert (package == NULL);
+
+	g_object_unref (sack);
+}
+
+static guint _sack_chunks_finished = 0;
+static guint _sack_chunks_max_running = 0;
+static GHashTable *_sack_chunks_running = NULL;
+
+/**
+ * pk_test_package_sack_chunks_progress_cb:
+ *
+ * Each chunk transaction has its own #PkProgress, so count them while they
+ * are running; every one is forced to finished when its transaction is done.
+ **/
+static void
+pk_test_package_sack_chunks_progress_cb (PkProgress *progress, PkProgressType type, gpointer user_data)
+{
+	PkStatusEnum status;
+
+	g_object_get (progress, "status", &status, NULL);
+	if (type == PK_PROGRESS_TYPE_STATUS && status == PK_STATUS_ENUM_FINISHED) {
+		g_hash_table_remove (_sack_chunks_running, progress);
+		_sack_chunks_finished++;
+		return;
+	}
+	g_hash_table_insert (_sack_chunks_running, progress, progress);
+	_sack_chunks_max_running = MAX (_sack_chunks_max_running,
+					g_hash_table_size (_sack_chunks_running));
+}
+
+static void
+pk_test_package_sack_chunks_error_cb (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+	PkPackageSack *sack = PK_PACKAGE_SACK (object);
+	GError *error = NULL;
+	gboolean ret;
+
+	/* get the result */
+	ret = pk_package_sack_merge_generic_finish (sack, res, &error);
+	g_assert (error != NULL);
+	g_assert (!ret);
+	g_error_free (error);
+
+	_g_test_loop_quit ();
+}
+
+/**
+ * pk_test_package_sack_chunks_fatal_cb:
+ *
+ * The sack warns about each chunk that fails, which is expected here.
+ **/
+static gboolean
+pk_test_package_sack_chunks_fatal_cb (const gchar *log_domain, GLogLevelFlags log_level,
+				      const gchar *message, gpointer user_data)
+{
+	return !g_str_has_prefix (message, "failed to resolve");
+}
+
+static void
+pk_test_package_sack_chunks_func (void)
+{
+	gboolean ret;
+	gchar *text;
+	guint i;
+	PkPackage *package;
+	PkPackageSack *sack;
+	const gchar *package_ids[] = { "glib2;2.14.0;i386;fedora",
+				       "powertop;1.8-1.fc8;i386;fedora",
+				       "kernel;2.6.23-0.115.rc3.git1.fc8;i386;installed",
+				       "gtkhtml2;2.19.1-4.fc8;i386;fedora",
+				       "vips-doc;7.12.4-2.fc8;noarch;linva",
+				       "foobar;1.1.0;i386;debian",
+				       "libawesome;42;i386;debian",
+				       NULL };
+	const gchar *invalid_ids[] = { "bad$1;0.1;i386;fedora",
+				       "bad$2;0.1;i386;fedora",
+				       "bad$3;0.1;i386;fedora",
+				       "bad$4;0.1;i386;fedora",
+				       NULL };
+
+	_sack_chunks_running = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	/* one package per transaction */
+	sack = pk_package_sack_new ();
+	pk_package_sack_set_chunk_size (sack, 1);
+	g_assert_cmpint (pk_package_sack_get_chunk_size (sack), ==, 1);
+	for (i = 0; package_ids[i] != NULL; i++) {
+		ret = pk_package_sack_add_package_by_id (sack, package_ids[i], NULL);
+		g_assert (ret);
+	}
+
+	/* merge resolve results from every chunk */
+	pk_package_sack_resolve_async (sack, NULL,
+				       pk_test_package_sack_chunks_progress_cb, NULL,
+				       (GAsyncReadyCallback) pk_test_package_sack_resolve_cb, NULL);
+	_g_test_loop_run_with_timeout (5000);
+	g_debug ("resolved in %f", g_test_timer_elapsed ());
+	g_assert_cmpint (_sack_chunks_finished, ==, 7);
+	g_assert_cmpint (g_hash_table_size (_sack_chunks_running), ==, 0);
+	g_assert_cmpint (_sack_chunks_max_running, >, 0);
+	g_assert_cmpint (_sack_chunks_max_running, <=, 4);
+
+	/* the first and the last chunk were both merged */
+	package = pk_package_sack_find_by_id (sack, "glib2;2.14.0;i386;fedora");
+	g_assert (package != NULL);
+	g_object_get (package, "summary", &text, NULL);
+	g_assert_cmpstr (text, ==, "The GLib library");
+	g_free (text);
+	g_object_unref (package);
+	package = pk_package_sack_find_by_id (sack, "gtkhtml2;2.19.1-4.fc8;i386;fedora");
+	g_assert (package != NULL);
+	g_assert_cmpint (pk_package_get_info (package), ==, PK_INFO_ENUM_INSTALLED);
+	g_object_unref (package);
+	g_object_unref (sack);
+
+	/* the four chunks started first all fail, so no more are started */
+	_sack_chunks_finished = 0;
+	_sack_chunks_max_running = 0;
+	sack = pk_package_sack_new ();
+	pk_package_sack_set_chunk_size (sack, 1);
+	for (i = 0; invalid_ids[i] != NULL; i++) {
+		ret = pk_package_sack_add_package_by_id (sack, invalid_ids[i], NULL);
+		g_assert (ret);
+	}
+	for (i = 0; package_ids[i] != NULL; i++) {
+		ret = pk_package_sack_add_package_by_id (sack, package_ids[i], NULL);
+		g_assert (ret);
+	}
+	g_test_log_set_fatal_handler (pk_test_package_sack_chunks_fatal_cb, NULL);
+	pk_package_sack_resolve_async (sack, NULL,
+				       pk_test_package_sack_chunks_progress_cb, NULL,
+				       (GAsyncReadyCallback) pk_test_package_sack_chunks_error_cb, NULL);
+	_g_test_loop_run_with_timeout (5000);
+	g_test_log_set_fatal_handler (NULL, NULL);
+	g_assert_cmpint (_sack_chunks_finished, ==, 4);
+	g_assert_cmpint (_sack_chunks_max_running, <=, 4);
+
+	/* nothing from the valid packages was merged */
+	package = pk_package_sack_find_by_id (sack, "glib2;2.14.0;i386;fedora");
+	g_assert (package != NULL);
+	g_assert_cmpint (pk_package_get_info (package), ==, PK_INFO_ENUM_UNKNOWN);
+	g_object_unref (package);
+
+	g_object_unref (sack);
+	g_hash_table_unref (_sack_chunks_running);
+	_sack_chunks_running = NULL;
+}
+
+static void
+pk_test_package_sack_index_func (void)
+{
+	gchar *package_id;
+	gdouble elapsed;
+	guint i;
+	PkPackage *package;
+	PkPackageSack *sack;
+
+	if (!g_test_perf ())
+		return;
+
+	/* a sack the size of a distribution */
+	sack = pk_package_sack_new ();
+	for (i = 0; i < 100000; i++) {
+		package_id = g_strdup_printf ("package%05u;1.0-1;%s;fedora",
+					      i, i % 2 == 0 ? "x86_64" : "i686");
+		pk_package_sack_add_package_by_id (sack, package_id, NULL);
+		g_free (package_id);
+	}
+
+	/* looking up every package should take linear time */
+	g_test_timer_start ();
+	for (i = 0; i < 100000; i++) {
+		package_id = g_strdup_printf ("package%05u;2.0-1;%s;updates",
+					      i, i % 2 == 0 ? "x86_64" : "i686");
+		package = pk_package_sack_find_by_id_name_arch (sack, package_id);
+		g_assert (package != NULL);
+		g_object_unref (package);
+		g_free (package_id);
+	}
+	elapsed = g_test_timer_elapsed ();
+	g_test_minimized_result (elapsed, "100000 name/arch lookups: %.3fs", elapsed);
+	g_assert_cmpfloat (elapsed, <, 1.0);
 
 	g_object_unref (sack);
 }
@@ -1541,8 +1867,12 @@ pk_test_progress_bar (void)
 static void
 pk_test_results_func (void)
 {
+	const gchar *summary_tmp;
+	const gchar *tmp;
 	gboolean ret;
 	PkResults *results;
+	PkResults *results2;
+	PkResultsPackageIter iter;
 	PkExitEnum exit_enum;
 	GPtrArray *packages;
 	PkPackage *item;
@@ -1619,6 +1949,49 @@ pk_test_results_func (void)
 	g_free (package_id);
 	g_free (summary);
 
+	/* add compact package */
+	ret = pk_results_add_package_data (results, PK_INFO_ENUM_INSTALLED,
+					   "powertop;1.8-1.fc8;i386;fedora",
+					   "Power consumption monitor");
+	g_assert (ret);
+
+	/* iterate without objects */
+	pk_results_package_iter_init (&iter, results);
+	ret = pk_results_package_iter_next (&iter, &info, &tmp, NULL);
+	g_assert (ret);
+	g_assert_cmpstr (tmp, ==, "gnome-power-manager;0.1.2;i386;fedora");
+	ret = pk_results_package_iter_next (&iter, &info, &tmp, &summary_tmp);
+	g_assert (ret);
+	g_assert_cmpint (info, ==, PK_INFO_ENUM_INSTALLED);
+	g_assert_cmpstr (tmp, ==, "powertop;1.8-1.fc8;i386;fedora");
+	g_assert_cmpstr (summary_tmp, ==, "Power consumption monitor");
+	ret = pk_results_package_iter_next (&iter, NULL, NULL, NULL);
+	g_assert (!ret);
+	pk_results_package_iter_clear (&iter);
+
+	/* the iterator keeps the results alive */
+	results2 = pk_results_new ();
+	ret = pk_results_add_package_data (results2, PK_INFO_ENUM_AVAILABLE,
+					   "powertop;1.8-1.fc8;i386;fedora",
+					   "Power consumption monitor");
+	g_assert (ret);
+	pk_results_package_iter_init (&iter, results2);
+	g_object_unref (results2);
+	ret = pk_results_package_iter_next (&iter, &info, &tmp, NULL);
+	g_assert (ret);
+	g_assert_cmpint (info, ==, PK_INFO_ENUM_AVAILABLE);
+	g_assert_cmpstr (tmp, ==, "powertop;1.8-1.fc8;i386;fedora");
+	pk_results_package_iter_clear (&iter);
+	pk_results_package_iter_clear (&iter);
+
+	/* objects are created on demand */
+	packages = pk_results_get_package_array (results);
+	g_assert_cmpint (packages->len, ==, 2);
+	item = g_ptr_array_index (packages, 1);
+	g_assert_cmpstr (pk_package_get_name (item), ==, "powertop");
+	g_assert_cmpstr (pk_package_get_summary (item), ==, "Power consumption monitor");
+	g_ptr_array_unref (packages);
+
 	g_object_unref (results);
 }
 
@@ -1937,6 +2310,10 @@ pk_test_package_func (void)
 	g_assert (!ret);
 	g_clear_error (&error);
 
+	/* invalid ids are still set */
+	g_assert_cmpstr (pk_package_get_id (package), ==, "gnome-power-manager");
+	g_assert_cmpstr (pk_package_get_name (package), ==, "gnome-power-manager");
+
 	/* set invalid id (sections) */
 	ret = pk_package_set_id (package, "gnome-power-manager;0.1.2;i386", &error);
 	g_assert_error (error, 1, 0);
@@ -2006,6 +2383,8 @@ main (int argc, char **argv)
 	g_test_add_func ("/packagekit-glib2/client-helper", pk_test_client_helper_func);
 	g_test_add_func ("/packagekit-glib2/client", pk_test_client_func);
 	g_test_add_func ("/packagekit-glib2/package-sack", pk_test_package_sack_func);
+	g_test_add_func ("/packagekit-glib2/package-sack-chunks", pk_test_package_sack_chunks_func);
+	g_test_add_func ("/packagekit-glib2/package-sack-index", pk_test_package_sack_index_func);
 	g_test_add_func ("/packagekit-glib2/task", pk_test_task_func);
 	g_test_add_func ("/packagekit-glib2/task-wrapper", pk_test_task_wrapper_func);
 	g_test_add_func ("/packagekit-glib2/task-text", pk_test_task_text_func);
@@ -27,18 +27,30 @@ from __future__ import print_function
 import sys
 import traceback
 import os.path
+import struct
+import atexit
 
 from .enums import *
 
 PACKAGE_IDS_DELIM = '&'
 FILENAME_DELIM = '|'
 
+# once the daemon sees this line, everything else on stdout is frames
+FRAMED_MAGIC = 'framed'
+# batched frames are written out once there is at least this much
+FRAMED_BUFFER_SIZE = 65536
+
 def _to_unicode(txt, encoding='utf-8'):
     if isinstance(txt, str):
         if not isinstance(txt, str):
             txt = str(txt, encoding, errors='replace')
     return txt
 
+def _to_bytes(txt):
+    if isinstance(txt, bytes):
+        return txt
+    return (u'%s' % txt).encode('utf-8', 'replace')
+
 def _to_utf8(txt, errors='replace'):
     if isinstance(txt, str):
         return txt
@@ -100,6 +112,57 @@ class PackageKitBaseBackend:
         except KeyError as e:
             pass
 
+        # use length prefixed frames rather than lines of text if the
+        # daemon supports them, which needs no escaping and lets us
+        # write many records at once
+        self._frames = None
+        if os.environ.get('PACKAGEKIT_FRAMED') == 'TRUE':
+            self._enable_frames()
+
+    def _enable_frames(self):
+        '''
+        Switch stdout to frames, sending anything else that gets printed
+        by us or by the libraries we use to stderr instead
+        '''
+        sys.stdout.write(_to_utf8(FRAMED_MAGIC + "\n"))
+        sys.stdout.flush()
+        self._output = os.fdopen(os.dup(1), 'wb')
+        os.dup2(2, 1)
+        self._frames = []
+        self._frames_size = 0
+        atexit.register(self._flush_frames)
+
+    def _flush_frames(self):
+        if not self._frames:
+            return
+        self._output.write(b''.join(self._frames))
+        self._output.flush()
+        self._frames = []
+        self._frames_size = 0
+
+    def _emit_batched(self, *fields):
+        '''
+        Queue a record for the daemon, which is only sent when the buffer
+        is full or when something that needs to be seen at once is sent
+        '''
+        if self._frames is None:
+            sys.stdout.write(_to_utf8('\t'.join(['%s' % f for f in fields]) + '\n'))
+            sys.stdout.flush()
+            return
+        payload = b''.join([_to_bytes(f) + b'\0' for f in fields])
+        self._frames.append(struct.pack('<I', len(payload)) + payload)
+        self._frames_size += 4 + len(payload)
+        if self._frames_size >= FRAMED_BUFFER_SIZE:
+            self._flush_frames()
+
+    def _emit(self, *fields):
+        '''
+        Send a record to the daemon at once, along with any queued ones
+        '''
+        self._emit_batched(*fields)
+        if self._frames is not None:
+            self._flush_frames()
+
     def doLock(self):
         ''' Generic locking, overide and extend in child class'''
         self._locked = True
@@ -117,19 +180,17 @@ class PackageKitBaseBackend:
         @param percent: Progress percentage (int preferred)
         '''
         if percent == None:
-            sys.stdout.write(_to_utf8("no-percentage-updates\n"))
+            self._emit('no-percentage-updates')
         elif percent == 0 or percent > self.percentage_old:
-            sys.stdout.write(_to_utf8("percentage\t%i\n" % percent))
+            self._emit('percentage', '%i' % percent)
             self.percentage_old = percent
-        sys.stdout.flush()
 
     def speed(self, bps=0):
         '''
         Write progress speed
         @param bps: Progress speed (int, bytes per second)
         '''
-        sys.stdout.write(_to_utf8("speed\t%i\n" % bps))
-        sys.stdout.flush()
+        self._emit('speed', '%i' % bps)
 
     def item_progress(self, package_id, status, percent=None):
         '''
@@ -137,8 +198,7 @@ class PackageKitBaseBackend:
         @param package_id: The package ID name, e.g. openoffice-clipart;2.6.22;ppc64;fedora
         @param percent: percentage of the current item (int preferred)
         '''
-        sys.stdout.write(_to_utf8("item-progress\t%s\t%s\t%i\n" % (package_id, status, percent)))
-        sys.stdout.flush()
+        self._emit('item-progress', package_id, status, '%i' % percent)
 
     def error(self, err, description, exit=True):
         '''
@@ -152,8 +212,7 @@ class PackageKitBaseBackend:
             self.unLock()
 
         # this should be fast now
-        sys.stdout.write(_to_utf8("error\t%s\t%s\n" % (err, description)))
-        sys.stdout.flush()
+        self._emit('error', err, description)
         if exit:
             # Paradoxically, we don't want to print "finished" to stdout here.
             # Python takes an _enormous_ amount of time to exit, and leaves a
@@ -167,8 +226,7 @@ class PackageKitBaseBackend:
         send 'message' signal
         @param typ: MESSAGE_BROKEN_MIRROR
         '''
-        sys.stdout.write(_to_utf8("message\t%s\t%s\n" % (typ, msg)))
-        sys.stdout.flush()
+        self._emit('message', typ, msg)
 
     def package(self, package_id, status, summary):
         '''
@@ -177,8 +235,7 @@ class PackageKitBaseBackend:
         @param package_id: The package ID name, e.g. openoffice-clipart;2.6.22;ppc64;fedora
         @param summary: The package Summary
         '''
-        sys.stdout.write(_to_utf8("package\t%s\t%s\t%s\n" % (status, package_id, summary)))
-        sys.stdout.flush()
+        self._emit_batched('package', status, package_id, summary)
 
     def media_change_required(self, mtype, id, text):
         '''
@@ -187,8 +244,7 @@ class PackageKitBaseBackend:
         @param id: the localised label of the media
         @param text: the localised text describing the media
         '''
-        sys.stdout.write(_to_utf8("media-change-required\t%s\t%s\t%s\n" % (mtype, id, text)))
-        sys.stdout.flush()
+        self._emit('media-change-required', mtype, id, text)
 
     def distro_upgrade(self, dtype, name, summary):
         '''
@@ -197,16 +253,14 @@ class PackageKitBaseBackend:
         @param name: The distro name, e.g. "fedora-9"
         @param summary: The localised distribution name and description
         '''
-        sys.stdout.write(_to_utf8("distro-upgrade\t%s\t%s\t%s\n" % (dtype, name, summary)))
-        sys.stdout.flush()
+        self._emit_batched('distro-upgrade', dtype, name, summary)
 
     def status(self, state):
         '''
         send 'status' signal
         @param state: STATUS_DOWNLOAD, STATUS_INSTALL, STATUS_UPDATE, STATUS_REMOVE, STATUS_WAIT
         '''
-        sys.stdout.write(_to_utf8("status\t%s\n" % state))
-        sys.stdout.flush()
+        self._emit('status', state)
 
     def repo_detail(self, repoid, name, state):
         '''
@@ -214,16 +268,14 @@ class PackageKitBaseBackend:
         @param repoid: The repo id tag
         @param state: false is repo is disabled else true.
         '''
-        sys.stdout.write(_to_utf8("repo-detail\t%s\t%s\t%s\n" % (repoid, name, _bool_to_string(state))))
-        sys.stdout.flush()
+        self._emit_batched('repo-detail', repoid, name, _bool_to_string(state))
 
     def data(self, data):
         '''
         send 'data' signal:
         @param data:  The current worked on package
         '''
-        sys.stdout.write(_to_utf8("data\t%s\n" % data))
-        sys.stdout.flush()
+        self._emit('data', data)
 
     def details(self, package_id, summary, package_license, group, desc, url, bytes):
         '''
@@ -235,16 +287,14 @@ class PackageKitBaseBackend:
         @param url: The upstream project homepage
         @param bytes: The size of the package, in bytes
         '''
-        sys.stdout.write(_to_utf8("details\t%s\t%s\t%s\t%s\t%s\t%s\t%ld\n" % (package_id, summary, package_license, group, desc, url, bytes)))
-        sys.stdout.flush()
+        self._emit_batched('details', package_id, summary, package_license, group, desc, url, '%ld' % bytes)
 
     def files(self, package_id, file_list):
         '''
         Send 'files' signal
         @param file_list: List of the files in the package, separated by ';'
         '''
-        sys.stdout.write(_to_utf8("files\t%s\t%s\n" % (package_id, file_list)))
-        sys.stdout.flush()
+        self._emit_batched('files', package_id, file_list)
 
     def category(self, parent_id, cat_id, name, summary, icon):
         '''
@@ -255,15 +305,13 @@ class PackageKitBaseBackend:
         summery   : a summary of the category in current locale.
         icon      : an icon name to represent the category
         '''
-        sys.stdout.write(_to_utf8("category\t%s\t%s\t%s\t%s\t%s\n" % (parent_id, cat_id, name, summary, icon)))
-        sys.stdout.flush()
+        self._emit_batched('category', parent_id, cat_id, name, summary, icon)
 
     def finished(self):
         '''
         Send 'finished' signal
         '''
-        sys.stdout.write(_to_utf8("finished\n"))
-        sys.stdout.flush()
+        self._emit('finished')
 
     def update_detail(self, package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated):
         '''
@@ -281,8 +329,8 @@ class PackageKitBaseBackend:
         @param issued:
         @param updated:
         '''
-        sys.stdout.write(_to_utf8("updatedetail\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (package_id, updates, obsoletes, vendor_url, bugzilla_url, cve_url, restart, update_text, changelog, state, issued, updated)))
-        sys.stdout.flush()
+        self._emit_batched('updatedetail', package_id, updates, obsoletes, vendor_url, bugzilla_url,
+                           cve_url, restart, update_text, changelog, state, issued, updated)
 
     def require_restart(self, restart_type, details):
         '''
@@ -290,8 +338,7 @@ class PackageKitBaseBackend:
         @param restart_type: RESTART_SYSTEM, RESTART_APPLICATION, RESTART_SESSION
         @param details: Optional details about the restart
         '''
-        sys.stdout.write(_to_utf8("requirerestart\t%s\t%s\n" % (restart_type, details)))
-        sys.stdout.flush()
+        self._emit('requirerestart', restart_type, details)
 
     def allow_cancel(self, allow):
         '''
@@ -302,8 +349,7 @@ class PackageKitBaseBackend:
             data = 'true'
         else:
             data = 'false'
-        sys.stdout.write(_to_utf8("allow-cancel\t%s\n" % data))
-        sys.stdout.flush()
+        self._emit('allow-cancel', data)
 
     def repo_signature_required(self, package_id, repo_name, key_url, key_userid, key_id, key_fingerprint, key_timestamp, sig_type):
         '''
@@ -317,10 +363,8 @@ class PackageKitBaseBackend:
         @param key_timestamp:   Key timestamp
         @param sig_type:        Key type (GPG)
         '''
-        sys.stdout.write(_to_utf8("repo-signature-required\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" % (
-            package_id, repo_name, key_url, key_userid, key_id, key_fingerprint, key_timestamp, sig_type
-            )))
-        sys.stdout.flush()
+        self._emit('repo-signature-required', package_id, repo_name, key_url, key_userid,
+                   key_id, key_fingerprint, key_timestamp, sig_type)
 
     def eula_required(self, eula_id, package_id, vendor_name, license_agreement):
         '''
@@ -330,10 +374,7 @@ class PackageKitBaseBackend:
         @param vendor_name:     Name of the vendor that wrote the EULA
         @param license_agreement: The license text
         '''
-        sys.stdout.write(_to_utf8("eula-required\t%s\t%s\t%s\t%s\n" % (
-            eula_id, package_id, vendor_name, license_agreement
-            )))
-        sys.stdout.flush()
+        self._emit('eula-required', eula_id, package_id, vendor_name, license_agreement)
 
 #
 # Backend Action Methods
@@ -699,6 +740,8 @@ class PackageKitBaseBackend:
         if len(args) > 0:
             self.dispatch_command(args[0], args[1:])
         while True:
+            if self._frames is not None:
+                self._flush_frames()
             try:
                 line = sys.stdin.readline().strip('\n')
             except IOError as e:
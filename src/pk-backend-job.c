@@ -64,12 +64,31 @@
  */
 #define PK_BACKEND_CANCEL_ACTION_TIMEOUT	2000 /* ms */
 
+/**
+ * PK_BACKEND_JOB_DISPATCH_MAX:
+ *
+ * The maximum number of queued events we dispatch in one main loop
+ * wakeup, so that a backend flooding us with packages does not stop
+ * other sources (and other transactions) from being serviced.
+ */
+#define PK_BACKEND_JOB_DISPATCH_MAX		500 /* events */
+
 typedef struct {
 	gboolean		 enabled;
 	PkBackendJobVFunc	 vfunc;
 	gpointer		 user_data;
 } PkBackendJobVFuncItem;
 
+/* used to call vfuncs in the main daemon thread */
+typedef struct PkBackendJobVFuncHelper PkBackendJobVFuncHelper;
+struct PkBackendJobVFuncHelper {
+	PkBackendJobSignal	 signal_kind;
+	gpointer		 object;
+	GDestroyNotify		 destroy_func;
+	gint64			 queued;
+	PkBackendJobVFuncHelper	*next;
+};
+
 struct PkBackendJobPrivate
 {
 	gboolean		 finished;
@@ -87,7 +106,7 @@ struct PkBackendJobPrivate
 	gchar			*proxy_https;
 	gchar			*proxy_socks;
 	gpointer		 user_data;
-	GThread			*thread;
+	gboolean		 has_thread;
 	guint64			 download_size_remaining;
 	guint			 cache_age;
 	guint			 download_files;
@@ -111,6 +130,18 @@ struct PkBackendJobPrivate
 	PkStatusEnum		 status;
 	PkTime			*time;
 	gboolean		 started;
+
+	/* pushed by any thread, newest first */
+	PkBackendJobVFuncHelper	*queue_head;
+	/* only used in the main thread, oldest first */
+	PkBackendJobVFuncHelper	*dispatch_head;
+	PkBackendJobVFuncHelper	*dispatch_tail;
+	gint			 queue_depth;
+	gint			 queue_depth_max;
+	guint			 dispatch_count;
+	guint			 dispatch_wakeups;
+	guint64			 dispatch_latency_max;
+	guint64			 dispatch_latency_total;
 };
 
 G_DEFINE_TYPE (PkBackendJob, pk_backend_job, G_TYPE_OBJECT)
@@ -127,7 +158,7 @@ pk_backend_job_reset (PkBackendJob *job)
 	job->priv->finished = FALSE;
 	job->priv->has_sent_package = FALSE;
 	job->priv->set_error = FALSE;
-	job->priv->thread = NULL;
+	job->priv->has_thread = FALSE;
 	job->priv->exit = PK_EXIT_ENUM_UNKNOWN;
 	job->priv->role = PK_ROLE_ENUM_UNKNOWN;
 	job->priv->status = PK_STATUS_ENUM_UNKNOWN;
@@ -572,14 +603,6 @@ pk_backend_job_get_is_error_set (PkBackendJob *job)
 	return job->priv->set_error;
 }
 
-/* used to call vfuncs in the main daemon thread */
-typedef struct {
-	PkBackendJob		*job;
-	PkBackendJobSignal	 signal_kind;
-	GObject			*object;
-	GDestroyNotify		 destroy_func;
-} PkBackendJobVFuncHelper;
-
 /**
  * pk_backend_job_signal_to_string:
  **/
@@ -632,34 +655,120 @@ pk_backend_job_signal_to_string (PkBackendJobSignal id)
 }
 
 /**
- * pk_backend_job_call_vfunc_idle_cb:
+ * pk_backend_job_vfunc_helper_free:
+ **/
+static void
+pk_backend_job_vfunc_helper_free (PkBackendJobVFuncHelper *helper)
+{
+	if (helper->destroy_func != NULL)
+		helper->destroy_func (helper->object);
+	g_slice_free (PkBackendJobVFuncHelper, helper);
+}
+
+/**
+ * pk_backend_job_queue_steal:
+ *
+ * Atomically takes all the events pushed by the backend threads and
+ * appends them, in the order they were emitted, to the list of events
+ * waiting to be dispatched in the main thread.
+ **/
+static void
+pk_backend_job_queue_steal (PkBackendJob *job)
+{
+	PkBackendJobVFuncHelper *list;
+	PkBackendJobVFuncHelper *next;
+	PkBackendJobVFuncHelper *newest;
+	PkBackendJobVFuncHelper *oldest = NULL;
+
+	do {
+		list = g_atomic_pointer_get (&job->priv->queue_head);
+	} while (!g_atomic_pointer_compare_and_exchange (&job->priv->queue_head,
+							 list, NULL));
+	if (list == NULL)
+		return;
+
+	/* reverse, as the threads push onto the front */
+	newest = list;
+	while (list != NULL) {
+		next = list->next;
+		list->next = oldest;
+		oldest = list;
+		list = next;
+	}
+	if (job->priv->dispatch_tail == NULL)
+		job->priv->dispatch_head = oldest;
+	else
+		job->priv->dispatch_tail->next = oldest;
+	job->priv->dispatch_tail = newest;
+}
+
+/**
+ * pk_backend_job_dispatch_cb:
  **/
 static gboolean
-pk_backend_job_call_vfunc_idle_cb (gpointer user_data)
+pk_backend_job_dispatch_cb (gpointer user_data)
 {
-	PkBackendJobVFuncHelper *helper = (PkBackendJobVFuncHelper *) user_data;
+	gint64 latency;
+	guint i;
+	PkBackendJob *job = PK_BACKEND_JOB (user_data);
+	PkBackendJobPrivate *priv = job->priv;
+	PkBackendJobVFuncHelper *helper;
 	PkBackendJobVFuncItem *item;
 
-	/* call transaction vfunc on main thread */
-	item = &helper->job->priv->vfunc_items[helper->signal_kind];
-	if (item != NULL && item->vfunc != NULL) {
-		item->vfunc (helper->job,
-			     helper->object,
-			     item->user_data);
-	} else {
-		g_warning ("tried to do signal %s when no longer connected",
-			   pk_backend_job_signal_to_string (helper->signal_kind));
+	pk_backend_job_queue_steal (job);
+	priv->dispatch_wakeups++;
+
+	for (i = 0; i < PK_BACKEND_JOB_DISPATCH_MAX; i++) {
+
+		/* pop first, as the vfunc may iterate the main loop */
+		helper = priv->dispatch_head;
+		if (helper == NULL)
+			break;
+		priv->dispatch_head = helper->next;
+		if (priv->dispatch_head == NULL)
+			priv->dispatch_tail = NULL;
+		g_atomic_int_add (&priv->queue_depth, -1);
+
+		/* keep statistics */
+		latency = g_get_monotonic_time () - helper->queued;
+		if (latency > 0) {
+			priv->dispatch_latency_total += latency;
+			if ((guint64) latency > priv->dispatch_latency_max)
+				priv->dispatch_latency_max = latency;
+		}
+		priv->dispatch_count++;
+		if (helper->signal_kind == PK_BACKEND_SIGNAL_FINISHED) {
+			g_debug ("dispatched %u events in %u wakeups, "
+				 "max depth %i, max latency %" G_GUINT64_FORMAT "us",
+				 priv->dispatch_count,
+				 priv->dispatch_wakeups,
+				 g_atomic_int_get (&priv->queue_depth_max),
+				 priv->dispatch_latency_max);
+		}
+
+		/* call transaction vfunc on main thread */
+		item = &priv->vfunc_items[helper->signal_kind];
+		if (item->vfunc != NULL) {
+			item->vfunc (job,
+				     helper->object,
+				     item->user_data);
+		} else {
+			g_warning ("tried to do signal %s when no longer connected",
+				   pk_backend_job_signal_to_string (helper->signal_kind));
+		}
+		pk_backend_job_vfunc_helper_free (helper);
 	}
-	if (helper->destroy_func != NULL)
-		helper->destroy_func (helper->object);
-	return FALSE;
+
+	/* more to do, so let other sources run and come back */
+	return priv->dispatch_head != NULL;
 }
 
 /**
  * pk_backend_job_call_vfunc:
  *
  * This method can be called in any thread, and the vfunc is guaranteed
- * to be called idle in the main thread.
+ * to be called idle in the main thread, in the same order as it was
+ * called for this job.
  **/
 static void
 pk_backend_job_call_vfunc (PkBackendJob *job,
@@ -667,28 +776,108 @@ pk_backend_job_call_vfunc (PkBackendJob *job,
 			   gpointer object,
 			   GDestroyNotify destroy_func)
 {
+	gint depth;
+	gint depth_max;
+	PkBackendJobVFuncHelper *head;
 	PkBackendJobVFuncHelper *helper;
 	PkBackendJobVFuncItem *item;
-	guint priority = G_PRIORITY_DEFAULT_IDLE;
 
 	/* call transaction vfunc if not disabled and set */
 	item = &job->priv->vfunc_items[signal_kind];
-	if (!item->enabled || item->vfunc == NULL)
+	if (!item->enabled || item->vfunc == NULL) {
+		if (destroy_func != NULL)
+			destroy_func (object);
 		return;
+	}
 
-	if (signal_kind == PK_BACKEND_SIGNAL_FINISHED)
-		priority = G_PRIORITY_LOW;
-
-	/* emit idle, TODO: do we ever need to cancel this? */
-	helper = g_new0 (PkBackendJobVFuncHelper, 1);
-	helper->job = job;
+	/* push onto the job queue without taking a lock */
+	helper = g_slice_new0 (PkBackendJobVFuncHelper);
 	helper->signal_kind = signal_kind;
 	helper->object = object;
 	helper->destroy_func = destroy_func;
-	g_idle_add_full (priority,
-			 pk_backend_job_call_vfunc_idle_cb,
-			 helper,
-			 g_free);
+	helper->queued = g_get_monotonic_time ();
+	do {
+		head = g_atomic_pointer_get (&job->priv->queue_head);
+		helper->next = head;
+	} while (!g_atomic_pointer_compare_and_exchange (&job->priv->queue_head,
+							 head, helper));
+
+	/* keep statistics */
+	depth = g_atomic_int_add (&job->priv->queue_depth, 1) + 1;
+	do {
+		depth_max = g_atomic_int_get (&job->priv->queue_depth_max);
+		if (depth <= depth_max)
+			break;
+	} while (!g_atomic_int_compare_and_exchange (&job->priv->queue_depth_max,
+						     depth_max, depth));
+
+	/* the dispatcher takes everything queued when it runs, so we only
+	 * have to wake it up when the queue was empty */
+	if (head == NULL) {
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 pk_backend_job_dispatch_cb,
+				 g_object_ref (job),
+				 g_object_unref);
+	}
+}
+
+/**
+ * pk_backend_job_get_dispatch_count:
+ *
+ * Return value: the number of events dispatched in the main thread
+ **/
+guint
+pk_backend_job_get_dispatch_count (PkBackendJob *job)
+{
+	g_return_val_if_fail (PK_IS_BACKEND_JOB (job), 0);
+	return job->priv->dispatch_count;
+}
+
+/**
+ * pk_backend_job_get_dispatch_wakeups:
+ *
+ * Return value: the number of times the main thread woke up to dispatch events
+ **/
+guint
+pk_backend_job_get_dispatch_wakeups (PkBackendJob *job)
+{
+	g_return_val_if_fail (PK_IS_BACKEND_JOB (job), 0);
+	return job->priv->dispatch_wakeups;
+}
+
+/**
+ * pk_backend_job_get_queue_depth_max:
+ *
+ * Return value: the most events that were waiting to be dispatched
+ **/
+guint
+pk_backend_job_get_queue_depth_max (PkBackendJob *job)
+{
+	g_return_val_if_fail (PK_IS_BACKEND_JOB (job), 0);
+	return g_atomic_int_get (&job->priv->queue_depth_max);
+}
+
+/**
+ * pk_backend_job_get_dispatch_latency:
+ * @job: A valid PkBackendJob
+ * @latency_max: (out) (allow-none): the maximum latency in us
+ * @latency_mean: (out) (allow-none): the mean latency in us
+ *
+ * Gets how long events waited in the queue before being dispatched.
+ **/
+void
+pk_backend_job_get_dispatch_latency (PkBackendJob *job,
+				     guint64 *latency_max,
+				     guint64 *latency_mean)
+{
+	g_return_if_fail (PK_IS_BACKEND_JOB (job));
+	if (latency_max != NULL)
+		*latency_max = job->priv->dispatch_latency_max;
+	if (latency_mean != NULL) {
+		*latency_mean = 0;
+		if (job->priv->dispatch_count > 0)
+			*latency_mean = job->priv->dispatch_latency_total / job->priv->dispatch_count;
+	}
 }
 
 /**
@@ -781,34 +970,32 @@ typedef struct {
 /**
  * pk_backend_job_thread_setup:
  **/
-static gpointer
-pk_backend_job_thread_setup (gpointer thread_data)
+static void
+pk_backend_job_thread_setup (gpointer thread_data, gpointer user_data)
 {
 	PkBackendJobThreadHelper *helper = (PkBackendJobThreadHelper *) thread_data;
-
-	/* run original function with automatic locking */
-	pk_backend_thread_start (helper->backend, helper->job, helper->func);
-	helper->func (helper->job, helper->job->priv->params, helper->user_data);
-	pk_backend_thread_stop (helper->backend, helper->job, helper->func);
+	gboolean background = helper->job->priv->background == PK_HINT_ENUM_TRUE;
 
 	/* set idle IO priority */
-	if (helper->job->priv->background == PK_HINT_ENUM_TRUE) {
+	if (background) {
 		g_debug ("setting ioprio class to idle");
 		pk_ioprio_set_idle (0);
 	}
 
-	/* unref the thread here as it holds a reference itself and we do
-	 * not need to join() this at any stage */
-	g_thread_unref (helper->job->priv->thread);
+	/* run original function with automatic locking */
+	pk_backend_thread_start (helper->backend, helper->job, helper->func);
+	helper->func (helper->job, helper->job->priv->params, helper->user_data);
+	pk_backend_thread_stop (helper->backend, helper->job, helper->func);
+
+	/* the pool thread is reused, so the next job must not inherit this */
+	if (background)
+		pk_ioprio_set_best_effort (0);
 
 	/* destroy helper */
 	g_object_unref (helper->job);
 	if (helper->destroy_func != NULL)
 		helper->destroy_func (helper->user_data);
 	g_free (helper);
-
-	/* no return value */
-	return NULL;
 }
 
 /**
@@ -827,7 +1014,7 @@ pk_backend_job_thread_create (PkBackendJob *job,
 	g_return_val_if_fail (PK_IS_BACKEND_JOB (job), FALSE);
 	g_return_val_if_fail (func != NULL, FALSE);
 
-	if (job->priv->thread != NULL) {
+	if (job->priv->has_thread) {
 		g_warning ("already has thread");
 		return FALSE;
 	}
@@ -839,15 +1026,18 @@ pk_backend_job_thread_create (PkBackendJob *job,
 	helper->func = func;
 	helper->user_data = user_data;
 
-	/* create a thread */
-	job->priv->thread = g_thread_new ("PK-Backend",
-					  pk_backend_job_thread_setup,
-					  helper);
-	if (job->priv->thread == NULL) {
+	/* run it on a backend thread */
+	ret = pk_backend_thread_pool_push (job->priv->backend,
+					   job,
+					   pk_backend_job_thread_setup,
+					   helper);
+	if (!ret) {
 		g_warning ("failed to create thread");
-		ret = FALSE;
+		g_object_unref (helper->job);
+		g_free (helper);
 		goto out;
 	}
+	job->priv->has_thread = TRUE;
 out:
 	return ret;
 }
@@ -1906,6 +2096,7 @@ static void
 pk_backend_job_finalize (GObject *object)
 {
 	PkBackendJob *job;
+	PkBackendJobVFuncHelper *helper;
 
 	g_return_if_fail (object != NULL);
 	g_return_if_fail (PK_IS_BACKEND_JOB (object));
@@ -1931,6 +2122,14 @@ pk_backend_job_finalize (GObject *object)
 	}
 	if (job->priv->params != NULL)
 		g_variant_unref (job->priv->params);
+
+	/* free anything that was never dispatched */
+	pk_backend_job_queue_steal (job);
+	while (job->priv->dispatch_head != NULL) {
+		helper = job->priv->dispatch_head;
+		job->priv->dispatch_head = helper->next;
+		pk_backend_job_vfunc_helper_free (helper);
+	}
 	g_object_unref (job->priv->time);
 	g_key_file_unref (job->priv->conf);
 
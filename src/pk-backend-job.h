@@ -153,6 +153,12 @@ void		 pk_backend_job_set_vfunc		(PkBackendJob	*job,
 							 gpointer	 user_data);
 gboolean	 pk_backend_job_get_vfunc_enabled	(PkBackendJob	*job,
 							 PkBackendJobSignal signal_kind);
+guint		 pk_backend_job_get_dispatch_count	(PkBackendJob	*job);
+guint		 pk_backend_job_get_dispatch_wakeups	(PkBackendJob	*job);
+guint		 pk_backend_job_get_queue_depth_max	(PkBackendJob	*job);
+void		 pk_backend_job_get_dispatch_latency	(PkBackendJob	*job,
+							 guint64	*latency_max,
+							 guint64	*latency_mean);
 
 /* thread helpers */
 typedef void	(*PkBackendJobThreadFunc)		(PkBackendJob	*job,
@@ -53,7 +53,68 @@
 #define PK_BACKEND_SPAWN_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_BACKEND_SPAWN, PkBackendSpawnPrivate))
 #define PK_BACKEND_SPAWN_PERCENTAGE_INVALID	101
 
-#define	PK_UNSAFE_DELIMITERS	"\\\f\r\t"
+/* the most sections in any command is 13, for updatedetail */
+#define PK_BACKEND_SPAWN_MAX_SECTIONS		16
+/* lines shorter than this are parsed without allocating */
+#define PK_BACKEND_SPAWN_LINE_BUF_SIZE		1024
+/* the commands hash perfectly on their length and first character */
+#define PK_BACKEND_SPAWN_COMMAND_HASH_SIZE	44
+#define PK_BACKEND_SPAWN_COMMAND_HASH(len,c)	(((len) * 24 + (guchar) (c)) % PK_BACKEND_SPAWN_COMMAND_HASH_SIZE)
+
+typedef enum {
+	PK_BACKEND_SPAWN_COMMAND_UNKNOWN,
+	PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL,
+	PK_BACKEND_SPAWN_COMMAND_CATEGORY,
+	PK_BACKEND_SPAWN_COMMAND_DETAILS,
+	PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE,
+	PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING,
+	PK_BACKEND_SPAWN_COMMAND_ERROR,
+	PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_FILES,
+	PK_BACKEND_SPAWN_COMMAND_FINISHED,
+	PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS,
+	PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES,
+	PK_BACKEND_SPAWN_COMMAND_PACKAGE,
+	PK_BACKEND_SPAWN_COMMAND_PERCENTAGE,
+	PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL,
+	PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED,
+	PK_BACKEND_SPAWN_COMMAND_REQUIRERESTART,
+	PK_BACKEND_SPAWN_COMMAND_SPEED,
+	PK_BACKEND_SPAWN_COMMAND_STATUS,
+	PK_BACKEND_SPAWN_COMMAND_UPDATEDETAIL,
+	PK_BACKEND_SPAWN_COMMAND_LAST
+} PkBackendSpawnCommand;
+
+typedef struct {
+	const gchar		*name;
+	gsize			 len;
+	PkBackendSpawnCommand	 command;
+} PkBackendSpawnCommandItem;
+
+/* indexed by PK_BACKEND_SPAWN_COMMAND_HASH, the rest of the slots are empty */
+static const PkBackendSpawnCommandItem pk_backend_spawn_commands[PK_BACKEND_SPAWN_COMMAND_HASH_SIZE] = {
+	[0] = { "percentage", 10, PK_BACKEND_SPAWN_COMMAND_PERCENTAGE },
+	[1] = { "error", 5, PK_BACKEND_SPAWN_COMMAND_ERROR },
+	[2] = { "files", 5, PK_BACKEND_SPAWN_COMMAND_FILES },
+	[4] = { "details", 7, PK_BACKEND_SPAWN_COMMAND_DETAILS },
+	[6] = { "repo-signature-required", 23, PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED },
+	[9] = { "updatedetail", 12, PK_BACKEND_SPAWN_COMMAND_UPDATEDETAIL },
+	[10] = { "requirerestart", 14, PK_BACKEND_SPAWN_COMMAND_REQUIRERESTART },
+	[15] = { "speed", 5, PK_BACKEND_SPAWN_COMMAND_SPEED },
+	[16] = { "package", 7, PK_BACKEND_SPAWN_COMMAND_PACKAGE },
+	[17] = { "eula-required", 13, PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED },
+	[21] = { "item-progress", 13, PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS },
+	[26] = { "repo-detail", 11, PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL },
+	[27] = { "category", 8, PK_BACKEND_SPAWN_COMMAND_CATEGORY },
+	[30] = { "finished", 8, PK_BACKEND_SPAWN_COMMAND_FINISHED },
+	[33] = { "allow-cancel", 12, PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL },
+	[36] = { "download-size-remaining", 23, PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING },
+	[39] = { "status", 6, PK_BACKEND_SPAWN_COMMAND_STATUS },
+	[40] = { "distro-upgrade", 14, PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE },
+	[41] = { "media-change-required", 21, PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED },
+	[42] = { "no-percentage-updates", 21, PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES },
+};
 
 struct PkBackendSpawnPrivate
 {
@@ -153,18 +214,127 @@ pk_backend_spawn_start_kill_timer (PkBackendSpawn *backend_spawn)
 }
 
 /**
- * pk_backend_spawn_parse_stdout:
+ * pk_backend_spawn_command_lookup:
+ *
+ * Finds the command using a single probe of the perfect hash table.
+ **/
+static PkBackendSpawnCommand
+pk_backend_spawn_command_lookup (const gchar *command)
+{
+	const PkBackendSpawnCommandItem *item;
+	gsize len;
+
+	len = strlen (command);
+	if (len == 0)
+		return PK_BACKEND_SPAWN_COMMAND_UNKNOWN;
+	item = &pk_backend_spawn_commands[PK_BACKEND_SPAWN_COMMAND_HASH (len, command[0])];
+	if (item->len != len || memcmp (item->name, command, len) != 0)
+		return PK_BACKEND_SPAWN_COMMAND_UNKNOWN;
+	return item->command;
+}
+
+/**
+ * pk_backend_spawn_split_line:
+ *
+ * Splits a line on tabs in place, returning the number of sections. Only
+ * the first @max_sections are stored, but all of them are counted.
+ **/
+static guint
+pk_backend_spawn_split_line (gchar *line, gchar **sections, guint max_sections)
+{
+	gchar *tab;
+	guint size = 0;
+
+	while (TRUE) {
+		if (size < max_sections)
+			sections[size] = line;
+		size++;
+		tab = strchr (line, '\t');
+		if (tab == NULL)
+			break;
+		*tab = '\0';
+		line = tab + 1;
+	}
+	return size;
+}
+
+/**
+ * pk_backend_spawn_sanitize_text:
+ *
+ * Replaces the unsafe delimiters "\\\f\r\t" with spaces and checks the text
+ * is valid UTF-8, only doing the full check if there are any non-ASCII bytes.
  **/
 static gboolean
-pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
-			       PkBackendJob *job,
-			       const gchar *line,
-			       GError **error)
+pk_backend_spawn_sanitize_text (gchar *text)
+{
+	gboolean ascii = TRUE;
+	gchar *tmp;
+
+	for (tmp = text; *tmp != '\0'; tmp++) {
+		switch (*tmp) {
+		case '\\':
+		case '\f':
+		case '\r':
+		case '\t':
+			*tmp = ' ';
+			break;
+		default:
+			if ((guchar) *tmp >= 0x80)
+				ascii = FALSE;
+			break;
+		}
+	}
+	if (ascii)
+		return TRUE;
+	return g_utf8_validate (text, tmp - text, NULL);
+}
+
+/**
+ * pk_backend_spawn_split_frame:
+ *
+ * Splits a frame of NUL terminated fields in place, returning the number of
+ * sections. Only the first @max_sections are stored, but all are counted.
+ **/
+static guint
+pk_backend_spawn_split_frame (gchar *frame, gsize len, gchar **sections, guint max_sections)
+{
+	gchar *end = frame + len;
+	gchar *nul;
+	guint size = 0;
+
+	while (frame < end) {
+		nul = memchr (frame, '\0', end - frame);
+		if (nul == NULL)
+			break;
+		if (size < max_sections)
+			sections[size] = frame;
+		size++;
+		frame = nul + 1;
+	}
+	return size;
+}
+
+/**
+ * pk_backend_spawn_parse_sections:
+ *
+ * Handles one command from the helper, whether it arrived as a line of
+ * text or as a binary frame.
+ **/
+static gboolean
+pk_backend_spawn_parse_sections (PkBackendSpawn *backend_spawn,
+				 PkBackendJob *job,
+				 gchar **sections,
+				 guint size,
+				 GError **error)
 {
-	gchar **sections;
-	guint size;
 	gchar *command;
 	gchar *text;
+	gchar **tmp;
+	gchar **updates;
+	gchar **obsoletes;
+	gchar **vendor_urls;
+	gchar **bugzilla_urls;
+	gchar **cve_urls;
 	gboolean ret = TRUE;
 	guint64 speed;
 	guint64 download_size_remaining;
@@ -182,20 +352,14 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 	PkDistroUpgradeEnum distro_upgrade_enum;
 	PkBackendSpawnPrivate *priv = backend_spawn->priv;
 
-	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
-
-	/* check if output line */
-	if (line == NULL)
+	if (size == 0) {
+		g_set_error_literal (error, 1, 0, "no command");
 		return FALSE;
-
-	/* split by tab */
-	sections = g_strsplit (line, "\t", 0);
+	}
 	command = sections[0];
 
-	/* get size */
-	size = g_strv_length (sections);
-
-	if (g_strcmp0 (command, "package") == 0) {
+	switch (pk_backend_spawn_command_lookup (command)) {
+	case PK_BACKEND_SPAWN_COMMAND_PACKAGE:
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -212,8 +376,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-		g_strdelimit (sections[3], PK_UNSAFE_DELIMITERS, ' ');
-		ret = g_utf8_validate (sections[3], -1, NULL);
+		ret = pk_backend_spawn_sanitize_text (sections[3]);
 		if (!ret) {
 			g_set_error (error, 1, 0,
 				     "text '%s' was not valid UTF8!",
@@ -222,7 +385,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_package (job, info, sections[2], sections[3]);
-	} else if (g_strcmp0 (command, "details") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_DETAILS:
 		if (size != 7 && size != 8) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -237,8 +401,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-		g_strdelimit (sections[4], PK_UNSAFE_DELIMITERS, ' ');
-		ret = g_utf8_validate (sections[4], -1, NULL);
+		ret = pk_backend_spawn_sanitize_text (sections[4]);
 		if (!ret) {
 			g_set_error (error, 1, 0,
 				     "text '%s' was not valid UTF8!",
@@ -252,7 +415,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		pk_backend_job_details (job, sections[1], size == 8 ? sections[7] : NULL, sections[2],
 					group, text, sections[5], package_size);
 		g_free (text);
-	} else if (g_strcmp0 (command, "finished") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_FINISHED:
 		if (size != 1) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -264,8 +428,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		/* from this point on, we can start the kill timer */
 		pk_backend_spawn_start_kill_timer (backend_spawn);
 
-	} else if (g_strcmp0 (command, "files") == 0) {
-		gchar **tmp;
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_FILES:
 		if (size != 3) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -274,14 +438,14 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		tmp = g_strsplit (sections[2], ";", -1);
 		pk_backend_job_files (job, sections[1], tmp);
 		g_strfreev (tmp);
-	} else if (g_strcmp0 (command, "repo-detail") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_REPO_DETAIL:
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
 			goto out;
 		}
-		g_strdelimit (sections[2], PK_UNSAFE_DELIMITERS, ' ');
-		ret = g_utf8_validate (sections[2], -1, NULL);
+		ret = pk_backend_spawn_sanitize_text (sections[2]);
 		if (!ret) {
 			g_set_error (error, 1, 0,
 				     "text '%s' was not valid UTF8!",
@@ -298,12 +462,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-	} else if (g_strcmp0 (command, "updatedetail") == 0) {
-		gchar **updates;
-		gchar **obsoletes;
-		gchar **vendor_urls;
-		gchar **bugzilla_urls;
-		gchar **cve_urls;
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_UPDATEDETAIL:
 		if (size != 13) {
 			g_set_error (error, 1, 0, "invalid command '%s', size %i", command, size);
 			ret = FALSE;
@@ -315,8 +475,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-		g_strdelimit (sections[12], PK_UNSAFE_DELIMITERS, ' ');
-		ret = g_utf8_validate (sections[12], -1, NULL);
+		ret = pk_backend_spawn_sanitize_text (sections[12]);
 		if (!ret) {
 			g_set_error (error, 1, 0,
 				     "text '%s' was not valid UTF8!",
@@ -351,7 +510,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		g_strfreev (vendor_urls);
 		g_strfreev (bugzilla_urls);
 		g_strfreev (cve_urls);
-	} else if (g_strcmp0 (command, "percentage") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_PERCENTAGE:
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -367,7 +527,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		} else {
 			pk_backend_job_set_percentage (job, percentage);
 		}
-	} else if (g_strcmp0 (command, "item-progress") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_ITEM_PROGRESS:
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -399,7 +560,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 						  sections[1],
 						  status_enum,
 						  percentage);
-	} else if (g_strcmp0 (command, "error") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_ERROR:
 		if (size != 3) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -422,7 +584,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 
 		pk_backend_job_error_code (job, error_enum, "%s", text);
 		g_free (text);
-	} else if (g_strcmp0 (command, "requirerestart") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_REQUIRERESTART:
 		if (size != 3) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -440,7 +603,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_require_restart (job, restart_enum, sections[2]);
-	} else if (g_strcmp0 (command, "status") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_STATUS:
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -453,7 +617,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_set_status (job, status_enum);
-	} else if (g_strcmp0 (command, "speed") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_SPEED:
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -468,7 +633,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_set_speed (job, speed);
-	} else if (g_strcmp0 (command, "download-size-remaining") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_DOWNLOAD_SIZE_REMAINING:
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -483,7 +649,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_set_download_size_remaining (job, download_size_remaining);
-	} else if (g_strcmp0 (command, "allow-cancel") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_ALLOW_CANCEL:
 		if (size != 2) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -498,15 +665,16 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-	} else if (g_strcmp0 (command, "no-percentage-updates") == 0) {
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_NO_PERCENTAGE_UPDATES:
 		if (size != 1) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
 			goto out;
 		}
 		pk_backend_job_set_percentage (job, PK_BACKEND_PERCENTAGE_INVALID);
-	} else if (g_strcmp0 (command, "repo-signature-required") == 0) {
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_REPO_SIGNATURE_REQUIRED:
 		if (size != 9) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -534,10 +702,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		pk_backend_job_repo_signature_required (job, sections[1],
 							  sections[2], sections[3], sections[4],
 							  sections[5], sections[6], sections[7], sig_type);
-		goto out;
-
-	} else if (g_strcmp0 (command, "eula-required") == 0) {
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_EULA_REQUIRED:
 		if (size != 5) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -563,10 +729,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_eula_required (job, sections[1], sections[2], sections[3], sections[4]);
-		goto out;
-
-	} else if (g_strcmp0 (command, "media-change-required") == 0) {
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_MEDIA_CHANGE_REQUIRED:
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -581,9 +745,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_media_change_required (job, media_type_enum, sections[2], sections[3]);
-		goto out;
-	} else if (g_strcmp0 (command, "distro-upgrade") == 0) {
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_DISTRO_UPGRADE:
 		if (size != 4) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -596,8 +759,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-		g_strdelimit (sections[3], PK_UNSAFE_DELIMITERS, ' ');
-		ret = g_utf8_validate (sections[3], -1, NULL);
+		ret = pk_backend_spawn_sanitize_text (sections[3]);
 		if (!ret) {
 			g_set_error (error, 1, 0,
 				     "text '%s' was not valid UTF8!",
@@ -607,9 +769,8 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 		}
 
 		pk_backend_job_distro_upgrade (job, distro_upgrade_enum, sections[2], sections[3]);
-		goto out;
-	} else if (g_strcmp0 (command, "category") == 0) {
-
+		break;
+	case PK_BACKEND_SPAWN_COMMAND_CATEGORY:
 		if (size != 6) {
 			g_set_error (error, 1, 0, "invalid command'%s', size %i", command, size);
 			ret = FALSE;
@@ -630,8 +791,7 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			ret = FALSE;
 			goto out;
 		}
-		g_strdelimit (sections[4], PK_UNSAFE_DELIMITERS, ' ');
-		ret = g_utf8_validate (sections[4], -1, NULL);
+		ret = pk_backend_spawn_sanitize_text (sections[4]);
 		if (!ret) {
 			g_set_error (error, 1, 0,
 				     "text '%s' was not valid UTF8!",
@@ -650,13 +810,52 @@ pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
 			goto out;
 		}
 		pk_backend_job_category (job, sections[1], sections[2], sections[3], sections[4], sections[5]);
-		goto out;
-	} else {
+		break;
+	default:
 		ret = FALSE;
 		g_set_error (error, 1, 0, "invalid command '%s'", command);
+		break;
 	}
 out:
-	g_strfreev (sections);
+	return ret;
+}
+
+/**
+ * pk_backend_spawn_parse_stdout:
+ **/
+static gboolean
+pk_backend_spawn_parse_stdout (PkBackendSpawn *backend_spawn,
+			       PkBackendJob *job,
+			       const gchar *line,
+			       GError **error)
+{
+	gchar *sections[PK_BACKEND_SPAWN_MAX_SECTIONS];
+	gchar line_buf[PK_BACKEND_SPAWN_LINE_BUF_SIZE];
+	gchar *line_copy = NULL;
+	gchar *buf;
+	gsize len;
+	guint size;
+	gboolean ret;
+
+	g_return_val_if_fail (PK_IS_BACKEND_SPAWN (backend_spawn), FALSE);
+
+	/* check if output line */
+	if (line == NULL)
+		return FALSE;
+
+	/* split by tab in a private copy, which is on the stack for all
+	 * but the very longest lines */
+	len = strlen (line);
+	if (len < sizeof (line_buf)) {
+		memcpy (line_buf, line, len + 1);
+		buf = line_buf;
+	} else {
+		line_copy = g_strdup (line);
+		buf = line_copy;
+	}
+	size = pk_backend_spawn_split_line (buf, sections, PK_BACKEND_SPAWN_MAX_SECTIONS);
+	ret = pk_backend_spawn_parse_sections (backend_spawn, job, sections, size, error);
+	g_free (line_copy);
 	return ret;
 }
 
@@ -739,6 +938,42 @@ pk_backend_spawn_stdout_cb (PkBackendSpawn *spawn, const gchar *line, PkBackendS
 	}
 }
 
+/**
+ * pk_backend_spawn_frame_cb:
+ *
+ * A helper that negotiated the framed protocol sends each command as
+ * NUL terminated fields, so no escaping or line scanning is needed.
+ **/
+static void
+pk_backend_spawn_frame_cb (PkSpawn *spawn, gchar *frame, guint len, PkBackendSpawn *backend_spawn)
+{
+	gboolean ret;
+	gchar *sections[PK_BACKEND_SPAWN_MAX_SECTIONS];
+	guint i;
+	guint size;
+	GError *error = NULL;
+
+	/* the filter funcs only understand text, so join the fields
+	 * with tabs and handle it like any other line */
+	if (backend_spawn->priv->stdout_func != NULL) {
+		for (i = 0; i + 1 < len; i++) {
+			if (frame[i] == '\0')
+				frame[i] = '\t';
+		}
+		pk_backend_spawn_stdout_cb (backend_spawn, frame, backend_spawn);
+		return;
+	}
+
+	size = pk_backend_spawn_split_frame (frame, len, sections, PK_BACKEND_SPAWN_MAX_SECTIONS);
+	ret = pk_backend_spawn_parse_sections (backend_spawn,
+					       backend_spawn->priv->job,
+					       sections, size, &error);
+	if (!ret) {
+		g_warning ("failed to parse frame: %s", error->message);
+		g_error_free (error);
+	}
+}
+
 /**
  * pk_backend_spawn_stderr_cb:
  **/
@@ -908,6 +1143,9 @@ pk_backend_spawn_get_envp (PkBackendSpawn *backend_spawn)
 	ret = pk_backend_job_get_interactive (priv->job) == PK_HINT_ENUM_TRUE;
 	g_hash_table_replace (env_table, g_strdup ("INTERACTIVE"), g_strdup (ret ? "TRUE" : "FALSE"));
 
+	/* let helpers that understand it send binary frames */
+	g_hash_table_replace (env_table, g_strdup ("PACKAGEKIT_FRAMED"), g_strdup ("TRUE"));
+
 	/* CACHE_AGE */
 	cache_age = pk_backend_job_get_cache_age (priv->job);
 	if (cache_age == G_MAXUINT) {
@@ -1260,6 +1498,8 @@ pk_backend_spawn_new (GKeyFile *conf)
 			  G_CALLBACK (pk_backend_spawn_exit_cb), backend_spawn);
 	g_signal_connect (backend_spawn->priv->spawn, "stdout",
 			  G_CALLBACK (pk_backend_spawn_stdout_cb), backend_spawn);
+	g_signal_connect (backend_spawn->priv->spawn, "frame",
+			  G_CALLBACK (pk_backend_spawn_frame_cb), backend_spawn);
 	g_signal_connect (backend_spawn->priv->spawn, "stderr",
 			  G_CALLBACK (pk_backend_spawn_stderr_cb), backend_spawn);
 	return PK_BACKEND_SPAWN (backend_spawn);
@@ -49,6 +49,22 @@
  */
 #define PK_BACKEND_PERCENTAGE_DEFAULT		102
 
+/**
+ * PK_BACKEND_THREAD_POOL_SIZE_DEFAULT:
+ *
+ * The number of threads used to run backend jobs if neither the config
+ * file nor the backend specify a value.
+ */
+#define PK_BACKEND_THREAD_POOL_SIZE_DEFAULT	4
+
+/* a job waiting to be run by the thread pool */
+typedef struct {
+	PkBackendJob		*job;
+	GFunc			 func;
+	gpointer		 data;
+	gint64			 queued;
+} PkBackendThreadItem;
+
 /**
  * PkBackendDesc:
  */
@@ -64,6 +80,10 @@ typedef struct {
 	PkBitfield	(*get_provides)			(PkBackend	*backend);
 	gchar		**(*get_mime_types)		(PkBackend	*backend);
 	gboolean	(*supports_parallelization)	(PkBackend	*backend);
+	guint		(*get_thread_pool_size)		(PkBackend	*backend);
+	PkBackendThreadAffinity (*get_thread_affinity)	(PkBackend	*backend);
+	PkBackendLockClass (*get_lock_class)		(PkBackend	*backend,
+							 PkRoleEnum	 role);
 	void		(*job_start)			(PkBackend	*backend,
 							 PkBackendJob	*job);
 	void		(*job_reset)			(PkBackend	*backend,
@@ -200,6 +220,14 @@ struct PkBackendPrivate
 	gboolean		 backend_roles_set;
 	GHashTable		*thread_hash;
 	GMutex			 thread_hash_mutex;
+	GRWLock			 cache_lock;
+	GRWLock			 db_lock;
+	GPtrArray		*thread_pools;
+	GPtrArray		*thread_pool_items;
+	GMutex			 thread_pool_mutex;
+	guint			 thread_pool_jobs;
+	guint64			 thread_pool_wait_max;
+	guint64			 thread_pool_wait_total;
 };
 
 G_DEFINE_TYPE (PkBackend, pk_backend, G_TYPE_OBJECT)
@@ -250,14 +278,433 @@ pk_backend_supports_parallelization (PkBackend	*backend)
 	return backend->priv->desc->supports_parallelization (backend);
 }
 
+/**
+ * pk_backend_get_thread_pool_size:
+ *
+ * Return value: the number of threads the backend would like to use for
+ * jobs, or 0 if the backend has no preference.
+ **/
+guint
+pk_backend_get_thread_pool_size (PkBackend *backend)
+{
+	g_return_val_if_fail (PK_IS_BACKEND (backend), 0);
+
+	/* not compulsory */
+	if (backend->priv->desc->get_thread_pool_size == NULL)
+		return 0;
+	return backend->priv->desc->get_thread_pool_size (backend);
+}
+
+/**
+ * pk_backend_get_thread_affinity:
+ **/
+PkBackendThreadAffinity
+pk_backend_get_thread_affinity (PkBackend *backend)
+{
+	g_return_val_if_fail (PK_IS_BACKEND (backend), PK_BACKEND_THREAD_AFFINITY_ANY);
+
+	/* not compulsory */
+	if (backend->priv->desc->get_thread_affinity == NULL)
+		return PK_BACKEND_THREAD_AFFINITY_ANY;
+	return backend->priv->desc->get_thread_affinity (backend);
+}
+
+/**
+ * pk_backend_thread_pool_cb:
+ **/
+static void
+pk_backend_thread_pool_cb (gpointer data, gpointer user_data)
+{
+	PkBackend *backend = PK_BACKEND (user_data);
+	PkBackendThreadItem *item = (PkBackendThreadItem *) data;
+	guint64 wait;
+
+	/* how long did the job wait for a free thread */
+	wait = g_get_monotonic_time () - item->queued;
+	g_mutex_lock (&backend->priv->thread_pool_mutex);
+	backend->priv->thread_pool_jobs++;
+	backend->priv->thread_pool_wait_total += wait;
+	if (wait > backend->priv->thread_pool_wait_max)
+		backend->priv->thread_pool_wait_max = wait;
+	g_mutex_unlock (&backend->priv->thread_pool_mutex);
+	if (wait > G_USEC_PER_SEC)
+		g_debug ("job waited %" G_GUINT64_FORMAT "ms for a thread", wait / 1000);
+
+	item->func (item->data, NULL);
+	g_mutex_lock (&backend->priv->thread_pool_mutex);
+	g_ptr_array_remove_fast (backend->priv->thread_pool_items, item);
+	g_mutex_unlock (&backend->priv->thread_pool_mutex);
+	g_object_unref (item->job);
+	g_slice_free (PkBackendThreadItem, item);
+
+	/* the backend may have been unloaded while we were running */
+	g_object_unref (backend);
+}
+
+/**
+ * pk_backend_thread_pool_create:
+ *
+ * Creates the threads up front and keeps them around for the lifetime of
+ * the backend, so any per-thread state in the backend libraries is only
+ * set up once. For the role and single affinities each pool only has one
+ * thread, and jobs are always sent to the same pool.
+ **/
+static gboolean
+pk_backend_thread_pool_create (PkBackend *backend, GError **error)
+{
+	gint size;
+	guint i;
+	guint pools = 1;
+	guint threads;
+	GThreadPool *pool;
+	PkBackendThreadAffinity affinity;
+
+	/* the config file overrides the backend */
+	size = g_key_file_get_integer (backend->priv->conf,
+				       "Daemon",
+				       "BackendThreadPoolSize",
+				       NULL);
+	if (size <= 0)
+		size = pk_backend_get_thread_pool_size (backend);
+	if (size <= 0)
+		size = PK_BACKEND_THREAD_POOL_SIZE_DEFAULT;
+
+	affinity = pk_backend_get_thread_affinity (backend);
+	switch (affinity) {
+	case PK_BACKEND_THREAD_AFFINITY_ROLE:
+		pools = size;
+		threads = 1;
+		break;
+	case PK_BACKEND_THREAD_AFFINITY_SINGLE:
+		threads = 1;
+		break;
+	default:
+		threads = size;
+		break;
+	}
+
+	backend->priv->thread_pools = g_ptr_array_new ();
+	for (i = 0; i < pools; i++) {
+		pool = g_thread_pool_new (pk_backend_thread_pool_cb,
+					  backend,
+					  threads,
+					  TRUE,
+					  error);
+		if (pool == NULL)
+			return FALSE;
+		g_ptr_array_add (backend->priv->thread_pools, pool);
+	}
+	g_debug ("using %u thread pools of %u threads", pools, threads);
+	return TRUE;
+}
+
+/**
+ * pk_backend_thread_pool_cancel:
+ *
+ * Asks every job that is queued or running to stop as soon as it can, if
+ * the job allows it.
+ **/
+static void
+pk_backend_thread_pool_cancel (PkBackend *backend)
+{
+	guint i;
+	GPtrArray *jobs;
+	PkBackendJob *job;
+	PkBackendThreadItem *item;
+
+	if (backend->priv->desc->cancel == NULL)
+		return;
+
+	g_mutex_lock (&backend->priv->thread_pool_mutex);
+	jobs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	for (i = 0; i < backend->priv->thread_pool_items->len; i++) {
+		item = g_ptr_array_index (backend->priv->thread_pool_items, i);
+		g_ptr_array_add (jobs, g_object_ref (item->job));
+	}
+	g_mutex_unlock (&backend->priv->thread_pool_mutex);
+
+	for (i = 0; i < jobs->len; i++) {
+		job = g_ptr_array_index (jobs, i);
+		if (!pk_backend_job_get_allow_cancel (job))
+			continue;
+		pk_backend_job_set_exit_code (job, PK_EXIT_ENUM_CANCELLED);
+		pk_backend_cancel (backend, job);
+	}
+	g_ptr_array_unref (jobs);
+}
+
+/**
+ * pk_backend_thread_pool_destroy:
+ *
+ * Never waits for the threads, as this is called from the main loop and a
+ * job can take minutes to finish. Each queued job holds a reference on the
+ * backend, and each pool is freed by its last thread.
+ **/
+static void
+pk_backend_thread_pool_destroy (PkBackend *backend)
+{
+	guint i;
+	GThreadPool *pool;
+
+	if (backend->priv->thread_pools == NULL)
+		return;
+
+	for (i = 0; i < backend->priv->thread_pools->len; i++) {
+		pool = g_ptr_array_index (backend->priv->thread_pools, i);
+		g_thread_pool_free (pool, FALSE, FALSE);
+	}
+	g_ptr_array_unref (backend->priv->thread_pools);
+	backend->priv->thread_pools = NULL;
+}
+
+/**
+ * pk_backend_thread_pool_push:
+ *
+ * Queues @func to be run by a pool thread on behalf of @job. If all the
+ * threads are busy the job waits until one is free.
+ *
+ * Return value: %TRUE if the job was queued
+ **/
+gboolean
+pk_backend_thread_pool_push (PkBackend *backend,
+			     PkBackendJob *job,
+			     GFunc func,
+			     gpointer data)
+{
+	gboolean ret = FALSE;
+	GError *error = NULL;
+	GThreadPool *pool;
+	guint idx = 0;
+	PkBackendThreadItem *item;
+
+	g_return_val_if_fail (PK_IS_BACKEND (backend), FALSE);
+	g_return_val_if_fail (func != NULL, FALSE);
+
+	/* created on demand, as the backend might not have been loaded */
+	g_mutex_lock (&backend->priv->thread_pool_mutex);
+	if (backend->priv->thread_pools == NULL) {
+		ret = pk_backend_thread_pool_create (backend, &error);
+		if (!ret) {
+			g_warning ("failed to create thread pool: %s", error->message);
+			g_error_free (error);
+			pk_backend_thread_pool_destroy (backend);
+			g_mutex_unlock (&backend->priv->thread_pool_mutex);
+			goto out;
+		}
+	}
+	g_mutex_unlock (&backend->priv->thread_pool_mutex);
+
+	/* keep the same role on the same thread */
+	if (backend->priv->thread_pools->len > 1)
+		idx = pk_backend_job_get_role (job) % backend->priv->thread_pools->len;
+	pool = g_ptr_array_index (backend->priv->thread_pools, idx);
+
+	item = g_slice_new (PkBackendThreadItem);
+	item->job = g_object_ref (job);
+	item->func = func;
+	item->data = data;
+	item->queued = g_get_monotonic_time ();
+	g_mutex_lock (&backend->priv->thread_pool_mutex);
+	g_ptr_array_add (backend->priv->thread_pool_items, item);
+	g_mutex_unlock (&backend->priv->thread_pool_mutex);
+	g_object_ref (backend);
+	ret = g_thread_pool_push (pool, item, &error);
+	if (!ret) {
+		g_warning ("failed to push to thread pool: %s", error->message);
+		g_error_free (error);
+		g_mutex_lock (&backend->priv->thread_pool_mutex);
+		g_ptr_array_remove_fast (backend->priv->thread_pool_items, item);
+		g_mutex_unlock (&backend->priv->thread_pool_mutex);
+		g_object_unref (backend);
+		g_object_unref (item->job);
+		g_slice_free (PkBackendThreadItem, item);
+		goto out;
+	}
+	if (g_thread_pool_unprocessed (pool) > 0)
+		g_debug ("%u jobs waiting for a thread", g_thread_pool_unprocessed (pool));
+out:
+	return ret;
+}
+
+/**
+ * pk_backend_get_thread_pool_stats:
+ * @jobs: (out): the number of jobs run by the pool
+ * @queue_time_max: (out): the longest a job waited for a thread, in us
+ * @queue_time_mean: (out): the mean time a job waited for a thread, in us
+ **/
+void
+pk_backend_get_thread_pool_stats (PkBackend *backend,
+				  guint *jobs,
+				  guint64 *queue_time_max,
+				  guint64 *queue_time_mean)
+{
+	PkBackendPrivate *priv;
+
+	g_return_if_fail (PK_IS_BACKEND (backend));
+
+	priv = backend->priv;
+	g_mutex_lock (&priv->thread_pool_mutex);
+	if (jobs != NULL)
+		*jobs = priv->thread_pool_jobs;
+	if (queue_time_max != NULL)
+		*queue_time_max = priv->thread_pool_wait_max;
+	if (queue_time_mean != NULL) {
+		*queue_time_mean = priv->thread_pool_jobs > 0 ?
+			priv->thread_pool_wait_total / priv->thread_pool_jobs : 0;
+	}
+	g_mutex_unlock (&priv->thread_pool_mutex);
+}
+
+/**
+ * pk_backend_get_default_lock_class:
+ *
+ * Gets the lock class that suits most backends for @role, which backends
+ * can use from pk_backend_get_lock_class() for the roles they do not
+ * handle specially.
+ **/
+PkBackendLockClass
+pk_backend_get_default_lock_class (PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_REFRESH_CACHE:
+	case PK_ROLE_ENUM_DOWNLOAD_PACKAGES:
+	case PK_ROLE_ENUM_REPO_ENABLE:
+	case PK_ROLE_ENUM_REPO_SET_DATA:
+	case PK_ROLE_ENUM_REPO_REMOVE:
+	case PK_ROLE_ENUM_INSTALL_SIGNATURE:
+		return PK_BACKEND_LOCK_CLASS_CACHE_WRITE;
+	case PK_ROLE_ENUM_INSTALL_PACKAGES:
+	case PK_ROLE_ENUM_INSTALL_FILES:
+	case PK_ROLE_ENUM_REMOVE_PACKAGES:
+	case PK_ROLE_ENUM_UPDATE_PACKAGES:
+	case PK_ROLE_ENUM_REPAIR_SYSTEM:
+	case PK_ROLE_ENUM_UNKNOWN:
+		return PK_BACKEND_LOCK_CLASS_DB_WRITE;
+	default:
+		return PK_BACKEND_LOCK_CLASS_READ_SHARED;
+	}
+}
+
+/**
+ * pk_backend_get_lock_class:
+ **/
+PkBackendLockClass
+pk_backend_get_lock_class (PkBackend *backend, PkRoleEnum role)
+{
+	g_return_val_if_fail (PK_IS_BACKEND (backend), PK_BACKEND_LOCK_CLASS_UNKNOWN);
+
+	/* not compulsory, backends that don't declare the classes keep
+	 * their per-function locks */
+	if (backend->priv->desc->get_lock_class == NULL)
+		return PK_BACKEND_LOCK_CLASS_UNKNOWN;
+	return backend->priv->desc->get_lock_class (backend, role);
+}
+
+/**
+ * pk_backend_thread_lock_class_start:
+ *
+ * The cache lock is always taken before the database lock so that two jobs
+ * can never wait for each other.
+ **/
+static void
+pk_backend_thread_lock_class_start (PkBackend *backend,
+				    PkBackendJob *job,
+				    PkBackendLockClass lock_class)
+{
+	gboolean ret;
+	PkBackendPrivate *priv = backend->priv;
+
+	/* try without blocking first, so we only report waiting if we are */
+	switch (lock_class) {
+	case PK_BACKEND_LOCK_CLASS_READ_SHARED:
+		ret = g_rw_lock_reader_trylock (&priv->cache_lock);
+		if (ret) {
+			ret = g_rw_lock_reader_trylock (&priv->db_lock);
+			if (!ret)
+				g_rw_lock_reader_unlock (&priv->cache_lock);
+		}
+		break;
+	case PK_BACKEND_LOCK_CLASS_CACHE_WRITE:
+		ret = g_rw_lock_writer_trylock (&priv->cache_lock);
+		if (ret) {
+			ret = g_rw_lock_reader_trylock (&priv->db_lock);
+			if (!ret)
+				g_rw_lock_writer_unlock (&priv->cache_lock);
+		}
+		break;
+	default:
+		ret = g_rw_lock_writer_trylock (&priv->cache_lock);
+		if (ret) {
+			ret = g_rw_lock_writer_trylock (&priv->db_lock);
+			if (!ret)
+				g_rw_lock_writer_unlock (&priv->cache_lock);
+		}
+		break;
+	}
+	if (ret)
+		return;
+
+	pk_backend_job_set_status (job, PK_STATUS_ENUM_WAITING_FOR_LOCK);
+	switch (lock_class) {
+	case PK_BACKEND_LOCK_CLASS_READ_SHARED:
+		g_rw_lock_reader_lock (&priv->cache_lock);
+		g_rw_lock_reader_lock (&priv->db_lock);
+		break;
+	case PK_BACKEND_LOCK_CLASS_CACHE_WRITE:
+		g_rw_lock_writer_lock (&priv->cache_lock);
+		g_rw_lock_reader_lock (&priv->db_lock);
+		break;
+	default:
+		g_rw_lock_writer_lock (&priv->cache_lock);
+		g_rw_lock_writer_lock (&priv->db_lock);
+		break;
+	}
+}
+
+/**
+ * pk_backend_thread_lock_class_stop:
+ **/
+static void
+pk_backend_thread_lock_class_stop (PkBackend *backend,
+				   PkBackendLockClass lock_class)
+{
+	PkBackendPrivate *priv = backend->priv;
+
+	switch (lock_class) {
+	case PK_BACKEND_LOCK_CLASS_READ_SHARED:
+		g_rw_lock_reader_unlock (&priv->db_lock);
+		g_rw_lock_reader_unlock (&priv->cache_lock);
+		break;
+	case PK_BACKEND_LOCK_CLASS_CACHE_WRITE:
+		g_rw_lock_reader_unlock (&priv->db_lock);
+		g_rw_lock_writer_unlock (&priv->cache_lock);
+		break;
+	default:
+		g_rw_lock_writer_unlock (&priv->db_lock);
+		g_rw_lock_writer_unlock (&priv->cache_lock);
+		break;
+	}
+}
+
 /**
  * pk_backend_thread_start:
+ *
+ * Takes the locks the job needs before its thread function is run. If
+ * the backend declares lock classes then the locks are shared by role,
+ * otherwise jobs running the same thread function are serialized.
  **/
 void
 pk_backend_thread_start (PkBackend *backend, PkBackendJob *job, gpointer func)
 {
 	GMutex *mutex;
 	gboolean ret;
+	PkBackendLockClass lock_class;
+
+	lock_class = pk_backend_get_lock_class (backend, pk_backend_job_get_role (job));
+	if (lock_class != PK_BACKEND_LOCK_CLASS_UNKNOWN) {
+		pk_backend_thread_lock_class_start (backend, job, lock_class);
+		return;
+	}
 
 	g_mutex_lock (&backend->priv->thread_hash_mutex);
 	mutex = g_hash_table_lookup (backend->priv->thread_hash, func);
@@ -283,6 +730,14 @@ void
 pk_backend_thread_stop (PkBackend *backend, PkBackendJob *job, gpointer func)
 {
 	GMutex *mutex;
+	PkBackendLockClass lock_class;
+
+	lock_class = pk_backend_get_lock_class (backend, pk_backend_job_get_role (job));
+	if (lock_class != PK_BACKEND_LOCK_CLASS_UNKNOWN) {
+		pk_backend_thread_lock_class_stop (backend, lock_class);
+		return;
+	}
+
 	mutex = g_hash_table_lookup (backend->priv->thread_hash, func);
 	g_assert (mutex);
 	g_mutex_unlock (mutex);
@@ -533,6 +988,9 @@ pk_backend_load (PkBackend *backend, GError **error)
 		g_module_symbol (handle, "pk_backend_get_groups", (gpointer *)&desc->get_groups);
 		g_module_symbol (handle, "pk_backend_get_mime_types", (gpointer *)&desc->get_mime_types);
 		g_module_symbol (handle, "pk_backend_supports_parallelization", (gpointer *)&desc->supports_parallelization);
+		g_module_symbol (handle, "pk_backend_get_thread_pool_size", (gpointer *)&desc->get_thread_pool_size);
+		g_module_symbol (handle, "pk_backend_get_thread_affinity", (gpointer *)&desc->get_thread_affinity);
+		g_module_symbol (handle, "pk_backend_get_lock_class", (gpointer *)&desc->get_lock_class);
 		g_module_symbol (handle, "pk_backend_get_packages", (gpointer *)&desc->get_packages);
 		g_module_symbol (handle, "pk_backend_get_repo_list", (gpointer *)&desc->get_repo_list);
 		g_module_symbol (handle, "pk_backend_required_by", (gpointer *)&desc->required_by);
@@ -618,6 +1076,8 @@ pk_backend_unload (PkBackend *backend)
 		g_warning ("not yet loaded backend, try pk_backend_load()");
 		return FALSE;
 	}
+	pk_backend_thread_pool_cancel (backend);
+	pk_backend_thread_pool_destroy (backend);
 	if (backend->priv->desc->destroy != NULL)
 		backend->priv->desc->destroy (backend);
 	backend->priv->loaded = FALSE;
@@ -960,6 +1420,11 @@ pk_backend_finalize (GObject *object)
 
 	g_mutex_clear (&backend->priv->thread_hash_mutex);
 	g_hash_table_unref (backend->priv->thread_hash);
+	g_rw_lock_clear (&backend->priv->cache_lock);
+	g_rw_lock_clear (&backend->priv->db_lock);
+	pk_backend_thread_pool_destroy (backend);
+	g_ptr_array_unref (backend->priv->thread_pool_items);
+	g_mutex_clear (&backend->priv->thread_pool_mutex);
 
 	if (backend->priv->monitor != NULL)
 		g_object_unref (backend->priv->monitor);
@@ -1617,6 +2082,10 @@ pk_backend_init (PkBackend *backend)
 							    NULL,
 							    g_free);
 	g_mutex_init (&backend->priv->thread_hash_mutex);
+	g_rw_lock_init (&backend->priv->cache_lock);
+	g_rw_lock_init (&backend->priv->db_lock);
+	g_mutex_init (&backend->priv->thread_pool_mutex);
+	backend->priv->thread_pool_items = g_ptr_array_new ();
 }
 
 /**
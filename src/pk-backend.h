@@ -66,6 +66,42 @@ typedef struct
  */
 #define PK_BACKEND_PERCENTAGE_INVALID		101
 
+/**
+ * PkBackendThreadAffinity:
+ * @PK_BACKEND_THREAD_AFFINITY_ANY:	jobs can run on any pool thread
+ * @PK_BACKEND_THREAD_AFFINITY_ROLE:	jobs with the same role always run on the same pool thread
+ * @PK_BACKEND_THREAD_AFFINITY_SINGLE:	all jobs run on the same pool thread
+ *
+ * Backends that keep per-thread state, for instance a library context that
+ * is expensive to set up or not safe to use from another thread, can ask for
+ * their jobs to be run on a stable thread.
+ **/
+typedef enum {
+	PK_BACKEND_THREAD_AFFINITY_ANY,
+	PK_BACKEND_THREAD_AFFINITY_ROLE,
+	PK_BACKEND_THREAD_AFFINITY_SINGLE,
+	PK_BACKEND_THREAD_AFFINITY_LAST
+} PkBackendThreadAffinity;
+
+/**
+ * PkBackendLockClass:
+ * @PK_BACKEND_LOCK_CLASS_UNKNOWN:	jobs using the same thread function are run one at a time
+ * @PK_BACKEND_LOCK_CLASS_READ_SHARED:	the job only reads the cache and the database
+ * @PK_BACKEND_LOCK_CLASS_CACHE_WRITE:	the job writes the cache and reads the database
+ * @PK_BACKEND_LOCK_CLASS_DB_WRITE:	the job writes both the cache and the database
+ *
+ * The locks a job needs while its thread is running. Any number of
+ * read-shared jobs can run at the same time, but a job writing the cache
+ * or the database waits for every other job using it to finish.
+ **/
+typedef enum {
+	PK_BACKEND_LOCK_CLASS_UNKNOWN,
+	PK_BACKEND_LOCK_CLASS_READ_SHARED,
+	PK_BACKEND_LOCK_CLASS_CACHE_WRITE,
+	PK_BACKEND_LOCK_CLASS_DB_WRITE,
+	PK_BACKEND_LOCK_CLASS_LAST
+} PkBackendLockClass;
+
 GType		 pk_backend_get_type			(void);
 PkBackend	*pk_backend_new				(GKeyFile		*conf);
 
@@ -105,6 +141,11 @@ PkBitfield	 pk_backend_get_filters			(PkBackend	*backend);
 PkBitfield	 pk_backend_get_roles			(PkBackend	*backend);
 gchar		**pk_backend_get_mime_types		(PkBackend	*backend);
 gboolean	 pk_backend_supports_parallelization	(PkBackend	*backend);
+guint		 pk_backend_get_thread_pool_size	(PkBackend	*backend);
+PkBackendThreadAffinity pk_backend_get_thread_affinity	(PkBackend	*backend);
+PkBackendLockClass pk_backend_get_lock_class		(PkBackend	*backend,
+							 PkRoleEnum	 role);
+PkBackendLockClass pk_backend_get_default_lock_class	(PkRoleEnum	 role);
 void		 pk_backend_initialize			(GKeyFile		*conf,
 							 PkBackend	*backend);
 void		 pk_backend_destroy			(PkBackend	*backend);
@@ -233,6 +274,14 @@ void		 pk_backend_thread_start		(PkBackend	*backend,
 void		 pk_backend_thread_stop			(PkBackend	*backend,
 							 PkBackendJob	*job,
 							 gpointer	 func);
+gboolean	 pk_backend_thread_pool_push		(PkBackend	*backend,
+							 PkBackendJob	*job,
+							 GFunc		 func,
+							 gpointer	 data);
+void		 pk_backend_get_thread_pool_stats	(PkBackend	*backend,
+							 guint		*jobs,
+							 guint64	*queue_time_max,
+							 guint64	*queue_time_mean);
 
 /* global backend state */
 void		 pk_backend_accept_eula			(PkBackend	*backend,
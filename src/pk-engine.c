@@ -47,6 +47,7 @@
 #include "pk-notify.h"
 #include "pk-plugin.h"
 #include "pk-shared.h"
+#include "pk-statistics.h"
 #include "pk-transaction-db.h"
 #include "pk-transaction.h"
 #include "pk-transaction-list.h"
@@ -67,6 +68,7 @@ struct PkEnginePrivate
 	PkBackend		*backend;
 	PkNetwork		*network;
 	PkNotify		*notify;
+	PkStatistics		*statistics;
 	GKeyFile		*conf;
 	PkDbus			*dbus;
 	GFileMonitor		*monitor_conf;
@@ -955,7 +957,10 @@ pk_engine_plugin_phase (PkEngine *engine,
 {
 	guint i;
 	const gchar *function = NULL;
+	gboolean ran_one = FALSE;
 	gboolean ret;
+	gchar *metric;
+	gint64 start;
 	PkPluginFunc plugin_func = NULL;
 	PkPlugin *plugin;
 
@@ -977,6 +982,7 @@ pk_engine_plugin_phase (PkEngine *engine,
 	g_assert (function != NULL);
 
 	/* run each plugin */
+	start = g_get_monotonic_time ();
 	for (i = 0; i < engine->priv->plugins->len; i++) {
 		plugin = g_ptr_array_index (engine->priv->plugins, i);
 		ret = g_module_symbol (plugin->module,
@@ -994,6 +1000,15 @@ pk_engine_plugin_phase (PkEngine *engine,
 		plugin_func (plugin);
 		plugin->backend = NULL;
 		g_debug ("finished %s", function);
+		ran_one = TRUE;
+	}
+
+	/* only record phases that did something */
+	if (ran_one) {
+		metric = g_strdup_printf ("plugin-phase:%s", function);
+		pk_statistics_add (engine->priv->statistics, metric,
+				   g_get_monotonic_time () - start);
+		g_free (metric);
 	}
 }
 
@@ -1054,6 +1069,8 @@ gboolean
 pk_engine_load_backend (PkEngine *engine, GError **error)
 {
 	gboolean ret;
+	GError *error_local = NULL;
+	guint max_age;
 
 	/* load any backend init */
 	ret = pk_backend_load (engine->priv->backend, error);
@@ -1070,6 +1087,13 @@ pk_engine_load_backend (PkEngine *engine, GError **error)
 	if (!ret)
 		goto out;
 
+	/* expire old history, this is not fatal */
+	max_age = g_key_file_get_integer (engine->priv->conf, "Daemon", "TransactionHistoryMaxAge", NULL);
+	if (!pk_transaction_db_compact (engine->priv->transaction_db, max_age, &error_local)) {
+		g_warning ("failed to compact transaction database: %s", error_local->message);
+		g_clear_error (&error_local);
+	}
+
 	/* create a new backend so we can get the static stuff */
 	engine->priv->roles = pk_backend_get_roles (engine->priv->backend);
 	engine->priv->groups = pk_backend_get_groups (engine->priv->backend);
@@ -1171,64 +1195,6 @@ out:
 	return retval;
 }
 
-/**
- * pk_engine_package_name_in_strv:
- **/
-static gboolean
-pk_engine_package_name_in_strv (gchar **strv, PkPackage *pkg)
-{
-	guint i;
-	for (i = 0; strv[i] != NULL; i++) {
-		if (g_strcmp0 (strv[i], pk_package_get_name (pkg)) == 0)
-			return TRUE;
-	}
-	return FALSE;
-}
-
-/**
- * pk_engine_get_package_history_pkg:
- *
- * Create a 'a{sv}' GVariant instance from all the PkTransactionPast data
- **/
-static GVariant *
-pk_engine_get_package_history_pkg (PkTransactionPast *item, PkPackage *pkg)
-{
-	GVariantBuilder builder;
-	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
-	g_variant_builder_add (&builder, "{sv}", "info",
-			       g_variant_new_uint32 (pk_package_get_info (pkg)));
-	g_variant_builder_add (&builder, "{sv}", "source",
-			       g_variant_new_string (pk_package_get_data (pkg)));
-	g_variant_builder_add (&builder, "{sv}", "version",
-			       g_variant_new_string (pk_package_get_version (pkg)));
-	g_variant_builder_add (&builder, "{sv}", "timestamp",
-			       g_variant_new_uint64 (pk_transaction_past_get_timestamp (item)));
-	g_variant_builder_add (&builder, "{sv}", "user-id",
-			       g_variant_new_uint32 (pk_transaction_past_get_uid (item)));
-	return g_variant_builder_end (&builder);
-}
-
-/**
- * pk_engine_is_package_history_interesing:
- **/
-static gboolean
-pk_engine_is_package_history_interesing (PkPackage *package)
-{
-	gboolean ret;
-
-	switch (pk_package_get_info (package)) {
-	case PK_INFO_ENUM_INSTALLING:
-	case PK_INFO_ENUM_REMOVING:
-	case PK_INFO_ENUM_UPDATING:
-		ret = TRUE;
-		break;
-	default:
-		ret = FALSE;
-		break;
-	}
-	return ret;
-}
-
 /**
  * pk_engine_get_package_history:
  **/
@@ -1238,118 +1204,27 @@ pk_engine_get_package_history (PkEngine *engine,
 			       guint max_size,
 			       GError **error)
 {
-	const gchar *data;
-	const gchar *pkgname;
-	gboolean ret;
-	gchar *key;
-	gchar **package_lines;
-	GHashTable *deduplicate_hash;
 	GHashTable *pkgname_hash;
-	gint64 timestamp;
-	GList *keys = NULL;
-	GList *l;
-	GList *list;
-	GPtrArray *array = NULL;
 	guint i;
 	GVariantBuilder builder;
-	GVariant *value = NULL;
-	PkPackage *package_tmp;
-	PkTransactionPast *item;
-
-	list = pk_transaction_db_get_list (engine->priv->transaction_db, max_size);
+	GVariant *value;
 
-	/* simplify the loop */
-	if (max_size == 0)
-		max_size = G_MAXUINT;
-
-	pkgname_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_ptr_array_unref);
-	deduplicate_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-	package_tmp = pk_package_new ();
-	for (l = list; l != NULL; l = l->next) {
-		item = PK_TRANSACTION_PAST (l->data);
-
-		/* ignore anything that failed */
-		if (!pk_transaction_past_get_succeeded (item))
+	/* each name is a bounded query on the package_events index */
+	pkgname_hash = g_hash_table_new (g_str_hash, g_str_equal);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{saa{sv}}"));
+	for (i = 0; package_names[i] != NULL; i++) {
+		if (g_hash_table_lookup (pkgname_hash, package_names[i]) != NULL)
 			continue;
-
-		/* split up data */
-		data = pk_transaction_past_get_data (item);
-		if (data == NULL)
+		g_hash_table_insert (pkgname_hash, package_names[i], package_names[i]);
+		value = pk_transaction_db_get_package_history (engine->priv->transaction_db,
+							       package_names[i],
+							       max_size);
+		if (value == NULL)
 			continue;
-		package_lines = g_strsplit (data, "\n", -1);
-		for (i = 0; package_lines[i] != NULL; i++) {
-			ret = pk_package_parse (package_tmp, package_lines[i], error);
-			g_assert (ret);
-
-			/* not the package we care about */
-			if (!pk_engine_package_name_in_strv (package_names, package_tmp))
-				continue;
-
-			/* not a state we care about */
-			if (!pk_engine_is_package_history_interesing (package_tmp))
-				continue;
-
-			/* transactions without a timestamp are not interesting */
-			timestamp = pk_transaction_past_get_timestamp (item);
-			if (timestamp == 0)
-				continue;
-
-			/* de-duplicate the entry, in the case of multiarch */
-			key = g_strdup_printf ("%s-%" G_GINT64_FORMAT,
-					       pk_package_get_name (package_tmp),
-					       timestamp);
-			if (g_hash_table_lookup (deduplicate_hash, key) != NULL) {
-				g_free (key);
-				continue;
-			}
-			g_hash_table_insert (deduplicate_hash, key, package_lines[i]);
-
-			/* get the blob for this data item */
-			value = pk_engine_get_package_history_pkg (item, package_tmp);
-			if (value == NULL)
-				continue;
-
-			/* find the array */
-			pkgname = pk_package_get_name (package_tmp);
-			array = g_hash_table_lookup (pkgname_hash, pkgname);
-			if (array == NULL) {
-				array = g_ptr_array_new ();
-				g_hash_table_insert (pkgname_hash,
-						     g_strdup (pkgname),
-						     array);
-			}
-			g_ptr_array_add (array, value);
-		}
-		g_strfreev (package_lines);
-	}
-
-	/* no history returns an empty array */
-	if (g_hash_table_size (pkgname_hash) == 0) {
-		value = g_variant_new_array (G_VARIANT_TYPE ("{saa{sv}}"), NULL, 0);
-		goto out;
-	}
-
-	/* we have a hash of pkgname:GPtrArray where the GPtrArray is an array
-	 * of GVariants of type a{sv} */
-	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
-	keys = g_hash_table_get_keys (pkgname_hash);
-	for (l = keys; l != NULL; l = l->next) {
-		pkgname = l->data;
-		array = g_hash_table_lookup (pkgname_hash, pkgname);
-		/* create aa{sv} */
-		value = g_variant_new_array (NULL,
-					     (GVariant * const *) array->pdata,
-					     MIN (array->len, max_size));
-		g_variant_builder_add (&builder, "{s@aa{sv}}", pkgname, value);
+		g_variant_builder_add (&builder, "{s@aa{sv}}", package_names[i], value);
 	}
-	value = g_variant_builder_end (&builder);
-out:
-	g_list_free (keys);
 	g_hash_table_unref (pkgname_hash);
-	g_hash_table_unref (deduplicate_hash);
-	g_object_unref (package_tmp);
-	g_list_free_full (list, (GDestroyNotify) g_object_unref);
-	return value;
+	return g_variant_builder_end (&builder);
 }
 
 /**
@@ -1398,6 +1273,13 @@ pk_engine_daemon_method_call (GDBusConnection *connection_, const gchar *sender,
 		goto out;
 	}
 
+	if (g_strcmp0 (method_name, "GetStatistics") == 0) {
+		value = g_variant_new ("(@a{sa{sv}})",
+				       pk_statistics_get_variant (engine->priv->statistics));
+		g_dbus_method_invocation_return_value (invocation, value);
+		goto out;
+	}
+
 	if (g_strcmp0 (method_name, "GetPackageHistory") == 0) {
 		g_variant_get (parameters, "(^a&su)", &package_names, &size);
 		if (package_names == NULL || g_strv_length (package_names) == 0) {
@@ -1707,6 +1589,9 @@ pk_engine_init (PkEngine *engine)
 	engine->priv->timeout_priority_id = 0;
 	engine->priv->timeout_normal_id = 0;
 
+	/* shared with the transactions */
+	engine->priv->statistics = pk_statistics_new ();
+
 	/* add the interface */
 	engine->priv->notify = pk_notify_new ();
 	g_signal_connect (engine->priv->notify, "repo-list-changed",
@@ -1814,6 +1699,7 @@ pk_engine_finalize (GObject *object)
 	if (engine->priv->authority != NULL)
 		g_object_unref (engine->priv->authority);
 	g_object_unref (engine->priv->notify);
+	g_object_unref (engine->priv->statistics);
 	g_object_unref (engine->priv->backend);
 	g_key_file_unref (engine->priv->conf);
 	g_object_unref (engine->priv->dbus);
@@ -24,6 +24,7 @@
 #include <glib.h>
 #include <glib-object.h>
 #include <glib/gstdio.h>
+#include <sqlite3.h>
 
 #include "pk-backend.h"
 #include "pk-backend-spawn.h"
@@ -31,6 +32,7 @@
 #include "pk-engine.h"
 #include "pk-notify.h"
 #include "pk-spawn.h"
+#include "pk-statistics.h"
 #include "pk-time.h"
 #include "pk-transaction-db.h"
 #include "pk-transaction.h"
@@ -170,6 +172,7 @@ pk_test_backend_func (void)
 	gboolean ret;
 	const gchar *filename;
 	GError *error = NULL;
+	guint jobs = 0;
 
 	/* get an backend */
 	conf = g_key_file_new ();
@@ -277,6 +280,17 @@ pk_test_backend_func (void)
 	/* check duplicate filter */
 	g_assert_cmpint (number_packages, ==, 1);
 
+	/* check the events were dispatched in bulk */
+	g_assert_cmpint (pk_backend_job_get_dispatch_count (job), >=, 2);
+	g_assert_cmpint (pk_backend_job_get_dispatch_wakeups (job), >=, 1);
+	g_assert_cmpint (pk_backend_job_get_dispatch_wakeups (job), <=,
+			 pk_backend_job_get_dispatch_count (job));
+	g_assert_cmpint (pk_backend_job_get_queue_depth_max (job), >=, 1);
+
+	/* check the job was run by the thread pool */
+	pk_backend_get_thread_pool_stats (backend, &jobs, NULL, NULL);
+	g_assert_cmpint (jobs, ==, 1);
+
 	/* reset */
 	pk_backend_start_job (backend, job);
 	pk_backend_reset_job (backend, job);
@@ -361,6 +375,7 @@ pk_test_backend_spawn_func (void)
 	GKeyFile *conf;
 	const gchar *text;
 	gboolean ret;
+	gchar *text_long;
 	gchar *uri;
 	GError *error = NULL;
 
@@ -464,6 +479,21 @@ pk_test_backend_spawn_func (void)
 		"package\tinstalled\tgnome-power-manager;0.0.1;i386;data\tMore useless software", NULL);
 	g_assert (ret);
 
+	/* test pk_backend_spawn_parse_common_out Package with a summary too long for the stack */
+	text_long = g_strdup_printf ("package\tinstalled\tgnome-power-manager;0.0.1;i386;data\t%02000i", 0);
+	ret = pk_backend_spawn_inject_data (backend_spawn, job, text_long, NULL);
+	g_assert (ret);
+	g_free (text_long);
+
+	/* test pk_backend_spawn_parse_common_out Package with invalid UTF-8 */
+	ret = pk_backend_spawn_inject_data (backend_spawn, job,
+		"package\tinstalled\tgnome-power-manager;0.0.1;i386;data\tMore \xff software", NULL);
+	g_assert (!ret);
+
+	/* test pk_backend_spawn_parse_common_out unknown command */
+	ret = pk_backend_spawn_inject_data (backend_spawn, job, "packages\tinstalled", NULL);
+	g_assert (!ret);
+
 	/* manually unlock as we have no engine */
 	ret = pk_backend_unload (backend);
 	g_assert (ret);
@@ -516,6 +546,68 @@ pk_test_backend_spawn_func (void)
 	g_key_file_unref (conf);
 }
 
+static void
+pk_test_backend_spawn_parse_func (void)
+{
+	PkBackendSpawn *backend_spawn;
+	PkBackend *backend;
+	PkBackendJob *job;
+	GKeyFile *conf;
+	gboolean ret;
+	gchar *data;
+	gchar **lines;
+	gdouble elapsed;
+	guint i;
+	guint j;
+	guint n_lines = 0;
+	GError *error = NULL;
+
+	if (!g_test_perf ())
+		return;
+
+	/* what a helper sends for a typical query */
+	ret = g_file_get_contents (TESTDATADIR "/pk-backend-spawn-transcript.txt",
+				   &data, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	lines = g_strsplit (data, "\n", -1);
+
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "test_spawn");
+	backend_spawn = pk_backend_spawn_new (conf);
+	pk_backend_spawn_set_name (backend_spawn, "test_spawn");
+	backend = pk_backend_new (conf);
+	job = pk_backend_job_new (conf);
+	pk_backend_job_set_backend (job, backend);
+	ret = pk_backend_load (backend, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* parse the transcript over and over */
+	g_test_timer_start ();
+	for (i = 0; i < 5000; i++) {
+		for (j = 0; lines[j] != NULL; j++) {
+			if (lines[j][0] == '\0')
+				continue;
+			ret = pk_backend_spawn_inject_data (backend_spawn, job, lines[j], &error);
+			g_assert_no_error (error);
+			g_assert (ret);
+			n_lines++;
+		}
+	}
+	elapsed = g_test_timer_elapsed ();
+	g_test_minimized_result (elapsed, "%u lines: %.3fs", n_lines, elapsed);
+
+	ret = pk_backend_unload (backend);
+	g_assert (ret);
+	g_object_unref (backend_spawn);
+	g_object_unref (job);
+	g_object_unref (backend);
+	g_key_file_unref (conf);
+	g_strfreev (lines);
+	g_free (data);
+}
+
 static void
 pk_test_dbus_func (void)
 {
@@ -529,6 +621,7 @@ pk_test_dbus_func (void)
 
 PkSpawnExitType mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
 guint stdout_count = 0;
+guint frame_count = 0;
 guint finished_count = 0;
 
 /**
@@ -553,6 +646,23 @@ pk_test_stdout_cb (PkSpawn *spawn, const gchar *line, gpointer user_data)
 	stdout_count++;
 }
 
+/**
+ * pk_test_frame_cb:
+ **/
+static void
+pk_test_frame_cb (PkSpawn *spawn, gchar *frame, guint len, gpointer user_data)
+{
+	g_debug ("frame '%s' of size %u", frame, len);
+	g_assert_cmpint (frame[len - 1], ==, '\0');
+	if (frame_count == 0) {
+		g_assert_cmpint (len, ==, 58);
+		g_assert_cmpstr (frame, ==, "package");
+		g_assert_cmpstr (frame + 8, ==, "available");
+		g_assert_cmpstr (frame + 41, ==, "PolicyKit daemon");
+	}
+	frame_count++;
+}
+
 static gboolean
 cancel_cb (gpointer data)
 {
@@ -574,7 +684,10 @@ new_spawn_object (PkSpawn **pspawn)
 			  G_CALLBACK (pk_test_exit_cb), NULL);
 	g_signal_connect (*pspawn, "stdout",
 			  G_CALLBACK (pk_test_stdout_cb), NULL);
+	g_signal_connect (*pspawn, "frame",
+			  G_CALLBACK (pk_test_frame_cb), NULL);
 	stdout_count = 0;
+	frame_count = 0;
 }
 
 static gboolean
@@ -769,6 +882,100 @@ pk_test_spawn_func (void)
 	g_object_unref (spawn);
 }
 
+static void
+pk_test_spawn_framed_func (void)
+{
+	gboolean ret;
+	gchar **argv;
+	GError *error = NULL;
+	PkSpawn *spawn = NULL;
+
+	/* the helper switches from lines of text to frames */
+	new_spawn_object (&spawn);
+	mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	argv = g_strsplit (TESTDATADIR "/pk-spawn-test-framed.sh", " ", 0);
+	ret = pk_spawn_argv (spawn, argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_strfreev (argv);
+	_g_test_loop_run_with_timeout (10000);
+
+	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SUCCESS);
+	g_assert_cmpint (stdout_count, ==, 1);
+	g_assert_cmpint (frame_count, ==, 2);
+
+	g_object_unref (spawn);
+}
+
+static void
+pk_test_spawn_throughput_func (void)
+{
+	gboolean ret;
+	gchar **argv;
+	gdouble elapsed;
+	GError *error = NULL;
+	PkSpawn *spawn = NULL;
+
+	if (!g_test_perf ())
+		return;
+
+	/* time how long it takes to get every line from a fast helper */
+	new_spawn_object (&spawn);
+	mexit = PK_SPAWN_EXIT_TYPE_UNKNOWN;
+	argv = g_strsplit (TESTDATADIR "/pk-spawn-test-throughput.sh", " ", 0);
+	g_test_timer_start ();
+	ret = pk_spawn_argv (spawn, argv, NULL, PK_SPAWN_ARGV_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_strfreev (argv);
+	_g_test_loop_run_with_timeout (60000);
+	elapsed = g_test_timer_elapsed ();
+
+	g_assert_cmpint (mexit, ==, PK_SPAWN_EXIT_TYPE_SUCCESS);
+	g_assert_cmpint (stdout_count, ==, 100000);
+	g_test_minimized_result (elapsed, "100000 lines: %.3fs", elapsed);
+
+	g_object_unref (spawn);
+}
+
+static void
+pk_test_statistics_func (void)
+{
+	guint i;
+	GVariant *value;
+	PkStatistics *statistics;
+
+	statistics = pk_statistics_new ();
+
+	/* nothing recorded */
+	g_assert_cmpint (pk_statistics_get_count (statistics, "runtime:resolve"), ==, 0);
+	g_assert_cmpint (pk_statistics_get_percentile (statistics, "runtime:resolve", 50), ==, 0);
+
+	/* small values are exact */
+	for (i = 1; i <= 10; i++)
+		pk_statistics_add (statistics, "small", i);
+	g_assert_cmpint (pk_statistics_get_count (statistics, "small"), ==, 10);
+	g_assert_cmpint (pk_statistics_get_percentile (statistics, "small", 50), ==, 5);
+	g_assert_cmpint (pk_statistics_get_percentile (statistics, "small", 100), ==, 10);
+
+	/* large values are within 12.5% */
+	for (i = 1; i <= 1000; i++)
+		pk_statistics_add_role (statistics, "runtime", PK_ROLE_ENUM_RESOLVE, i * 1000);
+	g_assert_cmpint (pk_statistics_get_count (statistics, "runtime:resolve"), ==, 1000);
+	g_assert_cmpint (pk_statistics_get_percentile (statistics, "runtime:resolve", 50), >=, 500000);
+	g_assert_cmpint (pk_statistics_get_percentile (statistics, "runtime:resolve", 50), <=, 562500);
+	g_assert_cmpint (pk_statistics_get_percentile (statistics, "runtime:resolve", 99), >=, 990000);
+	g_assert_cmpint (pk_statistics_get_percentile (statistics, "runtime:resolve", 100), ==, 1000000);
+
+	/* export */
+	value = pk_statistics_get_variant (statistics);
+	g_assert (g_variant_is_of_type (value, G_VARIANT_TYPE ("a{sa{sv}}")));
+	g_assert_cmpint (g_variant_n_children (value), ==, 2);
+	g_variant_unref (g_variant_ref_sink (value));
+
+	g_object_unref (statistics);
+}
+
 static void
 pk_test_time_func (void)
 {
@@ -866,6 +1073,56 @@ pk_test_transaction_func (void)
 	g_dbus_node_info_unref (introspection);
 }
 
+/**
+ * pk_test_transaction_db_sql:
+ *
+ * Runs a statement on the transaction database behind the daemon's back,
+ * returning the first column of the last row, or -1 if there is none.
+ **/
+static gint
+pk_test_transaction_db_sql (const gchar *sql)
+{
+	gint rc;
+	gint value = -1;
+	sqlite3 *sdb;
+	sqlite3_stmt *statement;
+
+	rc = sqlite3_open (PK_DB_DIR "/transactions.db", &sdb);
+	g_assert_cmpint (rc, ==, SQLITE_OK);
+	rc = sqlite3_prepare_v2 (sdb, sql, -1, &statement, NULL);
+	g_assert_cmpint (rc, ==, SQLITE_OK);
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW)
+		value = sqlite3_column_int (statement, 0);
+	g_assert_cmpint (rc, ==, SQLITE_DONE);
+	sqlite3_finalize (statement);
+	sqlite3_close (sdb);
+	return value;
+}
+
+/**
+ * pk_test_transaction_db_add:
+ *
+ * Adds a finished transaction that installed @package_id.
+ **/
+static gchar *
+pk_test_transaction_db_add (PkTransactionDb *tdb, const gchar *package_id)
+{
+	gboolean ret;
+	gchar *data;
+	gchar *tid;
+
+	tid = pk_transaction_db_generate_id (tdb);
+	ret = pk_transaction_db_add (tdb, tid);
+	g_assert (ret);
+	data = g_strdup_printf ("installing\t%s\tTest package", package_id);
+	ret = pk_transaction_db_set_data (tdb, tid, data);
+	g_assert (ret);
+	ret = pk_transaction_db_set_finished (tdb, tid, TRUE, 1000);
+	g_assert (ret);
+	g_free (data);
+	return tid;
+}
+
 static void
 pk_test_transaction_db_func (void)
 {
@@ -876,7 +1133,12 @@ pk_test_transaction_db_func (void)
 	gdouble ms;
 	gchar *proxy_http = NULL;
 	gchar *proxy_ftp = NULL;
+	gchar *sql;
+	gchar *tid_new;
+	gchar *tid_old;
+	gchar *tid_pending;
 	GError *error = NULL;
+	GVariant *history;
 
 	/* remove the self check file */
 #if PK_BUILD_LOCAL
@@ -993,6 +1255,96 @@ pk_test_transaction_db_func (void)
 	g_assert_cmpstr (proxy_http, ==, "127.0.0.1:80");
 	g_assert_cmpstr (proxy_ftp, ==, "127.0.0.1:21");
 
+	/* is the package history indexed */
+	tid = pk_transaction_db_generate_id (db);
+	ret = pk_transaction_db_add (db, tid);
+	g_assert (ret);
+	ret = pk_transaction_db_set_uid (db, tid, 500);
+	g_assert (ret);
+	ret = pk_transaction_db_set_data (db, tid,
+					  "installing\tpowertop;1.8-1.fc8;i386;fedora\tPower consumption monitor\n"
+					  "installing\tpowertop;1.8-1.fc8;x86_64;fedora\tPower consumption monitor\n"
+					  "downloading\tkernel;2.6.23-0.115.rc3.git1.fc8;i386;installed\tThe Linux kernel");
+	g_assert (ret);
+
+	/* failed transactions are not shown */
+	history = pk_transaction_db_get_package_history (db, "powertop", 0);
+	g_assert (history == NULL);
+	ret = pk_transaction_db_set_finished (db, tid, TRUE, 1000);
+	g_assert (ret);
+	g_free (tid);
+
+	/* multiarch entries are merged */
+	history = pk_transaction_db_get_package_history (db, "powertop", 10);
+	g_assert (history != NULL);
+	g_assert_cmpint (g_variant_n_children (history), ==, 1);
+	g_variant_unref (g_variant_ref_sink (history));
+
+	/* only interesting states are indexed */
+	history = pk_transaction_db_get_package_history (db, "kernel", 10);
+	g_assert (history == NULL);
+
+	/* can we checkpoint the log */
+	ret = pk_transaction_db_compact (db, 0, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* add a transaction from long ago, and one from today */
+	tid_old = pk_test_transaction_db_add (db, "oldpkg;1.0;i386;fedora");
+	tid_new = pk_test_transaction_db_add (db, "newpkg;1.0;i386;fedora");
+	sql = g_strdup_printf ("UPDATE transactions SET timespec = '2000-01-01T00:00:00Z' "
+			       "WHERE transaction_id = '%s'", tid_old);
+	pk_test_transaction_db_sql (sql);
+	g_free (sql);
+
+	/* and an old one that is still running */
+	tid_pending = pk_transaction_db_generate_id (db);
+	ret = pk_transaction_db_add (db, tid_pending);
+	g_assert (ret);
+	sql = g_strdup_printf ("UPDATE transactions SET timespec = '2000-01-01T00:00:00Z' "
+			       "WHERE transaction_id = '%s'", tid_pending);
+	pk_test_transaction_db_sql (sql);
+	g_free (sql);
+
+	/* a TransactionHistoryMaxAge of zero keeps everything */
+	ret = pk_transaction_db_compact (db, 0, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	history = pk_transaction_db_get_package_history (db, "oldpkg", 0);
+	g_assert (history != NULL);
+	g_variant_unref (g_variant_ref_sink (history));
+
+	/* only the old transaction is removed */
+	ret = pk_transaction_db_compact (db, 30, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	history = pk_transaction_db_get_package_history (db, "oldpkg", 0);
+	g_assert (history == NULL);
+	history = pk_transaction_db_get_package_history (db, "newpkg", 0);
+	g_assert (history != NULL);
+	g_variant_unref (g_variant_ref_sink (history));
+
+	/* along with its package events */
+	sql = g_strdup_printf ("SELECT COUNT(*) FROM package_events WHERE transaction_id = '%s'", tid_old);
+	g_assert_cmpint (pk_test_transaction_db_sql (sql), ==, 0);
+	g_free (sql);
+	sql = g_strdup_printf ("SELECT COUNT(*) FROM package_events WHERE transaction_id = '%s'", tid_new);
+	g_assert_cmpint (pk_test_transaction_db_sql (sql), ==, 1);
+	g_free (sql);
+
+	/* the running transaction can still be written */
+	ret = pk_transaction_db_set_data (db, tid_pending,
+					  "installing\tpendingpkg;1.0;i386;fedora\tTest package");
+	g_assert (ret);
+	ret = pk_transaction_db_set_finished (db, tid_pending, TRUE, 1000);
+	g_assert (ret);
+	history = pk_transaction_db_get_package_history (db, "pendingpkg", 0);
+	g_assert (history != NULL);
+	g_variant_unref (g_variant_ref_sink (history));
+	g_free (tid_old);
+	g_free (tid_new);
+	g_free (tid_pending);
+
 	g_free (proxy_http);
 	g_free (proxy_ftp);
 	g_object_unref (db);
@@ -1496,6 +1848,9 @@ pk_test_transaction_list_parallel_func (void)
 				       NULL);
 	g_strfreev (array);
 
+	/* make sure transaction5 (reader) did not queue behind the waiting writer */
+	g_assert_cmpint (pk_transaction_get_state (transaction1), ==, PK_TRANSACTION_STATE_RUNNING);
+
 	/* get all transactions in queue */
 	size = pk_transaction_list_get_size (tlist);
 	g_assert_cmpint (size, ==, 5);
@@ -1569,6 +1924,225 @@ pk_test_transaction_list_parallel_func (void)
 	g_key_file_unref (conf);
 }
 
+static void
+pk_test_transaction_list_shared_func (void)
+{
+	PkTransactionList *tlist;
+	PkTransaction *transaction1;
+	PkTransaction *transaction2;
+	PkTransaction *transaction3;
+	PkResults *results;
+	gboolean ret;
+	gchar **array;
+	gchar *tid_item1;
+	gchar *tid_item2;
+	gchar *tid_item3;
+	PkBackend *backend;
+	GKeyFile *conf;
+	GError *error = NULL;
+
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* try to load a valid backend */
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "MaximumItemsToResolve", "1000");
+	g_key_file_set_string (conf, "Daemon", "MaximumPackagesToProcess", "1000");
+	g_key_file_set_string (conf, "Daemon", "SimultaneousTransactionsForUid", "1000");
+	g_key_file_set_string (conf, "Daemon", "TransactionCreateCommitTimeout", "1000");
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "dummy");
+	backend = pk_backend_new (conf);
+	ret = pk_backend_load (backend, NULL);
+	g_assert (ret);
+
+	/* get a transaction list object */
+	tlist = pk_transaction_list_new (conf);
+	g_assert (tlist != NULL);
+	pk_transaction_list_set_backend (tlist, backend);
+
+	/* create three instances in list */
+	tid_item1 = pk_test_transaction_list_create_transaction (tlist);
+	tid_item2 = pk_test_transaction_list_create_transaction (tlist);
+	tid_item3 = pk_test_transaction_list_create_transaction (tlist);
+	transaction1 = pk_transaction_list_get_transaction (tlist, tid_item1);
+	g_signal_connect (transaction1, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+	transaction2 = pk_transaction_list_get_transaction (tlist, tid_item2);
+	g_signal_connect (transaction2, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+	transaction3 = pk_transaction_list_get_transaction (tlist, tid_item3);
+	g_signal_connect (transaction3, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+
+	/* this starts one action, like on a backend that can't run in parallel */
+	array = g_strsplit ("dave", " ", -1);
+	pk_transaction_make_exclusive (transaction1);
+	pk_transaction_search_details (transaction1,
+				       g_variant_new ("(t^as)",
+						      pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						      array),
+				       NULL);
+	g_strfreev (array);
+
+	/* queue the same query twice */
+	array = g_strsplit ("power", " ", -1);
+	pk_transaction_make_exclusive (transaction2);
+	pk_transaction_search_names (transaction2,
+				     g_variant_new ("(t^as)",
+						    pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						    array),
+				     NULL);
+	pk_transaction_make_exclusive (transaction3);
+	pk_transaction_search_names (transaction3,
+				     g_variant_new ("(t^as)",
+						    pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						    array),
+				     NULL);
+	g_strfreev (array);
+	g_assert_cmpint (pk_transaction_get_state (transaction2), ==, PK_TRANSACTION_STATE_READY);
+	g_assert_cmpint (pk_transaction_get_state (transaction3), ==, PK_TRANSACTION_STATE_READY);
+
+	/* wait for the first action */
+	_g_test_loop_run_with_timeout (10000);
+	g_assert_cmpint (pk_transaction_get_state (transaction1), ==, PK_TRANSACTION_STATE_FINISHED);
+
+	/* both identical queries are running, but only one reaches the backend */
+	while (pk_transaction_get_backend_job (transaction2) == NULL)
+		g_main_context_iteration (NULL, TRUE);
+	g_assert_cmpint (pk_transaction_get_state (transaction2), ==, PK_TRANSACTION_STATE_RUNNING);
+	g_assert_cmpint (pk_transaction_get_state (transaction3), ==, PK_TRANSACTION_STATE_RUNNING);
+	g_assert (pk_transaction_get_backend_job (transaction3) == NULL);
+
+	/* wait for the query that is really running */
+	_g_test_loop_run_with_timeout (10000);
+	g_assert_cmpint (pk_transaction_get_state (transaction2), ==, PK_TRANSACTION_STATE_FINISHED);
+
+	/* wait for the results to be replayed onto the other one */
+	_g_test_loop_run_with_timeout (10000);
+	g_assert_cmpint (pk_transaction_get_state (transaction3), ==, PK_TRANSACTION_STATE_FINISHED);
+	results = pk_transaction_get_results (transaction2);
+	g_assert_cmpint (pk_results_get_exit_code (results), ==, PK_EXIT_ENUM_SUCCESS);
+	results = pk_transaction_get_results (transaction3);
+	g_assert_cmpint (pk_results_get_exit_code (results), ==, PK_EXIT_ENUM_SUCCESS);
+
+	/* free tids */
+	g_free (tid_item1);
+	g_free (tid_item2);
+	g_free (tid_item3);
+
+	g_object_unref (tlist);
+	g_object_unref (backend);
+	g_object_unref (db);
+	g_key_file_unref (conf);
+}
+
+static void
+pk_test_transaction_list_cache_func (void)
+{
+	PkTransactionList *tlist;
+	PkTransaction *transaction;
+	PkResults *results;
+	gboolean ret;
+	gchar **array;
+	gchar *tid;
+	PkBackend *backend;
+	GKeyFile *conf;
+	GError *error = NULL;
+
+	db = pk_transaction_db_new ();
+	ret = pk_transaction_db_load (db, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* try to load a valid backend, caching results by default */
+	conf = g_key_file_new ();
+	g_key_file_set_string (conf, "Daemon", "MaximumItemsToResolve", "1000");
+	g_key_file_set_string (conf, "Daemon", "MaximumPackagesToProcess", "1000");
+	g_key_file_set_string (conf, "Daemon", "SimultaneousTransactionsForUid", "1000");
+	g_key_file_set_string (conf, "Daemon", "TransactionCreateCommitTimeout", "1000");
+	g_key_file_set_string (conf, "Daemon", "DefaultBackend", "dummy");
+	backend = pk_backend_new (conf);
+	ret = pk_backend_load (backend, NULL);
+	g_assert (ret);
+
+	/* get a transaction list object */
+	tlist = pk_transaction_list_new (conf);
+	g_assert (tlist != NULL);
+	pk_transaction_list_set_backend (tlist, backend);
+
+	/* the first query goes to the backend */
+	tid = pk_test_transaction_list_create_transaction (tlist);
+	transaction = pk_transaction_list_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+	pk_transaction_get_updates (transaction,
+				    g_variant_new ("(t)",
+						   pk_bitfield_value (PK_FILTER_ENUM_NONE)),
+				    NULL);
+	while (pk_transaction_get_backend_job (transaction) == NULL)
+		g_main_context_iteration (NULL, TRUE);
+	_g_test_loop_run_with_timeout (10000);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	g_free (tid);
+
+	/* the same query again is answered from the cache */
+	tid = pk_test_transaction_list_create_transaction (tlist);
+	transaction = pk_transaction_list_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+	pk_transaction_get_updates (transaction,
+				    g_variant_new ("(t)",
+						   pk_bitfield_value (PK_FILTER_ENUM_NONE)),
+				    NULL);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_RUNNING);
+	while (pk_transaction_get_state (transaction) != PK_TRANSACTION_STATE_FINISHED) {
+		g_assert (pk_transaction_get_backend_job (transaction) == NULL);
+		g_main_context_iteration (NULL, TRUE);
+	}
+	results = pk_transaction_get_results (transaction);
+	g_assert_cmpint (pk_results_get_exit_code (results), ==, PK_EXIT_ENUM_SUCCESS);
+	g_free (tid);
+
+	/* changing the system drops the cached results */
+	tid = pk_test_transaction_list_create_transaction (tlist);
+	transaction = pk_transaction_list_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+	array = g_strsplit ("libawesome;42;i386;debian", " ", -1);
+	pk_transaction_skip_auth_checks (transaction, TRUE);
+	pk_transaction_install_packages (transaction,
+				       g_variant_new ("(t^as)",
+						      pk_bitfield_value (PK_FILTER_ENUM_NONE),
+						      array),
+				       NULL);
+	g_strfreev (array);
+	_g_test_loop_run_with_timeout (20000);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	g_free (tid);
+
+	/* so the same query goes to the backend again */
+	tid = pk_test_transaction_list_create_transaction (tlist);
+	transaction = pk_transaction_list_get_transaction (tlist, tid);
+	g_signal_connect (transaction, "finished",
+			  G_CALLBACK (pk_test_transaction_list_finished_cb), NULL);
+	pk_transaction_get_updates (transaction,
+				    g_variant_new ("(t)",
+						   pk_bitfield_value (PK_FILTER_ENUM_NONE)),
+				    NULL);
+	while (pk_transaction_get_backend_job (transaction) == NULL)
+		g_main_context_iteration (NULL, TRUE);
+	_g_test_loop_run_with_timeout (10000);
+	g_assert_cmpint (pk_transaction_get_state (transaction), ==, PK_TRANSACTION_STATE_FINISHED);
+	g_free (tid);
+
+	g_object_unref (tlist);
+	g_object_unref (backend);
+	g_object_unref (db);
+	g_key_file_unref (conf);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1587,16 +2161,22 @@ main (int argc, char **argv)
 
 	/* components */
 	g_test_add_func ("/packagekit/time", pk_test_time_func);
+	g_test_add_func ("/packagekit/statistics", pk_test_statistics_func);
 	g_test_add_func ("/packagekit/dbus", pk_test_dbus_func);
 	g_test_add_func ("/packagekit/spawn", pk_test_spawn_func);
+	g_test_add_func ("/packagekit/spawn-framed", pk_test_spawn_framed_func);
+	g_test_add_func ("/packagekit/spawn-throughput", pk_test_spawn_throughput_func);
 	g_test_add_func ("/packagekit/transaction", pk_test_transaction_func);
 	g_test_add_func ("/packagekit/transaction-list", pk_test_transaction_list_func);
 	g_test_add_func ("/packagekit/transaction-list-parallel", pk_test_transaction_list_parallel_func);
+	g_test_add_func ("/packagekit/transaction-list-shared", pk_test_transaction_list_shared_func);
+	g_test_add_func ("/packagekit/transaction-list-cache", pk_test_transaction_list_cache_func);
 	g_test_add_func ("/packagekit/transaction-db", pk_test_transaction_db_func);
 
 	/* backend stuff */
 	g_test_add_func ("/packagekit/backend", pk_test_backend_func);
 	g_test_add_func ("/packagekit/backend_spawn", pk_test_backend_spawn_func);
+	g_test_add_func ("/packagekit/backend_spawn-parse", pk_test_backend_spawn_parse_func);
 
 	return g_test_run ();
 }
@@ -50,6 +50,9 @@ static void     pk_spawn_finalize	(GObject       *object);
 #define PK_SPAWN_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_SPAWN, PkSpawnPrivate))
 #define PK_SPAWN_POLL_DELAY	50 /* ms */
 #define PK_SPAWN_SIGKILL_DELAY	2500 /* ms */
+#define PK_SPAWN_READ_SIZE	65536 /* bytes */
+#define PK_SPAWN_FRAME_MAGIC	"framed"
+#define PK_SPAWN_FRAME_MAX_SIZE	(16 * 1024 * 1024) /* bytes */
 
 struct PkSpawnPrivate
 {
@@ -66,6 +69,9 @@ struct PkSpawnPrivate
 	gboolean		 allow_sigkill;
 	PkSpawnExitType		 exit;
 	GString			*stdout_buf;
+	gsize			 stdout_offset;		/* start of the first unsent line */
+	gsize			 stdout_scanned;	/* no newline before this */
+	gboolean		 stdout_framed;
 	GString			*stderr_buf;
 	gchar			*last_argv0;
 	gchar			**last_envp;
@@ -75,6 +81,7 @@ struct PkSpawnPrivate
 enum {
 	SIGNAL_EXIT,
 	SIGNAL_STDOUT,
+	SIGNAL_FRAME,
 	SIGNAL_STDERR,
 	SIGNAL_LAST
 };
@@ -96,53 +103,119 @@ G_DEFINE_TYPE (PkSpawn, pk_spawn, G_TYPE_OBJECT)
 static gboolean
 pk_spawn_read_fd_into_buffer (gint fd, GString *string)
 {
-	gint bytes_read;
-	gchar buffer[BUFSIZ];
+	gsize len;
+	gssize bytes_read;
 
-	/* ITS4: ignore, we manually NULL terminate and GString cannot overflow */
-	while ((bytes_read = read (fd, buffer, BUFSIZ-1)) > 0) {
-		buffer[bytes_read] = '\0';
-		g_string_append (string, buffer);
-	}
+	/* read straight into the end of the string, which GString keeps
+	 * NULL terminated and grows geometrically */
+	do {
+		len = string->len;
+		g_string_set_size (string, len + PK_SPAWN_READ_SIZE);
+		bytes_read = read (fd, string->str + len, PK_SPAWN_READ_SIZE);
+		g_string_set_size (string, len + MAX (bytes_read, 0));
+	} while (bytes_read > 0);
 
 	return TRUE;
 }
 
 /**
- * pk_spawn_emit_whole_lines:
+ * pk_spawn_emit_whole_frames:
+ *
+ * Emits each complete frame in place. A frame is a little endian 32 bit
+ * length followed by that many bytes of NUL terminated fields.
  **/
-static gboolean
-pk_spawn_emit_whole_lines (PkSpawn *spawn, GString *string)
+static void
+pk_spawn_emit_whole_frames (PkSpawn *spawn, GString *string)
 {
-	guint i;
-	guint size;
-	gchar **lines;
-	guint bytes_processed;
+	gchar *frame;
+	guint32 len;
+	PkSpawnPrivate *priv = spawn->priv;
 
-	/* if nothing then don't emit */
-	if (pk_strzero (string->str))
-		return FALSE;
+	while (string->len - priv->stdout_offset >= sizeof (guint32)) {
+		frame = string->str + priv->stdout_offset;
+		memcpy (&len, frame, sizeof (guint32));
+		len = GUINT32_FROM_LE (len);
+
+		/* the helper is not speaking our protocol, so give up on
+		 * everything it has sent so far rather than guessing */
+		if (len == 0 || len > PK_SPAWN_FRAME_MAX_SIZE) {
+			g_warning ("invalid frame size %u, dropping output", len);
+			priv->stdout_offset = string->len;
+			break;
+		}
+		if (string->len - priv->stdout_offset - sizeof (guint32) < len)
+			break;
+		frame += sizeof (guint32);
+		if (frame[len - 1] != '\0') {
+			g_warning ("frame of size %u was not terminated", len);
+		} else {
+			g_signal_emit (spawn, signals [SIGNAL_FRAME], 0, frame, len);
+		}
+		priv->stdout_offset += sizeof (guint32) + len;
+	}
+	priv->stdout_scanned = priv->stdout_offset;
+}
 
-	/* split into lines - the last line may be incomplete */
-	lines = g_strsplit (string->str, "\n", 0);
-	if (lines == NULL)
-		return FALSE;
+/**
+ * pk_spawn_emit_stdout:
+ *
+ * Emits each complete line or frame in place, remembering where the first
+ * partial one starts and how far it has already been scanned so that no
+ * byte is searched twice.
+ *
+ * Helpers start out sending text, and switch to frames by sending a
+ * single line containing PK_SPAWN_FRAME_MAGIC.
+ **/
+static gboolean
+pk_spawn_emit_stdout (PkSpawn *spawn, GString *string)
+{
+	gchar *end;
+	gchar *eol;
+	gchar *line;
+	gchar *scan;
+	PkSpawnPrivate *priv = spawn->priv;
 
-	/* find size */
-	size = g_strv_length (lines);
+	/* if nothing new then don't emit */
+	if (priv->stdout_scanned >= string->len)
+		return FALSE;
 
-	bytes_processed = 0;
-	/* we only emit n-1 strings */
-	for (i=0; i<(size-1); i++) {
-		g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, lines[i]);
-		/* ITS4: ignore, g_strsplit always NULL terminates */
-		bytes_processed += strlen (lines[i]) + 1;
+	if (!priv->stdout_framed) {
+		line = string->str + priv->stdout_offset;
+		scan = string->str + priv->stdout_scanned;
+		end = string->str + string->len;
+		while ((eol = memchr (scan, '\n', end - scan)) != NULL) {
+			*eol = '\0';
+			if (strcmp (line, PK_SPAWN_FRAME_MAGIC) == 0) {
+				g_debug ("helper switched to framed output");
+				priv->stdout_framed = TRUE;
+				line = eol + 1;
+				break;
+			}
+			g_signal_emit (spawn, signals [SIGNAL_STDOUT], 0, line);
+			line = eol + 1;
+			scan = line;
+		}
+		priv->stdout_offset = line - string->str;
+		priv->stdout_scanned = string->len;
 	}
+	if (priv->stdout_framed)
+		pk_spawn_emit_whole_frames (spawn, string);
 
-	/* remove the text we've processed */
-	g_string_erase (string, 0, bytes_processed);
+	/* everything was sent */
+	if (priv->stdout_offset == string->len) {
+		g_string_set_size (string, 0);
+		priv->stdout_offset = 0;
+		priv->stdout_scanned = 0;
+		return TRUE;
+	}
 
-	g_strfreev (lines);
+	/* only move the partial data down once it is shorter than the
+	 * space in front of it, which keeps the copying linear */
+	if (priv->stdout_offset >= string->len - priv->stdout_offset) {
+		g_string_erase (string, 0, priv->stdout_offset);
+		priv->stdout_scanned -= priv->stdout_offset;
+		priv->stdout_offset = 0;
+	}
 	return TRUE;
 }
 
@@ -196,7 +269,7 @@ pk_spawn_check_child (PkSpawn *spawn)
 	}
 
 	/* all usual output goes on standard out, only bad libraries bitch to stderr */
-	pk_spawn_emit_whole_lines (spawn, spawn->priv->stdout_buf);
+	pk_spawn_emit_stdout (spawn, spawn->priv->stdout_buf);
 
 	/* Only print one in twenty times to avoid filling the screen */
 	if (limit_printing++ % 20 == 0)
@@ -597,6 +670,12 @@ pk_spawn_argv (PkSpawn *spawn, gchar **argv, gchar **envp,
 
 	/* create spawned object for tracking */
 	spawn->priv->finished = FALSE;
+
+	/* every new helper starts off speaking text */
+	spawn->priv->stdout_framed = FALSE;
+	g_string_set_size (spawn->priv->stdout_buf, 0);
+	spawn->priv->stdout_offset = 0;
+	spawn->priv->stdout_scanned = 0;
 	g_debug ("creating new instance of %s", argv[0]);
 	ret = g_spawn_async_with_pipes (NULL, argv, envp,
 				 G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
@@ -755,6 +834,11 @@ pk_spawn_class_init (PkSpawnClass *klass)
 			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
 			      0, NULL, NULL, g_cclosure_marshal_VOID__STRING,
 			      G_TYPE_NONE, 1, G_TYPE_STRING);
+	signals [SIGNAL_FRAME] =
+		g_signal_new ("frame",
+			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
+			      0, NULL, NULL, g_cclosure_marshal_generic,
+			      G_TYPE_NONE, 2, G_TYPE_POINTER, G_TYPE_UINT);
 	signals [SIGNAL_STDERR] =
 		g_signal_new ("stderr",
 			      G_TYPE_FROM_CLASS (object_class), G_SIGNAL_RUN_LAST,
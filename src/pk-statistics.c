@@ -0,0 +1,362 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "pk-statistics.h"
+
+#define PK_STATISTICS_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_STATISTICS, PkStatisticsPrivate))
+
+/**
+ * PK_STATISTICS_SUB_BUCKET_BITS:
+ *
+ * Each power of two is split into this many (as a power of two) linear
+ * sub-buckets, so any recorded value is within 12.5% of the true value
+ * whatever its magnitude, in the same way as a HDR histogram.
+ */
+#define PK_STATISTICS_SUB_BUCKET_BITS	3
+#define PK_STATISTICS_SUB_BUCKETS	(1 << PK_STATISTICS_SUB_BUCKET_BITS)
+
+/* values below this are stored exactly */
+#define PK_STATISTICS_LINEAR_MAX	(PK_STATISTICS_SUB_BUCKETS * 2)
+
+/* enough for 2^48us, which is about nine years */
+#define PK_STATISTICS_EXPONENT_MAX	48
+#define PK_STATISTICS_BUCKETS		(PK_STATISTICS_LINEAR_MAX + \
+					 (PK_STATISTICS_EXPONENT_MAX - PK_STATISTICS_SUB_BUCKET_BITS - 1) * \
+					 PK_STATISTICS_SUB_BUCKETS)
+
+typedef struct {
+	guint64			 count;
+	guint64			 min;
+	guint64			 max;
+	guint64			 total;
+	guint64			 buckets[PK_STATISTICS_BUCKETS];
+} PkStatisticsHistogram;
+
+struct PkStatisticsPrivate
+{
+	GHashTable		*histograms;
+};
+
+static gpointer pk_statistics_object = NULL;
+
+G_DEFINE_TYPE (PkStatistics, pk_statistics, G_TYPE_OBJECT)
+
+/**
+ * pk_statistics_bucket_for_value:
+ **/
+static guint
+pk_statistics_bucket_for_value (guint64 value)
+{
+	guint exponent;
+	guint sub;
+
+	if (value < PK_STATISTICS_LINEAR_MAX)
+		return value;
+
+	/* find the highest set bit */
+	exponent = g_bit_nth_msf (value >> 32, -1);
+	if (exponent != (guint) -1)
+		exponent += 32;
+	else
+		exponent = g_bit_nth_msf (value & G_MAXUINT32, -1);
+	if (exponent >= PK_STATISTICS_EXPONENT_MAX)
+		return PK_STATISTICS_BUCKETS - 1;
+
+	/* the next bits below it choose the linear sub-bucket */
+	sub = (value >> (exponent - PK_STATISTICS_SUB_BUCKET_BITS)) & (PK_STATISTICS_SUB_BUCKETS - 1);
+	return PK_STATISTICS_LINEAR_MAX +
+	       (exponent - PK_STATISTICS_SUB_BUCKET_BITS - 1) * PK_STATISTICS_SUB_BUCKETS +
+	       sub;
+}
+
+/**
+ * pk_statistics_bucket_lowest_value:
+ **/
+static guint64
+pk_statistics_bucket_lowest_value (guint idx)
+{
+	guint exponent;
+	guint sub;
+
+	if (idx < PK_STATISTICS_LINEAR_MAX)
+		return idx;
+	idx -= PK_STATISTICS_LINEAR_MAX;
+	exponent = idx / PK_STATISTICS_SUB_BUCKETS + PK_STATISTICS_SUB_BUCKET_BITS + 1;
+	sub = idx % PK_STATISTICS_SUB_BUCKETS;
+	return ((guint64) PK_STATISTICS_SUB_BUCKETS + sub) << (exponent - PK_STATISTICS_SUB_BUCKET_BITS);
+}
+
+/**
+ * pk_statistics_bucket_highest_value:
+ **/
+static guint64
+pk_statistics_bucket_highest_value (guint idx)
+{
+	if (idx + 1 >= PK_STATISTICS_BUCKETS)
+		return G_MAXUINT64;
+	return pk_statistics_bucket_lowest_value (idx + 1) - 1;
+}
+
+/**
+ * pk_statistics_histogram_percentile:
+ **/
+static guint64
+pk_statistics_histogram_percentile (PkStatisticsHistogram *histogram, guint percentile)
+{
+	guint64 seen = 0;
+	guint64 wanted;
+	guint i;
+
+	if (histogram->count == 0)
+		return 0;
+
+	/* the rank of the value we want, rounding up */
+	wanted = (histogram->count * MIN (percentile, 100) + 99) / 100;
+	if (wanted == 0)
+		wanted = 1;
+	for (i = 0; i < PK_STATISTICS_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen >= wanted)
+			return CLAMP (pk_statistics_bucket_highest_value (i),
+				      histogram->min, histogram->max);
+	}
+	return histogram->max;
+}
+
+/**
+ * pk_statistics_add:
+ * @metric: the metric name, e.g. "plugin-phase:pk_plugin_transaction_run"
+ * @value: the value, normally a duration in microseconds
+ *
+ * Records a value into the histogram for @metric. This must only be called
+ * from the main thread.
+ **/
+void
+pk_statistics_add (PkStatistics *statistics, const gchar *metric, guint64 value)
+{
+	PkStatisticsHistogram *histogram;
+
+	g_return_if_fail (PK_IS_STATISTICS (statistics));
+	g_return_if_fail (metric != NULL);
+
+	histogram = g_hash_table_lookup (statistics->priv->histograms, metric);
+	if (histogram == NULL) {
+		histogram = g_new0 (PkStatisticsHistogram, 1);
+		histogram->min = G_MAXUINT64;
+		g_hash_table_insert (statistics->priv->histograms,
+				     g_strdup (metric),
+				     histogram);
+	}
+	histogram->count++;
+	histogram->total += value;
+	if (value < histogram->min)
+		histogram->min = value;
+	if (value > histogram->max)
+		histogram->max = value;
+	histogram->buckets[pk_statistics_bucket_for_value (value)]++;
+}
+
+/**
+ * pk_statistics_add_role:
+ *
+ * Records a value into the histogram for @metric for one role,
+ * e.g. "runtime:get-updates".
+ **/
+void
+pk_statistics_add_role (PkStatistics *statistics,
+			const gchar *metric,
+			PkRoleEnum role,
+			guint64 value)
+{
+	gchar *key;
+
+	g_return_if_fail (PK_IS_STATISTICS (statistics));
+
+	key = g_strdup_printf ("%s:%s", metric, pk_role_enum_to_string (role));
+	pk_statistics_add (statistics, key, value);
+	g_free (key);
+}
+
+/**
+ * pk_statistics_get_count:
+ *
+ * Return value: the number of values recorded for @metric
+ **/
+guint64
+pk_statistics_get_count (PkStatistics *statistics, const gchar *metric)
+{
+	PkStatisticsHistogram *histogram;
+
+	g_return_val_if_fail (PK_IS_STATISTICS (statistics), 0);
+
+	histogram = g_hash_table_lookup (statistics->priv->histograms, metric);
+	if (histogram == NULL)
+		return 0;
+	return histogram->count;
+}
+
+/**
+ * pk_statistics_get_percentile:
+ *
+ * Return value: the value that @percentile percent of the recorded values
+ * are less than or equal to, to within the histogram precision.
+ **/
+guint64
+pk_statistics_get_percentile (PkStatistics *statistics,
+			      const gchar *metric,
+			      guint percentile)
+{
+	PkStatisticsHistogram *histogram;
+
+	g_return_val_if_fail (PK_IS_STATISTICS (statistics), 0);
+
+	histogram = g_hash_table_lookup (statistics->priv->histograms, metric);
+	if (histogram == NULL)
+		return 0;
+	return pk_statistics_histogram_percentile (histogram, percentile);
+}
+
+/**
+ * pk_statistics_histogram_to_variant:
+ **/
+static GVariant *
+pk_statistics_histogram_to_variant (PkStatisticsHistogram *histogram)
+{
+	guint i;
+	GVariantBuilder buckets;
+	GVariantBuilder builder;
+
+	/* only send the buckets that have values */
+	g_variant_builder_init (&buckets, G_VARIANT_TYPE ("a(tt)"));
+	for (i = 0; i < PK_STATISTICS_BUCKETS; i++) {
+		if (histogram->buckets[i] == 0)
+			continue;
+		g_variant_builder_add (&buckets, "(tt)",
+				       pk_statistics_bucket_lowest_value (i),
+				       histogram->buckets[i]);
+	}
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", "count",
+			       g_variant_new_uint64 (histogram->count));
+	g_variant_builder_add (&builder, "{sv}", "min",
+			       g_variant_new_uint64 (histogram->min));
+	g_variant_builder_add (&builder, "{sv}", "max",
+			       g_variant_new_uint64 (histogram->max));
+	g_variant_builder_add (&builder, "{sv}", "mean",
+			       g_variant_new_uint64 (histogram->total / histogram->count));
+	g_variant_builder_add (&builder, "{sv}", "p50",
+			       g_variant_new_uint64 (pk_statistics_histogram_percentile (histogram, 50)));
+	g_variant_builder_add (&builder, "{sv}", "p90",
+			       g_variant_new_uint64 (pk_statistics_histogram_percentile (histogram, 90)));
+	g_variant_builder_add (&builder, "{sv}", "p99",
+			       g_variant_new_uint64 (pk_statistics_histogram_percentile (histogram, 99)));
+	g_variant_builder_add (&builder, "{sv}", "buckets",
+			       g_variant_builder_end (&buckets));
+	return g_variant_builder_end (&builder);
+}
+
+/**
+ * pk_statistics_get_variant:
+ *
+ * Return value: (transfer floating): all the histograms as a{sa{sv}}
+ **/
+GVariant *
+pk_statistics_get_variant (PkStatistics *statistics)
+{
+	const gchar *metric;
+	GHashTableIter iter;
+	GVariantBuilder builder;
+	PkStatisticsHistogram *histogram;
+
+	g_return_val_if_fail (PK_IS_STATISTICS (statistics), NULL);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+	g_hash_table_iter_init (&iter, statistics->priv->histograms);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &metric, (gpointer *) &histogram)) {
+		g_variant_builder_add (&builder, "{s@a{sv}}",
+				       metric,
+				       pk_statistics_histogram_to_variant (histogram));
+	}
+	return g_variant_builder_end (&builder);
+}
+
+/**
+ * pk_statistics_finalize:
+ **/
+static void
+pk_statistics_finalize (GObject *object)
+{
+	PkStatistics *statistics;
+
+	g_return_if_fail (PK_IS_STATISTICS (object));
+	statistics = PK_STATISTICS (object);
+
+	g_hash_table_unref (statistics->priv->histograms);
+
+	G_OBJECT_CLASS (pk_statistics_parent_class)->finalize (object);
+}
+
+/**
+ * pk_statistics_class_init:
+ **/
+static void
+pk_statistics_class_init (PkStatisticsClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = pk_statistics_finalize;
+	g_type_class_add_private (klass, sizeof (PkStatisticsPrivate));
+}
+
+/**
+ * pk_statistics_init:
+ **/
+static void
+pk_statistics_init (PkStatistics *statistics)
+{
+	statistics->priv = PK_STATISTICS_GET_PRIVATE (statistics);
+	statistics->priv->histograms = g_hash_table_new_full (g_str_hash,
+							      g_str_equal,
+							      g_free,
+							      g_free);
+}
+
+/**
+ * pk_statistics_new:
+ * Return value: A new statistics class instance.
+ **/
+PkStatistics *
+pk_statistics_new (void)
+{
+	if (pk_statistics_object != NULL) {
+		g_object_ref (pk_statistics_object);
+	} else {
+		pk_statistics_object = g_object_new (PK_TYPE_STATISTICS, NULL);
+		g_object_add_weak_pointer (pk_statistics_object, &pk_statistics_object);
+	}
+	return PK_STATISTICS (pk_statistics_object);
+}
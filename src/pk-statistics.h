@@ -0,0 +1,69 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 Richard Hughes <richard@hughsie.com>
+ *
+ * Licensed under the GNU General Public License Version 2
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __PK_STATISTICS_H
+#define __PK_STATISTICS_H
+
+#include <glib-object.h>
+#include <packagekit-glib2/pk-enum.h>
+
+G_BEGIN_DECLS
+
+#define PK_TYPE_STATISTICS		(pk_statistics_get_type ())
+#define PK_STATISTICS(o)		(G_TYPE_CHECK_INSTANCE_CAST ((o), PK_TYPE_STATISTICS, PkStatistics))
+#define PK_STATISTICS_CLASS(k)		(G_TYPE_CHECK_CLASS_CAST((k), PK_TYPE_STATISTICS, PkStatisticsClass))
+#define PK_IS_STATISTICS(o)		(G_TYPE_CHECK_INSTANCE_TYPE ((o), PK_TYPE_STATISTICS))
+#define PK_IS_STATISTICS_CLASS(k)	(G_TYPE_CHECK_CLASS_TYPE ((k), PK_TYPE_STATISTICS))
+#define PK_STATISTICS_GET_CLASS(o)	(G_TYPE_INSTANCE_GET_CLASS ((o), PK_TYPE_STATISTICS, PkStatisticsClass))
+
+typedef struct PkStatisticsPrivate PkStatisticsPrivate;
+
+typedef struct
+{
+	GObject			 parent;
+	PkStatisticsPrivate	*priv;
+} PkStatistics;
+
+typedef struct
+{
+	GObjectClass		 parent_class;
+} PkStatisticsClass;
+
+GType		 pk_statistics_get_type		(void);
+PkStatistics	*pk_statistics_new		(void);
+
+void		 pk_statistics_add		(PkStatistics	*statistics,
+						 const gchar	*metric,
+						 guint64	 value);
+void		 pk_statistics_add_role		(PkStatistics	*statistics,
+						 const gchar	*metric,
+						 PkRoleEnum	 role,
+						 guint64	 value);
+guint64		 pk_statistics_get_count	(PkStatistics	*statistics,
+						 const gchar	*metric);
+guint64		 pk_statistics_get_percentile	(PkStatistics	*statistics,
+						 const gchar	*metric,
+						 guint		 percentile);
+GVariant	*pk_statistics_get_variant	(PkStatistics	*statistics);
+
+G_END_DECLS
+
+#endif /* __PK_STATISTICS_H */
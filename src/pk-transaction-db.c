@@ -45,95 +45,131 @@
 #include "pk-transaction-db.h"
 
 static void     pk_transaction_db_finalize	(GObject        *object);
+static gboolean	pk_transaction_db_execute	(PkTransactionDb *tdb,
+						 const gchar	*statement,
+						 GError		**error);
 
 #define PK_TRANSACTION_DB_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_TRANSACTION_DB, PkTransactionDbPrivate))
 
+/* only rebuild the file if the retention policy removed this many rows */
+#define PK_TRANSACTION_DB_VACUUM_THRESHOLD	1000
+
 struct PkTransactionDbPrivate
 {
 	gboolean		 loaded;
 	sqlite3			*db;
 	guint			 job_count;
 	guint			 database_save_id;
+	GHashTable		*statements;
+	GHashTable		*pending;
 };
 
+/* a transaction that has not finished yet, and so only has its row written */
+typedef struct {
+	gchar		*tid;
+	gchar		*timespec;
+	PkRoleEnum	 role;
+	guint		 uid;
+	gchar		*cmdline;
+	gchar		*data;
+} PkTransactionDbItem;
+
 G_DEFINE_TYPE (PkTransactionDb, pk_transaction_db, G_TYPE_OBJECT)
 
-typedef struct {
-	gchar		*proxy_http;
-	gchar		*proxy_https;
-	gchar		*proxy_ftp;
-	gchar		*proxy_socks;
-	gchar		*no_proxy;
-	gchar		*pac;
-	gboolean	set;
-} PkTransactionDbProxyItem;
+static gpointer pk_transaction_db_object = NULL;
 
 /**
- * pk_transaction_sqlite_transaction_cb:
+ * pk_transaction_db_item_free:
  **/
-static gint
-pk_transaction_db_add_transaction_cb (void *data,
-				      gint argc,
-				      gchar **argv,
-				      gchar **col_name)
+static void
+pk_transaction_db_item_free (PkTransactionDbItem *item)
 {
-	PkTransactionPast *item;
-	GList **list = (GList **) data;
-	gint i;
-	gchar *col;
-	gchar *value;
-	guint temp;
-	gboolean ret;
+	g_free (item->tid);
+	g_free (item->timespec);
+	g_free (item->cmdline);
+	g_free (item->data);
+	g_free (item);
+}
 
-	item = pk_transaction_past_new ();
-	for (i = 0; i < argc; i++) {
-		col = col_name[i];
-		value = argv[i];
-		if (g_strcmp0 (col, "succeeded") == 0) {
-			ret = pk_strtouint (value, &temp);
-			if (!ret)
-				g_warning ("failed to parse succeeded: %s", value);
-			if (temp == 1)
-				g_object_set (item, "succeeded", TRUE, NULL);
-			else
-				g_object_set (item, "succeeded", FALSE, NULL);
-		} else if (g_strcmp0 (col, "role") == 0) {
-			if (value != NULL)
-				g_object_set (item, "role", pk_role_enum_from_string (value), NULL);
-		} else if (g_strcmp0 (col, "transaction_id") == 0) {
-			if (value != NULL)
-				g_object_set (item, "tid", value, NULL);
-		} else if (g_strcmp0 (col, "timespec") == 0) {
-			if (value != NULL)
-				g_object_set (item, "timespec", value, NULL);
-		} else if (g_strcmp0 (col, "cmdline") == 0) {
-			if (value != NULL)
-				g_object_set (item, "cmdline", value, NULL);
-		} else if (g_strcmp0 (col, "data") == 0) {
-			if (value != NULL)
-				g_object_set (item, "data", value, NULL);
-		} else if (g_strcmp0 (col, "uid") == 0) {
-			ret = pk_strtouint (value, &temp);
-			if (ret)
-				g_object_set (item, "uid", temp, NULL);
-		} else if (g_strcmp0 (col, "duration") == 0) {
-			ret = pk_strtouint (value, &temp);
-			if (!ret) {
-				g_warning ("failed to parse duration: %s", value);
-			} else if (temp > 60 * 60 * 12 * 1000) {
-				g_warning ("insane duration: %i", temp);
-			} else {
-				g_object_set (item, "duration", temp, NULL);
-			}
-		} else {
-			g_warning ("%s = %s", col, value);
-		}
+/**
+ * pk_transaction_db_prepare:
+ * @sql: a static string, which is also used as the cache key
+ *
+ * Gets a compiled statement, compiling it only the first time it is used.
+ * The statement is owned by the cache and must not be finalized.
+ *
+ * Return value: the statement, or %NULL if it could not be compiled
+ **/
+static sqlite3_stmt *
+pk_transaction_db_prepare (PkTransactionDb *tdb, const gchar *sql)
+{
+	gint rc;
+	sqlite3_stmt *statement;
+
+	/* already compiled */
+	statement = g_hash_table_lookup (tdb->priv->statements, sql);
+	if (statement != NULL) {
+		sqlite3_reset (statement);
+		sqlite3_clear_bindings (statement);
+		return statement;
 	}
 
-	/* add to start of the list */
-	*list = g_list_prepend (*list, item);
+	rc = sqlite3_prepare_v2 (tdb->priv->db, sql, -1, &statement, NULL);
+	if (rc != SQLITE_OK) {
+		g_warning ("failed to prepare statement: %s", sqlite3_errmsg (tdb->priv->db));
+		return NULL;
+	}
+	g_hash_table_insert (tdb->priv->statements, (gpointer) sql, statement);
+	return statement;
+}
 
-	return 0;
+/**
+ * pk_transaction_db_step:
+ *
+ * Executes a statement that does not return rows.
+ **/
+static gboolean
+pk_transaction_db_step (PkTransactionDb *tdb, sqlite3_stmt *statement)
+{
+	gint rc;
+
+	rc = sqlite3_step (statement);
+	sqlite3_reset (statement);
+	if (rc != SQLITE_DONE) {
+		g_warning ("failed to execute statement: %s", sqlite3_errmsg (tdb->priv->db));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * pk_transaction_db_past_from_statement:
+ **/
+static PkTransactionPast *
+pk_transaction_db_past_from_statement (sqlite3_stmt *statement)
+{
+	const gchar *value;
+	gint duration;
+	PkTransactionPast *item;
+
+	item = pk_transaction_past_new ();
+	g_object_set (item,
+		      "tid", sqlite3_column_text (statement, 0),
+		      "timespec", sqlite3_column_text (statement, 1),
+		      "succeeded", sqlite3_column_int (statement, 2) == 1,
+		      "data", sqlite3_column_text (statement, 5),
+		      "uid", (guint) sqlite3_column_int (statement, 6),
+		      "cmdline", sqlite3_column_text (statement, 7),
+		      NULL);
+	value = (const gchar *) sqlite3_column_text (statement, 4);
+	if (value != NULL)
+		g_object_set (item, "role", pk_role_enum_from_string (value), NULL);
+	duration = sqlite3_column_int (statement, 3);
+	if (duration < 0 || duration > 60 * 60 * 12 * 1000)
+		g_warning ("insane duration: %i", duration);
+	else
+		g_object_set (item, "duration", (guint) duration, NULL);
+	return item;
 }
 
 /**
@@ -158,28 +194,6 @@ pk_transaction_db_sql_statement (PkTransactionDb *tdb, const gchar *sql)
 	return TRUE;
 }
 
-/**
- * pk_time_action_sqlite_callback:
- **/
-static gint
-pk_time_action_sqlite_callback (void *data, gint argc, gchar **argv, gchar **col_name)
-{
-	gint i;
-	gchar *col;
-	gchar *value;
-	gchar **timespec = (gchar**) data;
-
-	for (i=0; i<argc; i++) {
-		col = col_name[i];
-		value = argv[i];
-		if (g_strcmp0 (col, "timespec") == 0)
-			*timespec = g_strdup (value);
-		else
-			g_warning ("%s = %s", col, value);
-	}
-	return 0;
-}
-
 /**
  * pk_transaction_db_iso8601_difference:
  * @isodate: The ISO8601 date to compare
@@ -216,26 +230,20 @@ pk_transaction_db_iso8601_difference (const gchar *isodate)
 guint
 pk_transaction_db_action_time_since (PkTransactionDb *tdb, PkRoleEnum role)
 {
-	gchar *error_msg = NULL;
-	gint rc;
-	const gchar *role_text;
-	gchar *statement;
 	gchar *timespec = NULL;
 	guint time_ms;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), 0);
 	g_return_val_if_fail (tdb->priv->db != NULL, 0);
 
-	role_text = pk_role_enum_to_string (role);
-
-	statement = g_strdup_printf ("SELECT timespec FROM last_action WHERE role = '%s'", role_text);
-	rc = sqlite3_exec (tdb->priv->db, statement, pk_time_action_sqlite_callback, &timespec, &error_msg);
-	g_free (statement);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
+	statement = pk_transaction_db_prepare (tdb, "SELECT timespec FROM last_action WHERE role = ?");
+	if (statement == NULL)
 		return G_MAXUINT;
-	}
+	sqlite3_bind_text (statement, 1, pk_role_enum_to_string (role), -1, SQLITE_STATIC);
+	if (sqlite3_step (statement) == SQLITE_ROW)
+		timespec = g_strdup ((const gchar *) sqlite3_column_text (statement, 0));
+	sqlite3_reset (statement);
 	if (timespec == NULL)
 		return G_MAXUINT;
 
@@ -252,41 +260,24 @@ pk_transaction_db_action_time_since (PkTransactionDb *tdb, PkRoleEnum role)
 gboolean
 pk_transaction_db_action_time_reset (PkTransactionDb *tdb, PkRoleEnum role)
 {
-	gchar *error_msg = NULL;
-	gint rc;
-	const gchar *role_text;
-	gboolean ret = TRUE;
-	gchar *statement;
+	gboolean ret = FALSE;
 	gchar *timespec;
-	guint since;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (tdb->priv->db != NULL, FALSE);
 
 	timespec = pk_iso8601_present ();
-	role_text = pk_role_enum_to_string (role);
-
-	/* get the previous entry */
-	since = pk_transaction_db_action_time_since (tdb, role);
-	if (since == G_MAXUINT) {
-		statement = g_strdup_printf ("INSERT INTO last_action (role, timespec) VALUES ('%s', '%s')", role_text, timespec);
-	} else {
-		statement = g_strdup_printf ("UPDATE last_action SET timespec = '%s' WHERE role = '%s'", timespec, role_text);
-	}
 
 	/* update or insert the entry */
-	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, &error_msg);
-
-	/* did we fail? */
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
-		ret = FALSE;
+	statement = pk_transaction_db_prepare (tdb, "INSERT OR REPLACE INTO last_action (role, timespec) VALUES (?, ?)");
+	if (statement == NULL)
 		goto out;
-	}
+	sqlite3_bind_text (statement, 1, pk_role_enum_to_string (role), -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, timespec, -1, SQLITE_STATIC);
+	ret = pk_transaction_db_step (tdb, statement);
 out:
 	g_free (timespec);
-	g_free (statement);
 	return ret;
 }
 
@@ -296,53 +287,62 @@ out:
 GList *
 pk_transaction_db_get_list (PkTransactionDb *tdb, guint limit)
 {
-	gchar *error_msg = NULL;
-	gchar *statement;
 	gint rc;
 	GList *list = NULL;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), NULL);
 
-	if (limit == 0) {
-		statement = g_strdup ("SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
-				      "FROM transactions ORDER BY timespec DESC");
-	} else {
-		statement = g_strdup_printf ("SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
-					     "FROM transactions ORDER BY timespec DESC LIMIT %i", limit);
-	}
-	rc = sqlite3_exec (tdb->priv->db,
-			   statement,
-			   pk_transaction_db_add_transaction_cb,
-			   &list,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
+	statement = pk_transaction_db_prepare (tdb,
+					       "SELECT transaction_id, timespec, succeeded, duration, role, data, uid, cmdline "
+					       "FROM transactions ORDER BY timespec DESC LIMIT ?");
+	if (statement == NULL)
 		goto out;
+
+	/* a negative limit means no limit */
+	sqlite3_bind_int64 (statement, 1, limit > 0 ? (sqlite3_int64) limit : -1);
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW) {
+		/* add to start of the list */
+		list = g_list_prepend (list, pk_transaction_db_past_from_statement (statement));
 	}
+	if (rc != SQLITE_DONE)
+		g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
+	sqlite3_reset (statement);
 out:
-	g_free (statement);
 	return list;
 }
 
 /**
  * pk_transaction_db_add:
+ *
+ * The row is written straight away, but the details are only written when
+ * the transaction finishes, so that they are all saved in a single commit.
  **/
 gboolean
 pk_transaction_db_add (PkTransactionDb *tdb, const gchar *tid)
 {
-	gchar *timespec;
-	gchar *statement;
+	PkTransactionDbItem *item;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	timespec = pk_iso8601_present ();
-	statement = g_strdup_printf ("INSERT INTO transactions (transaction_id, timespec) VALUES ('%s', '%s')", tid, timespec);
-	pk_transaction_db_sql_statement (tdb, statement);
-	g_free (statement);
-
-	g_free (timespec);
+	item = g_new0 (PkTransactionDbItem, 1);
+	item->tid = g_strdup (tid);
+	item->timespec = pk_iso8601_present ();
+	item->role = PK_ROLE_ENUM_UNKNOWN;
 
+	statement = pk_transaction_db_prepare (tdb, "INSERT INTO transactions (transaction_id, timespec) VALUES (?, ?)");
+	if (statement == NULL) {
+		pk_transaction_db_item_free (item);
+		return FALSE;
+	}
+	sqlite3_bind_text (statement, 1, item->tid, -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, item->timespec, -1, SQLITE_STATIC);
+	if (!pk_transaction_db_step (tdb, statement)) {
+		pk_transaction_db_item_free (item);
+		return FALSE;
+	}
+	g_hash_table_insert (tdb->priv->pending, item->tid, item);
 	return TRUE;
 }
 
@@ -352,16 +352,24 @@ pk_transaction_db_add (PkTransactionDb *tdb, const gchar *tid)
 gboolean
 pk_transaction_db_set_role (PkTransactionDb *tdb, const gchar *tid, PkRoleEnum role)
 {
-	gchar *statement;
-	const gchar *role_text;
+	PkTransactionDbItem *item;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	role_text = pk_role_enum_to_string (role);
-	statement = g_strdup_printf ("UPDATE transactions SET role = '%s' WHERE transaction_id = '%s'", role_text, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
-	g_free (statement);
-	return TRUE;
+	/* not yet written */
+	item = g_hash_table_lookup (tdb->priv->pending, tid);
+	if (item != NULL) {
+		item->role = role;
+		return TRUE;
+	}
+
+	statement = pk_transaction_db_prepare (tdb, "UPDATE transactions SET role = ? WHERE transaction_id = ?");
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_text (statement, 1, pk_role_enum_to_string (role), -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, tid, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb, statement);
 }
 
 /**
@@ -370,14 +378,24 @@ pk_transaction_db_set_role (PkTransactionDb *tdb, const gchar *tid, PkRoleEnum r
 gboolean
 pk_transaction_db_set_uid (PkTransactionDb *tdb, const gchar *tid, guint uid)
 {
-	gchar *statement;
+	PkTransactionDbItem *item;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	statement = g_strdup_printf ("UPDATE transactions SET uid = '%i' WHERE transaction_id = '%s'", uid, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
-	g_free (statement);
-	return TRUE;
+	/* not yet written */
+	item = g_hash_table_lookup (tdb->priv->pending, tid);
+	if (item != NULL) {
+		item->uid = uid;
+		return TRUE;
+	}
+
+	statement = pk_transaction_db_prepare (tdb, "UPDATE transactions SET uid = ? WHERE transaction_id = ?");
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_int (statement, 1, uid);
+	sqlite3_bind_text (statement, 2, tid, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb, statement);
 }
 
 /**
@@ -386,14 +404,127 @@ pk_transaction_db_set_uid (PkTransactionDb *tdb, const gchar *tid, guint uid)
 gboolean
 pk_transaction_db_set_cmdline (PkTransactionDb *tdb, const gchar *tid, const gchar *cmdline)
 {
-	gchar *statement;
+	PkTransactionDbItem *item;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	statement = g_strdup_printf ("UPDATE transactions SET cmdline = '%s' WHERE transaction_id = '%s'", cmdline, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
-	g_free (statement);
-	return TRUE;
+	/* not yet written */
+	item = g_hash_table_lookup (tdb->priv->pending, tid);
+	if (item != NULL) {
+		g_free (item->cmdline);
+		item->cmdline = g_strdup (cmdline);
+		return TRUE;
+	}
+
+	statement = pk_transaction_db_prepare (tdb, "UPDATE transactions SET cmdline = ? WHERE transaction_id = ?");
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_text (statement, 1, cmdline, -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, tid, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb, statement);
+}
+
+/**
+ * pk_transaction_db_end:
+ *
+ * Commits the open database transaction if @ret is set, and rolls it back
+ * if it is not or the commit failed.
+ *
+ * Return value: %TRUE if the changes were committed
+ **/
+static gboolean
+pk_transaction_db_end (PkTransactionDb *tdb, gboolean ret)
+{
+	GError *error = NULL;
+
+	if (ret) {
+		ret = pk_transaction_db_execute (tdb, "COMMIT", &error);
+		if (!ret) {
+			g_warning ("%s", error->message);
+			g_clear_error (&error);
+		}
+	}
+	if (!ret && !pk_transaction_db_execute (tdb, "ROLLBACK", &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+	}
+	return ret;
+}
+
+/**
+ * pk_transaction_db_add_package_events:
+ *
+ * Splits the package list of a transaction into one row per interesting
+ * package so that the history of a package name can use an index rather
+ * than parsing the data of every transaction ever run.
+ **/
+static gboolean
+pk_transaction_db_add_package_events (PkTransactionDb *tdb,
+				      const gchar *tid,
+				      const gchar *timespec,
+				      guint uid,
+				      const gchar *data)
+{
+	gboolean ret = FALSE;
+	gchar **lines = NULL;
+	GDateTime *datetime = NULL;
+	gint64 timestamp = 0;
+	guint i;
+	PkInfoEnum info;
+	PkPackage *package = NULL;
+	sqlite3_stmt *statement;
+
+	/* nothing to do */
+	if (data == NULL || data[0] == '\0')
+		return TRUE;
+
+	/* transactions without a timestamp are never returned */
+	if (timespec != NULL)
+		datetime = pk_iso8601_to_datetime (timespec);
+	if (datetime != NULL)
+		timestamp = g_date_time_to_unix (datetime);
+
+	statement = pk_transaction_db_prepare (tdb,
+					       "INSERT INTO package_events (transaction_id, "
+					       "name, version, arch, info, data, timestamp, uid) "
+					       "VALUES (?, ?, ?, ?, ?, ?, ?, ?)");
+	if (statement == NULL)
+		goto out;
+
+	package = pk_package_new ();
+	lines = g_strsplit (data, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		if (!pk_package_parse (package, lines[i], NULL))
+			continue;
+
+		/* only these states are shown in the history */
+		info = pk_package_get_info (package);
+		if (info != PK_INFO_ENUM_INSTALLING &&
+		    info != PK_INFO_ENUM_REMOVING &&
+		    info != PK_INFO_ENUM_UPDATING)
+			continue;
+
+		sqlite3_bind_text (statement, 1, tid, -1, SQLITE_STATIC);
+		sqlite3_bind_text (statement, 2, pk_package_get_name (package), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text (statement, 3, pk_package_get_version (package), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_text (statement, 4, pk_package_get_arch (package), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int (statement, 5, info);
+		sqlite3_bind_text (statement, 6, pk_package_get_data (package), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int64 (statement, 7, timestamp);
+		sqlite3_bind_int (statement, 8, uid);
+		if (!pk_transaction_db_step (tdb, statement))
+			goto out;
+		sqlite3_clear_bindings (statement);
+	}
+	ret = TRUE;
+out:
+	if (datetime != NULL)
+		g_date_time_unref (datetime);
+	if (package != NULL)
+		g_object_unref (package);
+	g_strfreev (lines);
+	return ret;
 }
 
 /**
@@ -402,16 +533,105 @@ pk_transaction_db_set_cmdline (PkTransactionDb *tdb, const gchar *tid, const gch
 gboolean
 pk_transaction_db_set_data (PkTransactionDb *tdb, const gchar *tid, const gchar *data)
 {
-	gchar *statement;
+	gboolean ret;
+	gchar *timespec = NULL;
+	guint uid = 0;
+	GError *error = NULL;
+	PkTransactionDbItem *item;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	/* TODO: we have to be careful of SQL injection attacks */
-	statement = g_strdup_printf ("UPDATE transactions SET data = \"%s\" WHERE transaction_id = '%s'",
-				     data, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
-	g_free (statement);
-	return TRUE;
+	/* not yet written */
+	item = g_hash_table_lookup (tdb->priv->pending, tid);
+	if (item != NULL) {
+		g_free (item->data);
+		item->data = g_strdup (data);
+		return TRUE;
+	}
+
+	ret = pk_transaction_db_execute (tdb, "BEGIN", &error);
+	if (!ret) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+	statement = pk_transaction_db_prepare (tdb, "UPDATE transactions SET data = ? WHERE transaction_id = ?");
+	if (statement == NULL) {
+		ret = FALSE;
+		goto out;
+	}
+	sqlite3_bind_text (statement, 1, data, -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 2, tid, -1, SQLITE_STATIC);
+	ret = pk_transaction_db_step (tdb, statement);
+	if (!ret)
+		goto out;
+
+	/* index the packages using the time and user of the transaction */
+	statement = pk_transaction_db_prepare (tdb, "SELECT timespec, uid FROM transactions WHERE transaction_id = ?");
+	if (statement == NULL) {
+		ret = FALSE;
+		goto out;
+	}
+	sqlite3_bind_text (statement, 1, tid, -1, SQLITE_STATIC);
+	if (sqlite3_step (statement) == SQLITE_ROW) {
+		timespec = g_strdup ((const gchar *) sqlite3_column_text (statement, 0));
+		uid = sqlite3_column_int (statement, 1);
+	}
+	sqlite3_reset (statement);
+	ret = pk_transaction_db_add_package_events (tdb, tid, timespec, uid, data);
+out:
+	g_free (timespec);
+	return pk_transaction_db_end (tdb, ret);
+}
+
+/**
+ * pk_transaction_db_write_item:
+ *
+ * Writes everything else we know about a transaction in one commit.
+ **/
+static gboolean
+pk_transaction_db_write_item (PkTransactionDb *tdb,
+			      PkTransactionDbItem *item,
+			      gboolean success,
+			      guint runtime)
+{
+	gboolean ret = FALSE;
+	GError *error = NULL;
+	sqlite3_stmt *statement;
+
+	ret = pk_transaction_db_execute (tdb, "BEGIN", &error);
+	if (!ret) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+	statement = pk_transaction_db_prepare (tdb,
+					       "UPDATE transactions SET duration = ?, succeeded = ?, "
+					       "role = ?, data = ?, uid = ?, cmdline = ? "
+					       "WHERE transaction_id = ?");
+	if (statement == NULL) {
+		ret = FALSE;
+		goto out;
+	}
+	sqlite3_bind_int (statement, 1, runtime);
+	sqlite3_bind_int (statement, 2, success);
+	if (item->role != PK_ROLE_ENUM_UNKNOWN)
+		sqlite3_bind_text (statement, 3, pk_role_enum_to_string (item->role), -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 4, item->data, -1, SQLITE_STATIC);
+	sqlite3_bind_int (statement, 5, item->uid);
+	sqlite3_bind_text (statement, 6, item->cmdline, -1, SQLITE_STATIC);
+	sqlite3_bind_text (statement, 7, item->tid, -1, SQLITE_STATIC);
+	ret = pk_transaction_db_step (tdb, statement);
+	if (!ret)
+		goto out;
+	ret = pk_transaction_db_add_package_events (tdb,
+						    item->tid,
+						    item->timespec,
+						    item->uid,
+						    item->data);
+out:
+	return pk_transaction_db_end (tdb, ret);
 }
 
 /**
@@ -422,15 +642,211 @@ pk_transaction_db_set_data (PkTransactionDb *tdb, const gchar *tid, const gchar
 gboolean
 pk_transaction_db_set_finished (PkTransactionDb *tdb, const gchar *tid, gboolean success, guint runtime)
 {
-	gchar *statement;
+	gboolean ret;
+	PkTransactionDbItem *item;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 
-	statement = g_strdup_printf ("UPDATE transactions SET succeeded = %i, duration = %i WHERE transaction_id = '%s'",
-				     success, runtime, tid);
-	pk_transaction_db_sql_statement (tdb, statement);
-	g_free (statement);
-	return TRUE;
+	/* write behind */
+	item = g_hash_table_lookup (tdb->priv->pending, tid);
+	if (item != NULL) {
+		ret = pk_transaction_db_write_item (tdb, item, success, runtime);
+		g_hash_table_remove (tdb->priv->pending, tid);
+		return ret;
+	}
+
+	statement = pk_transaction_db_prepare (tdb, "UPDATE transactions SET succeeded = ?, duration = ? WHERE transaction_id = ?");
+	if (statement == NULL)
+		return FALSE;
+	sqlite3_bind_int (statement, 1, success);
+	sqlite3_bind_int (statement, 2, runtime);
+	sqlite3_bind_text (statement, 3, tid, -1, SQLITE_STATIC);
+	return pk_transaction_db_step (tdb, statement);
+}
+
+/**
+ * pk_transaction_db_get_package_history:
+ * @tdb: the #PkTransactionDb instance
+ * @package_name: the package name, e.g. "hal"
+ * @max_size: the maximum number of entries to return, or 0 for no limit
+ *
+ * Gets the install, remove and update events for a package from successful
+ * transactions, oldest first. Multiarch packages changed in the same
+ * transaction only produce one entry.
+ *
+ * Return value: a 'aa{sv}' #GVariant, or %NULL if there is no history
+ **/
+GVariant *
+pk_transaction_db_get_package_history (PkTransactionDb *tdb,
+				       const gchar *package_name,
+				       guint max_size)
+{
+	GVariantBuilder builder;
+	GVariant *value = NULL;
+	gint rc;
+	guint len = 0;
+	sqlite3_stmt *statement;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), NULL);
+	g_return_val_if_fail (package_name != NULL, NULL);
+
+	/* use the (name, timestamp) index and only fetch what we return */
+	statement = pk_transaction_db_prepare (tdb,
+					       "SELECT info, data, version, timestamp, uid FROM "
+					       "(SELECT e.info, e.data, e.version, e.timestamp, e.uid "
+					       "FROM package_events e JOIN transactions t "
+					       "ON t.transaction_id = e.transaction_id "
+					       "WHERE e.name = ? AND e.timestamp != 0 AND t.succeeded = 1 "
+					       "GROUP BY e.timestamp ORDER BY e.timestamp DESC LIMIT ?) "
+					       "ORDER BY timestamp ASC");
+	if (statement == NULL)
+		goto out;
+	sqlite3_bind_text (statement, 1, package_name, -1, SQLITE_STATIC);
+	sqlite3_bind_int64 (statement, 2, max_size > 0 ? (sqlite3_int64) max_size : -1);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("aa{sv}"));
+	while ((rc = sqlite3_step (statement)) == SQLITE_ROW) {
+		g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sv}"));
+		g_variant_builder_add (&builder, "{sv}", "info",
+				       g_variant_new_uint32 (sqlite3_column_int (statement, 0)));
+		g_variant_builder_add (&builder, "{sv}", "source",
+				       g_variant_new_string ((const gchar *) sqlite3_column_text (statement, 1)));
+		g_variant_builder_add (&builder, "{sv}", "version",
+				       g_variant_new_string ((const gchar *) sqlite3_column_text (statement, 2)));
+		g_variant_builder_add (&builder, "{sv}", "timestamp",
+				       g_variant_new_uint64 (sqlite3_column_int64 (statement, 3)));
+		g_variant_builder_add (&builder, "{sv}", "user-id",
+				       g_variant_new_uint32 (sqlite3_column_int (statement, 4)));
+		g_variant_builder_close (&builder);
+		len++;
+	}
+	if (rc != SQLITE_DONE)
+		g_warning ("failed to execute statement: %s", sqlite3_errmsg (tdb->priv->db));
+	sqlite3_reset (statement);
+	value = g_variant_builder_end (&builder);
+
+	/* no history */
+	if (len == 0) {
+		g_variant_unref (g_variant_ref_sink (value));
+		value = NULL;
+	}
+out:
+	return value;
+}
+
+/**
+ * pk_transaction_db_compact:
+ * @tdb: the #PkTransactionDb instance
+ * @max_age: the number of days of history to keep, or 0 to keep everything
+ * @error: a #GError, or %NULL
+ *
+ * Removes old transactions and their package history, and folds the
+ * write-ahead log back into the database. Transactions that have not been
+ * written in full yet are always kept.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean
+pk_transaction_db_compact (PkTransactionDb *tdb, guint max_age, GError **error)
+{
+	gboolean ret = TRUE;
+	gchar *timespec = NULL;
+	gint rc;
+	GPtrArray *tids = NULL;
+	GTimeVal timeval;
+	guint i;
+	guint removed = 0;
+	sqlite3_stmt *statement;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
+	g_return_val_if_fail (tdb->priv->db != NULL, FALSE);
+
+	if (max_age > 0) {
+		/* the timespec is always UTC, so this sorts as text */
+		g_get_current_time (&timeval);
+		timeval.tv_sec -= (glong) max_age * 24 * 60 * 60;
+		timeval.tv_usec = 0;
+		timespec = g_time_val_to_iso8601 (&timeval);
+		statement = pk_transaction_db_prepare (tdb, "SELECT transaction_id FROM transactions WHERE timespec < ?");
+		if (statement == NULL) {
+			ret = FALSE;
+			g_set_error (error, 1, 0,
+				     "failed to prepare retention: %s",
+				     sqlite3_errmsg (tdb->priv->db));
+			goto out;
+		}
+		sqlite3_bind_text (statement, 1, timespec, -1, SQLITE_STATIC);
+		tids = g_ptr_array_new_with_free_func (g_free);
+		while ((rc = sqlite3_step (statement)) == SQLITE_ROW) {
+			/* still being written behind, so not ours to remove */
+			if (g_hash_table_contains (tdb->priv->pending, sqlite3_column_text (statement, 0)))
+				continue;
+			g_ptr_array_add (tids, g_strdup ((const gchar *) sqlite3_column_text (statement, 0)));
+		}
+		sqlite3_reset (statement);
+		if (rc != SQLITE_DONE) {
+			ret = FALSE;
+			g_set_error (error, 1, 0,
+				     "failed to find old transactions: %s",
+				     sqlite3_errmsg (tdb->priv->db));
+			goto out;
+		}
+
+		/* remove the transactions and their package history together */
+		ret = pk_transaction_db_execute (tdb, "BEGIN", error);
+		if (!ret)
+			goto out;
+		statement = pk_transaction_db_prepare (tdb, "DELETE FROM transactions WHERE transaction_id = ?");
+		if (statement == NULL) {
+			ret = FALSE;
+			g_set_error (error, 1, 0,
+				     "failed to prepare retention: %s",
+				     sqlite3_errmsg (tdb->priv->db));
+			pk_transaction_db_end (tdb, FALSE);
+			goto out;
+		}
+		for (i = 0; i < tids->len; i++) {
+			sqlite3_bind_text (statement, 1, g_ptr_array_index (tids, i), -1, SQLITE_STATIC);
+			ret = pk_transaction_db_step (tdb, statement);
+			if (!ret) {
+				g_set_error (error, 1, 0,
+					     "failed to remove old transactions: %s",
+					     sqlite3_errmsg (tdb->priv->db));
+				pk_transaction_db_end (tdb, FALSE);
+				goto out;
+			}
+			removed += sqlite3_changes (tdb->priv->db);
+		}
+		ret = pk_transaction_db_execute (tdb,
+						 "DELETE FROM package_events WHERE transaction_id NOT IN "
+						 "(SELECT transaction_id FROM transactions)",
+						 error);
+		if (!ret) {
+			pk_transaction_db_end (tdb, FALSE);
+			goto out;
+		}
+		removed += sqlite3_changes (tdb->priv->db);
+		ret = pk_transaction_db_execute (tdb, "COMMIT", error);
+		if (!ret) {
+			pk_transaction_db_end (tdb, FALSE);
+			goto out;
+		}
+		g_debug ("removed %i history rows older than %s", removed, timespec);
+	}
+
+	/* only rebuild the file when it is worth it */
+	if (removed >= PK_TRANSACTION_DB_VACUUM_THRESHOLD) {
+		ret = pk_transaction_db_execute (tdb, "VACUUM", error);
+		if (!ret)
+			goto out;
+	}
+	ret = pk_transaction_db_execute (tdb, "PRAGMA wal_checkpoint(TRUNCATE)", error);
+out:
+	if (tids != NULL)
+		g_ptr_array_unref (tids);
+	g_free (timespec);
+	return ret;
 }
 
 /**
@@ -511,9 +927,7 @@ pk_transaction_db_get_random_hex_string (guint length)
 static gboolean
 pk_transaction_db_defer_write_job_count_cb (PkTransactionDb *tdb)
 {
-	gchar *statement = NULL;
-	gchar *error_msg = NULL;
-	gint rc;
+	sqlite3_stmt *statement;
 
 	/* not loaded! */
 	if (tdb->priv->db == NULL) {
@@ -522,23 +936,20 @@ pk_transaction_db_defer_write_job_count_cb (PkTransactionDb *tdb)
 	}
 
 	/* force fsync as we don't want to repeat this number */
-	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=ON", NULL, NULL, NULL);
+	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=FULL", NULL, NULL, NULL);
 
 	/* save the job count */
-	statement = g_strdup_printf ("UPDATE config SET value = '%i' WHERE key = 'job_count'",
-				     tdb->priv->job_count);
-	rc = sqlite3_exec (tdb->priv->db, statement, NULL, NULL, &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("failed to set job id: %s", error_msg);
-		sqlite3_free (error_msg);
-		goto out;
+	statement = pk_transaction_db_prepare (tdb, "UPDATE config SET value = ? WHERE key = 'job_count'");
+	if (statement != NULL) {
+		sqlite3_bind_int (statement, 1, tdb->priv->job_count);
+		if (!pk_transaction_db_step (tdb, statement))
+			g_warning ("failed to set job id");
 	}
 
-	/* turn off fsync */
-	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=OFF", NULL, NULL, NULL);
+	/* the WAL does not need a fsync for every commit */
+	sqlite3_exec (tdb->priv->db, "PRAGMA synchronous=NORMAL", NULL, NULL, NULL);
 out:
 	tdb->priv->database_save_id = 0;
-	g_free (statement);
 	return FALSE;
 }
 
@@ -571,60 +982,6 @@ pk_transaction_db_generate_id (PkTransactionDb *tdb)
 	return tid;
 }
 
-/**
- * pk_transaction_sqlite_proxy_cb:
- **/
-static gint
-pk_transaction_sqlite_proxy_cb (void *data, gint argc, gchar **argv, gchar **col_name)
-{
-	PkTransactionDbProxyItem *item = (PkTransactionDbProxyItem *) data;
-	gint i;
-
-	g_return_val_if_fail (item != NULL, 0);
-
-	for (i=0; i<argc; i++) {
-		if (g_strcmp0 (col_name[i], "proxy_http") == 0) {
-			item->proxy_http = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_https") == 0) {
-			item->proxy_https = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_ftp") == 0) {
-			item->proxy_ftp = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "proxy_socks") == 0) {
-			item->proxy_socks = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "no_proxy") == 0) {
-			item->no_proxy = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else if (g_strcmp0 (col_name[i], "pac") == 0) {
-			item->pac = g_strdup (argv[i]);
-			item->set = TRUE;
-		} else {
-			g_warning ("%s = %s", col_name[i], argv[i]);
-		}
-	}
-	return 0;
-}
-
-/**
- * pk_transaction_db_proxy_item_free:
- **/
-static void
-pk_transaction_db_proxy_item_free (PkTransactionDbProxyItem *item)
-{
-	if (item == NULL)
-		return;
-	g_free (item->proxy_http);
-	g_free (item->proxy_https);
-	g_free (item->proxy_ftp);
-	g_free (item->proxy_socks);
-	g_free (item->no_proxy);
-	g_free (item->pac);
-	g_free (item);
-}
-
 /**
  * pk_transaction_db_get_proxy:
  * @tdb: the #PkTransactionDb instance
@@ -646,52 +1003,48 @@ pk_transaction_db_get_proxy (PkTransactionDb *tdb, guint uid, const gchar *sessi
 			     gchar **no_proxy,
 			     gchar **pac)
 {
-	gchar *error_msg = NULL;
-	gchar *statement;
 	gboolean ret = FALSE;
 	gint rc;
-	PkTransactionDbProxyItem *item;
+	sqlite3_stmt *statement;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
 	g_return_val_if_fail (uid != G_MAXUINT, FALSE);
 
 	/* get existing data */
-	item = g_new0 (PkTransactionDbProxyItem, 1);
-	statement = g_strdup_printf ("SELECT proxy_http, proxy_https, proxy_ftp, proxy_socks, no_proxy, pac FROM proxy WHERE uid = '%i' AND session = '%s' LIMIT 1",
-				     uid, session);
-	rc = sqlite3_exec (tdb->priv->db, statement,
-			   pk_transaction_sqlite_proxy_cb,
-			   item,
-			   &error_msg);
-	if (rc != SQLITE_OK) {
-		g_warning ("SQL error: %s", error_msg);
-		sqlite3_free (error_msg);
+	statement = pk_transaction_db_prepare (tdb,
+					       "SELECT proxy_http, proxy_https, proxy_ftp, proxy_socks, no_proxy, pac "
+					       "FROM proxy WHERE uid = ? AND session = ? LIMIT 1");
+	if (statement == NULL)
 		goto out;
-	}
-
-	/* nothing matched */
-	if (!item->set)
+	sqlite3_bind_int (statement, 1, uid);
+	sqlite3_bind_text (statement, 2, session, -1, SQLITE_STATIC);
+	rc = sqlite3_step (statement);
+	if (rc != SQLITE_ROW) {
+		/* nothing matched */
+		if (rc != SQLITE_DONE)
+			g_warning ("SQL error: %s", sqlite3_errmsg (tdb->priv->db));
 		goto out;
+	}
 
 	/* success, even if we got no data */
 	ret = TRUE;
 
 	/* copy data */
 	if (proxy_http != NULL)
-		*proxy_http = g_strdup (item->proxy_http);
+		*proxy_http = g_strdup ((const gchar *) sqlite3_column_text (statement, 0));
 	if (proxy_https != NULL)
-		*proxy_https = g_strdup (item->proxy_https);
+		*proxy_https = g_strdup ((const gchar *) sqlite3_column_text (statement, 1));
 	if (proxy_ftp != NULL)
-		*proxy_ftp = g_strdup (item->proxy_ftp);
+		*proxy_ftp = g_strdup ((const gchar *) sqlite3_column_text (statement, 2));
 	if (proxy_socks != NULL)
-		*proxy_socks = g_strdup (item->proxy_socks);
+		*proxy_socks = g_strdup ((const gchar *) sqlite3_column_text (statement, 3));
 	if (no_proxy != NULL)
-		*no_proxy = g_strdup (item->no_proxy);
+		*no_proxy = g_strdup ((const gchar *) sqlite3_column_text (statement, 4));
 	if (pac != NULL)
-		*pac = g_strdup (item->pac);
+		*pac = g_strdup ((const gchar *) sqlite3_column_text (statement, 5));
 out:
-	pk_transaction_db_proxy_item_free (item);
-	g_free (statement);
+	if (statement != NULL)
+		sqlite3_reset (statement);
 	return ret;
 }
 
@@ -720,7 +1073,6 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 	gchar *timespec = NULL;
 	gchar *proxy_http_tmp = NULL;
 	gboolean ret = FALSE;
-	gint rc;
 	sqlite3_stmt *statement = NULL;
 
 	g_return_val_if_fail (PK_IS_TRANSACTION_DB (tdb), FALSE);
@@ -739,18 +1091,17 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 			 proxy_http, proxy_ftp, uid, session);
 
 		/* prepare statement */
-		rc = sqlite3_prepare_v2 (tdb->priv->db,
-					 "UPDATE proxy SET "
-					 "proxy_http = ?, "
-					 "proxy_https = ?, "
-					 "proxy_ftp = ?, "
-					 "proxy_socks = ?, "
-					 "no_proxy = ?, "
-					 "pac = ? "
-					 "WHERE uid = ? AND session = ?",
-					 -1, &statement, NULL);
-		if (rc != SQLITE_OK) {
-			g_warning ("failed to prepare statement: %s", sqlite3_errmsg (tdb->priv->db));
+		statement = pk_transaction_db_prepare (tdb,
+						       "UPDATE proxy SET "
+						       "proxy_http = ?, "
+						       "proxy_https = ?, "
+						       "proxy_ftp = ?, "
+						       "proxy_socks = ?, "
+						       "no_proxy = ?, "
+						       "pac = ? "
+						       "WHERE uid = ? AND session = ?");
+		if (statement == NULL) {
+			ret = FALSE;
 			goto out;
 		}
 
@@ -765,11 +1116,7 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 		sqlite3_bind_text (statement, 8, session, -1, SQLITE_STATIC);
 
 		/* execute statement */
-		rc = sqlite3_step (statement);
-		if (rc != SQLITE_DONE) {
-			g_warning ("failed to execute statement: %s", sqlite3_errmsg (tdb->priv->db));
-			goto out;
-		}
+		ret = pk_transaction_db_step (tdb, statement);
 		goto out;
 	}
 
@@ -778,20 +1125,17 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 	g_debug ("set proxy %s, %s for uid:%i and session:%s", proxy_http, proxy_ftp, uid, session);
 
 	/* prepare statement */
-	rc = sqlite3_prepare_v2 (tdb->priv->db,
-				 "INSERT INTO proxy (created, uid, session, "
-				 "proxy_http, "
-				 "proxy_https, "
-				 "proxy_ftp, "
-				 "proxy_socks, "
-				 "no_proxy, "
-				 "pac) "
-				 "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
-				 -1, &statement, NULL);
-	if (rc != SQLITE_OK) {
-		g_warning ("failed to prepare statement: %s", sqlite3_errmsg (tdb->priv->db));
+	statement = pk_transaction_db_prepare (tdb,
+					       "INSERT INTO proxy (created, uid, session, "
+					       "proxy_http, "
+					       "proxy_https, "
+					       "proxy_ftp, "
+					       "proxy_socks, "
+					       "no_proxy, "
+					       "pac) "
+					       "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
+	if (statement == NULL)
 		goto out;
-	}
 
 	/* bind data, so that the freeform proxy text cannot be used to inject SQL */
 	sqlite3_bind_text (statement, 1, timespec, -1, SQLITE_STATIC);
@@ -805,16 +1149,8 @@ pk_transaction_db_set_proxy (PkTransactionDb *tdb, guint uid,
 	sqlite3_bind_text (statement, 9, pac, -1, SQLITE_STATIC);
 
 	/* execute statement */
-	rc = sqlite3_step (statement);
-	if (rc != SQLITE_DONE) {
-		g_warning ("failed to execute statement: %s", sqlite3_errmsg (tdb->priv->db));
-		goto out;
-	}
-
-	ret = TRUE;
+	ret = pk_transaction_db_step (tdb, statement);
 out:
-	if (statement != NULL)
-		sqlite3_finalize (statement);
 	g_free (timespec);
 	g_free (proxy_http_tmp);
 	return ret;
@@ -871,6 +1207,49 @@ pk_transaction_db_execute (PkTransactionDb *tdb,
 	return ret;
 }
 
+/**
+ * pk_transaction_db_migrate_package_events:
+ **/
+static gboolean
+pk_transaction_db_migrate_package_events (PkTransactionDb *tdb, GError **error)
+{
+	gboolean ret;
+	GList *l;
+	GList *list;
+	guint cnt = 0;
+	PkTransactionPast *item;
+
+	ret = pk_transaction_db_execute (tdb, "BEGIN", error);
+	if (!ret)
+		return FALSE;
+	list = pk_transaction_db_get_list (tdb, 0);
+	for (l = list; l != NULL; l = l->next) {
+		item = PK_TRANSACTION_PAST (l->data);
+		if (pk_transaction_past_get_data (item) == NULL)
+			continue;
+		ret = pk_transaction_db_add_package_events (tdb,
+							    pk_transaction_past_get_id (item),
+							    pk_transaction_past_get_timespec (item),
+							    pk_transaction_past_get_uid (item),
+							    pk_transaction_past_get_data (item));
+		if (!ret) {
+			g_set_error (error, 1, 0,
+				     "failed to import history for %s",
+				     pk_transaction_past_get_id (item));
+			sqlite3_exec (tdb->priv->db, "ROLLBACK", NULL, NULL, NULL);
+			goto out;
+		}
+		cnt++;
+	}
+	ret = pk_transaction_db_execute (tdb, "COMMIT", error);
+	if (!ret)
+		goto out;
+	g_debug ("imported package history from %i transactions", cnt);
+out:
+	g_list_free_full (list, (GDestroyNotify) g_object_unref);
+	return ret;
+}
+
 /**
  * pk_transaction_db_load:
  **/
@@ -900,11 +1279,18 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 			     "Can't open transaction database: %s",
 			     sqlite3_errmsg (tdb->priv->db));
 		sqlite3_close (tdb->priv->db);
+		tdb->priv->db = NULL;
 		goto out;
 	}
 
-	/* we don't need to keep doing fsync */
-	ret = pk_transaction_db_execute (tdb, "PRAGMA synchronous=OFF", error);
+	/* the write-ahead log lets readers and the writer work at the same
+	 * time, and only needs a fsync at checkpoint time */
+	ret = pk_transaction_db_execute (tdb, "PRAGMA journal_mode=WAL", &error_local);
+	if (!ret) {
+		g_warning ("failed to use WAL: %s", error_local->message);
+		g_clear_error (&error_local);
+	}
+	ret = pk_transaction_db_execute (tdb, "PRAGMA synchronous=NORMAL", error);
 	if (!ret)
 		goto out;
 
@@ -974,12 +1360,39 @@ pk_transaction_db_load (PkTransactionDb *tdb, GError **error)
 	ret = pk_transaction_db_execute (tdb, "SELECT * FROM proxy LIMIT 1", &error_local);
 	if (!ret) {
 		g_debug ("adding table proxy: %s", error_local->message);
+		g_clear_error (&error_local);
 		statement = "CREATE TABLE proxy (created TEXT, proxy_http TEXT, proxy_https TEXT, proxy_ftp TEXT, proxy_socks TEXT, no_proxy TEXT, pac TEXT, uid INTEGER, session TEXT);";
 		ret = pk_transaction_db_execute (tdb, statement, error);
 		if (!ret)
 			goto out;
 	}
 
+	/* package history index (since 0.9.6) */
+	ret = pk_transaction_db_execute (tdb, "SELECT * FROM package_events LIMIT 1", &error_local);
+	if (!ret) {
+		g_debug ("adding table package_events: %s", error_local->message);
+		g_clear_error (&error_local);
+		statement = "CREATE TABLE package_events ("
+			    "transaction_id TEXT,"
+			    "name TEXT,"
+			    "version TEXT,"
+			    "arch TEXT,"
+			    "info INTEGER,"
+			    "data TEXT,"
+			    "timestamp INTEGER DEFAULT 0,"
+			    "uid INTEGER DEFAULT 0);"
+			    "CREATE INDEX package_events_name_timestamp "
+			    "ON package_events (name, timestamp);";
+		ret = pk_transaction_db_execute (tdb, statement, error);
+		if (!ret)
+			goto out;
+
+		/* one-time import of the old transactions */
+		ret = pk_transaction_db_migrate_package_events (tdb, error);
+		if (!ret)
+			goto out;
+	}
+
 	/* try to set correct permissions */
 	g_chmod (PK_DB_DIR "/transactions.db", 0644);
 
@@ -997,6 +1410,10 @@ static void
 pk_transaction_db_init (PkTransactionDb *tdb)
 {
 	tdb->priv = PK_TRANSACTION_DB_GET_PRIVATE (tdb);
+	tdb->priv->statements = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       NULL, (GDestroyNotify) sqlite3_finalize);
+	tdb->priv->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+						    NULL, (GDestroyNotify) pk_transaction_db_item_free);
 }
 
 /**
@@ -1006,7 +1423,9 @@ pk_transaction_db_init (PkTransactionDb *tdb)
 static void
 pk_transaction_db_finalize (GObject *object)
 {
+	GHashTableIter iter;
 	PkTransactionDb *tdb;
+	PkTransactionDbItem *item;
 	g_return_if_fail (PK_IS_TRANSACTION_DB (object));
 	tdb = PK_TRANSACTION_DB (object);
 	g_return_if_fail (tdb->priv != NULL);
@@ -1017,7 +1436,16 @@ pk_transaction_db_finalize (GObject *object)
 		g_source_remove (tdb->priv->database_save_id);
 	}
 
-	/* close the database */
+	/* save any transactions that never finished as failed */
+	if (tdb->priv->db != NULL) {
+		g_hash_table_iter_init (&iter, tdb->priv->pending);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &item))
+			pk_transaction_db_write_item (tdb, item, FALSE, 0);
+	}
+	g_hash_table_unref (tdb->priv->pending);
+
+	/* statements have to be finalized before the database is closed */
+	g_hash_table_unref (tdb->priv->statements);
 	sqlite3_close (tdb->priv->db);
 
 	G_OBJECT_CLASS (pk_transaction_db_parent_class)->finalize (object);
@@ -1031,8 +1459,11 @@ pk_transaction_db_finalize (GObject *object)
 PkTransactionDb *
 pk_transaction_db_new (void)
 {
-	PkTransactionDb *tdb;
-	tdb = g_object_new (PK_TYPE_TRANSACTION_DB, NULL);
-	return PK_TRANSACTION_DB (tdb);
+	if (pk_transaction_db_object != NULL) {
+		g_object_ref (pk_transaction_db_object);
+	} else {
+		pk_transaction_db_object = g_object_new (PK_TYPE_TRANSACTION_DB, NULL);
+		g_object_add_weak_pointer (pk_transaction_db_object, &pk_transaction_db_object);
+	}
+	return PK_TRANSACTION_DB (pk_transaction_db_object);
 }
-
@@ -73,6 +73,12 @@ gboolean	 pk_transaction_db_set_data		(PkTransactionDb	*tdb,
 							 const gchar		*data);
 GList		*pk_transaction_db_get_list		(PkTransactionDb	*tdb,
 							 guint			 limit);
+GVariant	*pk_transaction_db_get_package_history	(PkTransactionDb	*tdb,
+							 const gchar		*package_name,
+							 guint			 max_size);
+gboolean	 pk_transaction_db_compact		(PkTransactionDb	*tdb,
+							 guint			 max_age,
+							 GError			**error);
 gboolean	 pk_transaction_db_action_time_reset	(PkTransactionDb	*tdb,
 							 PkRoleEnum		 role);
 guint		 pk_transaction_db_action_time_since	(PkTransactionDb	*tdb,
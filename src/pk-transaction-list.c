@@ -23,7 +23,13 @@
  * Transaction Commit Logic:
  *
  * State = COMMIT
- * Transaction.Run()
+ * Transaction.Writer = Transaction.Exclusive OR Transaction.Role is not read-only
+ * 	OR the backend does not let Transaction.Role share its locks
+ * IF an identical query (same role, filters and arguments) is queued or running
+ * 	Wait for its results and replay them instead of starting a job
+ * ELSE
+ * 	Push transaction onto the ready queue for {Interactive,Background} x {Reader,Writer}
+ * Schedule()
  * WHEN transaction finished:
  * 	IF error = LOCK_REQUIRED
  * 		IF number_of_tries > 4
@@ -33,15 +39,29 @@
  * 			Reset transaction
  * 			Transaction.Exclusive = TRUE
  * 			number_of_tries++
- * 			Leave transaction in the FIFO queue
+ * 			Push transaction onto the writer ready queue again
  *	ELSE
  * 		State = Finished
- * 		IF Transaction.Exclusive
- * 			Take the first PK_TRANSACTION_STATE_READY transaction which has Transaction.Exclusive == TRUE
- * 			from the list and run it. If there's none, just do nothing
- * 		ELSE
- * 			Do nothing
+ * 		Give the results to every transaction waiting on this one
  * 		Transaction.Destroy()
+ * 	Schedule()
+ *
+ * Schedule:
+ * 	Run every queued reader, as the backend keeps readers and writers apart
+ * 	IF no writer is running
+ * 		IF the oldest background writer has waited too long
+ * 			Run it
+ * 		ELSE
+ * 			Run the oldest interactive writer, or else the oldest background writer
+ *
+ * Each decision only looks at the head of a queue, so it does not depend on
+ * the number of transactions in the list.
+ *
+ * Run:
+ * 	IF the results of an identical GetUpdates or GetPackages are cached
+ * 		Replay them instead of starting a job
+ * 	ELSE
+ * 		Transaction.Run()
 **/
 
 #include "config.h"
@@ -62,12 +82,18 @@
 #include <glib/gi18n.h>
 #include <packagekit-glib2/pk-common.h>
 
+#include "pk-notify.h"
+#include "pk-statistics.h"
 #include "pk-shared.h"
 #include "pk-transaction.h"
 #include "pk-transaction-private.h"
 #include "pk-transaction-list.h"
 
 static void     pk_transaction_list_finalize	(GObject	*object);
+static void     pk_transaction_list_enqueue	(PkTransactionList *tlist,
+						 PkTransactionItem *item);
+static void     pk_transaction_list_schedule	(PkTransactionList *tlist);
+static gboolean pk_transaction_list_replay_idle_cb (PkTransactionItem *item);
 
 #define PK_TRANSACTION_LIST_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_TRANSACTION_LIST, PkTransactionListPrivate))
 
@@ -80,6 +106,20 @@ static void     pk_transaction_list_finalize	(GObject	*object);
 /* how many times we should retry a locked transaction */
 #define PK_TRANSACTION_LIST_MAX_LOCK_RETRIES	4
 
+/* how long a background writer can be overtaken by interactive writers */
+#define PK_TRANSACTION_LIST_STARVATION_TIMEOUT	30 /* s */
+
+/* how long cached results are used if nothing invalidates them first */
+#define PK_TRANSACTION_LIST_CACHE_LIFETIME_DEFAULT	600 /* s */
+
+typedef enum {
+	PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_READER,
+	PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_WRITER,
+	PK_TRANSACTION_LIST_QUEUE_BACKGROUND_READER,
+	PK_TRANSACTION_LIST_QUEUE_BACKGROUND_WRITER,
+	PK_TRANSACTION_LIST_QUEUE_LAST
+} PkTransactionListQueue;
+
 struct PkTransactionListPrivate
 {
 	GPtrArray		*array;
@@ -89,8 +129,22 @@ struct PkTransactionListPrivate
 	GPtrArray		*plugins;
 	PkBackend		*backend;
 	GDBusNodeInfo		*introspection;
+	GQueue			 ready[PK_TRANSACTION_LIST_QUEUE_LAST];
+	guint			 writers_running;
+	guint			 readers_running;
+	GHashTable		*leaders;
+	GHashTable		*cache;
+	guint			 cache_lifetime;
+	guint			 cache_generation;
+	PkNotify		*notify;
+	PkStatistics		*statistics;
 };
 
+typedef struct {
+	PkResults		*results;
+	gint64			 created;
+} PkTransactionCacheItem;
+
 typedef struct {
 	PkTransaction		*transaction;
 	PkTransactionList	*list;
@@ -102,6 +156,19 @@ typedef struct {
 	guint			 uid;
 	guint			 tries;
 	gboolean		 background;
+	gboolean		 writer;
+	gboolean		 writer_running;
+	gboolean		 reader_running;
+	PkTransactionListQueue	 queue;
+	GList			 link;
+	gint64			 queued;
+	gchar			*shared_key;
+	gpointer		 leader;
+	GPtrArray		*followers;
+	PkResults		*results;
+	gint64			 attached;
+	gboolean		 replayed;
+	guint			 generation;
 } PkTransactionItem;
 
 enum {
@@ -204,10 +271,205 @@ pk_transaction_list_item_free (PkTransactionItem *item)
 	if (item->remove_id != 0)
 		g_source_remove (item->remove_id);
 	g_object_unref (item->list);
+	if (item->results != NULL)
+		g_object_unref (item->results);
+	g_ptr_array_unref (item->followers);
+	g_free (item->shared_key);
 	g_free (item->tid);
 	g_free (item);
 }
 
+/**
+ * pk_transaction_list_role_is_read_only:
+ *
+ * Return value: %TRUE if transactions with this role only query the
+ * package database and can share it with any other reader.
+ **/
+static gboolean
+pk_transaction_list_role_is_read_only (PkRoleEnum role)
+{
+	switch (role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_CATEGORIES:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_DETAILS_LOCAL:
+	case PK_ROLE_ENUM_GET_DISTRO_UPGRADES:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_FILES_LOCAL:
+	case PK_ROLE_ENUM_GET_OLD_TRANSACTIONS:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_REPO_LIST:
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+	case PK_ROLE_ENUM_RESOLVE:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+		return TRUE;
+	default:
+		break;
+	}
+	return FALSE;
+}
+
+/**
+ * pk_transaction_list_dequeue:
+ *
+ * Removes the item from whatever ready queue it is waiting in.
+ **/
+static void
+pk_transaction_list_dequeue (PkTransactionList *tlist, PkTransactionItem *item)
+{
+	if (item->queue == PK_TRANSACTION_LIST_QUEUE_LAST)
+		return;
+	g_queue_unlink (&tlist->priv->ready[item->queue], &item->link);
+	item->queue = PK_TRANSACTION_LIST_QUEUE_LAST;
+}
+
+/**
+ * pk_transaction_list_detach:
+ *
+ * Stops the item sharing a backend job with other transactions. Anything
+ * still waiting for the results of this item is queued to run by itself.
+ **/
+static void
+pk_transaction_list_detach (PkTransactionList *tlist, PkTransactionItem *item)
+{
+	guint i;
+	PkTransactionItem *leader;
+	PkTransactionItem *follower;
+
+	/* waiting for somebody else */
+	leader = item->leader;
+	if (leader != NULL) {
+		g_ptr_array_remove (leader->followers, item);
+		item->leader = NULL;
+	}
+
+	/* somebody else is waiting for us */
+	if (item->shared_key != NULL &&
+	    g_hash_table_lookup (tlist->priv->leaders, item->shared_key) == item)
+		g_hash_table_remove (tlist->priv->leaders, item->shared_key);
+	for (i = 0; i < item->followers->len; i++) {
+		follower = g_ptr_array_index (item->followers, i);
+		g_debug ("%s no longer shares the results of %s",
+			 follower->tid, item->tid);
+		follower->leader = NULL;
+		pk_transaction_list_enqueue (tlist, follower);
+	}
+	g_ptr_array_set_size (item->followers, 0);
+}
+
+/**
+ * pk_transaction_list_release_slot:
+ *
+ * Gives up the writer slot or the reader slot if the item was holding one.
+ **/
+static void
+pk_transaction_list_release_slot (PkTransactionList *tlist, PkTransactionItem *item)
+{
+	if (item->writer_running) {
+		item->writer_running = FALSE;
+		tlist->priv->writers_running--;
+	}
+	if (item->reader_running) {
+		item->reader_running = FALSE;
+		tlist->priv->readers_running--;
+	}
+}
+
+/**
+ * pk_transaction_list_cache_item_free:
+ **/
+static void
+pk_transaction_list_cache_item_free (PkTransactionCacheItem *cache_item)
+{
+	g_object_unref (cache_item->results);
+	g_free (cache_item);
+}
+
+/**
+ * pk_transaction_list_invalidate_cache:
+ *
+ * Drops all the cached results, and makes sure that nothing already running
+ * can add results that were computed before now.
+ **/
+static void
+pk_transaction_list_invalidate_cache (PkTransactionList *tlist)
+{
+	tlist->priv->cache_generation++;
+	if (g_hash_table_size (tlist->priv->cache) == 0)
+		return;
+	g_debug ("invalidating %i cached results",
+		 g_hash_table_size (tlist->priv->cache));
+	g_hash_table_remove_all (tlist->priv->cache);
+}
+
+/**
+ * pk_transaction_list_cache_lookup:
+ **/
+static PkResults *
+pk_transaction_list_cache_lookup (PkTransactionList *tlist, PkTransactionItem *item)
+{
+	gint64 age;
+	PkTransactionCacheItem *cache_item;
+
+	if (item->shared_key == NULL)
+		return NULL;
+	cache_item = g_hash_table_lookup (tlist->priv->cache, item->shared_key);
+	if (cache_item == NULL)
+		return NULL;
+
+	/* too old, so the system may have changed without telling us */
+	age = g_get_monotonic_time () - cache_item->created;
+	if (age > (gint64) tlist->priv->cache_lifetime * G_USEC_PER_SEC) {
+		g_hash_table_remove (tlist->priv->cache, item->shared_key);
+		return NULL;
+	}
+	return cache_item->results;
+}
+
+/**
+ * pk_transaction_list_cache_results:
+ **/
+static void
+pk_transaction_list_cache_results (PkTransactionList *tlist, PkTransactionItem *item)
+{
+	PkResults *results;
+	PkRoleEnum role;
+	PkTransactionCacheItem *cache_item;
+
+	if (tlist->priv->cache_lifetime == 0)
+		return;
+	if (item->shared_key == NULL || item->replayed)
+		return;
+
+	/* only the roles that clients poll for */
+	role = pk_transaction_get_role (item->transaction);
+	if (role != PK_ROLE_ENUM_GET_UPDATES &&
+	    role != PK_ROLE_ENUM_GET_PACKAGES)
+		return;
+
+	/* something changed the system while we were running */
+	if (item->generation != tlist->priv->cache_generation)
+		return;
+
+	results = pk_transaction_get_results (item->transaction);
+	if (pk_results_get_exit_code (results) != PK_EXIT_ENUM_SUCCESS)
+		return;
+
+	g_debug ("caching results of %s", item->tid);
+	cache_item = g_new0 (PkTransactionCacheItem, 1);
+	cache_item->results = g_object_ref (results);
+	cache_item->created = g_get_monotonic_time ();
+	g_hash_table_replace (tlist->priv->cache,
+			      g_strdup (item->shared_key),
+			      cache_item);
+}
+
 /**
  * pk_transaction_list_remove_internal:
  **/
@@ -225,6 +487,9 @@ pk_transaction_list_remove_internal (PkTransactionList *tlist, PkTransactionItem
 		g_warning ("could not remove %p as not present in list", item);
 		return FALSE;
 	}
+	pk_transaction_list_dequeue (tlist, item);
+	pk_transaction_list_release_slot (tlist, item);
+	pk_transaction_list_detach (tlist, item);
 	pk_transaction_list_item_free (item);
 
 	return TRUE;
@@ -270,6 +535,9 @@ pk_transaction_list_remove (PkTransactionList *tlist, const gchar *tid)
 		item->idle_id = 0;
 	}
 	ret = pk_transaction_list_remove_internal (tlist, item);
+
+	/* this may have freed the writer slot */
+	pk_transaction_list_schedule (tlist);
 	return ret;
 }
 
@@ -298,6 +566,14 @@ pk_transaction_list_set_background (PkTransactionList *tlist,
 		return;
 	}
 	g_debug ("%s is now background: %i", tid, background);
+
+	/* move to the other priority class if already waiting */
+	if (item->queue != PK_TRANSACTION_LIST_QUEUE_LAST) {
+		pk_transaction_list_dequeue (tlist, item);
+		item->background = background;
+		pk_transaction_list_enqueue (tlist, item);
+		return;
+	}
 	item->background = background;
 }
 
@@ -338,6 +614,44 @@ pk_transaction_list_run_idle_cb (PkTransactionItem *item)
 static void
 pk_transaction_list_run_item (PkTransactionList *tlist, PkTransactionItem *item)
 {
+	guint i;
+	PkResults *results;
+	PkTransactionItem *follower;
+
+	/* not waiting anymore */
+	pk_statistics_add_role (tlist->priv->statistics, "queue-wait",
+				pk_transaction_get_role (item->transaction),
+				g_get_monotonic_time () - item->queued);
+	pk_transaction_list_dequeue (tlist, item);
+
+	/* anything waiting for our results is running as well now */
+	for (i = 0; i < item->followers->len; i++) {
+		follower = g_ptr_array_index (item->followers, i);
+		pk_transaction_set_state (follower->transaction, PK_TRANSACTION_STATE_RUNNING);
+	}
+
+	/* an identical query was answered since the system last changed */
+	results = pk_transaction_list_cache_lookup (tlist, item);
+	if (results != NULL) {
+		g_debug ("%s is using cached results", item->tid);
+		item->attached = g_get_monotonic_time ();
+		item->results = g_object_ref (results);
+		pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_RUNNING);
+		item->idle_id = g_idle_add ((GSourceFunc) pk_transaction_list_replay_idle_cb, item);
+		g_source_set_name_by_id (item->idle_id, "[PkTransactionList] replay");
+		return;
+	}
+
+	item->generation = tlist->priv->cache_generation;
+
+	if (item->writer) {
+		item->writer_running = TRUE;
+		tlist->priv->writers_running++;
+	} else {
+		item->reader_running = TRUE;
+		tlist->priv->readers_running++;
+	}
+
 	/* we set this here so that we don't try starting more than one */
 	pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_RUNNING);
 
@@ -346,6 +660,167 @@ pk_transaction_list_run_item (PkTransactionList *tlist, PkTransactionItem *item)
 	g_source_set_name_by_id (item->idle_id, "[PkTransactionList] run");
 }
 
+/**
+ * pk_transaction_list_enqueue:
+ *
+ * Adds a ready item to the tail of the queue for its priority class, unless
+ * an identical query is already queued or running, in which case the item
+ * just waits for the results of that one.
+ **/
+static void
+pk_transaction_list_enqueue (PkTransactionList *tlist, PkTransactionItem *item)
+{
+	PkBackendLockClass lock_class;
+	PkRoleEnum role;
+	PkTransactionItem *leader;
+
+	/* the request cannot change once committed */
+	if (item->shared_key == NULL)
+		item->shared_key = pk_transaction_get_shared_key (item->transaction);
+
+	/* share the backend job of an identical query */
+	if (item->shared_key != NULL) {
+		leader = g_hash_table_lookup (tlist->priv->leaders, item->shared_key);
+		if (leader == NULL) {
+			g_hash_table_insert (tlist->priv->leaders, item->shared_key, item);
+		} else if (leader != item && item->followers->len == 0) {
+			g_debug ("%s is sharing the results of %s", item->tid, leader->tid);
+			item->leader = leader;
+			item->attached = g_get_monotonic_time ();
+			item->queued = item->attached;
+			g_ptr_array_add (leader->followers, item);
+			if (pk_transaction_get_state (leader->transaction) == PK_TRANSACTION_STATE_RUNNING)
+				pk_transaction_set_state (item->transaction, PK_TRANSACTION_STATE_RUNNING);
+			return;
+		}
+	}
+
+	/* exclusive transactions, anything that changes the system and the
+	 * queries the backend won't run next to a writer are writers */
+	role = pk_transaction_get_role (item->transaction);
+	lock_class = pk_backend_get_lock_class (tlist->priv->backend, role);
+	item->writer = pk_transaction_is_exclusive (item->transaction) ||
+		       !pk_transaction_list_role_is_read_only (role) ||
+		       (lock_class != PK_BACKEND_LOCK_CLASS_UNKNOWN &&
+			lock_class != PK_BACKEND_LOCK_CLASS_READ_SHARED);
+
+	if (item->background) {
+		item->queue = item->writer ? PK_TRANSACTION_LIST_QUEUE_BACKGROUND_WRITER :
+					     PK_TRANSACTION_LIST_QUEUE_BACKGROUND_READER;
+	} else {
+		item->queue = item->writer ? PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_WRITER :
+					     PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_READER;
+	}
+	item->queued = g_get_monotonic_time ();
+	g_queue_push_tail_link (&tlist->priv->ready[item->queue], &item->link);
+}
+
+/**
+ * pk_transaction_list_replay_idle_cb:
+ **/
+static gboolean
+pk_transaction_list_replay_idle_cb (PkTransactionItem *item)
+{
+	guint time_ms;
+	PkResults *results;
+
+	/* never try to idle add this again */
+	item->idle_id = 0;
+	item->replayed = TRUE;
+	results = item->results;
+	item->results = NULL;
+
+	time_ms = (g_get_monotonic_time () - item->attached) / 1000;
+	pk_transaction_replay (item->transaction, results, time_ms);
+	g_object_unref (results);
+	return FALSE;
+}
+
+/**
+ * pk_transaction_list_share_results:
+ *
+ * Hands the results of a finished item to everything waiting for them.
+ **/
+static void
+pk_transaction_list_share_results (PkTransactionList *tlist, PkTransactionItem *item)
+{
+	guint i;
+	PkExitEnum exit_enum;
+	PkResults *results;
+	PkTransactionItem *follower;
+
+	if (item->followers->len == 0)
+		goto out;
+
+	/* not worth sharing, so let each one try by itself */
+	results = pk_transaction_get_results (item->transaction);
+	exit_enum = pk_results_get_exit_code (results);
+	if (exit_enum == PK_EXIT_ENUM_UNKNOWN ||
+	    exit_enum == PK_EXIT_ENUM_CANCELLED ||
+	    exit_enum == PK_EXIT_ENUM_CANCELLED_PRIORITY)
+		goto out;
+
+	/* replay from idle, so that we don't have a deep out-of-order callchain */
+	for (i = 0; i < item->followers->len; i++) {
+		follower = g_ptr_array_index (item->followers, i);
+		follower->leader = NULL;
+		follower->results = g_object_ref (results);
+		follower->idle_id = g_idle_add ((GSourceFunc) pk_transaction_list_replay_idle_cb, follower);
+		g_source_set_name_by_id (follower->idle_id, "[PkTransactionList] replay");
+	}
+	g_debug ("%s shared its results with %i transactions",
+		 item->tid, item->followers->len);
+	g_ptr_array_set_size (item->followers, 0);
+out:
+	pk_transaction_list_detach (tlist, item);
+}
+
+/**
+ * pk_transaction_list_schedule:
+ *
+ * Runs everything that is allowed to run now. Readers are started as soon
+ * as they are ready, also next to a running writer, as the lock classes of
+ * the backend keep the jobs that read the package database apart from the
+ * ones that change it. Only one writer can run at a time; interactive
+ * writers go first unless the oldest background writer has been waiting
+ * for too long.
+ **/
+static void
+pk_transaction_list_schedule (PkTransactionList *tlist)
+{
+	GQueue *ready = tlist->priv->ready;
+	PkTransactionItem *background;
+	PkTransactionItem *item;
+	gint64 waited;
+
+	/* readers never conflict with each other */
+	while ((item = g_queue_peek_head (&ready[PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_READER])) != NULL)
+		pk_transaction_list_run_item (tlist, item);
+	while ((item = g_queue_peek_head (&ready[PK_TRANSACTION_LIST_QUEUE_BACKGROUND_READER])) != NULL)
+		pk_transaction_list_run_item (tlist, item);
+
+	/* writer slot already taken */
+	if (tlist->priv->writers_running > 0)
+		return;
+
+	item = g_queue_peek_head (&ready[PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_WRITER]);
+	background = g_queue_peek_head (&ready[PK_TRANSACTION_LIST_QUEUE_BACKGROUND_WRITER]);
+	if (background != NULL) {
+		waited = g_get_monotonic_time () - background->queued;
+		if (item == NULL) {
+			item = background;
+		} else if (waited > PK_TRANSACTION_LIST_STARVATION_TIMEOUT * G_USEC_PER_SEC) {
+			g_debug ("background transaction %s waited %" G_GINT64_FORMAT "ms, running before %s",
+				 background->tid, waited / 1000, item->tid);
+			item = background;
+		}
+	}
+	if (item == NULL)
+		return;
+	g_debug ("running writer %s", item->tid);
+	pk_transaction_list_run_item (tlist, item);
+}
+
 /**
  * pk_transaction_list_get_active_transactions:
  *
@@ -399,6 +874,10 @@ pk_transaction_list_get_exclusive_running (PkTransactionList *tlist)
 	for (i = 0; i < array->len; i++) {
 		item = (PkTransactionItem *) g_ptr_array_index (array, i);
 
+		/* only waiting for the results of another transaction */
+		if (item->leader != NULL || item->results != NULL)
+			continue;
+
 		/* check if a transaction is running in exclusive */
 		if (pk_transaction_is_exclusive (item->transaction)) {
 			/* should never be more that one, but we count them for sanity checks */
@@ -443,61 +922,6 @@ out:
 	return ret;
 }
 
-/**
- * pk_transaction_list_get_next_item:
- **/
-static PkTransactionItem *
-pk_transaction_list_get_next_item (PkTransactionList *tlist)
-{
-	PkTransactionItem *item = NULL;
-	GPtrArray *array;
-	guint i;
-	PkTransactionState state;
-	gboolean exclusive_running;
-
-	array = tlist->priv->array;
-
-	/* check for running exclusive transaction */
-	exclusive_running = pk_transaction_list_get_exclusive_running (tlist) > 0;
-
-	/* first try the waiting non-background transactions */
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-		state = pk_transaction_get_state (item->transaction);
-
-		if ((state == PK_TRANSACTION_STATE_READY) && (!item->background)) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
-	}
-
-	/* then try the other waiting transactions (background tasks) */
-	for (i = 0; i < array->len; i++) {
-		item = (PkTransactionItem *) g_ptr_array_index (array, i);
-		state = pk_transaction_get_state (item->transaction);
-
-		if (state == PK_TRANSACTION_STATE_READY) {
-			/* check if we can run the transaction now or if we need to wait for lock release */
-			if (pk_transaction_is_exclusive (item->transaction)) {
-				if (!exclusive_running)
-					goto out;
-			} else {
-				goto out;
-			}
-		}
-	}
-
-	/* nothing to run */
-	item = NULL;
-out:
-	return item;
-}
-
 /**
  * pk_transaction_list_transaction_finished_cb:
  **/
@@ -525,6 +949,20 @@ pk_transaction_list_transaction_finished_cb (PkTransaction *transaction,
 		return;
 	}
 
+	/* not waiting or running as a writer anymore */
+	pk_transaction_list_dequeue (tlist, item);
+	pk_transaction_list_release_slot (tlist, item);
+
+	/* cancelled before it was started or got the shared results */
+	if (item->idle_id != 0) {
+		g_source_remove (item->idle_id);
+		item->idle_id = 0;
+	}
+	if (item->results != NULL) {
+		g_object_unref (item->results);
+		item->results = NULL;
+	}
+
 	if (pk_transaction_is_finished_with_lock_required (item->transaction)) {
 		pk_transaction_reset_after_lock_error (item->transaction);
 
@@ -545,7 +983,20 @@ pk_transaction_list_transaction_finished_cb (PkTransaction *transaction,
 			pk_backend_job_finished (job);
 			return;
 		}
+
+		/* wait for the writer slot this time, keeping anything that
+		 * is waiting for our results */
+		pk_transaction_make_exclusive (item->transaction);
+		pk_transaction_list_enqueue (tlist, item);
 	} else {
+		/* anything waiting for the same results can have ours */
+		pk_transaction_list_cache_results (tlist, item);
+		pk_transaction_list_share_results (tlist, item);
+
+		/* the package database may have changed */
+		if (!pk_transaction_list_role_is_read_only (pk_transaction_get_role (item->transaction)))
+			pk_transaction_list_invalidate_cache (tlist);
+
 		/* we've been 'used' */
 		if (item->commit_id != 0) {
 			g_source_remove (item->commit_id);
@@ -562,12 +1013,8 @@ pk_transaction_list_transaction_finished_cb (PkTransaction *transaction,
 		g_source_set_name_by_id (item->remove_id, "[PkTransactionList] remove");
 	}
 
-	/* try to run the next transaction, if possible */
-	item = pk_transaction_list_get_next_item (tlist);
-	if (item != NULL) {
-		g_debug ("running %s as previous one finished", item->tid);
-		pk_transaction_list_run_item (tlist, item);
-	}
+	/* run whatever can now be run */
+	pk_transaction_list_schedule (tlist);
 
 	/* we have changed what is running */
 	g_signal_emit (tlist, signals [PK_TRANSACTION_LIST_CHANGED], 0);
@@ -638,6 +1085,9 @@ pk_transaction_list_create (PkTransactionList *tlist,
 	item = g_new0 (PkTransactionItem, 1);
 	item->list = g_object_ref (tlist);
 	item->tid = g_strdup (tid);
+	item->queue = PK_TRANSACTION_LIST_QUEUE_LAST;
+	item->link.data = item;
+	item->followers = g_ptr_array_new ();
 	item->transaction = pk_transaction_new (tlist->priv->conf,
 						tlist->priv->introspection);
 	item->finished_id =
@@ -785,6 +1235,8 @@ pk_transaction_list_cancel_background (PkTransactionList *tlist)
 			continue;
 		if (!item->background)
 			continue;
+		if (item->leader != NULL || item->results != NULL)
+			continue;
 		g_debug ("cancelling running background transaction %s",
 			 item->tid);
 		pk_transaction_cancel_bg (item->transaction);
@@ -871,9 +1323,8 @@ pk_transaction_list_commit (PkTransactionList *tlist, const gchar *tid)
 	}
 
 	/* do the transaction now, if possible */
-	if (pk_transaction_is_exclusive (item->transaction) == FALSE ||
-	    pk_transaction_list_get_exclusive_running (tlist) == 0)
-		pk_transaction_list_run_item (tlist, item);
+	pk_transaction_list_enqueue (tlist, item);
+	pk_transaction_list_schedule (tlist);
 
 	return TRUE;
 }
@@ -965,6 +1416,13 @@ pk_transaction_list_get_state (PkTransactionList *tlist)
 					pk_transaction_is_exclusive (item->transaction),
 					item->background);
 	}
+	g_string_append_printf (string, "Queued readers[%u/%u] writers[%u/%u] (interactive/background), running readers[%u] writers[%u]\n",
+				g_queue_get_length (&tlist->priv->ready[PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_READER]),
+				g_queue_get_length (&tlist->priv->ready[PK_TRANSACTION_LIST_QUEUE_BACKGROUND_READER]),
+				g_queue_get_length (&tlist->priv->ready[PK_TRANSACTION_LIST_QUEUE_INTERACTIVE_WRITER]),
+				g_queue_get_length (&tlist->priv->ready[PK_TRANSACTION_LIST_QUEUE_BACKGROUND_WRITER]),
+				tlist->priv->readers_running,
+				tlist->priv->writers_running);
 
 	/* nothing running */
 	if (waiting == length)
@@ -1142,6 +1600,15 @@ pk_transaction_list_set_backend (PkTransactionList *tlist,
 	tlist->priv->backend = g_object_ref (backend);
 }
 
+/**
+ * pk_transaction_list_notify_changed_cb:
+ **/
+static void
+pk_transaction_list_notify_changed_cb (PkNotify *notify, PkTransactionList *tlist)
+{
+	pk_transaction_list_invalidate_cache (tlist);
+}
+
 /**
  * pk_transaction_list_class_init:
  * @klass: The PkTransactionListClass
@@ -1169,8 +1636,21 @@ pk_transaction_list_class_init (PkTransactionListClass *klass)
 static void
 pk_transaction_list_init (PkTransactionList *tlist)
 {
+	guint i;
+
 	tlist->priv = PK_TRANSACTION_LIST_GET_PRIVATE (tlist);
 	tlist->priv->array = g_ptr_array_new ();
+	for (i = 0; i < PK_TRANSACTION_LIST_QUEUE_LAST; i++)
+		g_queue_init (&tlist->priv->ready[i]);
+	tlist->priv->leaders = g_hash_table_new (g_str_hash, g_str_equal);
+	tlist->priv->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						    (GDestroyNotify) pk_transaction_list_cache_item_free);
+	tlist->priv->notify = pk_notify_new ();
+	tlist->priv->statistics = pk_statistics_new ();
+	g_signal_connect (tlist->priv->notify, "updates-changed",
+			  G_CALLBACK (pk_transaction_list_notify_changed_cb), tlist);
+	g_signal_connect (tlist->priv->notify, "repo-list-changed",
+			  G_CALLBACK (pk_transaction_list_notify_changed_cb), tlist);
 	tlist->priv->introspection = pk_load_introspection (PK_DBUS_INTERFACE_TRANSACTION ".xml",
 							    NULL);
 	tlist->priv->unwedge2_id = 0;
@@ -1201,6 +1681,11 @@ pk_transaction_list_finalize (GObject *object)
 
 	g_ptr_array_foreach (tlist->priv->array, (GFunc) pk_transaction_list_item_free, NULL);
 	g_ptr_array_free (tlist->priv->array, TRUE);
+	g_hash_table_unref (tlist->priv->leaders);
+	g_hash_table_unref (tlist->priv->cache);
+	g_signal_handlers_disconnect_by_data (tlist->priv->notify, tlist);
+	g_object_unref (tlist->priv->notify);
+	g_object_unref (tlist->priv->statistics);
 	g_dbus_node_info_unref (tlist->priv->introspection);
 	g_key_file_unref (tlist->priv->conf);
 	if (tlist->priv->plugins != NULL)
@@ -1224,6 +1709,13 @@ pk_transaction_list_new (GKeyFile *conf)
 	} else {
 		pk_transaction_list_object = g_object_new (PK_TYPE_TRANSACTION_LIST, NULL);
 		PK_TRANSACTION_LIST(pk_transaction_list_object)->priv->conf = g_key_file_ref (conf);
+		if (g_key_file_has_key (conf, "Daemon", "ResultCacheLifetime", NULL)) {
+			PK_TRANSACTION_LIST(pk_transaction_list_object)->priv->cache_lifetime =
+				g_key_file_get_integer (conf, "Daemon", "ResultCacheLifetime", NULL);
+		} else {
+			PK_TRANSACTION_LIST(pk_transaction_list_object)->priv->cache_lifetime =
+				PK_TRANSACTION_LIST_CACHE_LIFETIME_DEFAULT;
+		}
 		g_object_add_weak_pointer (pk_transaction_list_object, &pk_transaction_list_object);
 	}
 	return PK_TRANSACTION_LIST (pk_transaction_list_object);
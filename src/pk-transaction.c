@@ -21,6 +21,11 @@
 
 #include "config.h"
 
+/* for memfd_create() and the file sealing API */
+#if defined(HAVE_MEMFD_CREATE) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
@@ -36,10 +41,14 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <syslog.h>
+#ifdef HAVE_MEMFD_CREATE
+#include <sys/mman.h>
+#endif
 
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <packagekit-glib2/pk-common.h>
 #include <packagekit-glib2/pk-enum.h>
 #include <packagekit-glib2/pk-package-id.h>
@@ -50,6 +59,7 @@
 #include "pk-backend.h"
 #include "pk-dbus.h"
 #include "pk-notify.h"
+#include "pk-statistics.h"
 #include "pk-plugin.h"
 #include "pk-shared.h"
 #include "pk-transaction-db.h"
@@ -65,6 +75,20 @@ static gboolean pk_transaction_is_supported_content_type (PkTransaction *transac
 
 #define PK_TRANSACTION_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), PK_TYPE_TRANSACTION, PkTransactionPrivate))
 #define PK_TRANSACTION_UPDATES_CHANGED_TIMEOUT	100 /* ms */
+#define PK_TRANSACTION_PACKAGES_FLUSH_TIMEOUT	100 /* ms */
+#define PK_TRANSACTION_PACKAGES_FLUSH_SIZE	500 /* packages */
+
+/* progress properties that have changed but not yet been emitted */
+typedef enum {
+	PK_TRANSACTION_PROGRESS_PERCENTAGE		= 1 << 0,
+	PK_TRANSACTION_PROGRESS_REMAINING_TIME		= 1 << 1,
+	PK_TRANSACTION_PROGRESS_SPEED			= 1 << 2,
+	PK_TRANSACTION_PROGRESS_DOWNLOAD_SIZE_REMAINING	= 1 << 3,
+	PK_TRANSACTION_PROGRESS_ELAPSED_TIME		= 1 << 4
+} PkTransactionProgress;
+
+/* used when ProgressUpdateInterval is missing from the config file */
+#define PK_TRANSACTION_PROGRESS_INTERVAL_DEFAULT	100 /* ms */
 
 /* when the UID is invalid or not known */
 #define PK_TRANSACTION_UID_INVALID		G_MAXUINT
@@ -89,6 +113,15 @@ struct PkTransactionPrivate
 	gboolean		 exclusive;
 	PkHintEnum		 background;
 	PkHintEnum		 interactive;
+	gboolean		 supports_plural_signals;
+	gboolean		 supports_results_fd;
+	gint			 results_fd;
+	GPtrArray		*pending_packages;
+	guint			 pending_packages_id;
+	guint			 progress_interval;
+	guint			 progress_id;
+	guint			 progress_dirty;
+	GPtrArray		*pending_item_progress;
 	gchar			*locale;
 	gchar			*frontend_socket;
 	guint			 cache_age;
@@ -98,6 +131,10 @@ struct PkTransactionPrivate
 	PkBackendJob		*job;
 	GKeyFile		*conf;
 	PkNotify		*notify;
+	PkStatistics		*statistics;
+	gint64			 start_time;
+	gboolean		 has_first_result;
+	guint			 signal_count;
 	PkDbus			*dbus;
 	PolkitAuthority		*authority;
 	PolkitSubject		*subject;
@@ -310,23 +347,58 @@ out:
 }
 
 /**
- * pk_transaction_emit_property_changed:
+ * pk_transaction_emit_signal:
+ *
+ * Emits a signal on the transaction interface, counting it so we know how
+ * chatty each role is.
  **/
 static void
-pk_transaction_emit_property_changed (PkTransaction *transaction,
-				      const gchar *property_name,
-				      GVariant *property_value)
+pk_transaction_emit_signal (PkTransaction *transaction,
+			    const gchar *signal_name,
+			    GVariant *parameters)
+{
+	transaction->priv->signal_count++;
+	g_dbus_connection_emit_signal (transaction->priv->connection,
+				       NULL,
+				       transaction->priv->tid,
+				       PK_DBUS_INTERFACE_TRANSACTION,
+				       signal_name,
+				       parameters,
+				       NULL);
+}
+
+/**
+ * pk_transaction_first_result:
+ *
+ * Records how long the client waited for the first result.
+ **/
+static void
+pk_transaction_first_result (PkTransaction *transaction)
+{
+	if (transaction->priv->has_first_result)
+		return;
+	transaction->priv->has_first_result = TRUE;
+
+	/* replayed results were never run */
+	if (transaction->priv->start_time == 0)
+		return;
+	pk_statistics_add_role (transaction->priv->statistics,
+				"first-result",
+				transaction->priv->role,
+				g_get_monotonic_time () - transaction->priv->start_time);
+}
+
+/**
+ * pk_transaction_emit_properties_changed:
+ **/
+static void
+pk_transaction_emit_properties_changed (PkTransaction *transaction,
+					GVariantBuilder *builder)
 {
-	GVariantBuilder builder;
 	GVariantBuilder invalidated_builder;
 
-	/* build the dict */
 	g_variant_builder_init (&invalidated_builder, G_VARIANT_TYPE ("as"));
-	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
-	g_variant_builder_add (&builder,
-			       "{sv}",
-			       property_name,
-			       property_value);
+	transaction->priv->signal_count++;
 	g_dbus_connection_emit_signal (transaction->priv->connection,
 				       NULL,
 				       transaction->priv->tid,
@@ -334,11 +406,140 @@ pk_transaction_emit_property_changed (PkTransaction *transaction,
 				       "PropertiesChanged",
 				       g_variant_new ("(sa{sv}as)",
 				       PK_DBUS_INTERFACE_TRANSACTION,
-				       &builder,
+				       builder,
 				       &invalidated_builder),
 				       NULL);
 }
 
+/**
+ * pk_transaction_emit_property_changed:
+ **/
+static void
+pk_transaction_emit_property_changed (PkTransaction *transaction,
+				      const gchar *property_name,
+				      GVariant *property_value)
+{
+	GVariantBuilder builder;
+
+	/* build the dict */
+	g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
+	g_variant_builder_add (&builder,
+			       "{sv}",
+			       property_name,
+			       property_value);
+	pk_transaction_emit_properties_changed (transaction, &builder);
+}
+
+/**
+ * pk_transaction_item_progress_emit:
+ **/
+static void
+pk_transaction_item_progress_emit (PkTransaction *transaction,
+				   PkItemProgress *item_progress)
+{
+	g_debug ("emitting item-progress %s, %s: %u",
+		 pk_item_progress_get_package_id (item_progress),
+		 pk_status_enum_to_string (pk_item_progress_get_status (item_progress)),
+		 pk_item_progress_get_percentage (item_progress));
+	pk_transaction_emit_signal (transaction,
+				    "ItemProgress",
+				    g_variant_new ("(suu)",
+						   pk_item_progress_get_package_id (item_progress),
+						   pk_item_progress_get_status (item_progress),
+						   pk_item_progress_get_percentage (item_progress)));
+}
+
+/**
+ * pk_transaction_progress_flush:
+ *
+ * Emits the latest value of every progress property that changed since
+ * the last flush as one ::PropertiesChanged, and the latest
+ * ::ItemProgress for each package.
+ **/
+static void
+pk_transaction_progress_flush (PkTransaction *transaction)
+{
+	guint i;
+	GVariantBuilder builder;
+	PkTransactionPrivate *priv = transaction->priv;
+
+	/* cancel any pending timeout, we're doing it now */
+	if (priv->progress_id != 0) {
+		g_source_remove (priv->progress_id);
+		priv->progress_id = 0;
+	}
+
+	if (priv->progress_dirty != 0) {
+		g_variant_builder_init (&builder, G_VARIANT_TYPE_ARRAY);
+		if (priv->progress_dirty & PK_TRANSACTION_PROGRESS_PERCENTAGE) {
+			g_variant_builder_add (&builder, "{sv}", "Percentage",
+					       g_variant_new_uint32 (priv->percentage));
+		}
+		if (priv->progress_dirty & PK_TRANSACTION_PROGRESS_ELAPSED_TIME) {
+			g_variant_builder_add (&builder, "{sv}", "ElapsedTime",
+					       g_variant_new_uint32 (priv->elapsed_time));
+		}
+		if (priv->progress_dirty & PK_TRANSACTION_PROGRESS_REMAINING_TIME) {
+			g_variant_builder_add (&builder, "{sv}", "RemainingTime",
+					       g_variant_new_uint32 (priv->remaining_time));
+		}
+		if (priv->progress_dirty & PK_TRANSACTION_PROGRESS_SPEED) {
+			g_variant_builder_add (&builder, "{sv}", "Speed",
+					       g_variant_new_uint32 (priv->speed));
+		}
+		if (priv->progress_dirty & PK_TRANSACTION_PROGRESS_DOWNLOAD_SIZE_REMAINING) {
+			g_variant_builder_add (&builder, "{sv}", "DownloadSizeRemaining",
+					       g_variant_new_uint64 (priv->download_size_remaining));
+		}
+		priv->progress_dirty = 0;
+		pk_transaction_emit_properties_changed (transaction, &builder);
+	}
+
+	for (i = 0; i < priv->pending_item_progress->len; i++) {
+		pk_transaction_item_progress_emit (transaction,
+						   g_ptr_array_index (priv->pending_item_progress, i));
+	}
+	g_ptr_array_set_size (priv->pending_item_progress, 0);
+}
+
+/**
+ * pk_transaction_progress_flush_cb:
+ **/
+static gboolean
+pk_transaction_progress_flush_cb (gpointer user_data)
+{
+	PkTransaction *transaction = PK_TRANSACTION (user_data);
+	transaction->priv->progress_id = 0;
+	pk_transaction_progress_flush (transaction);
+	return FALSE;
+}
+
+/**
+ * pk_transaction_progress_queue:
+ *
+ * Schedules the progress to be emitted at the next flush, or emits it
+ * now if progress coalescing has been turned off in the config file.
+ **/
+static void
+pk_transaction_progress_queue (PkTransaction *transaction,
+			       PkTransactionProgress progress)
+{
+	PkTransactionPrivate *priv = transaction->priv;
+
+	priv->progress_dirty |= progress;
+	if (priv->progress_interval == 0) {
+		pk_transaction_progress_flush (transaction);
+		return;
+	}
+	if (priv->progress_id == 0) {
+		priv->progress_id = g_timeout_add (priv->progress_interval,
+						   pk_transaction_progress_flush_cb,
+						   transaction);
+		g_source_set_name_by_id (priv->progress_id,
+					 "[PkTransaction] progress");
+	}
+}
+
 /**
  * pk_transaction_progress_changed_emit:
  **/
@@ -356,15 +557,10 @@ pk_transaction_progress_changed_emit (PkTransaction *transaction,
 	transaction->priv->remaining_time = remaining;
 
 	/* emit */
-	pk_transaction_emit_property_changed (transaction,
-					      "Percentage",
-					      g_variant_new_uint32 (percentage));
-	pk_transaction_emit_property_changed (transaction,
-					      "ElapsedTime",
-					      g_variant_new_uint32 (elapsed));
-	pk_transaction_emit_property_changed (transaction,
-					      "RemainingTime",
-					      g_variant_new_uint32 (remaining));
+	pk_transaction_progress_queue (transaction,
+				       PK_TRANSACTION_PROGRESS_PERCENTAGE |
+				       PK_TRANSACTION_PROGRESS_ELAPSED_TIME |
+				       PK_TRANSACTION_PROGRESS_REMAINING_TIME);
 }
 
 /**
@@ -402,6 +598,9 @@ pk_transaction_status_changed_emit (PkTransaction *transaction, PkStatusEnum sta
 	if (transaction->priv->status == status)
 		return;
 
+	/* the client should see the final progress for the old status */
+	pk_transaction_progress_flush (transaction);
+
 	transaction->priv->status = status;
 
 	/* emit */
@@ -410,6 +609,208 @@ pk_transaction_status_changed_emit (PkTransaction *transaction, PkStatusEnum sta
 					      g_variant_new_uint32 (status));
 }
 
+/**
+ * pk_transaction_packages_flush:
+ *
+ * Emits all the packages queued up by clients that understand the
+ * plural ::Packages signal as one D-Bus message.
+ **/
+static void
+pk_transaction_packages_flush (PkTransaction *transaction)
+{
+	guint i;
+	GVariantBuilder builder;
+	PkTransactionPrivate *priv = transaction->priv;
+
+	/* cancel any pending timeout, we're doing it now */
+	if (priv->pending_packages_id != 0) {
+		g_source_remove (priv->pending_packages_id);
+		priv->pending_packages_id = 0;
+	}
+
+	/* nothing to do */
+	if (priv->pending_packages->len == 0)
+		return;
+
+	/* emit */
+	g_debug ("emitting packages (%u)", priv->pending_packages->len);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(uss)"));
+	for (i = 0; i < priv->pending_packages->len; i++)
+		g_variant_builder_add_value (&builder, g_ptr_array_index (priv->pending_packages, i));
+	pk_transaction_emit_signal (transaction,
+				    "Packages",
+				    g_variant_new ("(a(uss))", &builder));
+	g_ptr_array_set_size (priv->pending_packages, 0);
+}
+
+/**
+ * pk_transaction_packages_flush_cb:
+ **/
+static gboolean
+pk_transaction_packages_flush_cb (gpointer user_data)
+{
+	PkTransaction *transaction = PK_TRANSACTION (user_data);
+	transaction->priv->pending_packages_id = 0;
+	pk_transaction_packages_flush (transaction);
+	return FALSE;
+}
+
+/**
+ * pk_transaction_uses_results_fd:
+ *
+ * Return value: %TRUE if the packages and files are sent to the client in
+ * a sealed memory file when the transaction finishes, rather than as signals.
+ **/
+static gboolean
+pk_transaction_uses_results_fd (PkTransaction *transaction)
+{
+	if (!transaction->priv->supports_results_fd)
+		return FALSE;
+	return transaction->priv->role == PK_ROLE_ENUM_GET_PACKAGES ||
+	       transaction->priv->role == PK_ROLE_ENUM_GET_FILES ||
+	       transaction->priv->role == PK_ROLE_ENUM_SEARCH_FILE;
+}
+
+/**
+ * pk_transaction_results_fd_create:
+ *
+ * Serializes the packages and files as a (a(uss)a(sas)) variant into a
+ * sealed memory file that the client can map without any copying.
+ *
+ * Return value: %TRUE if the file was created
+ **/
+static gboolean
+pk_transaction_results_fd_create (PkTransaction *transaction)
+{
+	gboolean ret = FALSE;
+#ifdef HAVE_MEMFD_CREATE
+	const gchar *data;
+	const gchar *id;
+	const gchar *summary;
+	gchar **files;
+	gchar *package_id;
+	gint fd;
+	gsize size;
+	gsize written = 0;
+	gssize wrote;
+	guint i;
+	GPtrArray *array;
+	GVariant *value;
+	GVariantBuilder builder;
+	PkFiles *item_files;
+	PkInfoEnum info;
+	PkResultsPackageIter iter;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("(a(uss)a(sas))"));
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(uss)"));
+	pk_results_package_iter_init (&iter, transaction->priv->results);
+	while (pk_results_package_iter_next (&iter, &info, &id, &summary)) {
+		g_variant_builder_add (&builder, "(uss)",
+				       info, id,
+				       summary != NULL ? summary : "");
+	}
+	pk_results_package_iter_clear (&iter);
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(sas)"));
+	array = pk_results_get_files_array (transaction->priv->results);
+	for (i = 0; i < array->len; i++) {
+		item_files = g_ptr_array_index (array, i);
+		g_object_get (item_files,
+			      "package-id", &package_id,
+			      "files", &files,
+			      NULL);
+		g_variant_builder_add (&builder, "(s^as)",
+				       package_id != NULL ? package_id : "",
+				       files);
+		g_free (package_id);
+		g_strfreev (files);
+	}
+	g_ptr_array_unref (array);
+	g_variant_builder_close (&builder);
+	value = g_variant_ref_sink (g_variant_builder_end (&builder));
+
+	/* write it all to an anonymous file */
+	fd = memfd_create ("packagekit-results", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		g_warning ("failed to create results file: %s", strerror (errno));
+		goto out;
+	}
+	data = g_variant_get_data (value);
+	size = g_variant_get_size (value);
+	while (written < size) {
+		wrote = write (fd, data + written, size - written);
+		if (wrote < 0 && errno == EINTR)
+			continue;
+		if (wrote < 0) {
+			g_warning ("failed to write results file: %s", strerror (errno));
+			close (fd);
+			goto out;
+		}
+		written += wrote;
+	}
+
+	/* the client can trust it will never change under it */
+	if (fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+				    F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+		g_warning ("failed to seal results file: %s", strerror (errno));
+		close (fd);
+		goto out;
+	}
+	g_debug ("wrote %" G_GSIZE_FORMAT " bytes of results", size);
+	transaction->priv->results_fd = fd;
+	ret = TRUE;
+out:
+	g_variant_unref (value);
+#endif
+	return ret;
+}
+
+/**
+ * pk_transaction_results_fd_fallback:
+ *
+ * Sends the results as signals when the results file could not be created,
+ * as the client would otherwise never get them.
+ **/
+static void
+pk_transaction_results_fd_fallback (PkTransaction *transaction)
+{
+	const gchar *id;
+	const gchar *summary;
+	gchar **files;
+	gchar *package_id;
+	guint i;
+	GPtrArray *array;
+	PkFiles *item_files;
+	PkInfoEnum info;
+	PkResultsPackageIter iter;
+
+	transaction->priv->supports_results_fd = FALSE;
+	pk_results_package_iter_init (&iter, transaction->priv->results);
+	while (pk_results_package_iter_next (&iter, &info, &id, &summary)) {
+		pk_transaction_emit_signal (transaction,
+					    "Package",
+					    g_variant_new ("(uss)", info, id,
+							   summary != NULL ? summary : ""));
+	}
+	pk_results_package_iter_clear (&iter);
+	array = pk_results_get_files_array (transaction->priv->results);
+	for (i = 0; i < array->len; i++) {
+		item_files = g_ptr_array_index (array, i);
+		g_object_get (item_files,
+			      "package-id", &package_id,
+			      "files", &files,
+			      NULL);
+		pk_transaction_emit_signal (transaction,
+					    "Files",
+					    g_variant_new ("(s^as)",
+							   package_id != NULL ? package_id : "",
+							   files));
+		g_free (package_id);
+		g_strfreev (files);
+	}
+	g_ptr_array_unref (array);
+}
+
 /**
  * pk_transaction_finished_emit:
  **/
@@ -418,18 +819,29 @@ pk_transaction_finished_emit (PkTransaction *transaction,
 			      PkExitEnum exit_enum,
 			      guint time_ms)
 {
+	/* the client has to get all the packages and progress before ::Finished */
+	pk_transaction_packages_flush (transaction);
+	pk_transaction_progress_flush (transaction);
+	if (transaction->priv->results_fd < 0 &&
+	    pk_transaction_uses_results_fd (transaction)) {
+		/* the client only asks for the file after a success */
+		if (exit_enum != PK_EXIT_ENUM_SUCCESS ||
+		    !pk_transaction_results_fd_create (transaction))
+			pk_transaction_results_fd_fallback (transaction);
+	}
+
 	g_debug ("emitting finished '%s', %i",
 		 pk_exit_enum_to_string (exit_enum),
 		 time_ms);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "Finished",
-				       g_variant_new ("(uu)",
-						      exit_enum,
-						      time_ms),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "Finished",
+				    g_variant_new ("(uu)",
+						   exit_enum,
+						   time_ms));
+	pk_statistics_add_role (transaction->priv->statistics,
+				"signals",
+				transaction->priv->role,
+				transaction->priv->signal_count);
 
 	/* For the transaction list */
 	g_signal_emit (transaction, signals[SIGNAL_FINISHED], 0);
@@ -446,15 +858,11 @@ pk_transaction_error_code_emit (PkTransaction *transaction,
 	g_debug ("emitting error-code %s, '%s'",
 		 pk_error_enum_to_string (error_enum),
 		 details);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "ErrorCode",
-				       g_variant_new ("(us)",
-						      error_enum,
-						      details),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "ErrorCode",
+				    g_variant_new ("(us)",
+						   error_enum,
+						   details));
 }
 
 /**
@@ -512,6 +920,7 @@ pk_transaction_details_cb (PkBackendJob *job,
 
 	/* add to results */
 	pk_results_add_details (transaction->priv->results, item);
+	pk_transaction_first_result (transaction);
 
 	/* get data */
 	g_object_get (item,
@@ -546,13 +955,9 @@ pk_transaction_details_cb (PkBackendJob *job,
 	g_variant_builder_add (&builder, "{sv}", "size",
 			       g_variant_new_uint64 (size));
 
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "Details",
-				       g_variant_new ("(a{sv})", &builder),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "Details",
+				    g_variant_new ("(a{sv})", &builder));
 }
 
 /**
@@ -630,18 +1035,20 @@ pk_transaction_files_cb (PkBackendJob *job,
 
 	/* add to results */
 	pk_results_add_files (transaction->priv->results, item);
+	pk_transaction_first_result (transaction);
+
+	/* the client gets these from the results file */
+	if (pk_transaction_uses_results_fd (transaction))
+		goto out;
 
 	/* emit */
 	g_debug ("emitting files %s", package_id);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "Files",
-				       g_variant_new ("(s^as)",
-						      package_id != NULL ? package_id : "",
-						      files),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "Files",
+				    g_variant_new ("(s^as)",
+						   package_id != NULL ? package_id : "",
+						   files));
+out:
 	g_free (package_id);
 	g_strfreev (files);
 }
@@ -665,6 +1072,7 @@ pk_transaction_category_cb (PkBackendJob *job,
 
 	/* add to results */
 	pk_results_add_category (transaction->priv->results, item);
+	pk_transaction_first_result (transaction);
 
 	/* get data */
 	g_object_get (item,
@@ -677,18 +1085,14 @@ pk_transaction_category_cb (PkBackendJob *job,
 
 	/* emit */
 	g_debug ("emitting category %s, %s, %s, %s, %s ", parent_id, cat_id, name, summary, icon);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "Category",
-				       g_variant_new ("(sssss)",
-						      parent_id != NULL ? parent_id : "",
-						      cat_id,
-						      name,
-						      summary,
-						      icon != NULL ? icon : ""),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "Category",
+				    g_variant_new ("(sssss)",
+						   parent_id != NULL ? parent_id : "",
+						   cat_id,
+						   name,
+						   summary,
+						   icon != NULL ? icon : ""));
 	g_free (parent_id);
 	g_free (cat_id);
 	g_free (name);
@@ -704,24 +1108,32 @@ pk_transaction_item_progress_cb (PkBackendJob *job,
 				 PkItemProgress *item_progress,
 				 PkTransaction *transaction)
 {
+	guint i;
+	PkItemProgress *item_tmp;
+	GPtrArray *pending;
+
 	g_return_if_fail (PK_IS_TRANSACTION (transaction));
 	g_return_if_fail (transaction->priv->tid != NULL);
 
-	/* emit */
-	g_debug ("emitting item-progress %s, %s: %u",
-		 pk_item_progress_get_package_id (item_progress),
-		 pk_status_enum_to_string (pk_item_progress_get_status (item_progress)),
-		 pk_item_progress_get_percentage (item_progress));
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "ItemProgress",
-				       g_variant_new ("(suu)",
-						      pk_item_progress_get_package_id (item_progress),
-						      pk_item_progress_get_status (item_progress),
-						      pk_item_progress_get_percentage (item_progress)),
-				       NULL);
+	/* not coalescing */
+	if (transaction->priv->progress_interval == 0) {
+		pk_transaction_item_progress_emit (transaction, item_progress);
+		return;
+	}
+
+	/* only keep the latest progress for each package */
+	pending = transaction->priv->pending_item_progress;
+	for (i = 0; i < pending->len; i++) {
+		item_tmp = g_ptr_array_index (pending, i);
+		if (g_strcmp0 (pk_item_progress_get_package_id (item_tmp),
+			       pk_item_progress_get_package_id (item_progress)) == 0) {
+			g_object_unref (item_tmp);
+			pending->pdata[i] = g_object_ref (item_progress);
+			return;
+		}
+	}
+	g_ptr_array_add (pending, g_object_ref (item_progress));
+	pk_transaction_progress_queue (transaction, 0);
 }
 
 /**
@@ -741,6 +1153,7 @@ pk_transaction_distro_upgrade_cb (PkBackendJob *job,
 
 	/* add to results */
 	pk_results_add_distro_upgrade (transaction->priv->results, item);
+	pk_transaction_first_result (transaction);
 
 	/* get data */
 	g_object_get (item,
@@ -753,16 +1166,12 @@ pk_transaction_distro_upgrade_cb (PkBackendJob *job,
 	g_debug ("emitting distro-upgrade %s, %s, %s",
 		 pk_distro_upgrade_enum_to_string (state),
 		 name, summary);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "DistroUpgrade",
-				       g_variant_new ("(uss)",
-						      state,
-						      name,
-						      summary != NULL ? summary : ""),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "DistroUpgrade",
+				    g_variant_new ("(uss)",
+						   state,
+						   name,
+						   summary != NULL ? summary : ""));
 
 	g_free (name);
 	g_free (summary);
@@ -910,6 +1319,8 @@ pk_transaction_plugin_phase (PkTransaction *transaction,
 	const gchar *function = NULL;
 	gboolean ran_one = FALSE;
 	gboolean ret;
+	gchar *metric;
+	gint64 start;
 	guint i;
 	PkBackendJob *job;
 	PkExitEnum exit_code;
@@ -939,6 +1350,7 @@ pk_transaction_plugin_phase (PkTransaction *transaction,
 	}
 
 	g_assert (function != NULL);
+	start = g_get_monotonic_time ();
 	if (transaction->priv->plugins == NULL)
 		goto out;
 
@@ -987,8 +1399,14 @@ out:
 		pk_transaction_signals_reset (transaction,
 					    transaction->priv->job);
 	}
-	if (!ran_one)
+	if (!ran_one) {
 		g_debug ("no plugins provided %s", function);
+		return;
+	}
+	metric = g_strdup_printf ("plugin-phase:%s", function);
+	pk_statistics_add (transaction->priv->statistics, metric,
+			   g_get_monotonic_time () - start);
+	g_free (metric);
 }
 
 /**
@@ -1217,6 +1635,14 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 	/* find the length of time we have been running */
 	time_ms = pk_transaction_get_runtime (transaction);
 	g_debug ("backend was running for %i ms", time_ms);
+	pk_statistics_add_role (transaction->priv->statistics, "runtime",
+				transaction->priv->role, (guint64) time_ms * 1000);
+	pk_statistics_add_role (transaction->priv->statistics, "job-events",
+				transaction->priv->role,
+				pk_backend_job_get_dispatch_count (job));
+	pk_statistics_add_role (transaction->priv->statistics, "job-wakeups",
+				transaction->priv->role,
+				pk_backend_job_get_dispatch_wakeups (job));
 
 	/* add to the database if we are going to log it */
 	if (transaction->priv->role == PK_ROLE_ENUM_UPDATE_PACKAGES ||
@@ -1302,6 +1728,59 @@ pk_transaction_finished_cb (PkBackendJob *job, PkExitEnum exit_enum, PkTransacti
 	pk_transaction_finished_emit (transaction, exit_enum, time_ms);
 }
 
+/**
+ * pk_transaction_package_emit:
+ *
+ * Sends a package to the client, batched up with other packages if the
+ * client understands ::Packages.
+ **/
+static void
+pk_transaction_package_emit (PkTransaction *transaction,
+			     PkInfoEnum info,
+			     const gchar *package_id,
+			     const gchar *summary)
+{
+	g_free (transaction->priv->last_package_id);
+	transaction->priv->last_package_id = g_strdup (package_id);
+
+	/* the client gets these from the results file */
+	if (pk_transaction_uses_results_fd (transaction))
+		return;
+
+	/* the client understands ::Packages, so batch them up */
+	if (transaction->priv->supports_plural_signals) {
+		g_ptr_array_add (transaction->priv->pending_packages,
+				 g_variant_ref_sink (g_variant_new ("(uss)",
+								    info,
+								    package_id,
+								    summary != NULL ? summary : "")));
+		if (transaction->priv->pending_packages->len >= PK_TRANSACTION_PACKAGES_FLUSH_SIZE) {
+			pk_transaction_packages_flush (transaction);
+		} else if (transaction->priv->pending_packages_id == 0) {
+			transaction->priv->pending_packages_id =
+				g_timeout_add (PK_TRANSACTION_PACKAGES_FLUSH_TIMEOUT,
+					       pk_transaction_packages_flush_cb,
+					       transaction);
+			g_source_set_name_by_id (transaction->priv->pending_packages_id,
+						 "[PkTransaction] packages");
+		}
+		return;
+	}
+
+	if (transaction->priv->role != PK_ROLE_ENUM_GET_PACKAGES) {
+		g_debug ("emit package %s, %s, %s",
+			 pk_info_enum_to_string (info),
+			 package_id,
+			 summary);
+	}
+	pk_transaction_emit_signal (transaction,
+				    "Package",
+				    g_variant_new ("(uss)",
+						   info,
+						   package_id,
+						   summary ? summary : ""));
+}
+
 /**
  * pk_transaction_package_cb:
  **/
@@ -1359,30 +1838,16 @@ pk_transaction_package_cb (PkBackend *backend,
 	}
 
 	/* add to results even if we already got a result */
-	if (info != PK_INFO_ENUM_FINISHED)
-		pk_results_add_package (transaction->priv->results, item);
-
-	/* emit */
 	package_id = pk_package_get_id (item);
-	g_free (transaction->priv->last_package_id);
-	transaction->priv->last_package_id = g_strdup (package_id);
 	summary = pk_package_get_summary (item);
-	if (transaction->priv->role != PK_ROLE_ENUM_GET_PACKAGES) {
-		g_debug ("emit package %s, %s, %s",
-			 pk_info_enum_to_string (info),
-			 package_id,
-			 summary);
-	}
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "Package",
-				       g_variant_new ("(uss)",
-						      info,
-						      package_id,
-						      summary ? summary : ""),
-				       NULL);
+	if (info != PK_INFO_ENUM_FINISHED) {
+		pk_results_add_package_data (transaction->priv->results,
+					     info,
+					     package_id,
+					     summary);
+		pk_transaction_first_result (transaction);
+	}
+	pk_transaction_package_emit (transaction, info, package_id, summary);
 }
 
 /**
@@ -1402,6 +1867,7 @@ pk_transaction_repo_detail_cb (PkBackend *backend,
 
 	/* add to results */
 	pk_results_add_repo_detail (transaction->priv->results, item);
+	pk_transaction_first_result (transaction);
 
 	/* get data */
 	g_object_get (item,
@@ -1412,16 +1878,12 @@ pk_transaction_repo_detail_cb (PkBackend *backend,
 
 	/* emit */
 	g_debug ("emitting repo-detail %s, %s, %i", repo_id, description, enabled);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "RepoDetail",
-				       g_variant_new ("(ssb)",
-						      repo_id,
-						      description != NULL ? description : "",
-						      enabled),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "RepoDetail",
+				    g_variant_new ("(ssb)",
+						   repo_id,
+						   description != NULL ? description : "",
+						   enabled));
 	g_free (repo_id);
 	g_free (description);
 }
@@ -1466,21 +1928,17 @@ pk_transaction_repo_signature_required_cb (PkBackend *backend,
 		 package_id, repository_name, key_url, key_userid, key_id,
 		 key_fingerprint, key_timestamp,
 		 pk_sig_type_enum_to_string (type));
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "RepoSignatureRequired",
-				       g_variant_new ("(sssssssu)",
-						      package_id,
-						      repository_name,
-						      key_url != NULL ? key_url : "",
-						      key_userid != NULL ? key_userid : "",
-						      key_id != NULL ? key_id : "",
-						      key_fingerprint != NULL ? key_fingerprint : "",
-						      key_timestamp != NULL ? key_timestamp : "",
-						      type),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "RepoSignatureRequired",
+				    g_variant_new ("(sssssssu)",
+						   package_id,
+						   repository_name,
+						   key_url != NULL ? key_url : "",
+						   key_userid != NULL ? key_userid : "",
+						   key_id != NULL ? key_id : "",
+						   key_fingerprint != NULL ? key_fingerprint : "",
+						   key_timestamp != NULL ? key_timestamp : "",
+						   type));
 
 	/* we should mark this transaction so that we finish with a special code */
 	transaction->priv->emit_signature_required = TRUE;
@@ -1524,17 +1982,13 @@ pk_transaction_eula_required_cb (PkBackend *backend,
 	/* emit */
 	g_debug ("emitting eula-required %s, %s, %s, %s",
 		   eula_id, package_id, vendor_name, license_agreement);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "EulaRequired",
-				       g_variant_new ("(ssss)",
-						      eula_id,
-						      package_id,
-						      vendor_name != NULL ? vendor_name : "",
-						      license_agreement != NULL ? license_agreement : ""),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "EulaRequired",
+				    g_variant_new ("(ssss)",
+						   eula_id,
+						   package_id,
+						   vendor_name != NULL ? vendor_name : "",
+						   license_agreement != NULL ? license_agreement : ""));
 
 	/* we should mark this transaction so that we finish with a special code */
 	transaction->priv->emit_eula_required = TRUE;
@@ -1575,16 +2029,12 @@ pk_transaction_media_change_required_cb (PkBackend *backend,
 		 pk_media_type_enum_to_string (media_type),
 		 media_id,
 		 media_text);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "MediaChangeRequired",
-				       g_variant_new ("(uss)",
-						      media_type,
-						      media_id,
-						      media_text != NULL ? media_text : ""),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "MediaChangeRequired",
+				    g_variant_new ("(uss)",
+						   media_type,
+						   media_id,
+						   media_text != NULL ? media_text : ""));
 
 	/* we should mark this transaction so that we finish with a special code */
 	transaction->priv->emit_media_change_required = TRUE;
@@ -1649,15 +2099,11 @@ pk_transaction_require_restart_cb (PkBackend *backend,
 	g_debug ("emitting require-restart %s, '%s'",
 		 pk_restart_enum_to_string (restart),
 		 package_id);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "RequireRestart",
-				       g_variant_new ("(us)",
-						      restart,
-						      package_id),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "RequireRestart",
+				    g_variant_new ("(us)",
+						   restart,
+						   package_id));
 	g_free (package_id);
 }
 
@@ -1711,6 +2157,7 @@ pk_transaction_update_detail_cb (PkBackend *backend,
 
 	/* add to results */
 	pk_results_add_update_detail (transaction->priv->results, item);
+	pk_transaction_first_result (transaction);
 
 	/* emit */
 	package_id = pk_update_detail_get_package_id (item);
@@ -1724,25 +2171,21 @@ pk_transaction_update_detail_cb (PkBackend *backend,
 	issued = pk_update_detail_get_issued (item);
 	updated = pk_update_detail_get_updated (item);
 	g_debug ("emitting update-detail for %s", package_id);
-	g_dbus_connection_emit_signal (transaction->priv->connection,
-				       NULL,
-				       transaction->priv->tid,
-				       PK_DBUS_INTERFACE_TRANSACTION,
-				       "UpdateDetail",
-				       g_variant_new ("(s^as^as^as^as^asussuss)",
-						      package_id,
-						      updates != NULL ? updates : empty,
-						      obsoletes != NULL ? obsoletes : empty,
-						      vendor_urls != NULL ? vendor_urls : empty,
-						      bugzilla_urls != NULL ? bugzilla_urls : empty,
-						      cve_urls != NULL ? cve_urls : empty,
-						      pk_update_detail_get_restart (item),
-						      update_text != NULL ? update_text : "",
-						      changelog != NULL ? changelog : "",
-						      pk_update_detail_get_state (item),
-						      issued != NULL ? issued : "",
-						      updated != NULL ? updated : ""),
-				       NULL);
+	pk_transaction_emit_signal (transaction,
+				    "UpdateDetail",
+				    g_variant_new ("(s^as^as^as^as^asussuss)",
+						   package_id,
+						   updates != NULL ? updates : empty,
+						   obsoletes != NULL ? obsoletes : empty,
+						   vendor_urls != NULL ? vendor_urls : empty,
+						   bugzilla_urls != NULL ? bugzilla_urls : empty,
+						   cve_urls != NULL ? cve_urls : empty,
+						   pk_update_detail_get_restart (item),
+						   update_text != NULL ? update_text : "",
+						   changelog != NULL ? changelog : "",
+						   pk_update_detail_get_state (item),
+						   issued != NULL ? issued : "",
+						   updated != NULL ? updated : ""));
 }
 
 /**
@@ -1821,11 +2264,9 @@ pk_transaction_speed_cb (PkBackendJob *job,
 			 guint speed,
 			 PkTransaction *transaction)
 {
-	/* emit */
 	transaction->priv->speed = speed;
-	pk_transaction_emit_property_changed (transaction,
-					      "Speed",
-					      g_variant_new_uint32 (speed));
+	pk_transaction_progress_queue (transaction,
+				       PK_TRANSACTION_PROGRESS_SPEED);
 }
 
 /**
@@ -1836,11 +2277,9 @@ pk_transaction_download_size_remaining_cb (PkBackendJob *job,
 					   guint64 *download_size_remaining,
 					   PkTransaction *transaction)
 {
-	/* emit */
 	transaction->priv->download_size_remaining = *download_size_remaining;
-	pk_transaction_emit_property_changed (transaction,
-					      "DownloadSizeRemaining",
-					      g_variant_new_uint64 (*download_size_remaining));
+	pk_transaction_progress_queue (transaction,
+				       PK_TRANSACTION_PROGRESS_DOWNLOAD_SIZE_REMAINING);
 }
 
 /**
@@ -1851,11 +2290,9 @@ pk_transaction_percentage_cb (PkBackendJob *job,
 			      guint percentage,
 			      PkTransaction *transaction)
 {
-	/* emit */
 	transaction->priv->percentage = percentage;
-	pk_transaction_emit_property_changed (transaction,
-					      "Percentage",
-					      g_variant_new_uint32 (percentage));
+	pk_transaction_progress_queue (transaction,
+				       PK_TRANSACTION_PROGRESS_PERCENTAGE);
 }
 
 /**
@@ -1866,11 +2303,9 @@ pk_transaction_remaining_cb (PkBackendJob *job,
 			     guint remaining_time,
 			     PkTransaction *transaction)
 {
-	/* emit */
 	transaction->priv->remaining_time = remaining_time;
-	pk_transaction_emit_property_changed (transaction,
-					      "RemainingTime",
-					      g_variant_new_uint32 (remaining_time));
+	pk_transaction_progress_queue (transaction,
+				       PK_TRANSACTION_PROGRESS_REMAINING_TIME);
 }
 
 /**
@@ -2010,6 +2445,7 @@ pk_transaction_run (PkTransaction *transaction)
 		pk_backend_job_set_cache_age (priv->job, priv->cache_age);
 
 	/* we are no longer waiting, we are setting up */
+	priv->start_time = g_get_monotonic_time ();
 	pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_SETUP);
 
 	/* set proxy */
@@ -2272,6 +2708,158 @@ out:
 	return ret;
 }
 
+/**
+ * pk_transaction_get_shared_key:
+ *
+ * Transactions that only query the package database and have the same key
+ * produce the same results, so one backend job can be shared between them.
+ *
+ * Return value: a key describing the request, or %NULL if the transaction
+ * cannot share its results with anything else. Free with g_free().
+ */
+gchar *
+pk_transaction_get_shared_key (PkTransaction *transaction)
+{
+	gchar *tmp;
+	GString *string;
+	PkTransactionPrivate *priv = transaction->priv;
+
+	g_return_val_if_fail (PK_IS_TRANSACTION (transaction), NULL);
+
+	switch (priv->role) {
+	case PK_ROLE_ENUM_DEPENDS_ON:
+	case PK_ROLE_ENUM_GET_CATEGORIES:
+	case PK_ROLE_ENUM_GET_DETAILS:
+	case PK_ROLE_ENUM_GET_DISTRO_UPGRADES:
+	case PK_ROLE_ENUM_GET_FILES:
+	case PK_ROLE_ENUM_GET_PACKAGES:
+	case PK_ROLE_ENUM_GET_REPO_LIST:
+	case PK_ROLE_ENUM_GET_UPDATE_DETAIL:
+	case PK_ROLE_ENUM_GET_UPDATES:
+	case PK_ROLE_ENUM_REQUIRED_BY:
+	case PK_ROLE_ENUM_RESOLVE:
+	case PK_ROLE_ENUM_SEARCH_DETAILS:
+	case PK_ROLE_ENUM_SEARCH_FILE:
+	case PK_ROLE_ENUM_SEARCH_GROUP:
+	case PK_ROLE_ENUM_SEARCH_NAME:
+	case PK_ROLE_ENUM_WHAT_PROVIDES:
+		break;
+	default:
+		return NULL;
+	}
+
+	/* everything the backend gets passed for these roles */
+	string = g_string_new (pk_role_enum_to_string (priv->role));
+	g_string_append_printf (string, "|%" G_GUINT64_FORMAT "|%" G_GUINT64_FORMAT "|%i|%u|%s",
+				priv->cached_filters,
+				priv->cached_transaction_flags,
+				priv->cached_force,
+				priv->cache_age,
+				priv->locale != NULL ? priv->locale : "C");
+	if (priv->cached_package_ids != NULL) {
+		tmp = g_strjoinv ("\t", priv->cached_package_ids);
+		g_string_append_printf (string, "|%s", tmp);
+		g_free (tmp);
+	}
+	if (priv->cached_values != NULL) {
+		tmp = g_strjoinv ("\t", priv->cached_values);
+		g_string_append_printf (string, "|%s", tmp);
+		g_free (tmp);
+	}
+	return g_string_free (string, FALSE);
+}
+
+/**
+ * pk_transaction_replay:
+ * @results: the results of an identical transaction
+ * @time_ms: how long we were waiting for the results
+ *
+ * Finishes the transaction without ever running it, by emitting the
+ * results of another transaction with the same shared key.
+ */
+void
+pk_transaction_replay (PkTransaction *transaction,
+		       PkResults *results,
+		       guint time_ms)
+{
+	const gchar *package_id;
+	const gchar *summary;
+	guint i;
+	GPtrArray *array;
+	PkError *error_code;
+	PkExitEnum exit_enum;
+	PkInfoEnum info;
+	PkResultsPackageIter iter;
+	PkTransactionPrivate *priv = transaction->priv;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (PK_IS_RESULTS (results));
+	g_return_if_fail (priv->job == NULL);
+
+	/* have we already been marked as finished? */
+	if (priv->finished) {
+		g_warning ("Already finished");
+		return;
+	}
+
+	g_debug ("replaying results onto %s", priv->tid);
+	pk_results_package_iter_init (&iter, results);
+	while (pk_results_package_iter_next (&iter, &info, &package_id, &summary)) {
+		pk_results_add_package_data (priv->results, info, package_id, summary);
+		pk_transaction_first_result (transaction);
+		pk_transaction_package_emit (transaction, info, package_id, summary);
+	}
+	pk_results_package_iter_clear (&iter);
+	array = pk_results_get_details_array (results);
+	for (i = 0; i < array->len; i++)
+		pk_transaction_details_cb (NULL, g_ptr_array_index (array, i), transaction);
+	g_ptr_array_unref (array);
+	array = pk_results_get_update_detail_array (results);
+	for (i = 0; i < array->len; i++)
+		pk_transaction_update_detail_cb (NULL, g_ptr_array_index (array, i), transaction);
+	g_ptr_array_unref (array);
+	array = pk_results_get_files_array (results);
+	for (i = 0; i < array->len; i++)
+		pk_transaction_files_cb (NULL, g_ptr_array_index (array, i), transaction);
+	g_ptr_array_unref (array);
+	array = pk_results_get_category_array (results);
+	for (i = 0; i < array->len; i++)
+		pk_transaction_category_cb (NULL, g_ptr_array_index (array, i), transaction);
+	g_ptr_array_unref (array);
+	array = pk_results_get_repo_detail_array (results);
+	for (i = 0; i < array->len; i++)
+		pk_transaction_repo_detail_cb (NULL, g_ptr_array_index (array, i), transaction);
+	g_ptr_array_unref (array);
+	array = pk_results_get_distro_upgrade_array (results);
+	for (i = 0; i < array->len; i++)
+		pk_transaction_distro_upgrade_cb (NULL, g_ptr_array_index (array, i), transaction);
+	g_ptr_array_unref (array);
+	exit_enum = pk_results_get_exit_code (results);
+	if (exit_enum != PK_EXIT_ENUM_SUCCESS) {
+		error_code = pk_results_get_error_code (results);
+		if (error_code != NULL) {
+			pk_transaction_error_code_cb (NULL, error_code, transaction);
+			g_object_unref (error_code);
+		}
+	}
+
+	/* we should get nothing more for this tid */
+	pk_results_set_exit_code (priv->results, exit_enum);
+	if (priv->allow_cancel)
+		pk_transaction_allow_cancel_emit (transaction, FALSE);
+	priv->finished = TRUE;
+	pk_transaction_db_set_finished (priv->transaction_db, priv->tid,
+					exit_enum == PK_EXIT_ENUM_SUCCESS, time_ms);
+	syslog (LOG_DAEMON | LOG_INFO,
+		"%s transaction %s shared results and finished with %s after %ims",
+		pk_role_enum_to_string (priv->role),
+		priv->tid,
+		pk_exit_enum_to_string (exit_enum),
+		time_ms);
+	pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_FINISHED);
+	pk_transaction_finished_emit (transaction, exit_enum, time_ms);
+}
+
 /**
  * pk_transaction_get_tid:
  */
@@ -3067,6 +3655,14 @@ pk_transaction_cancel_bg (PkTransaction *transaction)
 		goto out;
 	}
 
+	/* about to be run, or waiting for a shared result */
+	if (transaction->priv->job == NULL) {
+		pk_transaction_allow_cancel_emit (transaction, FALSE);
+		pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_FINISHED);
+		pk_transaction_finished_emit (transaction, PK_EXIT_ENUM_CANCELLED, 0);
+		goto out;
+	}
+
 	/* set the state, as cancelling might take a few seconds */
 	pk_backend_job_set_status (transaction->priv->job, PK_STATUS_ENUM_CANCEL);
 
@@ -3170,6 +3766,14 @@ skip_uid:
 		goto out;
 	}
 
+	/* about to be run, or waiting for a shared result */
+	if (transaction->priv->job == NULL) {
+		pk_transaction_allow_cancel_emit (transaction, FALSE);
+		pk_transaction_status_changed_emit (transaction, PK_STATUS_ENUM_FINISHED);
+		pk_transaction_finished_emit (transaction, PK_EXIT_ENUM_CANCELLED, 0);
+		goto out;
+	}
+
 	/* set the state, as cancelling might take a few seconds */
 	pk_backend_job_set_status (transaction->priv->job, PK_STATUS_ENUM_CANCEL);
 
@@ -3185,6 +3789,45 @@ out:
 	pk_transaction_dbus_return (context, error);
 }
 
+/**
+ * pk_transaction_get_results_fd:
+ **/
+static void
+pk_transaction_get_results_fd (PkTransaction *transaction,
+			       GVariant *params,
+			       GDBusMethodInvocation *context)
+{
+	gint idx;
+	GError *error = NULL;
+	GUnixFDList *fd_list = NULL;
+
+	g_return_if_fail (PK_IS_TRANSACTION (transaction));
+	g_return_if_fail (transaction->priv->tid != NULL);
+
+	g_debug ("GetResultsFd method called on %s", transaction->priv->tid);
+
+	/* not finished, or everything was sent as signals */
+	if (transaction->priv->results_fd < 0) {
+		error = g_error_new (PK_TRANSACTION_ERROR, PK_TRANSACTION_ERROR_INVALID_STATE,
+				     "No results file is available");
+		goto out;
+	}
+
+	/* the fd is duplicated, so we can send it more than once */
+	fd_list = g_unix_fd_list_new ();
+	idx = g_unix_fd_list_append (fd_list, transaction->priv->results_fd, &error);
+	if (idx < 0)
+		goto out;
+	g_dbus_method_invocation_return_value_with_unix_fd_list (context,
+								 g_variant_new ("(h)", idx),
+								 fd_list);
+out:
+	if (error != NULL)
+		pk_transaction_dbus_return (context, error);
+	if (fd_list != NULL)
+		g_object_unref (fd_list);
+}
+
 /**
  * pk_transaction_download_packages:
  **/
@@ -3919,21 +4562,17 @@ pk_transaction_get_old_transactions (PkTransaction *transaction,
 			 tid, modified, succeeded,
 			 pk_role_enum_to_string (role),
 			 duration, data, uid, cmdline);
-		g_dbus_connection_emit_signal (transaction->priv->connection,
-					       NULL,
-					       transaction->priv->tid,
-					       PK_DBUS_INTERFACE_TRANSACTION,
-					       "Transaction",
-					       g_variant_new ("(osbuusus)",
-							      tid,
-							      modified,
-							      succeeded,
-							      role,
-							      duration,
-							      data != NULL ? data : "",
-							      uid,
-							      cmdline != NULL ? cmdline : ""),
-					       NULL);
+		pk_transaction_emit_signal (transaction,
+					    "Transaction",
+					    g_variant_new ("(osbuusus)",
+							   tid,
+							   modified,
+							   succeeded,
+							   role,
+							   duration,
+							   data != NULL ? data : "",
+							   uid,
+							   cmdline != NULL ? cmdline : ""));
 	}
 	g_list_free_full (transactions, (GDestroyNotify) g_object_unref);
 
@@ -5160,6 +5799,7 @@ pk_transaction_set_hint (PkTransaction *transaction,
 			 GError **error)
 {
 	gboolean ret = TRUE;
+	PkHintEnum hint;
 	PkTransactionPrivate *priv = transaction->priv;
 
 	/* locale=en_GB.utf8 */
@@ -5242,6 +5882,34 @@ pk_transaction_set_hint (PkTransaction *transaction,
 		goto out;
 	}
 
+	/* supports-plural-signals=true */
+	if (g_strcmp0 (key, "supports-plural-signals") == 0) {
+		hint = pk_hint_enum_from_string (value);
+		if (hint == PK_HINT_ENUM_INVALID) {
+			g_set_error (error, PK_TRANSACTION_ERROR, PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "supports-plural-signals hint expects true or false, not %s", value);
+			ret = FALSE;
+			goto out;
+		}
+		priv->supports_plural_signals = (hint == PK_HINT_ENUM_TRUE);
+		goto out;
+	}
+
+	/* supports-results-fd=true */
+	if (g_strcmp0 (key, "supports-results-fd") == 0) {
+		hint = pk_hint_enum_from_string (value);
+		if (hint == PK_HINT_ENUM_INVALID) {
+			g_set_error (error, PK_TRANSACTION_ERROR, PK_TRANSACTION_ERROR_NOT_SUPPORTED,
+				     "supports-results-fd hint expects true or false, not %s", value);
+			ret = FALSE;
+			goto out;
+		}
+#ifdef HAVE_MEMFD_CREATE
+		priv->supports_results_fd = (hint == PK_HINT_ENUM_TRUE);
+#endif
+		goto out;
+	}
+
 	/* cache-age=<time-in-seconds> */
 	if (g_strcmp0 (key, "cache-age") == 0) {
 		ret = pk_strtouint (value, &priv->cache_age);
@@ -5629,6 +6297,11 @@ pk_transaction_method_call (GDBusConnection *connection_, const gchar *sender,
 		goto out;
 	}
 
+	if (g_strcmp0 (method_name, "GetResultsFd") == 0) {
+		pk_transaction_get_results_fd (transaction, parameters, invocation);
+		goto out;
+	}
+
 	if (g_strcmp0 (method_name, "GetCategories") == 0) {
 		pk_transaction_get_categories (transaction, parameters, invocation);
 		goto out;
@@ -5894,9 +6567,13 @@ pk_transaction_init (PkTransaction *transaction)
 	transaction->priv->background = PK_HINT_ENUM_UNSET;
 	transaction->priv->state = PK_TRANSACTION_STATE_UNKNOWN;
 	transaction->priv->notify = pk_notify_new ();
+	transaction->priv->statistics = pk_statistics_new ();
 	transaction->priv->dbus = pk_dbus_new ();
 	transaction->priv->results = pk_results_new ();
 	transaction->priv->supported_content_types = g_ptr_array_new_with_free_func (g_free);
+	transaction->priv->pending_packages = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+	transaction->priv->results_fd = -1;
+	transaction->priv->pending_item_progress = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	transaction->priv->authority = polkit_authority_get_sync (NULL, &error);
 	if (transaction->priv->authority == NULL) {
 		g_error ("failed to get pokit authority: %s", error->message);
@@ -5925,6 +6602,16 @@ pk_transaction_dispose (GObject *object)
 
 	transaction = PK_TRANSACTION (object);
 
+	/* no more packages are going to be sent */
+	if (transaction->priv->pending_packages_id > 0) {
+		g_source_remove (transaction->priv->pending_packages_id);
+		transaction->priv->pending_packages_id = 0;
+	}
+	if (transaction->priv->progress_id > 0) {
+		g_source_remove (transaction->priv->progress_id);
+		transaction->priv->progress_id = 0;
+	}
+
 	/* were we waiting for the client to authorise */
 	if (transaction->priv->waiting_for_auth) {
 		g_cancellable_cancel (transaction->priv->cancellable);
@@ -5942,13 +6629,9 @@ pk_transaction_dispose (GObject *object)
 	/* send signal to clients that we are about to be destroyed */
 	if (transaction->priv->connection != NULL) {
 		g_debug ("emitting destroy %s", transaction->priv->tid);
-		g_dbus_connection_emit_signal (transaction->priv->connection,
-					       NULL,
-					       transaction->priv->tid,
-					       PK_DBUS_INTERFACE_TRANSACTION,
-					       "Destroy",
-					       NULL,
-					       NULL);
+		pk_transaction_emit_signal (transaction,
+					    "Destroy",
+					    NULL);
 	}
 
 	G_OBJECT_CLASS (pk_transaction_parent_class)->dispose (object);
@@ -5985,6 +6668,8 @@ pk_transaction_finalize (GObject *object)
 	g_free (transaction->priv->tid);
 	g_free (transaction->priv->sender);
 	g_free (transaction->priv->cmdline);
+	if (transaction->priv->results_fd >= 0)
+		close (transaction->priv->results_fd);
 
 	if (transaction->priv->connection != NULL)
 		g_object_unref (transaction->priv->connection);
@@ -5998,7 +6683,10 @@ pk_transaction_finalize (GObject *object)
 	g_object_unref (transaction->priv->transaction_list);
 	g_object_unref (transaction->priv->transaction_db);
 	g_object_unref (transaction->priv->notify);
+	g_object_unref (transaction->priv->statistics);
 	g_object_unref (transaction->priv->results);
+	g_ptr_array_unref (transaction->priv->pending_packages);
+	g_ptr_array_unref (transaction->priv->pending_item_progress);
 //	g_object_unref (transaction->priv->authority);
 	g_object_unref (transaction->priv->cancellable);
 	if (transaction->priv->plugins != NULL)
@@ -6018,6 +6706,14 @@ pk_transaction_new (GKeyFile *conf, GDBusNodeInfo *introspection)
 	PkTransaction *transaction;
 	transaction = g_object_new (PK_TYPE_TRANSACTION, NULL);
 	transaction->priv->conf = g_key_file_ref (conf);
+	if (g_key_file_has_key (conf, "Daemon", "ProgressUpdateInterval", NULL)) {
+		transaction->priv->progress_interval = g_key_file_get_integer (conf,
+									      "Daemon",
+									      "ProgressUpdateInterval",
+									      NULL);
+	} else {
+		transaction->priv->progress_interval = PK_TRANSACTION_PROGRESS_INTERVAL_DEFAULT;
+	}
 	transaction->priv->transaction_list = pk_transaction_list_new (transaction->priv->conf);
 	transaction->priv->introspection = g_dbus_node_info_ref (introspection);
 	return PK_TRANSACTION (transaction);
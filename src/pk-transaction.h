@@ -103,6 +103,10 @@ void		 pk_transaction_reset_after_lock_error		(PkTransaction *transaction);
 void		 pk_transaction_make_exclusive			(PkTransaction *transaction);
 void		 pk_transaction_skip_auth_checks		(PkTransaction *transaction,
 								 gboolean skip_checks);
+gchar		*pk_transaction_get_shared_key			(PkTransaction	*transaction);
+void		 pk_transaction_replay				(PkTransaction	*transaction,
+								 PkResults	*results,
+								 guint		 time_ms);
 
 G_END_DECLS
 